@@ -2,8 +2,11 @@
 
 #include "activation.hpp"
 
+#include "compiled_image.hpp"
 #include "item_updater.hpp"
+#include "jbc_source.hpp"
 #include "serialize.hpp"
+#include "version.hpp"
 
 #include <phosphor-logging/elog-errors.hpp>
 #include <phosphor-logging/elog.hpp>
@@ -13,6 +16,7 @@
 #include <xyz/openbmc_project/Common/error.hpp>
 #include <xyz/openbmc_project/Software/Version/error.hpp>
 #include <filesystem>
+#include <sstream>
 
 namespace wistron
 {
@@ -27,43 +31,16 @@ PHOSPHOR_LOG2_USING;
 using namespace phosphor::logging;
 using InternalFailure =
     sdbusplus::xyz::openbmc_project::Common::Error::InternalFailure;
+using Unavailable = sdbusplus::xyz::openbmc_project::Common::Error::Unavailable;
+using ResourceNotFound =
+    sdbusplus::xyz::openbmc_project::Common::Error::ResourceNotFound;
 
-constexpr auto SYSTEMD_SERVICE = "org.freedesktop.systemd1";
-constexpr auto SYSTEMD_OBJ_PATH = "/org/freedesktop/systemd1";
-
-void Activation::subscribeToSystemdSignals()
-{
-    auto method = this->bus.new_method_call(SYSTEMD_SERVICE, SYSTEMD_OBJ_PATH,
-                                            SYSTEMD_INTERFACE, "Subscribe");
-    try
-    {
-        this->bus.call_noreply(method);
-    }
-    catch (const sdbusplus::exception_t& e)
-    {
-        if (e.name() != nullptr &&
-            strcmp("org.freedesktop.systemd1.AlreadySubscribed", e.name()) == 0)
-        {
-            // If an Activation attempt fails, the Unsubscribe method is not
-            // called. This may lead to an AlreadySubscribed error if the
-            // Activation is re-attempted.
-        }
-        else
-        {
-            log<level::ERR>("Error subscribing to systemd",
-                            entry("ERROR=%s", e.what()));
-        }
-    }
-    return;
-}
-
-void Activation::unsubscribeFromSystemdSignals()
+Activation::~Activation()
 {
-    auto method = this->bus.new_method_call(SYSTEMD_SERVICE, SYSTEMD_OBJ_PATH,
-                                            SYSTEMD_INTERFACE, "Unsubscribe");
-    this->bus.call_noreply(method);
-
-    return;
+    // Stop the workers before the next job gets the chain.
+    programmer.reset();
+    verifier.reset();
+    parent.scheduler.release(this);
 }
 
 void Activation::deleteImageManagerObject()
@@ -192,14 +169,18 @@ auto Activation::activation(Activations value) -> Activations
 
     if (value == softwareServer::Activation::Activations::Activating)
     {
-        parent.freeSpace();
+        parent.freeSpace(jtagDevice());
         softwareServer::Activation::activation(value);
 
         if (svfCreated == false)
         {
-            // Enable systemd signals
-            subscribeToSystemdSignals();
-            startActivation();
+            if (!startActivation())
+            {
+                activationBlocksTransition.reset(nullptr);
+                activationProgress.reset(nullptr);
+                return softwareServer::Activation::activation(
+                    softwareServer::Activation::Activations::Failed);
+            }
             return softwareServer::Activation::activation(value);
         }
         else if (svfCreated == true)
@@ -248,8 +229,15 @@ auto Activation::requestedActivation(RequestedActivations value)
     return softwareServer::Activation::requestedActivation(value);
 }
 
-void Activation::startActivation()
+bool Activation::startActivation()
 {
+    if (verifying())
+    {
+        error("Version {VERSIONID} is being verified, can not activate it",
+              "VERSIONID", versionId);
+        return false;
+    }
+
     if (!activationProgress)
     {
         activationProgress = std::make_unique<ActivationProgress>(bus, path);
@@ -261,67 +249,428 @@ void Activation::startActivation()
             std::make_unique<ActivationBlocksTransition>(bus, path);
     }
 
-    auto svfUpadteServiceFile = "obmc-cpld-update-fw@" + versionId + ".service";
-    auto method = bus.new_method_call(SYSTEMD_BUSNAME, SYSTEMD_PATH,
-                                      SYSTEMD_INTERFACE, "StartUnit");
-    method.append(svfUpadteServiceFile, "replace");
-    
+    auto request = programRequest();
+    if (request.svfPaths.empty() && request.compiledPath.empty())
+    {
+        error("No .svf file found for version {VERSIONID}", "VERSIONID",
+              versionId);
+        report<InternalFailure>();
+        return false;
+    }
+
+    if (!parent.scheduler.submit(request.device, this,
+                                 [this]() { startProgramming(); }))
+    {
+        info("Version {VERSIONID} waits for {COUNT} job(s) on {DEVICE}",
+             "VERSIONID", versionId, "COUNT",
+             parent.scheduler.position(this), "DEVICE", request.device);
+        return true;
+    }
+
+    // On a free chain programming started right here, and may have failed
+    // already.
+    return softwareServer::Activation::activation() !=
+           softwareServer::Activation::Activations::Failed;
+}
+
+void Activation::startProgramming()
+{
+    // An interrupted run is resumed from its checkpoints, after a reboot
+    // too, when the upload is gone: keep what identifies the version.
+    std::filesystem::path dir(checkpointDir(versionId));
+    std::error_code ec;
+    std::filesystem::create_directories(dir, ec);
+    auto manifest = manifestPath();
+    if (!std::filesystem::exists(manifest))
+    {
+        manifest = std::filesystem::path(CPLD_SVF_PREFIX + versionId) /
+                   CPLD_RELEASE_FILE_NAME;
+    }
+    if (!std::filesystem::equivalent(manifest, dir / MANIFEST_FILE_NAME, ec))
+    {
+        std::filesystem::copy_file(
+            manifest, dir / MANIFEST_FILE_NAME,
+            std::filesystem::copy_options::overwrite_existing, ec);
+    }
+
     try
     {
-        auto reply = bus.call(method);
+        // Release a finished previous attempt before starting over.
+        programmer.reset();
+        programmer = std::make_unique<Programmer>(
+            bus.get_event(), programRequest(),
+            [this](const ProgrammingProgress& current) {
+                if (activationProgress)
+                {
+                    activationProgress->estimatedDuration(
+                        current.estimated.count());
+                    activationProgress->remainingTime(
+                        current.remaining.count());
+                    activationProgress->progress(10 +
+                                                 current.percent * 80 / 100);
+                }
+            },
+            std::bind(std::mem_fn(&Activation::programmingDone), this,
+                      std::placeholders::_1));
     }
-    catch (const sdbusplus::exception::exception& e)
+    catch (const std::system_error& e)
     {
         error("Error in trying to upgrade CPLD firmware: {ERROR}", "ERROR", e);
         report<InternalFailure>();
+        parent.scheduler.release(this);
+        activation(softwareServer::Activation::Activations::Failed);
+        return;
+    }
+
+    if (activationProgress)
+    {
+        activationProgress->progress(10);
     }
+}
 
-    activationProgress->progress(10);
+ProgramRequest Activation::programRequest()
+{
+    ProgramRequest request;
+    request.device = jtagDevice();
+    request.svfPaths = findSvfFiles();
+    request.irLengths = chainIrLengths();
+    request.compiledPath = compiledImagePath(request.svfPaths);
+    request.compiled = compiled;
+    request.checkpointDir = checkpointDir(versionId);
+    if (request.svfPaths.empty() &&
+        !std::filesystem::exists(request.compiledPath))
+    {
+        // Kept by an interrupted run, to resume it.
+        request.compiledPath = std::filesystem::path(request.checkpointDir) /
+                               CPLD_COMPILED_FILE_NAME;
+    }
+    if (request.svfPaths.empty() &&
+        !std::filesystem::exists(request.compiledPath))
+    {
+        request.compiledPath.clear();
+    }
+    if (request.svfPaths.size() == 1 && isJbcPath(request.svfPaths.front()))
+    {
+        // A JBC program runs as is, there is no image to build.
+        request.compiledPath.clear();
+    }
+    return request;
 }
 
-void Activation::unitStateChange(sdbusplus::message_t& msg)
+std::string Activation::jtagDevice()
 {
+    auto manifest = manifestPath();
+    if (!std::filesystem::exists(manifest))
+    {
+        // Installed versions keep their MANIFEST as cpld-release.
+        manifest = std::filesystem::path(CPLD_SVF_PREFIX + versionId) /
+                   CPLD_RELEASE_FILE_NAME;
+    }
+    if (!std::filesystem::exists(manifest))
+    {
+        return JTAG_DEVICE;
+    }
+
+    auto device = Version::getValue(manifest.string(),
+                                    {{"JtagDevice", ""}})["JtagDevice"];
+    return device.empty() ? std::string(JTAG_DEVICE) : device;
+}
+
+void Activation::programmingDone(const std::string& failure)
+{
+    parent.scheduler.release(this);
+
     if (softwareServer::Activation::activation() !=
         softwareServer::Activation::Activations::Activating)
     {
         return;
     }
 
-    uint32_t newStateID{};
-    sdbusplus::message::object_path newStateObjPath;
-    std::string newStateUnit{};
-    std::string newStateResult{};
+    if (!failure.empty())
+    {
+        error("Error in trying to upgrade CPLD firmware: {ERROR}", "ERROR",
+              failure);
+        report<InternalFailure>();
+        activation(softwareServer::Activation::Activations::Failed);
+        return;
+    }
+
+    try
+    {
+        updateReleaseFiles();
+    }
+    catch (const std::filesystem::filesystem_error& e)
+    {
+        error("Failed to update cpld-release: {ERROR}", "ERROR", e);
+        activation(softwareServer::Activation::Activations::Failed);
+        return;
+    }
+
+    // There is nothing left to resume, for other versions on the chain
+    // neither: the device holds this image now.
+    std::error_code ec;
+    std::filesystem::remove_all(checkpointDir(versionId), ec);
+    removeCheckpoints(jtagDevice());
+
+    svfCreated = true;
+    activationProgress->progress(90);
+    activation(softwareServer::Activation::Activations::Activating);
+}
+
+void Activation::verify()
+{
+    if (verifying() || softwareServer::Activation::activation() ==
+                           softwareServer::Activation::Activations::Activating)
+    {
+        throw Unavailable();
+    }
+
+    auto request = programRequest();
+    if (request.svfPaths.empty() && request.compiledPath.empty())
+    {
+        throw ResourceNotFound();
+    }
+
+    mismatch({});
+    status(VerifyStatus::InProgress);
+    parent.scheduler.submit(request.device, this,
+                            [this]() { startVerifying(); });
+}
+
+void Activation::startVerifying()
+{
+    auto request = programRequest();
+    request.verifyOnly = true;
+    try
+    {
+        verifier.reset();
+        verifier = std::make_unique<Programmer>(
+            bus.get_event(), std::move(request), nullptr,
+            std::bind(std::mem_fn(&Activation::verifyDone), this,
+                      std::placeholders::_1));
+    }
+    catch (const std::system_error& e)
+    {
+        error("Failed to start verifying version {VERSIONID}: {ERROR}",
+              "VERSIONID", versionId, "ERROR", e);
+        parent.scheduler.release(this);
+        mismatch(e.what());
+        status(VerifyStatus::Failed);
+    }
+}
+
+void Activation::verifyDone(const std::string& failure)
+{
+    parent.scheduler.release(this);
+
+    if (failure.empty())
+    {
+        info("CPLD matches version {VERSIONID}", "VERSIONID", versionId);
+        mismatch({});
+        status(VerifyStatus::Match);
+        return;
+    }
+
+    auto result = verifier->mismatched() ? VerifyStatus::Mismatch
+                                         : VerifyStatus::Failed;
+    error("CPLD verification against version {VERSIONID} ended: {ERROR}",
+          "VERSIONID", versionId, "ERROR", failure);
+    mismatch(failure);
+    status(result);
+}
 
-    // Read the msg and populate each variable
-    msg.read(newStateID, newStateObjPath, newStateUnit, newStateResult);
+bool Activation::verifying()
+{
+    return status() == VerifyStatus::InProgress;
+}
 
-    auto svfUpadteServiceFile = "obmc-cpld-update-fw@" + versionId + ".service";
+std::vector<std::string> Activation::findSvfFiles()
+{
+    std::filesystem::path imageDir(SVF_UPLOAD_DIR);
+    imageDir /= versionId;
 
-    if (newStateUnit == svfUpadteServiceFile)
+    // A daisy-chained image names its SVFs in chain order.
+    auto manifestPath = imageDir / MANIFEST_FILE_NAME;
+    std::string chain;
+    if (std::filesystem::exists(manifestPath))
+    {
+        chain = Version::getValue(manifestPath.string(),
+                                  {{"ChainSvf", ""}})["ChainSvf"];
+    }
+    if (!chain.empty())
     {
-        if(newStateResult == "done")
+        std::vector<std::string> svfPaths;
+        std::istringstream names(chain);
+        std::string name;
+        while (names >> name)
         {
-            svfCreated = true;
-            activationProgress->progress(80);
+            auto svfPath = imageDir / name;
+            if (!std::filesystem::is_regular_file(svfPath))
+            {
+                error("{PATH} named by ChainSvf is missing", "PATH",
+                      svfPath);
+                return {};
+            }
+            svfPaths.push_back(svfPath);
         }
-        else if (newStateResult == "failed" || newStateResult == "dependency")
+        return svfPaths;
+    }
+
+    std::error_code ec;
+    for (const auto& entry :
+         std::filesystem::directory_iterator(imageDir, ec))
+    {
+        if (entry.is_regular_file() &&
+            (entry.path().extension() == ".svf" ||
+             entry.path().extension() == ".xsvf" ||
+             entry.path().extension() == ".jbc"))
         {
-            activation(softwareServer::Activation::Activations::Failed);
+            return {entry.path()};
         }
     }
+    return {};
+}
 
-    if (svfCreated)
+std::vector<size_t> Activation::chainIrLengths()
+{
+    auto manifest = manifestPath();
+    if (!std::filesystem::exists(manifest))
     {
-        activation(softwareServer::Activation::Activations::Activating);
+        return {};
     }
 
-    return;
+    auto value = Version::getValue(manifest.string(),
+                                   {{"ChainIrLengths", ""}})["ChainIrLengths"];
+    std::vector<size_t> irLengths;
+    std::istringstream lengths(value);
+    size_t length = 0;
+    while (lengths >> length)
+    {
+        irLengths.push_back(length);
+    }
+    return irLengths;
 }
 
-void Activation::finishActivation()
+std::filesystem::path Activation::manifestPath()
 {
-    activationProgress->progress(90);
+    std::filesystem::path uploaded(SVF_UPLOAD_DIR);
+    uploaded /= versionId;
+    uploaded /= MANIFEST_FILE_NAME;
+    if (std::filesystem::exists(uploaded))
+    {
+        return uploaded;
+    }
+
+    auto kept = std::filesystem::path(checkpointDir(versionId)) /
+                MANIFEST_FILE_NAME;
+    return std::filesystem::exists(kept) ? kept : uploaded;
+}
+
+void Activation::compileImage()
+{
+    auto svfPaths = findSvfFiles();
+    if (svfPaths.empty() || isJbcPath(svfPaths.front()))
+    {
+        return;
+    }
+
+    auto compiledPath = std::filesystem::path(svfPaths.front())
+                            .replace_filename(CPLD_COMPILED_FILE_NAME);
+    compiled = std::async(std::launch::async,
+                          [svfPaths, compiledPath, versionId = versionId,
+                           irLengths = chainIrLengths()]() {
+        try
+        {
+            if (isCompiledImageCurrent(compiledPath, svfPaths))
+            {
+                return;
+            }
+
+            auto stats = compileChain(svfPaths, irLengths, compiledPath);
+            if (svfPaths.size() > 1)
+            {
+                info("Merged {COUNT} devices of version {VERSIONID}: "
+                     "{MERGED} shared scans, {SOLO} single-device scans, "
+                     "{BYPASS} bypass loads, {SAVED} us of waits saved",
+                     "COUNT", svfPaths.size(), "VERSIONID", versionId,
+                     "MERGED", stats.chain.mergedScans, "SOLO",
+                     stats.chain.soloScans, "BYPASS", stats.chain.bypassLoads,
+                     "SAVED",
+                     std::chrono::duration_cast<std::chrono::microseconds>(
+                         stats.chain.waitSaved)
+                         .count());
+            }
+            info("Compiled version {VERSIONID} into {SIZE} bytes, "
+                 "{PATTERN} bytes of scan data as fill patterns: dropped "
+                 "{DROPPED} redundant TAP transitions, trimmed {TRIMMED} "
+                 "walks, saved {TMS} TMS clocks",
+                 "VERSIONID", versionId, "SIZE", stats.imageSize, "PATTERN",
+                 stats.patternBytes, "DROPPED", stats.tap.opsDropped,
+                 "TRIMMED", stats.tap.walksTrimmed, "TMS", stats.tap.tmsSaved);
+        }
+        catch (const std::exception& e)
+        {
+            // Activation compiles again, or plays the .svf.
+            error("Failed to compile {PATH}: {ERROR}", "PATH",
+                  svfPaths.front(), "ERROR", e);
+        }
+    }).share();
+}
 
+std::string
+    Activation::compiledImagePath(const std::vector<std::string>& svfPaths)
+{
+    std::filesystem::path cached(CPLD_SVF_PREFIX + versionId);
+    cached /= CPLD_COMPILED_FILE_NAME;
+    if (svfPaths.empty() || std::filesystem::exists(cached))
+    {
+        return cached;
+    }
+    return std::filesystem::path(svfPaths.front())
+        .replace_filename(CPLD_COMPILED_FILE_NAME);
+}
+
+void Activation::updateReleaseFiles()
+{
+    auto manifest = manifestPath();
+
+    std::filesystem::path mediaDir(CPLD_SVF_PREFIX + versionId);
+    std::filesystem::create_directories(mediaDir);
+    std::filesystem::create_directories(PERSIST_DIR);
+
+    for (const auto& target :
+         {std::filesystem::path(CPLD_RELEASE_FILE),
+          std::filesystem::path(PERSIST_DIR) / CPLD_RELEASE_FILE_NAME,
+          mediaDir / CPLD_RELEASE_FILE_NAME})
+    {
+        std::filesystem::copy_file(
+            manifest, target,
+            std::filesystem::copy_options::overwrite_existing);
+    }
+
+    // A run resumed after a reboot has only the image kept with its
+    // checkpoints.
+    auto svfPaths = findSvfFiles();
+    auto compiledPath = std::filesystem::path(checkpointDir(versionId)) /
+                        CPLD_COMPILED_FILE_NAME;
+    if (!svfPaths.empty())
+    {
+        compiledPath = std::filesystem::path(svfPaths.front())
+                           .replace_filename(CPLD_COMPILED_FILE_NAME);
+    }
+    std::error_code ec;
+    auto target = mediaDir / CPLD_COMPILED_FILE_NAME;
+    if (std::filesystem::exists(compiledPath) &&
+        !std::filesystem::equivalent(compiledPath, target, ec))
+    {
+        std::filesystem::copy_file(
+            compiledPath, target,
+            std::filesystem::copy_options::overwrite_existing);
+    }
+}
+
+void Activation::finishActivation()
+{
     // Set Redundancy Priority before setting to Active
     if (!redundancyPriority)
     {
@@ -335,7 +684,6 @@ void Activation::finishActivation()
     activationProgress.reset(nullptr);
 
     svfCreated = false;
-    unsubscribeFromSystemdSignals();
     // Remove version object from .svf manager
     deleteImageManagerObject();
     // Create active association
@@ -2,17 +2,23 @@
 
 #include "config.h"
 
+#include "programmer.hpp"
 #include "utils.hpp"
 #include "xyz/openbmc_project/Software/ActivationProgress/server.hpp"
 #include "xyz/openbmc_project/Software/ExtendedVersion/server.hpp"
+#include "xyz/openbmc_project/Software/ProgrammingTime/server.hpp"
 #include "xyz/openbmc_project/Software/RedundancyPriority/server.hpp"
+#include "xyz/openbmc_project/Software/Verify/server.hpp"
 
 #include <sdbusplus/server.hpp>
 #include <xyz/openbmc_project/Association/Definitions/server.hpp>
 #include <xyz/openbmc_project/Software/Activation/server.hpp>
 #include <xyz/openbmc_project/Software/ActivationBlocksTransition/server.hpp>
 
+#include <filesystem>
+#include <future>
 #include <string>
+#include <vector>
 
 namespace wistron
 {
@@ -26,6 +32,7 @@ using AssociationList =
 using ActivationInherit = sdbusplus::server::object_t<
     sdbusplus::xyz::openbmc_project::Software::server::ExtendedVersion,
     sdbusplus::xyz::openbmc_project::Software::server::Activation,
+    sdbusplus::xyz::openbmc_project::Software::server::Verify,
     sdbusplus::xyz::openbmc_project::Association::server::Definitions>;
 using ActivationBlocksTransitionInherit =
     sdbusplus::server::object_t<sdbusplus::xyz::openbmc_project::Software::
@@ -33,7 +40,8 @@ using ActivationBlocksTransitionInherit =
 using RedundancyPriorityInherit = sdbusplus::server::object_t<
     sdbusplus::xyz::openbmc_project::Software::server::RedundancyPriority>;
 using ActivationProgressInherit = sdbusplus::server::object_t<
-    sdbusplus::xyz::openbmc_project::Software::server::ActivationProgress>;
+    sdbusplus::xyz::openbmc_project::Software::server::ActivationProgress,
+    sdbusplus::xyz::openbmc_project::Software::server::ProgrammingTime>;
 
 constexpr auto applyTimeImmediate =
     "xyz.openbmc_project.Software.ApplyTime.RequestedApplyTimes.Immediate";
@@ -117,6 +125,12 @@ class ActivationBlocksTransition : public ActivationBlocksTransitionInherit
     {}
 };
 
+/** @class ActivationProgress
+ *  @brief The progress of an activation and the time programming takes.
+ *  @details A concrete implementation for the
+ *  xyz.openbmc_project.Software.ActivationProgress and
+ *  xyz.openbmc_project.Software.ProgrammingTime DBus APIs.
+ */
 class ActivationProgress : public ActivationProgressInherit
 {
   public:
@@ -159,14 +173,7 @@ class Activation : public ActivationInherit
                AssociationList& assocs) :
         ActivationInherit(bus, path.c_str(),
                           ActivationInherit::action::defer_emit),
-        bus(bus), path(path), parent(parent), versionId(versionId),
-        systemdSignals(
-            bus,
-            sdbusRule::type::signal() + sdbusRule::member("JobRemoved") +
-                sdbusRule::path("/org/freedesktop/systemd1") +
-                sdbusRule::interface("org.freedesktop.systemd1.Manager"),
-            std::bind(std::mem_fn(&Activation::unitStateChange), this,
-                      std::placeholders::_1))
+        bus(bus), path(path), parent(parent), versionId(versionId)
     {
         // Set Properties.
         extendedVersion(extVersion);
@@ -176,7 +183,9 @@ class Activation : public ActivationInherit
         // Emit deferred signal.
         emit_object_added();
     }
-    ~Activation() = default;
+    /** @brief Gives up the JTAG chain if a job of this version holds or
+     *         waits for it */
+    ~Activation();
 
     /** @brief Overloaded Activation property setter function
      *
@@ -198,23 +207,13 @@ class Activation : public ActivationInherit
     RequestedActivations
         requestedActivation(RequestedActivations value) override;
 
-    /**
-     * @brief subscribe to the systemd signals
-     *
-     * This object needs to capture when it's systemd targets complete
-     * so it can keep it's state updated
-     *
-     **/
-    void subscribeToSystemdSignals();
-
-    /**
-     * @brief unsubscribe from the systemd signals
+    /** @brief Start checking the CPLD against this version's image,
+     *         without programming it
      *
-     * Once the activation process has completed successfully, we can
-     * safely unsubscribe from systemd signals.
-     *
-     **/
-    void unsubscribeFromSystemdSignals();
+     *  @error  Unavailable while the CPLD is programmed or checked,
+     *          ResourceNotFound if the version has no image left
+     */
+    void verify() override;
 
     /** @brief Persistent sdbusplus DBus bus connection */
     sdbusplus::bus_t& bus;
@@ -237,8 +236,29 @@ class Activation : public ActivationInherit
     /** @brief Persistent RedundancyPriority dbus object */
     std::unique_ptr<RedundancyPriority> redundancyPriority;
 
-    /** @brief Used to subscribe to dbus systemd signals **/
-    sdbusplus::bus::match_t systemdSignals;
+    /** @brief Programs the CPLD while activating */
+    std::unique_ptr<Programmer> programmer;
+
+    /** @brief Reads the CPLD back for verify() */
+    std::unique_ptr<Programmer> verifier;
+
+    /** @brief Background compilation of the .svf, if one was started */
+    std::shared_future<void> compiled;
+
+    /**
+     * @brief Compile the .svf of this version into its binary op stream in
+     *        the background, so activating it needs no text parsing.
+     **/
+    void compileImage();
+
+    /**
+     * @brief Get the JTAG device node this version is programmed through:
+     *        the MANIFEST's JtagDevice, JTAG_DEVICE if it names none. An
+     *        I2C adapter, /dev/i2c-N[@address], selects the config port.
+     *
+     * @return The device node
+     */
+    std::string jtagDevice();
 
     /**
      * @brief Determine the configured .svf apply time value
@@ -248,15 +268,68 @@ class Activation : public ActivationInherit
     bool checkApplyTimeImmediate();
 
   protected:
-    /** @brief Check if systemd state change is relevant to this object
+    /** @brief Handle the end of CPLD programming
+     *
+     * @param[in]  failure   - Empty on success, the failure otherwise
+     *
+     */
+    void programmingDone(const std::string& failure);
+
+    /** @brief Handle the end of a verify() check
+     *
+     * @param[in]  failure   - Empty if the CPLD holds the image, the
+     *                         difference or failure otherwise
+     *
+     */
+    void verifyDone(const std::string& failure);
+
+    /** @brief Whether a verify() check is running */
+    bool verifying();
+
+    /**
+     * @brief Find the .svf files of this version in the .svf upload dir:
+     *        the ones the MANIFEST's ChainSvf names for a daisy chain,
+     *        otherwise the single .svf, .xsvf or .jbc.
      *
-     * Instance specific interface to handle the detected systemd state
-     * change
+     * @return The .svf paths, the device nearest TDO first; empty if there
+     *         is none
+     */
+    std::vector<std::string> findSvfFiles();
+
+    /**
+     * @brief Get the instruction lengths the MANIFEST's ChainIrLengths
+     *        gives for the devices of a daisy chain.
      *
-     * @param[in]  msg       - Data associated with subscribed signal
+     * @return The lengths, in chain order; empty if not given
+     */
+    std::vector<size_t> chainIrLengths();
+
+    /**
+     * @brief Get the MANIFEST of this version: the uploaded one, or the
+     *        copy kept with its programming checkpoints once the upload is
+     *        gone.
      *
+     * @return The MANIFEST path, the uploaded one if neither exists
      */
-    void unitStateChange(sdbusplus::message_t& msg);
+    std::filesystem::path manifestPath();
+
+    /**
+     * @brief Get the path of the compiled image this version is programmed
+     *        from: the copy kept in the versioned media dir if there is
+     *        one, otherwise the one next to the .svf.
+     *
+     * @param[in] svfPaths - The .svf paths, may be empty
+     *
+     * @return The compiled image path
+     */
+    std::string compiledImagePath(const std::vector<std::string>& svfPaths);
+
+    /**
+     * @brief Install the MANIFEST of this version as cpld-release in
+     *        /etc, PERSIST_DIR and the versioned media dir, and keep the
+     *        compiled image in the media dir for later re-flashes.
+     */
+    void updateReleaseFiles();
 
     /**
      * @brief Deletes the version from .svf Manager and the
@@ -264,8 +337,25 @@ class Activation : public ActivationInherit
      */
     void deleteImageManagerObject();
 
-    /** @brief Member function for clarity & brevity at activation start */
-    void startActivation();
+    /** @brief Member function for clarity & brevity at activation start
+     *
+     * @return true if programming was started or queued behind other jobs
+     *         for the same JTAG chain
+     */
+    bool startActivation();
+
+    /** @brief Start the programmer once the JTAG chain is free */
+    void startProgramming();
+
+    /** @brief Start the verifier once the JTAG chain is free */
+    void startVerifying();
+
+    /** @brief Build the request to program or verify this version
+     *
+     * @return The request; svfPaths and compiledPath are empty if there is
+     *         no image left
+     */
+    ProgramRequest programRequest();
 
     /** @brief Member function for clarity & brevity at activation end */
     void finishActivation();
@@ -0,0 +1,79 @@
+#include "bit_vector.hpp"
+#include "hex_decode.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <string>
+
+using namespace wistron::software::updater;
+
+namespace
+{
+
+/** @brief Build hex scan data, broken into lines like vendor SVFs are */
+std::string makeHex(size_t digits, size_t lineLength)
+{
+    constexpr auto hexDigits = "0123456789ABCDEF";
+    std::mt19937 rng(digits);
+    std::string hex;
+    hex.reserve(digits + digits / (lineLength ? lineLength : digits) + 1);
+    for (size_t i = 0; i < digits; ++i)
+    {
+        if (lineLength != 0 && i != 0 && i % lineLength == 0)
+        {
+            hex += "\n\t\t";
+        }
+        hex += hexDigits[rng() % 16];
+    }
+    return hex;
+}
+
+/** @brief Decode throughput in MB of hex text per second */
+double measure(const std::string& hex, size_t bits, const HexKernel& kernel)
+{
+    constexpr auto minTime = std::chrono::milliseconds(500);
+    size_t rounds = 0;
+    size_t checksum = 0;
+    auto start = std::chrono::steady_clock::now();
+    auto elapsed = std::chrono::steady_clock::duration::zero();
+    while (elapsed < minTime)
+    {
+        auto vector = BitVector::fromHex(hex, bits, kernel);
+        checksum += vector.data()[rounds % vector.byteSize()];
+        ++rounds;
+        elapsed = std::chrono::steady_clock::now() - start;
+    }
+
+    // Keep the decode from being optimized away.
+    if (checksum == static_cast<size_t>(-1))
+    {
+        std::puts("");
+    }
+
+    auto seconds = std::chrono::duration<double>(elapsed).count();
+    return hex.size() * rounds / seconds / 1e6;
+}
+
+} // namespace
+
+int main()
+{
+    constexpr size_t digits = 4 * 1024 * 1024;
+    const auto& best = bestHexKernel();
+
+    std::printf("%-12s %12s %12s %8s\n", "layout", "scalar MB/s",
+                (std::string(best.name) + " MB/s").c_str(), "speedup");
+    for (auto lineLength : {size_t{0}, size_t{256}, size_t{64}})
+    {
+        auto hex = makeHex(digits, lineLength);
+        auto scalar = measure(hex, digits * 4, scalarHexKernel());
+        auto vector = measure(hex, digits * 4, best);
+        auto layout = lineLength ? std::to_string(lineLength) + "/line"
+                                 : std::string("one line");
+        std::printf("%-12s %12.1f %12.1f %7.1fx\n", layout.c_str(), scalar,
+                    vector, vector / scalar);
+    }
+
+    return 0;
+}
@@ -0,0 +1,390 @@
+#include "compiled_image.hpp"
+#include "jtag_simulator.hpp"
+#include "svf_parser.hpp"
+#include "svf_player.hpp"
+
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <new>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <variant>
+#include <vector>
+
+using namespace wistron::software::updater;
+
+namespace
+{
+
+/** @brief Heap allocations made by the process so far */
+std::atomic<uint64_t> heapAllocations{0};
+
+} // namespace
+
+// Counts every allocation of the process. Kept out of line, so the compiler
+// does not see malloc() and free() pair up with new and delete.
+[[gnu::noinline]] void* operator new(size_t size)
+{
+    heapAllocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1))
+    {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+[[gnu::noinline]] void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+[[gnu::noinline]] void operator delete(void* p,
+                                     size_t /*size*/) noexcept
+{
+    std::free(p);
+}
+
+namespace
+{
+
+/** @struct Shape
+ *  @brief A synthetic SVF of a kind the engine sees in the field.
+ */
+struct Shape
+{
+    /** @brief The name results are reported under */
+    std::string name;
+
+    /** @brief Build the SVF text */
+    std::function<std::string()> generate;
+};
+
+/** @struct Result
+ *  @brief What one shape measured.
+ */
+struct Result
+{
+    size_t svfBytes = 0;
+    uint64_t commands = 0;
+    uint64_t scanBits = 0;
+    double parseMBps = 0;
+    double allocationsPerCommand = 0;
+    double compileSeconds = 0;
+    uint64_t compiledBytes = 0;
+    double playSeconds = 0;
+    double shiftMbps = 0;
+    double playAllocationsPerCommand = 0;
+    long peakRssKiB = 0;
+};
+
+/** @brief Append random hex digits, broken into lines like vendor SVFs */
+void appendHex(std::string& svf, std::mt19937& rng, size_t digits)
+{
+    constexpr auto hexDigits = "0123456789ABCDEF";
+    constexpr size_t lineLength = 64;
+    for (size_t i = 0; i < digits; ++i)
+    {
+        if (i != 0 && i % lineLength == 0)
+        {
+            svf += "\n\t\t";
+        }
+        svf += hexDigits[rng() % 16];
+    }
+}
+
+/** @brief A Lattice MachXO2 update: enable, erase, a loop programming one
+ *         page per row and a loop reading every row back */
+std::string rowLoop(size_t rows)
+{
+    std::mt19937 rng(rows);
+    std::vector<std::string> pages(rows);
+    for (auto& page : pages)
+    {
+        appendHex(page, rng, 32);
+    }
+
+    std::string svf = "! Synthetic row program loop\n"
+                      "HDR 0;\nHIR 0;\nTDR 0;\nTIR 0;\n"
+                      "ENDDR DRPAUSE;\nENDIR IRPAUSE;\nSTATE IDLE;\n"
+                      "SIR 8 TDI (E0);\n"
+                      "SDR 32 TDI (00000000) TDO (012BA043) "
+                      "MASK (FFFFFFFF);\n"
+                      "SIR 8 TDI (C6);\nSDR 8 TDI (00);\n"
+                      "RUNTEST IDLE 2 TCK;\n"
+                      "SIR 8 TDI (0E);\nSDR 8 TDI (04);\n"
+                      "RUNTEST IDLE 2 TCK;\n"
+                      "SIR 8 TDI (46);\nSDR 8 TDI (04);\n"
+                      "RUNTEST IDLE 2 TCK;\n";
+    for (const auto& page : pages)
+    {
+        svf += "SIR 8 TDI (70);\nSDR 128 TDI (" + page +
+               ");\nRUNTEST IDLE 2 TCK;\n";
+    }
+    svf += "SIR 8 TDI (46);\nSDR 8 TDI (04);\nRUNTEST IDLE 2 TCK;\n";
+    for (const auto& page : pages)
+    {
+        svf += "SIR 8 TDI (73);\nSDR 128 TDI (" + std::string(32, '0') +
+               ")\n\tTDO (" + page + ")\n\tMASK (" + std::string(32, 'F') +
+               ");\nRUNTEST IDLE 2 TCK;\n";
+    }
+    svf += "SIR 8 TDI (26);\nSDR 8 TDI (00);\nRUNTEST IDLE 2 TCK;\n"
+           "SIR 8 TDI (FF);\nRUNTEST IDLE 100 TCK;\n";
+    return svf;
+}
+
+/** @brief A few scans of megabits of TDI only, as FPGA bitstreams are */
+std::string hugeSdr(size_t scans, size_t bits)
+{
+    std::mt19937 rng(bits);
+    std::string svf = "! Synthetic huge SDR\nSTATE IDLE;\nSIR 8 TDI (FF);\n";
+    for (size_t i = 0; i < scans; ++i)
+    {
+        svf += "SDR " + std::to_string(bits) + " TDI (";
+        appendHex(svf, rng, bits / 4);
+        svf += ");\n";
+    }
+    return svf;
+}
+
+/** @brief Many short instructions each followed by a wait */
+std::string manyRuntests(size_t count)
+{
+    std::string svf = "! Synthetic RUNTEST heavy\nSTATE IDLE;\n";
+    for (size_t i = 0; i < count; ++i)
+    {
+        svf += "SIR 8 TDI (F0);\nRUNTEST IDLE 3 TCK 1.00E-06 SEC;\n";
+    }
+    return svf;
+}
+
+/** @brief Parse throughput and the allocations per command of one pass */
+void measureParse(const std::string& svf, Result& result)
+{
+    constexpr auto minTime = std::chrono::milliseconds(500);
+
+    SvfOp op;
+    auto before = heapAllocations.load();
+    SvfParser first(svf);
+    while (first.next(op))
+    {
+        ++result.commands;
+        if (auto* scan = std::get_if<ScanOp>(&op))
+        {
+            result.scanBits += scan->bits();
+        }
+    }
+    result.allocationsPerCommand =
+        double(heapAllocations.load() - before) / result.commands;
+
+    size_t rounds = 0;
+    auto start = std::chrono::steady_clock::now();
+    auto elapsed = std::chrono::steady_clock::duration::zero();
+    while (elapsed < minTime)
+    {
+        SvfParser parser(svf);
+        while (parser.next(op))
+        {}
+        ++rounds;
+        elapsed = std::chrono::steady_clock::now() - start;
+    }
+    auto seconds = std::chrono::duration<double>(elapsed).count();
+    result.parseMBps = svf.size() * rounds / seconds / 1e6;
+}
+
+/** @brief Compile the SVF and play the image into a simulated MachXO2 */
+void measureCompileAndPlay(const std::string& svf, size_t rows,
+                           Result& result)
+{
+    char pattern[] = "/tmp/svf-bench-XXXXXX";
+    if (!mkdtemp(pattern))
+    {
+        throw std::runtime_error("Failed to create a scratch directory");
+    }
+    std::filesystem::path dir(pattern);
+    auto svfPath = dir / "image.svf";
+    auto compiledPath = dir / "image.ops";
+    std::ofstream(svfPath, std::ios::binary) << svf;
+
+    auto start = std::chrono::steady_clock::now();
+    compileSvf(svfPath, compiledPath);
+    result.compileSeconds = std::chrono::duration<double>(
+                                std::chrono::steady_clock::now() - start)
+                                .count();
+    result.compiledBytes = std::filesystem::file_size(compiledPath);
+
+    // No busy time and no TCK frequency, so only the simulation of every
+    // clock is timed.
+    SimulatedCpldConfig part;
+    part.configPages = std::max<size_t>(rows, part.configPages);
+    part.eraseTime = {};
+    part.programTime = {};
+    SimulatedChain chain({std::make_shared<SimulatedCpld>(part)});
+    SvfPlayer player(chain, 0);
+    CompiledImageReader reader(compiledPath);
+
+    auto before = heapAllocations.load();
+    start = std::chrono::steady_clock::now();
+    player.play(reader);
+    result.playSeconds = std::chrono::duration<double>(
+                             std::chrono::steady_clock::now() - start)
+                             .count();
+    result.playAllocationsPerCommand =
+        double(heapAllocations.load() - before) / result.commands;
+    result.shiftMbps = result.scanBits / result.playSeconds / 1e6;
+
+    std::filesystem::remove_all(dir);
+}
+
+/** @brief Format a result as a JSON object */
+std::string toJson(const std::string& name, const Result& result)
+{
+    char json[1024];
+    std::snprintf(
+        json, sizeof(json),
+        "{\"name\": \"%s\", \"svf_bytes\": %zu, \"commands\": %llu, "
+        "\"scan_bits\": %llu, \"parse_mb_per_s\": %.2f, "
+        "\"allocations_per_command\": %.4f, \"compile_s\": %.4f, "
+        "\"compiled_bytes\": %llu, \"play_s\": %.4f, "
+        "\"shift_mbit_per_s\": %.2f, "
+        "\"play_allocations_per_command\": %.4f, \"peak_rss_kib\": %ld}",
+        name.c_str(), result.svfBytes,
+        static_cast<unsigned long long>(result.commands),
+        static_cast<unsigned long long>(result.scanBits), result.parseMBps,
+        result.allocationsPerCommand, result.compileSeconds,
+        static_cast<unsigned long long>(result.compiledBytes),
+        result.playSeconds, result.shiftMbps,
+        result.playAllocationsPerCommand, result.peakRssKiB);
+    return json;
+}
+
+/** @brief Measure a shape in a child process, so its peak RSS is its own.
+ *
+ *  @return The JSON object of the result
+ */
+std::string run(const Shape& shape, size_t rows)
+{
+    int fds[2];
+    if (pipe(fds) < 0)
+    {
+        throw std::runtime_error("Failed to create a pipe");
+    }
+    auto pid = fork();
+    if (pid < 0)
+    {
+        throw std::runtime_error("Failed to fork");
+    }
+    if (pid == 0)
+    {
+        close(fds[0]);
+        int status = 0;
+        try
+        {
+            auto svf = shape.generate();
+            Result result;
+            result.svfBytes = svf.size();
+            measureParse(svf, result);
+            measureCompileAndPlay(svf, rows, result);
+            svf = std::string();
+
+            rusage usage{};
+            getrusage(RUSAGE_SELF, &usage);
+            result.peakRssKiB = usage.ru_maxrss;
+
+            auto json = toJson(shape.name, result);
+            if (write(fds[1], json.data(), json.size()) !=
+                static_cast<ssize_t>(json.size()))
+            {
+                status = 1;
+            }
+        }
+        catch (const std::exception& e)
+        {
+            std::fprintf(stderr, "%s: %s\n", shape.name.c_str(), e.what());
+            status = 1;
+        }
+        _exit(status);
+    }
+
+    close(fds[1]);
+    std::string json;
+    char buffer[512];
+    ssize_t length = 0;
+    while ((length = read(fds[0], buffer, sizeof(buffer))) > 0)
+    {
+        json.append(buffer, length);
+    }
+    close(fds[0]);
+
+    int status = 0;
+    waitpid(pid, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0 || json.empty())
+    {
+        throw std::runtime_error("Benchmark " + shape.name + " failed");
+    }
+    return json;
+}
+
+} // namespace
+
+/** @brief Measure the engine on synthetic SVFs and print the results as
+ *         JSON, to be compared between releases.
+ *
+ *  @param[in] argv[1] - Optionally a file to write the JSON to as well
+ */
+int main(int argc, char** argv)
+{
+    struct Entry
+    {
+        Shape shape;
+        size_t rows;
+    };
+    const std::vector<Entry> entries = {
+        {{"row-loop-2k", [] { return rowLoop(2175); }}, 2175},
+        {{"row-loop-9k", [] { return rowLoop(9212); }}, 9212},
+        {{"huge-sdr-4x1m", [] { return hugeSdr(4, 1 << 20); }}, 0},
+        {{"runtest-20k", [] { return manyRuntests(20000); }}, 0},
+    };
+
+    std::string json = "{\n  \"benchmark\": \"svf\",\n  \"shapes\": [\n";
+    try
+    {
+        for (size_t i = 0; i < entries.size(); ++i)
+        {
+            json += "    " + run(entries[i].shape, entries[i].rows);
+            json += i + 1 < entries.size() ? ",\n" : "\n";
+        }
+    }
+    catch (const std::exception& e)
+    {
+        std::fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+    json += "  ]\n}\n";
+
+    std::fputs(json.c_str(), stdout);
+    if (argc > 1)
+    {
+        std::ofstream out(argv[1]);
+        out << json;
+        if (!out)
+        {
+            std::fprintf(stderr, "Failed to write %s\n", argv[1]);
+            return 1;
+        }
+    }
+
+    return 0;
+}
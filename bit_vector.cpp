@@ -0,0 +1,345 @@
+#include "bit_vector.hpp"
+
+#include "hex_decode.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+namespace wistron
+{
+namespace software
+{
+namespace updater
+{
+
+namespace
+{
+
+/** @brief Value of a hex digit, or -1 if the character is not one */
+int hexValue(char c)
+{
+    if (c >= '0' && c <= '9')
+    {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f')
+    {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F')
+    {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+bool isSpace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+#if defined(__SSE2__)
+
+/** @brief Whether any masked bit of 16 bytes differs */
+bool differs16(const uint8_t* actual, const uint8_t* expected,
+               const uint8_t* mask)
+{
+    auto diff = _mm_and_si128(
+        _mm_xor_si128(
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(actual)),
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(expected))),
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(mask)));
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(diff, _mm_setzero_si128())) !=
+           0xffff;
+}
+
+#elif defined(__ARM_NEON)
+
+bool differs16(const uint8_t* actual, const uint8_t* expected,
+               const uint8_t* mask)
+{
+    auto diff = vandq_u8(veorq_u8(vld1q_u8(actual), vld1q_u8(expected)),
+                         vld1q_u8(mask));
+
+    // Horizontal maximum, spelled out for ARMv7 which lacks vmaxvq_u8.
+    auto folded = vorr_u8(vget_low_u8(diff), vget_high_u8(diff));
+    folded = vpmax_u8(folded, folded);
+    folded = vpmax_u8(folded, folded);
+    folded = vpmax_u8(folded, folded);
+    return vget_lane_u8(folded, 0) != 0;
+}
+
+#endif
+
+} // namespace
+
+BitVector::BitVector(size_t bits, std::pmr::memory_resource* resource) :
+    bits(bits), storage((bits + 7) / 8, 0, resource)
+{}
+
+BitVector& BitVector::operator=(BitVector&& other) noexcept
+{
+    if (this != &other)
+    {
+        bits = std::exchange(other.bits, 0);
+        // A polymorphic allocator does not follow a move assignment, which
+        // would copy the bits between resources instead of handing over
+        // the buffer.
+        std::destroy_at(&storage);
+        std::construct_at(&storage, std::move(other.storage));
+    }
+    return *this;
+}
+
+BitVector BitVector::fromHex(std::string_view hex, size_t bits)
+{
+    return fromHex(hex, bits, bestHexKernel());
+}
+
+BitVector BitVector::fromHex(std::string_view hex, size_t bits,
+                             const HexKernel& kernel)
+{
+    BitVector vector;
+    vector.decodeHex(hex, bits, kernel);
+    return vector;
+}
+
+void BitVector::decodeHex(std::string_view hex, size_t bits)
+{
+    decodeHex(hex, bits, bestHexKernel());
+}
+
+void BitVector::decodeHex(std::string_view hex, size_t bits,
+                          const HexKernel& kernel)
+{
+    resize(bits);
+    auto block = kernel.blockChars;
+
+    // Walk from the last (least significant) digit towards the first.
+    size_t nibble = 0;
+    auto end = hex.size();
+    while (end > 0)
+    {
+        // Whole blocks go through the vector kernel while the output is byte
+        // aligned and in range. When the kernel rejects a block, typically
+        // for a line break, digits up to that character are done one by one
+        // and the kernel takes over again right after it.
+        size_t scalarEnd = end - 1;
+        if (block != 0 && end >= block && nibble % 2 == 0 &&
+            nibble / 2 + block / 2 <= storage.size())
+        {
+            if (kernel.decode(hex.data() + end - block,
+                              storage.data() + nibble / 2))
+            {
+                end -= block;
+                nibble += block;
+                continue;
+            }
+            while (scalarEnd > end - block && hexValue(hex[scalarEnd]) >= 0)
+            {
+                --scalarEnd;
+            }
+        }
+
+        for (; end > scalarEnd; --end)
+        {
+            auto c = hex[end - 1];
+            if (isSpace(c))
+            {
+                continue;
+            }
+
+            auto value = hexValue(c);
+            if (value < 0)
+            {
+                throw std::invalid_argument("invalid hex digit in scan data");
+            }
+
+            if (nibble / 2 < storage.size())
+            {
+                storage[nibble / 2] |=
+                    static_cast<uint8_t>(value << ((nibble % 2) * 4));
+            }
+            else if (value != 0)
+            {
+                throw std::invalid_argument("scan data exceeds its length");
+            }
+            ++nibble;
+        }
+    }
+
+    auto tail = storage.empty() ? 0 : storage.back();
+    clearTail();
+    if (!storage.empty() && tail != storage.back())
+    {
+        throw std::invalid_argument("scan data exceeds its length");
+    }
+}
+
+BitVector BitVector::fromBytes(const uint8_t* bytes, size_t bits)
+{
+    BitVector vector;
+    vector.load(bytes, bits);
+    return vector;
+}
+
+void BitVector::resize(size_t bits)
+{
+    this->bits = bits;
+    storage.assign((bits + 7) / 8, 0);
+}
+
+void BitVector::resize(size_t bits, bool value)
+{
+    this->bits = bits;
+    storage.assign((bits + 7) / 8, value ? 0xff : 0x00);
+    clearTail();
+}
+
+void BitVector::load(const uint8_t* bytes, size_t bits)
+{
+    this->bits = bits;
+    storage.assign(bytes, bytes + (bits + 7) / 8);
+    clearTail();
+}
+
+void BitVector::loadReversed(const uint8_t* bytes, size_t bits)
+{
+    auto size = (bits + 7) / 8;
+    this->bits = bits;
+    storage.assign(std::reverse_iterator(bytes + size),
+                   std::reverse_iterator(bytes));
+    clearTail();
+}
+
+std::string BitVector::toHex() const
+{
+    constexpr auto digits = "0123456789ABCDEF";
+
+    auto nibbles = std::max<size_t>((bits + 3) / 4, 1);
+    std::string hex(nibbles, '0');
+    for (size_t i = 0; i < nibbles && i / 2 < storage.size(); ++i)
+    {
+        hex[nibbles - 1 - i] = digits[(storage[i / 2] >> ((i % 2) * 4)) & 0xf];
+    }
+    return hex;
+}
+
+void BitVector::fill(bool value)
+{
+    std::fill(storage.begin(), storage.end(), value ? 0xff : 0x00);
+    clearTail();
+}
+
+void BitVector::fill(size_t offset, size_t length, bool value)
+{
+    if (offset + length > bits)
+    {
+        throw std::out_of_range("bit vector fill out of range");
+    }
+
+    for (size_t i = offset; i < offset + length; ++i)
+    {
+        set(i, value);
+    }
+}
+
+void BitVector::assign(size_t offset, const BitVector& other)
+{
+    if (offset + other.bits > bits)
+    {
+        throw std::out_of_range("bit vector assignment out of range");
+    }
+
+    size_t i = 0;
+    if (offset % 8 == 0)
+    {
+        // Whole bytes can be copied, only a partial last byte needs bitwise
+        // handling so the bits following it are preserved.
+        auto wholeBytes = other.bits / 8;
+        std::copy_n(other.storage.begin(), wholeBytes,
+                    storage.begin() + offset / 8);
+        i = wholeBytes * 8;
+    }
+
+    for (; i < other.bits; ++i)
+    {
+        set(offset + i, other.test(i));
+    }
+}
+
+BitVector BitVector::slice(size_t offset, size_t length) const
+{
+    if (offset + length > bits)
+    {
+        throw std::out_of_range("bit vector slice out of range");
+    }
+
+    BitVector result(length);
+    size_t i = 0;
+    if (offset % 8 == 0)
+    {
+        auto wholeBytes = length / 8;
+        std::copy_n(storage.begin() + offset / 8, wholeBytes,
+                    result.storage.begin());
+        i = wholeBytes * 8;
+    }
+
+    for (; i < length; ++i)
+    {
+        result.set(i, test(offset + i));
+    }
+    return result;
+}
+
+void BitVector::clearTail()
+{
+    if (bits % 8 != 0)
+    {
+        storage.back() &= static_cast<uint8_t>((1u << (bits % 8)) - 1);
+    }
+}
+
+std::optional<size_t> firstMismatch(const BitVector& actual,
+                                    const BitVector& expected,
+                                    const BitVector& mask)
+{
+    auto bytes = std::min({actual.byteSize(), expected.byteSize(),
+                           mask.byteSize()});
+    size_t i = 0;
+#if defined(__SSE2__) || defined(__ARM_NEON)
+    // Skip matching blocks 16 bytes at a time, the byte loop below finds
+    // the bit within the first block that differs.
+    for (; i + 16 <= bytes; i += 16)
+    {
+        if (differs16(actual.data() + i, expected.data() + i,
+                      mask.data() + i))
+        {
+            break;
+        }
+    }
+#endif
+    for (; i < bytes; ++i)
+    {
+        uint8_t diff = (actual.data()[i] ^ expected.data()[i]) & mask.data()[i];
+        if (diff != 0)
+        {
+            return i * 8 + std::countr_zero(diff);
+        }
+    }
+    return std::nullopt;
+}
+
+} // namespace updater
+} // namespace software
+} // namespace wistron
@@ -0,0 +1,255 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace wistron
+{
+namespace software
+{
+namespace updater
+{
+
+struct HexKernel;
+
+/** @class BitVector
+ *  @brief Fixed length bit buffer used for JTAG scan data.
+ *  @details Bit 0 is the first bit shifted into TDI (or out of TDO), and is
+ *  stored in the least significant bit of byte 0. This is the layout the
+ *  Linux JTAG driver expects, so data() can be handed to it directly.
+ *  Unused bits of the last byte are always zero. The buffer comes from a
+ *  memory resource, so the scans of a run can be served from one arena;
+ *  copies use the default resource.
+ */
+class BitVector
+{
+  public:
+    BitVector() = default;
+
+    /** @brief Constructs an empty vector allocating from a resource.
+     *
+     *  @param[in] resource - The memory resource of the buffer
+     */
+    explicit BitVector(std::pmr::memory_resource* resource) :
+        storage(resource)
+    {}
+
+    /** @brief Constructs a zero filled vector.
+     *
+     *  @param[in] bits     - The length in bits
+     *  @param[in] resource - The memory resource of the buffer
+     */
+    explicit BitVector(
+        size_t bits,
+        std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+
+    BitVector(const BitVector&) = default;
+    BitVector(BitVector&&) = default;
+    BitVector& operator=(const BitVector&) = default;
+
+    /** @brief Take over another vector's buffer together with its memory
+     *         resource, as the move constructor does. */
+    BitVector& operator=(BitVector&& other) noexcept;
+
+    ~BitVector() = default;
+
+    /** @brief Decode an SVF hex string.
+     *  @details SVF writes scan data most significant digit first, so the
+     *  last digit of the string holds bits 3..0. Whitespace is ignored and
+     *  missing leading digits are zero.
+     *
+     *  @param[in] hex  - The hex digits, without the parentheses
+     *  @param[in] bits - The length of the vector in bits
+     *
+     *  @return The decoded vector
+     *  @error  std::invalid_argument on a non hex character, or when a bit
+     *          beyond the length is set
+     */
+    static BitVector fromHex(std::string_view hex, size_t bits);
+
+    /** @brief Decode an SVF hex string with a specific kernel.
+     *  @details fromHex() uses the fastest kernel of the running CPU, this
+     *  overload exists to compare kernels.
+     *
+     *  @param[in] hex    - The hex digits, without the parentheses
+     *  @param[in] bits   - The length of the vector in bits
+     *  @param[in] kernel - The block decoder to use
+     *
+     *  @return The decoded vector
+     *  @error  std::invalid_argument as for fromHex()
+     */
+    static BitVector fromHex(std::string_view hex, size_t bits,
+                             const HexKernel& kernel);
+
+    /** @brief Build a vector from packed bytes in the BitVector layout.
+     *
+     *  @param[in] bytes - (bits + 7) / 8 bytes
+     *  @param[in] bits  - The length of the vector in bits
+     *
+     *  @return The vector; bits of the last byte beyond the length are
+     *          dropped
+     */
+    static BitVector fromBytes(const uint8_t* bytes, size_t bits);
+
+    /** @brief Replace the contents with a decoded SVF hex string, reusing
+     *         the backing buffer.
+     *
+     *  @param[in] hex    - The hex digits, without the parentheses
+     *  @param[in] bits   - The new length in bits
+     *  @param[in] kernel - The block decoder to use
+     *
+     *  @error  std::invalid_argument as for fromHex(); the contents are
+     *          unspecified then
+     */
+    void decodeHex(std::string_view hex, size_t bits,
+                   const HexKernel& kernel);
+
+    /** @brief Replace the contents with a decoded SVF hex string, using the
+     *         fastest kernel of the running CPU */
+    void decodeHex(std::string_view hex, size_t bits);
+
+    /** @brief Replace the contents with packed bytes in the BitVector
+     *         layout, reusing the backing buffer.
+     *
+     *  @param[in] bytes - (bits + 7) / 8 bytes
+     *  @param[in] bits  - The new length in bits
+     */
+    void load(const uint8_t* bytes, size_t bits);
+
+    /** @brief Replace the contents with a big-endian number, the last byte
+     *         holding bits 7..0, reusing the backing buffer.
+     *  @details This is how XSVF stores scan data.
+     *
+     *  @param[in] bytes - (bits + 7) / 8 bytes
+     *  @param[in] bits  - The new length in bits
+     */
+    void loadReversed(const uint8_t* bytes, size_t bits);
+
+    /** @brief Change the length and zero all bits, keeping the backing
+     *         buffer for reuse */
+    void resize(size_t bits);
+
+    /** @brief Change the length and set all bits to a value, keeping the
+     *         backing buffer for reuse */
+    void resize(size_t bits, bool value);
+
+    /** @brief Drop all bits, keeping the backing buffer for reuse */
+    void clear()
+    {
+        bits = 0;
+        storage.clear();
+    }
+
+    /** @brief Encode as an SVF hex string, most significant digit first */
+    std::string toHex() const;
+
+    /** @brief The length in bits */
+    size_t size() const
+    {
+        return bits;
+    }
+
+    /** @brief Whether the vector has zero length */
+    bool empty() const
+    {
+        return bits == 0;
+    }
+
+    /** @brief The length of the backing buffer in bytes */
+    size_t byteSize() const
+    {
+        return storage.size();
+    }
+
+    const uint8_t* data() const
+    {
+        return storage.data();
+    }
+
+    uint8_t* data()
+    {
+        return storage.data();
+    }
+
+    /** @brief Get the value of a bit */
+    bool test(size_t bit) const
+    {
+        return (storage[bit / 8] >> (bit % 8)) & 1;
+    }
+
+    /** @brief Set the value of a bit */
+    void set(size_t bit, bool value)
+    {
+        auto mask = static_cast<uint8_t>(1u << (bit % 8));
+        storage[bit / 8] = value ? (storage[bit / 8] | mask)
+                                 : (storage[bit / 8] & ~mask);
+    }
+
+    /** @brief Set all bits to the given value */
+    void fill(bool value);
+
+    /** @brief Set a range of bits to the given value.
+     *
+     *  @param[in] offset - The first bit to set
+     *  @param[in] length - The number of bits to set
+     *  @param[in] value  - The value
+     */
+    void fill(size_t offset, size_t length, bool value);
+
+    /** @brief Copy all bits of another vector into this one.
+     *
+     *  @param[in] offset - The bit position the copy starts at
+     *  @param[in] other  - The bits to copy
+     */
+    void assign(size_t offset, const BitVector& other);
+
+    /** @brief Copy a range of bits out of this vector.
+     *
+     *  @param[in] offset - The first bit to copy
+     *  @param[in] length - The number of bits to copy
+     *
+     *  @return The bits, bit offset of this vector in bit 0
+     *  @error  std::out_of_range if the range exceeds the vector
+     */
+    BitVector slice(size_t offset, size_t length) const;
+
+    /** @brief Get the memory resource of the backing buffer */
+    std::pmr::memory_resource* resource() const
+    {
+        return storage.get_allocator().resource();
+    }
+
+    bool operator==(const BitVector& other) const = default;
+
+  private:
+    /** @brief Clear the unused bits of the last byte */
+    void clearTail();
+
+    /** @brief The length in bits */
+    size_t bits = 0;
+
+    /** @brief The backing buffer */
+    std::pmr::vector<uint8_t> storage;
+};
+
+/** @brief Compare captured scan data against the expected value.
+ *
+ *  @param[in] actual   - The captured bits
+ *  @param[in] expected - The expected bits
+ *  @param[in] mask     - Bits set here are compared, others are ignored
+ *
+ *  @return The first mismatching bit, or std::nullopt if all masked bits
+ *          match
+ */
+std::optional<size_t> firstMismatch(const BitVector& actual,
+                                    const BitVector& expected,
+                                    const BitVector& mask);
+
+} // namespace updater
+} // namespace software
+} // namespace wistron
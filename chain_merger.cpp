@@ -0,0 +1,503 @@
+#include "chain_merger.hpp"
+
+#include "xsvf_parser.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace wistron
+{
+namespace software
+{
+namespace updater
+{
+
+namespace
+{
+
+std::chrono::nanoseconds toDuration(double seconds)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::duration<double>(seconds));
+}
+
+bool passesReset(const StateOp& op)
+{
+    return std::ranges::find(op.path, TapState::Reset) != op.path.end();
+}
+
+} // namespace
+
+ChainMerger::ChainMerger(std::vector<ChainDevice> devices)
+{
+    if (devices.empty())
+    {
+        throw std::invalid_argument("a chain needs at least one device");
+    }
+
+    for (const auto& device : devices)
+    {
+        if (!device.ops || device.irLength == 0)
+        {
+            throw std::invalid_argument(
+                "every chain device needs a stream and an IR length");
+        }
+        chainIrLength += device.irLength;
+        Lane lane;
+        lane.device = device;
+        lanes.push_back(std::move(lane));
+    }
+}
+
+size_t ChainMerger::offset() const
+{
+    size_t total = 0;
+    for (const auto& lane : lanes)
+    {
+        total += lane.device.ops->offset();
+    }
+    return total;
+}
+
+size_t ChainMerger::size() const
+{
+    size_t total = 0;
+    for (const auto& lane : lanes)
+    {
+        total += lane.device.ops->size();
+    }
+    return total;
+}
+
+bool ChainMerger::next(SvfOp& op)
+{
+    while (pending.empty())
+    {
+        refill();
+        if (std::ranges::none_of(lanes, [](const Lane& lane) {
+                return lane.head.has_value();
+            }))
+        {
+            return false;
+        }
+        step();
+    }
+
+    op = std::move(pending.front());
+    pending.pop_front();
+    return true;
+}
+
+void ChainMerger::refill()
+{
+    for (size_t i = 0; i < lanes.size(); ++i)
+    {
+        auto& lane = lanes[i];
+        if (lane.done || lane.head)
+        {
+            continue;
+        }
+
+        SvfOp op;
+        if (!lane.device.ops->next(op))
+        {
+            lane.done = true;
+            continue;
+        }
+
+        lane.line = lane.device.ops->line();
+        if (auto scan = std::get_if<ScanOp>(&op))
+        {
+            unpad(lane, *scan);
+        }
+        lane.head = std::move(op);
+    }
+}
+
+void ChainMerger::unpad(Lane& lane, ScanOp& scan) const
+{
+    auto index = static_cast<size_t>(&lane - lanes.data());
+    size_t offset = 0;
+    size_t length = scan.tdi.size();
+
+    if (scan.type == ScanType::IR)
+    {
+        if (length == chainIrLength && length != lane.device.irLength)
+        {
+            lane.padded = true;
+            for (size_t i = 0; i < index; ++i)
+            {
+                offset += lanes[i].device.irLength;
+            }
+            length = lane.device.irLength;
+        }
+        else if (length != lane.device.irLength)
+        {
+            throw SvfError(lane.line,
+                           "SIR of " + std::to_string(length) +
+                               " bits fits neither the device's " +
+                               std::to_string(lane.device.irLength) +
+                               " bit instruction register nor the chain");
+        }
+    }
+    else if (lane.padded)
+    {
+        // Every other device adds its one bit BYPASS register.
+        if (length < lanes.size() - 1)
+        {
+            throw SvfError(lane.line, "SDR is shorter than the chain's "
+                                      "BYPASS padding");
+        }
+        offset = index;
+        length -= lanes.size() - 1;
+    }
+
+    if (offset == 0 && length == scan.tdi.size())
+    {
+        return;
+    }
+
+    scan.tdi = scan.tdi.slice(offset, length);
+    if (!scan.tdo.empty())
+    {
+        scan.tdo = scan.tdo.slice(offset, length);
+        scan.mask = scan.mask.slice(offset, length);
+    }
+}
+
+BitVector ChainMerger::bypass(const Lane& lane) const
+{
+    BitVector bits(lane.device.irLength);
+    bits.fill(true);
+    return bits;
+}
+
+void ChainMerger::step()
+{
+    auto control = std::ranges::find_if(lanes, [](const Lane& lane) {
+        return lane.head && !std::holds_alternative<ScanOp>(*lane.head);
+    });
+    if (control != lanes.end())
+    {
+        currentLine = control->line;
+        emitControl(*control);
+        return;
+    }
+
+    // Instructions go first, devices waiting with a data scan keep theirs.
+    std::vector<const ScanOp*> scans(lanes.size());
+    size_t participants = 0;
+    auto collect = [&](ScanType type) {
+        participants = 0;
+        for (size_t i = 0; i < lanes.size(); ++i)
+        {
+            scans[i] = nullptr;
+            if (!lanes[i].head)
+            {
+                continue;
+            }
+            const auto& scan = std::get<ScanOp>(*lanes[i].head);
+            if (scan.type == type)
+            {
+                scans[i] = &scan;
+                if (participants++ == 0)
+                {
+                    currentLine = lanes[i].line;
+                }
+            }
+        }
+        return participants != 0;
+    };
+
+    auto endState = [&scans]() {
+        return (*std::ranges::find_if(scans, [](auto scan) {
+                   return scan != nullptr;
+               }))->endState;
+    };
+
+    auto count = [this, &participants]() {
+        if (participants > 1)
+        {
+            ++mergeStats.mergedScans;
+        }
+        else
+        {
+            ++mergeStats.soloScans;
+        }
+    };
+
+    if (collect(ScanType::IR))
+    {
+        std::vector<BitVector> instructions(lanes.size());
+        for (size_t i = 0; i < lanes.size(); ++i)
+        {
+            auto& lane = lanes[i];
+            // Finished devices go to BYPASS for good.
+            instructions[i] = scans[i] ? scans[i]->tdi
+                              : lane.done || lane.wanted.empty()
+                                  ? bypass(lane)
+                                  : lane.wanted;
+        }
+        emitInstructions(instructions, scans, endState());
+        count();
+        for (size_t i = 0; i < lanes.size(); ++i)
+        {
+            if (scans[i])
+            {
+                lanes[i].wanted = instructions[i];
+                lanes[i].head.reset();
+            }
+        }
+        return;
+    }
+
+    collect(ScanType::DR);
+
+    // Devices sitting the scan out have to be in BYPASS, the others need
+    // their own instruction back if an earlier scan replaced it.
+    std::vector<BitVector> required(lanes.size());
+    bool reload = false;
+    bool resetDefault = false;
+    for (size_t i = 0; i < lanes.size(); ++i)
+    {
+        auto& lane = lanes[i];
+        if (scans[i] && lane.wanted.empty())
+        {
+            // The device still holds the instruction it reset to.
+            if (!lane.loaded.empty())
+            {
+                throw SvfError(lane.line, "SDR without an instruction after "
+                                          "the chain's instructions changed");
+            }
+            resetDefault = true;
+            continue;
+        }
+        required[i] = scans[i] ? lane.wanted : bypass(lane);
+        reload = reload || lane.loaded != required[i];
+    }
+
+    if (reload)
+    {
+        if (resetDefault)
+        {
+            throw SvfError(currentLine, "SDR without an instruction while "
+                                        "other devices need theirs loaded");
+        }
+        emitInstructions(required, std::vector<const ScanOp*>(lanes.size()),
+                         TapState::Idle);
+        ++mergeStats.bypassLoads;
+    }
+
+    ScanOp merged;
+    merged.type = ScanType::DR;
+    merged.endState = endState();
+    size_t length = 0;
+    bool checked = false;
+    for (size_t i = 0; i < lanes.size(); ++i)
+    {
+        length += scans[i] ? scans[i]->tdi.size() : 1;
+        checked = checked || (scans[i] && !scans[i]->tdo.empty());
+    }
+
+    // BYPASS registers shift zeros and are not checked.
+    merged.tdi = BitVector(length);
+    if (checked)
+    {
+        merged.tdo = BitVector(length);
+        merged.mask = BitVector(length);
+    }
+    size_t offset = 0;
+    for (size_t i = 0; i < lanes.size(); ++i)
+    {
+        if (!scans[i])
+        {
+            ++offset;
+            continue;
+        }
+        merged.tdi.assign(offset, scans[i]->tdi);
+        if (!scans[i]->tdo.empty())
+        {
+            merged.tdo.assign(offset, scans[i]->tdo);
+            merged.mask.assign(offset, scans[i]->mask);
+        }
+        offset += scans[i]->tdi.size();
+    }
+
+    pending.push_back(std::move(merged));
+    count();
+    for (size_t i = 0; i < lanes.size(); ++i)
+    {
+        if (scans[i])
+        {
+            lanes[i].head.reset();
+        }
+    }
+}
+
+void ChainMerger::emitControl(Lane& first)
+{
+    auto& head = *first.head;
+
+    if (auto runTest = std::get_if<RunTestOp>(&head))
+    {
+        // All devices idle in the same state, so one wait covers everyone
+        // waiting there.
+        RunTestOp merged = *runTest;
+        std::chrono::nanoseconds total{0};
+        uint64_t count = 0;
+        for (auto& lane : lanes)
+        {
+            auto other = lane.head ? std::get_if<RunTestOp>(&*lane.head)
+                                   : nullptr;
+            if (!other || other->runState != runTest->runState ||
+                other->endState != runTest->endState)
+            {
+                continue;
+            }
+            merged.tck = std::max(merged.tck, other->tck);
+            merged.minTime = std::max(merged.minTime, other->minTime);
+            merged.maxTime = merged.maxTime == 0 || other->maxTime == 0
+                                 ? 0
+                                 : std::max(merged.maxTime, other->maxTime);
+            total += toDuration(other->minTime);
+            ++count;
+            if (&lane != &first)
+            {
+                lane.head.reset();
+            }
+        }
+        if (count > 1)
+        {
+            mergeStats.mergedWaits += count - 1;
+            mergeStats.waitSaved += total - toDuration(merged.minTime);
+        }
+        pending.push_back(merged);
+    }
+    else if (auto state = std::get_if<StateOp>(&head))
+    {
+        // The TAP controllers move together, one walk serves all devices
+        // asking for the same.
+        for (auto& lane : lanes)
+        {
+            auto other =
+                lane.head ? std::get_if<StateOp>(&*lane.head) : nullptr;
+            if (&lane != &first && other && other->path == state->path)
+            {
+                lane.head.reset();
+            }
+        }
+        if (passesReset(*state))
+        {
+            for (auto& lane : lanes)
+            {
+                lane.wanted = BitVector();
+                lane.loaded = BitVector();
+            }
+        }
+        pending.push_back(*state);
+    }
+    else if (auto frequency = std::get_if<FrequencyOp>(&head))
+    {
+        // The chain runs at the speed of its slowest device.
+        first.frequency = frequency->hz;
+        FrequencyOp merged;
+        for (const auto& lane : lanes)
+        {
+            if (lane.frequency > 0 &&
+                (merged.hz == 0 || lane.frequency < merged.hz))
+            {
+                merged.hz = lane.frequency;
+            }
+        }
+        pending.push_back(merged);
+    }
+    else if (auto trst = std::get_if<TrstOp>(&head))
+    {
+        for (auto& lane : lanes)
+        {
+            auto other = lane.head ? std::get_if<TrstOp>(&*lane.head) : nullptr;
+            if (&lane != &first && other &&
+                other->asserted == trst->asserted)
+            {
+                lane.head.reset();
+            }
+            if (trst->asserted)
+            {
+                lane.wanted = BitVector();
+                lane.loaded = BitVector();
+            }
+        }
+        pending.push_back(*trst);
+    }
+
+    first.head.reset();
+}
+
+void ChainMerger::emitInstructions(const std::vector<BitVector>& instructions,
+                                   const std::vector<const ScanOp*>& scans,
+                                   TapState endState)
+{
+    ScanOp merged;
+    merged.type = ScanType::IR;
+    merged.endState = endState;
+    merged.tdi = BitVector(chainIrLength);
+    bool checked = std::ranges::any_of(scans, [](auto scan) {
+        return scan && !scan->tdo.empty();
+    });
+    if (checked)
+    {
+        merged.tdo = BitVector(chainIrLength);
+        merged.mask = BitVector(chainIrLength);
+    }
+
+    size_t offset = 0;
+    for (size_t i = 0; i < lanes.size(); ++i)
+    {
+        merged.tdi.assign(offset, instructions[i]);
+        if (scans[i] && !scans[i]->tdo.empty())
+        {
+            merged.tdo.assign(offset, scans[i]->tdo);
+            merged.mask.assign(offset, scans[i]->mask);
+        }
+        lanes[i].loaded = instructions[i];
+        offset += lanes[i].device.irLength;
+    }
+
+    pending.push_back(std::move(merged));
+}
+
+size_t firstIrLength(OpSource& source)
+{
+    SvfOp op;
+    while (source.next(op))
+    {
+        auto scan = std::get_if<ScanOp>(&op);
+        if (scan && scan->type == ScanType::IR)
+        {
+            return scan->tdi.size();
+        }
+    }
+    throw std::runtime_error("the SVF loads no instruction");
+}
+
+ChainFiles::ChainFiles(const std::vector<std::string>& paths,
+                       const std::vector<size_t>& irLengths)
+{
+    std::vector<ChainDevice> devices;
+    for (size_t i = 0; i < paths.size(); ++i)
+    {
+        size_t irLength = i < irLengths.size() ? irLengths[i] : 0;
+        if (irLength == 0)
+        {
+            irLength = firstIrLength(*openOpFile(paths[i]));
+        }
+
+        files.push_back(openOpFile(paths[i]));
+        devices.push_back(ChainDevice{files.back().get(), irLength});
+    }
+    merger = std::make_unique<ChainMerger>(std::move(devices));
+}
+
+} // namespace updater
+} // namespace software
+} // namespace wistron
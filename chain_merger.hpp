@@ -0,0 +1,234 @@
+#pragma once
+
+#include "ops.hpp"
+#include "svf_parser.hpp"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace wistron
+{
+namespace software
+{
+namespace updater
+{
+
+/** @struct ChainDevice
+ *  @brief The programming stream of one device of a daisy chain.
+ */
+struct ChainDevice
+{
+    /** @brief The device's operations */
+    OpSource* ops = nullptr;
+
+    /** @brief The device's instruction register length */
+    size_t irLength = 0;
+};
+
+/** @struct ChainMergeStats
+ *  @brief How well the device streams of a chain lined up.
+ */
+struct ChainMergeStats
+{
+    /** @brief Scans shared by two or more devices */
+    uint64_t mergedScans = 0;
+
+    /** @brief Scans only one device took part in */
+    uint64_t soloScans = 0;
+
+    /** @brief Instruction scans added to put devices into BYPASS or to
+     *         restore their instruction */
+    uint64_t bypassLoads = 0;
+
+    /** @brief RUNTESTs run once for several devices */
+    uint64_t mergedWaits = 0;
+
+    /** @brief Wait time saved against playing the devices one by one */
+    std::chrono::nanoseconds waitSaved{0};
+};
+
+/** @class ChainMerger
+ *  @brief Merges the programming streams of the devices of one JTAG daisy
+ *         chain into a single chain-wide stream.
+ *  @details The streams are walked in lockstep. Scans of the same register
+ *  are shifted together, each device's bits in its chain position, and
+ *  RUNTESTs run once with the longest of the delays, so identical erase and
+ *  program phases of several devices take the time of one. A device that
+ *  sits out a data scan is put into BYPASS first, and gets its instruction
+ *  loaded again before its own next data scan.
+ *
+ *  A stream may be written for the device alone, or for the whole chain
+ *  with HIR/HDR/TIR/TDR padding the other devices in BYPASS, as vendor tools
+ *  generate them for a chain position. The padding is recognized by the
+ *  instruction length and stripped.
+ */
+class ChainMerger : public OpSource
+{
+  public:
+    /** @brief Constructs ChainMerger.
+     *
+     *  @param[in] devices - The devices, the one nearest TDO first
+     *
+     *  @error  std::invalid_argument if a device has no stream or no
+     *          instruction length
+     */
+    explicit ChainMerger(std::vector<ChainDevice> devices);
+
+    /** @brief Read the next chain-wide operation.
+     *
+     *  @param[out] op - The operation
+     *
+     *  @return false once all streams are done
+     *  @error  SvfError if a scan does not fit the device or the chain
+     */
+    bool next(SvfOp& op) override;
+
+    size_t offset() const override;
+
+    size_t size() const override;
+
+    size_t line() const override
+    {
+        return currentLine;
+    }
+
+    /** @brief Get the statistics so far */
+    const ChainMergeStats& stats() const
+    {
+        return mergeStats;
+    }
+
+  private:
+    /** @brief The merge state of one device */
+    struct Lane
+    {
+        ChainDevice device;
+
+        /** @brief The device's next operation, device local */
+        std::optional<SvfOp> head;
+
+        /** @brief Whether the stream ended */
+        bool done = false;
+
+        /** @brief Whether the stream pads for the whole chain */
+        bool padded = false;
+
+        /** @brief The instruction the stream loaded last; empty if none */
+        BitVector wanted;
+
+        /** @brief The instruction in the device; empty if unknown */
+        BitVector loaded;
+
+        /** @brief The TCK frequency the stream asked for; 0 for full */
+        double frequency = 0;
+
+        /** @brief The line of head */
+        size_t line = 0;
+    };
+
+    /** @brief Read the next operation of every lane without one */
+    void refill();
+
+    /** @brief Strip the chain padding off a scan of a padded stream */
+    void unpad(Lane& lane, ScanOp& scan) const;
+
+    /** @brief Merge the next step of the lanes into pending */
+    void step();
+
+    /** @brief Emit the non-scan operation at the head of a lane */
+    void emitControl(Lane& lane);
+
+    /** @brief Emit an instruction scan for all devices */
+    void emitInstructions(const std::vector<BitVector>& instructions,
+                          const std::vector<const ScanOp*>& scans,
+                          TapState endState);
+
+    /** @brief Get the BYPASS instruction of a device */
+    BitVector bypass(const Lane& lane) const;
+
+    /** @brief The lanes, the device nearest TDO first */
+    std::vector<Lane> lanes;
+
+    /** @brief The chain's total instruction length */
+    size_t chainIrLength = 0;
+
+    /** @brief Merged operations to hand out */
+    std::deque<SvfOp> pending;
+
+    /** @brief The line of the last operation handed out */
+    size_t currentLine = 0;
+
+    /** @brief The statistics */
+    ChainMergeStats mergeStats;
+};
+
+/** @brief Find the instruction length a device stream uses.
+ *
+ *  @param[in] source - The stream, read up to its first instruction scan
+ *
+ *  @return The length of the first instruction scan
+ *  @error  std::runtime_error if the stream has none
+ */
+size_t firstIrLength(OpSource& source);
+
+/** @class ChainFiles
+ *  @brief The merged stream of a chain's mapped SVF or XSVF files.
+ */
+class ChainFiles : public OpSource
+{
+  public:
+    /** @brief Maps the SVF or XSVF files of a chain.
+     *
+     *  @param[in] paths     - One file per device, the device nearest TDO
+     *                         first
+     *  @param[in] irLengths - The instruction length per device; missing or
+     *                         0 entries are taken from the SVF's first SIR
+     *
+     *  @error  std::system_error if a file can not be mapped
+     */
+    ChainFiles(const std::vector<std::string>& paths,
+               const std::vector<size_t>& irLengths);
+
+    bool next(SvfOp& op) override
+    {
+        return merger->next(op);
+    }
+
+    size_t offset() const override
+    {
+        return merger->offset();
+    }
+
+    size_t size() const override
+    {
+        return merger->size();
+    }
+
+    size_t line() const override
+    {
+        return merger->line();
+    }
+
+    /** @brief Get the merge statistics so far */
+    const ChainMergeStats& stats() const
+    {
+        return merger->stats();
+    }
+
+  private:
+    /** @brief The mapped files */
+    std::vector<std::unique_ptr<OpSource>> files;
+
+    /** @brief The merger reading them */
+    std::unique_ptr<ChainMerger> merger;
+};
+
+} // namespace updater
+} // namespace software
+} // namespace wistron
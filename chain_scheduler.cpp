@@ -0,0 +1,80 @@
+#include "chain_scheduler.hpp"
+
+#include <algorithm>
+
+namespace wistron
+{
+namespace software
+{
+namespace updater
+{
+
+bool ChainScheduler::submit(const std::string& device, const void* owner,
+                            Job job)
+{
+    auto& chain = chains[device];
+    if (chain.running || !chain.queue.empty())
+    {
+        chain.queue.emplace_back(owner, std::move(job));
+        return false;
+    }
+
+    chain.running = owner;
+    job();
+    return true;
+}
+
+void ChainScheduler::release(const void* owner)
+{
+    for (auto& [device, chain] : chains)
+    {
+        std::erase_if(chain.queue, [owner](const auto& entry) {
+            return entry.first == owner;
+        });
+        if (chain.running == owner)
+        {
+            chain.running = nullptr;
+            startNext(chain);
+        }
+    }
+}
+
+bool ChainScheduler::busy(const std::string& device) const
+{
+    auto it = chains.find(device);
+    return it != chains.end() && it->second.running;
+}
+
+size_t ChainScheduler::position(const void* owner) const
+{
+    for (const auto& [device, chain] : chains)
+    {
+        auto it = std::ranges::find_if(chain.queue, [owner](const auto& entry) {
+            return entry.first == owner;
+        });
+        if (it != chain.queue.end())
+        {
+            return static_cast<size_t>(it - chain.queue.begin()) + 1;
+        }
+    }
+    return 0;
+}
+
+void ChainScheduler::startNext(Chain& chain)
+{
+    if (chain.queue.empty())
+    {
+        return;
+    }
+
+    auto [owner, job] = std::move(chain.queue.front());
+    chain.queue.pop_front();
+    chain.running = owner;
+    // The job may release the chain again right away, e.g. when it fails to
+    // start, which starts the one after it.
+    job();
+}
+
+} // namespace updater
+} // namespace software
+} // namespace wistron
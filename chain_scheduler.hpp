@@ -0,0 +1,80 @@
+#pragma once
+
+#include <deque>
+#include <functional>
+#include <map>
+#include <string>
+#include <utility>
+
+namespace wistron
+{
+namespace software
+{
+namespace updater
+{
+
+/** @class ChainScheduler
+ *  @brief Runs one job per JTAG chain at a time.
+ *  @details Devices on separate JTAG controllers are programmed in parallel,
+ *  each on its own Programmer worker, while jobs for the same chain wait for
+ *  the one ahead of them. Every job is identified by its owner, which
+ *  releases the chain once the job finished or it gave up on it. The
+ *  scheduler is only used from the event loop.
+ */
+class ChainScheduler
+{
+  public:
+    /** @brief A job start; it has to release its owner eventually */
+    using Job = std::function<void()>;
+
+    /** @brief Run a job on a chain, right away if the chain is free.
+     *
+     *  @param[in] device - The JTAG device node of the chain
+     *  @param[in] owner  - Identifies the job; one job per owner
+     *  @param[in] job    - Starts the job
+     *
+     *  @return true if the job started, false if it is queued
+     */
+    bool submit(const std::string& device, const void* owner, Job job);
+
+    /** @brief Release the chain an owner holds, or drop its queued job.
+     *  @details The next job queued for the chain is started. Releasing an
+     *  owner without a job does nothing.
+     *
+     *  @param[in] owner - The owner passed to submit()
+     */
+    void release(const void* owner);
+
+    /** @brief Check whether a chain runs a job.
+     *
+     *  @param[in] device - The JTAG device node of the chain
+     */
+    bool busy(const std::string& device) const;
+
+    /** @brief Get the number of jobs ahead of an owner's queued job; 0 if
+     *         the job runs or there is none */
+    size_t position(const void* owner) const;
+
+  private:
+    /** @struct Chain
+     *  @brief The jobs of one JTAG chain.
+     */
+    struct Chain
+    {
+        /** @brief The owner of the running job; null if the chain is free */
+        const void* running = nullptr;
+
+        /** @brief Jobs waiting for the chain, in submission order */
+        std::deque<std::pair<const void*, Job>> queue;
+    };
+
+    /** @brief Start the next queued job of a free chain */
+    void startNext(Chain& chain);
+
+    /** @brief The chains by device node */
+    std::map<std::string, Chain> chains;
+};
+
+} // namespace updater
+} // namespace software
+} // namespace wistron
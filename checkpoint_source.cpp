@@ -0,0 +1,71 @@
+#include "checkpoint_source.hpp"
+
+#include "lattice_isc.hpp"
+
+namespace wistron
+{
+namespace software
+{
+namespace updater
+{
+
+bool CheckpointSource::next(SvfOp& op)
+{
+    if (!source.next(op))
+    {
+        return false;
+    }
+
+    auto scan = std::get_if<ScanOp>(&op);
+    if (!scan)
+    {
+        return true;
+    }
+
+    if (scan->type == ScanType::IR)
+    {
+        ir.reset();
+        if (scan->tdi.size() == lattice::irBits)
+        {
+            ir = scan->tdi.data()[0];
+        }
+        if (ir == lattice::LSC_INIT_ADDRESS)
+        {
+            row = 0;
+        }
+        else if (ir == lattice::LSC_INIT_ADDR_UFM)
+        {
+            row.reset();
+        }
+        return true;
+    }
+
+    if (ir == lattice::LSC_WRITE_ADDRESS && scan->tdi.size() == 32)
+    {
+        // Operand bits 13..0 hold the page, bit 30 selects the UFM.
+        size_t page = 0;
+        for (size_t i = 0; i < 14; ++i)
+        {
+            page |= static_cast<size_t>(scan->tdi.test(i)) << i;
+        }
+        row = page;
+        if (scan->tdi.test(30))
+        {
+            row.reset();
+        }
+    }
+    else if (ir == lattice::LSC_PROG_INCR_NV && row)
+    {
+        if (*row >= checkpoint + group)
+        {
+            callback(*row);
+            checkpoint = *row;
+        }
+        ++*row;
+    }
+    return true;
+}
+
+} // namespace updater
+} // namespace software
+} // namespace wistron
@@ -0,0 +1,87 @@
+#pragma once
+
+#include "ops.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <optional>
+
+namespace wistron
+{
+namespace software
+{
+namespace updater
+{
+
+/** @class CheckpointSource
+ *  @brief Reports how many configuration rows of a MachXO2/MachXO3 stream
+ *         have been programmed, every few rows, so an interrupted run can
+ *         resume from there.
+ *  @details The row address is followed the way the device keeps it:
+ *  LSC_INIT_ADDRESS sets it to the first row, LSC_WRITE_ADDRESS to the
+ *  page it names and every LSC_PROG_INCR_NV data scan advances it. When
+ *  the player asks for the scan programming a row at least a group past
+ *  the last checkpoint, everything played before, the preceding rows and
+ *  their programming delays included, has been handed to the backend, and
+ *  the callback is invoked with that row. It is up to the callback to
+ *  flush the backend before recording the checkpoint.
+ */
+class CheckpointSource : public OpSource
+{
+  public:
+    /** @brief Callback receiving the number of rows programmed */
+    using CheckpointCallback = std::function<void(size_t)>;
+
+    /** @brief Constructs CheckpointSource.
+     *
+     *  @param[in] source   - The operations to pass on
+     *  @param[in] rows     - The rows between checkpoints
+     *  @param[in] callback - The checkpoint callback
+     */
+    CheckpointSource(OpSource& source, size_t rows,
+                     CheckpointCallback callback) :
+        source(source), group(rows), callback(std::move(callback))
+    {}
+
+    bool next(SvfOp& op) override;
+
+    size_t offset() const override
+    {
+        return source.offset();
+    }
+
+    size_t size() const override
+    {
+        return source.size();
+    }
+
+    size_t line() const override
+    {
+        return source.line();
+    }
+
+  private:
+    /** @brief The wrapped stream */
+    OpSource& source;
+
+    /** @brief The rows between checkpoints */
+    size_t group;
+
+    /** @brief The callback */
+    CheckpointCallback callback;
+
+    /** @brief The last instruction the stream loaded */
+    std::optional<uint8_t> ir;
+
+    /** @brief The row address; unset while it points outside the
+     *         configuration rows or is not known */
+    std::optional<size_t> row;
+
+    /** @brief The rows recorded at the last checkpoint */
+    size_t checkpoint = 0;
+};
+
+} // namespace updater
+} // namespace software
+} // namespace wistron
@@ -0,0 +1,658 @@
+#include "compiled_image.hpp"
+
+#include "xsvf_parser.hpp"
+
+#include <array>
+#include <bit>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <system_error>
+
+namespace wistron
+{
+namespace software
+{
+namespace updater
+{
+
+namespace
+{
+
+static_assert(std::endian::native == std::endian::little,
+              "compiled images are stored in host byte order");
+
+constexpr std::array<char, 8> imageMagic = {'C', 'P', 'L', 'D',
+                                            'O', 'P', 'S', '\0'};
+
+/** @brief On-disk header, followed by the op payload.
+ *  @details Every op starts with its opcode and source line:
+ *      u8 opcode, u32 line
+ *  followed by, per opcode:
+ *      scan:      u8 type, u8 endState, u8 hasTdo, u32 bits, tdi,
+ *                 [tdo, mask]
+ *      runtest:   u8 runState, u8 endState, u32 tck, u64 minNs, u64 maxNs
+ *      state:     u16 count, count x u8 state
+ *      frequency: u32 hz
+ *      trst:      u8 asserted
+ *  Scan data holds (bits + 7) / 8 bytes in the BitVector layout, encoded
+ *  as one of:
+ *      raw:       u8 0, the bytes
+ *      fill:      u8 1, u8 level of every bit
+ *      runs:      u8 2, u32 count, count x (u32 length, u8 byte)
+ */
+struct ImageHeader
+{
+    std::array<char, 8> magic;
+    uint32_t version;
+    uint32_t headerSize;
+    uint64_t sourceSize;
+    uint32_t sourceCrc;
+    uint32_t payloadCrc;
+    uint64_t payloadSize;
+    uint64_t opCount;
+    std::array<uint8_t, 12> reserved;
+    uint32_t headerCrc;
+};
+static_assert(sizeof(ImageHeader) == 64);
+
+enum class Opcode : uint8_t
+{
+    Scan = 1,
+    RunTest = 2,
+    State = 3,
+    Frequency = 4,
+    Trst = 5,
+};
+
+enum class Encoding : uint8_t
+{
+    Raw = 0,
+    Fill = 1,
+    Runs = 2,
+};
+
+/** @brief Fill scans at least this long are handed out without TDI data.
+ *  @details Shorter ones are expanded: instructions and the configuration
+ *  rows differential programming reads back are inspected bit by bit, and
+ *  are far shorter than this. */
+constexpr size_t fillScanBits = 1024;
+
+/** @brief Get the level of a vector whose bits are all the same.
+ *
+ *  @param[in] bytes - (bits + 7) / 8 bytes in the BitVector layout
+ *  @param[in] bits  - The length in bits; not 0
+ *
+ *  @return The level, or std::nullopt if the bits differ
+ */
+std::optional<bool> uniformLevel(const uint8_t* bytes, size_t bits)
+{
+    bool level = bytes[0] & 1;
+    uint8_t full = level ? 0xff : 0x00;
+    auto wholeBytes = bits / 8;
+    for (size_t i = 0; i < wholeBytes; ++i)
+    {
+        if (bytes[i] != full)
+        {
+            return std::nullopt;
+        }
+    }
+    if (bits % 8 != 0 &&
+        bytes[wholeBytes] != (full & ((1u << (bits % 8)) - 1)))
+    {
+        return std::nullopt;
+    }
+    return level;
+}
+
+/** @brief Count the runs of equal bytes */
+size_t countRuns(const uint8_t* bytes, size_t size)
+{
+    size_t runs = 0;
+    for (size_t i = 0; i < size; ++runs)
+    {
+        auto value = bytes[i];
+        while (i < size && bytes[i] == value)
+        {
+            ++i;
+        }
+    }
+    return runs;
+}
+
+constexpr auto crcTable = [] {
+    std::array<uint32_t, 256> table{};
+    for (uint32_t i = 0; i < table.size(); ++i)
+    {
+        uint32_t crc = i;
+        for (int bit = 0; bit < 8; ++bit)
+        {
+            crc = (crc >> 1) ^ ((crc & 1) ? 0xedb88320u : 0);
+        }
+        table[i] = crc;
+    }
+    return table;
+}();
+
+/** @brief Continue a CRC-32 (IEEE) over more data */
+uint32_t crc32(uint32_t crc, const void* data, size_t size)
+{
+    auto bytes = static_cast<const uint8_t*>(data);
+    crc = ~crc;
+    for (size_t i = 0; i < size; ++i)
+    {
+        crc = crcTable[(crc ^ bytes[i]) & 0xff] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+uint64_t toNanoseconds(double seconds)
+{
+    return static_cast<uint64_t>(std::llround(seconds * 1e9));
+}
+
+/** @class ImageWriter
+ *  @brief Streams ops into a compiled image file.
+ */
+class ImageWriter
+{
+  public:
+    explicit ImageWriter(const std::string& path) :
+        file(path, std::ios::binary | std::ios::trunc)
+    {
+        if (!file)
+        {
+            auto error = errno;
+            throw std::system_error(error, std::generic_category(),
+                                    "Failed to create " + path);
+        }
+        // Reserve room for the header, it is written once the payload is
+        // known.
+        ImageHeader header{};
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    }
+
+    void write(const SvfOp& op, size_t line)
+    {
+        std::visit(
+            [this, line](const auto& op) {
+                writeOp(op, static_cast<uint32_t>(line));
+            },
+            op);
+        ++opCount;
+    }
+
+    void finish(uint64_t sourceSize, uint32_t sourceCrc)
+    {
+        ImageHeader header{};
+        header.magic = imageMagic;
+        header.version = compiledImageVersion;
+        header.headerSize = sizeof(header);
+        header.sourceSize = sourceSize;
+        header.sourceCrc = sourceCrc;
+        header.payloadCrc = payloadCrc;
+        header.payloadSize = payloadSize;
+        header.opCount = opCount;
+        header.headerCrc =
+            crc32(0, &header, offsetof(ImageHeader, headerCrc));
+
+        file.seekp(0);
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.flush();
+        if (!file)
+        {
+            auto error = errno;
+            throw std::system_error(error, std::generic_category(),
+                                    "Failed to write compiled image");
+        }
+    }
+
+    /** @brief Get the size of the image written */
+    uint64_t imageSize() const
+    {
+        return sizeof(ImageHeader) + payloadSize;
+    }
+
+    /** @brief Get the scan data bytes stored as fills or runs */
+    uint64_t patternBytes() const
+    {
+        return encodedBytes;
+    }
+
+  private:
+    template <typename T>
+    void put(T value)
+    {
+        putBytes(&value, sizeof(value));
+    }
+
+    void putBytes(const void* data, size_t size)
+    {
+        file.write(static_cast<const char*>(data),
+                   static_cast<std::streamsize>(size));
+        payloadCrc = crc32(payloadCrc, data, size);
+        payloadSize += size;
+    }
+
+    void header(Opcode opcode, uint32_t line)
+    {
+        put(static_cast<uint8_t>(opcode));
+        put(line);
+    }
+
+    void writeOp(const ScanOp& op, uint32_t line)
+    {
+        header(Opcode::Scan, line);
+        put(static_cast<uint8_t>(op.type));
+        put(static_cast<uint8_t>(op.endState));
+        put(static_cast<uint8_t>(!op.tdo.empty()));
+        put(static_cast<uint32_t>(op.bits()));
+        if (op.fill)
+        {
+            put(Encoding::Fill);
+            put(static_cast<uint8_t>(*op.fill));
+            encodedBytes += (op.fillBits + 7) / 8;
+        }
+        else
+        {
+            putBits(op.tdi);
+        }
+        if (!op.tdo.empty())
+        {
+            putBits(op.tdo);
+            putBits(op.mask);
+        }
+    }
+
+    /** @brief Write scan data in the smallest encoding */
+    void putBits(const BitVector& bits)
+    {
+        auto size = bits.byteSize();
+        if (size > 2)
+        {
+            if (auto level = uniformLevel(bits.data(), bits.size()))
+            {
+                put(Encoding::Fill);
+                put(static_cast<uint8_t>(*level));
+                encodedBytes += size;
+                return;
+            }
+
+            auto runs = countRuns(bits.data(), size);
+            if (sizeof(uint32_t) + runs * 5 < size)
+            {
+                put(Encoding::Runs);
+                put(static_cast<uint32_t>(runs));
+                for (size_t i = 0; i < size;)
+                {
+                    auto start = i;
+                    auto value = bits.data()[i];
+                    while (i < size && bits.data()[i] == value)
+                    {
+                        ++i;
+                    }
+                    put(static_cast<uint32_t>(i - start));
+                    put(value);
+                }
+                encodedBytes += size;
+                return;
+            }
+        }
+
+        put(Encoding::Raw);
+        putBytes(bits.data(), size);
+    }
+
+    void writeOp(const RunTestOp& op, uint32_t line)
+    {
+        header(Opcode::RunTest, line);
+        put(static_cast<uint8_t>(op.runState));
+        put(static_cast<uint8_t>(op.endState));
+        put(op.tck);
+        put(toNanoseconds(op.minTime));
+        put(toNanoseconds(op.maxTime));
+    }
+
+    void writeOp(const StateOp& op, uint32_t line)
+    {
+        header(Opcode::State, line);
+        put(static_cast<uint16_t>(op.path.size()));
+        for (auto state : op.path)
+        {
+            put(static_cast<uint8_t>(state));
+        }
+    }
+
+    void writeOp(const FrequencyOp& op, uint32_t line)
+    {
+        header(Opcode::Frequency, line);
+        put(static_cast<uint32_t>(op.hz));
+    }
+
+    void writeOp(const TrstOp& op, uint32_t line)
+    {
+        header(Opcode::Trst, line);
+        put(static_cast<uint8_t>(op.asserted));
+    }
+
+    std::ofstream file;
+    uint32_t payloadCrc = 0;
+    uint64_t payloadSize = 0;
+    uint64_t opCount = 0;
+    uint64_t encodedBytes = 0;
+};
+
+TapState toTapState(uint8_t value)
+{
+    if (value >= tapStateCount)
+    {
+        throw CompiledImageError("invalid TAP state in compiled image");
+    }
+    return static_cast<TapState>(value);
+}
+
+} // namespace
+
+void compileSvf(const std::string& svfPath, const std::string& compiledPath)
+{
+    compileChain({svfPath}, {}, compiledPath);
+}
+
+CompileStats compileChain(const std::vector<std::string>& svfPaths,
+                          const std::vector<size_t>& irLengths,
+                          const std::string& compiledPath)
+{
+    // The image records the concatenation of the sources, so a single SVF
+    // gets the same identity as it always had.
+    uint64_t sourceSize = 0;
+    uint32_t sourceCrc = 0;
+    for (const auto& svfPath : svfPaths)
+    {
+        MappedFile svf(svfPath);
+        auto text = svf.view();
+        sourceSize += text.size();
+        sourceCrc = crc32(sourceCrc, text.data(), text.size());
+    }
+
+    CompileStats stats;
+    auto tmpPath = compiledPath + ".tmp";
+    try
+    {
+        ImageWriter writer(tmpPath);
+        auto write = [&writer](OpSource& source) {
+            TapOptimizer optimizer(source);
+            SvfOp op;
+            while (optimizer.next(op))
+            {
+                writer.write(op, optimizer.line());
+            }
+            return optimizer.stats();
+        };
+
+        if (svfPaths.size() == 1)
+        {
+            auto source = openOpFile(svfPaths.front());
+            stats.tap = write(*source);
+        }
+        else
+        {
+            ChainFiles source(svfPaths, irLengths);
+            stats.tap = write(source);
+            stats.chain = source.stats();
+        }
+        writer.finish(sourceSize, sourceCrc);
+        stats.imageSize = writer.imageSize();
+        stats.patternBytes = writer.patternBytes();
+    }
+    catch (...)
+    {
+        std::error_code ec;
+        std::filesystem::remove(tmpPath, ec);
+        throw;
+    }
+
+    std::filesystem::rename(tmpPath, compiledPath);
+    return stats;
+}
+
+bool isCompiledImageCurrent(const std::string& compiledPath,
+                            const std::string& svfPath)
+{
+    return isCompiledImageCurrent(
+        compiledPath,
+        svfPath.empty() ? std::vector<std::string>{}
+                        : std::vector<std::string>{svfPath});
+}
+
+bool isCompiledImageCurrent(const std::string& compiledPath,
+                            const std::vector<std::string>& svfPaths)
+{
+    try
+    {
+        CompiledImageReader reader(compiledPath);
+        return svfPaths.empty() || reader.builtFrom(svfPaths);
+    }
+    catch (const std::exception&)
+    {
+        return false;
+    }
+}
+
+CompiledImageReader::CompiledImageReader(const std::string& path,
+                                         std::pmr::memory_resource* resource) :
+    file(path), recycler(resource), data(file.view())
+{
+    ImageHeader header{};
+    if (data.size() < sizeof(header))
+    {
+        throw CompiledImageError("compiled image is truncated");
+    }
+    std::memcpy(&header, data.data(), sizeof(header));
+
+    if (header.magic != imageMagic ||
+        header.headerCrc != crc32(0, &header, offsetof(ImageHeader, headerCrc)))
+    {
+        throw CompiledImageError("not a compiled image");
+    }
+    if (header.version != compiledImageVersion ||
+        header.headerSize != sizeof(header))
+    {
+        throw CompiledImageError("compiled image format version " +
+                                 std::to_string(header.version) +
+                                 " is not supported");
+    }
+    if (header.payloadSize != data.size() - sizeof(header) ||
+        header.payloadCrc !=
+            crc32(0, data.data() + sizeof(header), header.payloadSize))
+    {
+        throw CompiledImageError("compiled image checksum mismatch");
+    }
+
+    payloadStart = sizeof(header);
+    payloadEnd = data.size();
+    pos = payloadStart;
+    sourceSize = header.sourceSize;
+    sourceCrc = header.sourceCrc;
+}
+
+bool CompiledImageReader::builtFrom(const std::string& svfPath) const
+{
+    return builtFrom(std::vector<std::string>{svfPath});
+}
+
+bool CompiledImageReader::builtFrom(
+    const std::vector<std::string>& svfPaths) const
+{
+    uint64_t size = 0;
+    for (const auto& svfPath : svfPaths)
+    {
+        std::error_code ec;
+        size += std::filesystem::file_size(svfPath, ec);
+        if (ec)
+        {
+            return false;
+        }
+    }
+    if (size != sourceSize)
+    {
+        return false;
+    }
+
+    uint32_t crc = 0;
+    for (const auto& svfPath : svfPaths)
+    {
+        MappedFile svf(svfPath);
+        auto text = svf.view();
+        crc = crc32(crc, text.data(), text.size());
+    }
+    return crc == sourceCrc;
+}
+
+template <typename T>
+T CompiledImageReader::read()
+{
+    if (payloadEnd - pos < sizeof(T))
+    {
+        throw CompiledImageError("compiled image is truncated");
+    }
+    T value;
+    std::memcpy(&value, data.data() + pos, sizeof(T));
+    pos += sizeof(T);
+    return value;
+}
+
+std::optional<bool> CompiledImageReader::readBits(BitVector& bits,
+                                                  size_t length, bool lazy)
+{
+    auto bytes = (length + 7) / 8;
+    switch (read<Encoding>())
+    {
+        case Encoding::Raw:
+            if (payloadEnd - pos < bytes)
+            {
+                throw CompiledImageError("compiled image is truncated");
+            }
+            bits.load(reinterpret_cast<const uint8_t*>(data.data() + pos),
+                      length);
+            pos += bytes;
+            return std::nullopt;
+        case Encoding::Fill:
+        {
+            bool level = read<uint8_t>() != 0;
+            if (lazy)
+            {
+                bits.clear();
+                return level;
+            }
+            bits.resize(length, level);
+            return std::nullopt;
+        }
+        case Encoding::Runs:
+        {
+            bits.resize(length);
+            auto runs = read<uint32_t>();
+            size_t filled = 0;
+            for (uint32_t i = 0; i < runs; ++i)
+            {
+                auto count = read<uint32_t>();
+                auto value = read<uint8_t>();
+                if (count > bytes - filled)
+                {
+                    throw CompiledImageError("scan data runs overflow");
+                }
+                std::memset(bits.data() + filled, value, count);
+                filled += count;
+            }
+            if (filled != bytes)
+            {
+                throw CompiledImageError("scan data runs are short");
+            }
+            if (length % 8 != 0)
+            {
+                bits.data()[bytes - 1] &= (1u << (length % 8)) - 1;
+            }
+            return std::nullopt;
+        }
+    }
+
+    throw CompiledImageError("unknown scan data encoding in compiled image");
+}
+
+bool CompiledImageReader::next(SvfOp& op)
+{
+    if (pos >= payloadEnd)
+    {
+        return false;
+    }
+
+    auto opcode = static_cast<Opcode>(read<uint8_t>());
+    currentLine = read<uint32_t>();
+
+    switch (opcode)
+    {
+        case Opcode::Scan:
+        {
+            auto& scan = recycler.scan(op);
+            scan.type = static_cast<ScanType>(read<uint8_t>());
+            scan.endState = toTapState(read<uint8_t>());
+            auto hasTdo = read<uint8_t>() != 0;
+            auto length = read<uint32_t>();
+            scan.fill = readBits(scan.tdi, length, length >= fillScanBits);
+            scan.fillBits = scan.fill ? length : 0;
+            if (hasTdo)
+            {
+                readBits(scan.tdo, length);
+                readBits(scan.mask, length);
+            }
+            else
+            {
+                scan.tdo.clear();
+                scan.mask.clear();
+            }
+            return true;
+        }
+        case Opcode::RunTest:
+        {
+            RunTestOp runTest;
+            runTest.runState = toTapState(read<uint8_t>());
+            runTest.endState = toTapState(read<uint8_t>());
+            runTest.tck = read<uint32_t>();
+            runTest.minTime = read<uint64_t>() / 1e9;
+            runTest.maxTime = read<uint64_t>() / 1e9;
+            recycler.assign(op, runTest);
+            return true;
+        }
+        case Opcode::State:
+        {
+            auto* state = std::get_if<StateOp>(&op);
+            if (!state)
+            {
+                recycler.assign(op, StateOp{});
+                state = &std::get<StateOp>(op);
+            }
+            state->path.clear();
+            auto count = read<uint16_t>();
+            for (uint16_t i = 0; i < count; ++i)
+            {
+                state->path.push_back(toTapState(read<uint8_t>()));
+            }
+            return true;
+        }
+        case Opcode::Frequency:
+            recycler.assign(
+                op, FrequencyOp{static_cast<double>(read<uint32_t>())});
+            return true;
+        case Opcode::Trst:
+            recycler.assign(op, TrstOp{read<uint8_t>() != 0});
+            return true;
+    }
+
+    throw CompiledImageError("unknown opcode in compiled image");
+}
+
+} // namespace updater
+} // namespace software
+} // namespace wistron
@@ -0,0 +1,212 @@
+#pragma once
+
+#include "chain_merger.hpp"
+#include "mapped_file.hpp"
+#include "ops.hpp"
+#include "tap_optimizer.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace wistron
+{
+namespace software
+{
+namespace updater
+{
+
+/** @brief The version of the compiled image format.
+ *  @details Bump it whenever the encoding changes; images of another version
+ *  are treated as stale and rebuilt.
+ */
+constexpr uint32_t compiledImageVersion = 2;
+
+/** @class CompiledImageError
+ *  @brief A compiled image that is corrupt, truncated or of another format
+ *         version.
+ */
+class CompiledImageError : public std::runtime_error
+{
+  public:
+    using std::runtime_error::runtime_error;
+};
+
+/** @brief Compile an SVF file into a binary op stream.
+ *  @details The stream holds the parser's output: packed scan buffers,
+ *  resolved STATE paths and RUNTEST times in nanoseconds, so replaying it
+ *  involves no text parsing. It is written to a temporary file that is then
+ *  renamed, so readers never see a partial image.
+ *
+ *  @param[in] svfPath      - The SVF source
+ *  @param[in] compiledPath - Where to store the compiled image
+ *
+ *  @error  SvfError on malformed SVF, std::system_error on I/O failures
+ */
+void compileSvf(const std::string& svfPath, const std::string& compiledPath);
+
+/** @struct CompileStats
+ *  @brief What compiling an image took out of its SVF.
+ */
+struct CompileStats
+{
+    /** @brief How well the devices' streams merged; zero for one device */
+    ChainMergeStats chain;
+
+    /** @brief The TAP transitions dropped as redundant */
+    TapOptimizerStats tap;
+
+    /** @brief The size of the compiled image in bytes */
+    uint64_t imageSize = 0;
+
+    /** @brief Scan data bytes stored as fills or runs rather than
+     *         verbatim */
+    uint64_t patternBytes = 0;
+};
+
+/** @brief Compile the SVF files of the devices of a daisy chain into one
+ *         merged op stream.
+ *  @details The files are merged with ChainMerger, so the image programs
+ *  all devices in a single pass. A single file compiles as compileSvf()
+ *  does. Either way the stream passes the TapOptimizer, so the image holds
+ *  no redundant TAP transitions.
+ *
+ *  @param[in] svfPaths     - One SVF per device, the device nearest TDO
+ *                            first
+ *  @param[in] irLengths    - The instruction length per device; missing or
+ *                            0 entries are taken from the SVF's first SIR
+ *  @param[in] compiledPath - Where to store the compiled image
+ *
+ *  @return How well the devices' streams merged and what the optimizer
+ *          dropped
+ *  @error  SvfError on malformed SVF or SVFs that can not be merged,
+ *          std::system_error on I/O failures
+ */
+CompileStats compileChain(const std::vector<std::string>& svfPaths,
+                          const std::vector<size_t>& irLengths,
+                          const std::string& compiledPath);
+
+/** @brief Check whether a compiled image can be used.
+ *
+ *  @param[in] compiledPath - The compiled image
+ *  @param[in] svfPath      - The SVF it must have been built from; empty to
+ *                            only check the image itself
+ *
+ *  @return true if the image is intact, of the current format version and
+ *          built from svfPath
+ */
+bool isCompiledImageCurrent(const std::string& compiledPath,
+                            const std::string& svfPath);
+
+/** @brief Check whether a compiled image of a chain can be used.
+ *
+ *  @param[in] compiledPath - The compiled image
+ *  @param[in] svfPaths     - The SVFs it must have been built from, in
+ *                            chain order; empty to only check the image
+ *
+ *  @return true if the image is intact, of the current format version and
+ *          built from svfPaths
+ */
+bool isCompiledImageCurrent(const std::string& compiledPath,
+                            const std::vector<std::string>& svfPaths);
+
+/** @class CompiledImageReader
+ *  @brief Replays a compiled image as an operation stream.
+ */
+class CompiledImageReader : public OpSource
+{
+  public:
+    /** @brief Maps and validates a compiled image.
+     *
+     *  @param[in] path     - The compiled image
+     *  @param[in] resource - The memory resource scan data is allocated
+     *                        from
+     *
+     *  @error  CompiledImageError if the image is corrupt or stale,
+     *          std::system_error if it can not be mapped
+     */
+    explicit CompiledImageReader(
+        const std::string& path,
+        std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+
+    bool next(SvfOp& op) override;
+
+    size_t offset() const override
+    {
+        return pos - payloadStart;
+    }
+
+    size_t size() const override
+    {
+        return payloadEnd - payloadStart;
+    }
+
+    size_t line() const override
+    {
+        return currentLine;
+    }
+
+    /** @brief Check whether the image was compiled from an SVF file.
+     *
+     *  @param[in] svfPath - The SVF source
+     *
+     *  @return true if size and checksum of svfPath match the image's
+     */
+    bool builtFrom(const std::string& svfPath) const;
+
+    /** @brief Check whether the image was compiled from the SVF files of a
+     *         chain.
+     *
+     *  @param[in] svfPaths - The SVF sources, in chain order
+     *
+     *  @return true if their total size and checksum match the image's
+     */
+    bool builtFrom(const std::vector<std::string>& svfPaths) const;
+
+  private:
+    /** @brief Read a value, throwing on truncation */
+    template <typename T>
+    T read();
+
+    /** @brief Read scan data into a vector.
+     *
+     *  @param[out] bits   - The vector
+     *  @param[in]  length - The length in bits
+     *  @param[in]  lazy   - Whether a fill is returned rather than
+     *                       expanded
+     *
+     *  @return The level of a fill left in the image; bits is empty then
+     */
+    std::optional<bool> readBits(BitVector& bits, size_t length,
+                                 bool lazy = false);
+
+    /** @brief The mapped image */
+    MappedFile file;
+
+    /** @brief Reuses the scan buffers of the operations handed out */
+    ScanRecycler recycler;
+
+    /** @brief The image contents */
+    std::string_view data;
+
+    /** @brief The payload bounds within data */
+    size_t payloadStart = 0;
+    size_t payloadEnd = 0;
+
+    /** @brief The read position within data */
+    size_t pos = 0;
+
+    /** @brief Size and checksum of the SVF source */
+    uint64_t sourceSize = 0;
+    uint32_t sourceCrc = 0;
+
+    /** @brief The source line of the last operation */
+    size_t currentLine = 0;
+};
+
+} // namespace updater
+} // namespace software
+} // namespace wistron
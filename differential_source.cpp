@@ -0,0 +1,430 @@
+#include "differential_source.hpp"
+
+#include "lattice_isc.hpp"
+
+#include <algorithm>
+#include <chrono>
+
+namespace wistron
+{
+namespace software
+{
+namespace updater
+{
+
+namespace
+{
+
+/** @brief Get the opcode an instruction scan loads */
+std::optional<uint8_t> opcodeOf(const ScanOp& scan)
+{
+    if (scan.type != ScanType::IR || scan.tdi.size() != lattice::irBits)
+    {
+        return std::nullopt;
+    }
+    return scan.tdi.data()[0];
+}
+
+BitVector opcodeBits(uint8_t opcode)
+{
+    BitVector bits(lattice::irBits);
+    bits.data()[0] = opcode;
+    return bits;
+}
+
+ScanOp instructionScan(uint8_t opcode)
+{
+    ScanOp scan;
+    scan.type = ScanType::IR;
+    scan.tdi = opcodeBits(opcode);
+    return scan;
+}
+
+} // namespace
+
+RowPlan RowPlan::build(OpSource& source)
+{
+    RowPlan plan;
+    auto fail = [&plan](const char* reason) {
+        if (plan.reason.empty())
+        {
+            plan.reason = reason;
+        }
+    };
+
+    std::optional<uint8_t> ir;
+    std::vector<ScanOp> init;
+    bool lattice = false;
+    bool enabled = false;
+    bool erased = false;
+    bool verifies = false;
+    bool readDelaySeen = false;
+    bool reinitialized = false;
+
+    SvfOp op;
+    while (source.next(op))
+    {
+        if (auto runTest = std::get_if<RunTestOp>(&op))
+        {
+            if (ir == lattice::LSC_READ_INCR_NV && verifies && !readDelaySeen)
+            {
+                plan.readDelay = *runTest;
+                readDelaySeen = true;
+            }
+            continue;
+        }
+
+        auto scan = std::get_if<ScanOp>(&op);
+        if (!scan)
+        {
+            continue;
+        }
+
+        if (scan->type == ScanType::IR)
+        {
+            ir = opcodeOf(*scan);
+            if (!ir)
+            {
+                fail("the chain is not a single MachXO2/MachXO3");
+                continue;
+            }
+
+            switch (*ir)
+            {
+                case lattice::ISC_ENABLE:
+                    enabled = true;
+                    break;
+                case lattice::ISC_ERASE:
+                    if (!enabled || erased)
+                    {
+                        fail("the SVF erases outside ISC mode or repeatedly");
+                    }
+                    erased = true;
+                    break;
+                case lattice::LSC_INIT_ADDRESS:
+                    init = {*scan};
+                    reinitialized = !plan.rows.empty();
+                    break;
+                case lattice::LSC_INIT_ADDR_UFM:
+                case lattice::LSC_PROG_FEATURE:
+                case lattice::LSC_PROG_FEABITS:
+                    fail("the SVF programs UFM or feature rows");
+                    break;
+                case lattice::LSC_READ_INCR_NV:
+                    if (erased && plan.rows.empty())
+                    {
+                        fail("the SVF checks the erase by reading rows");
+                    }
+                    verifies = !plan.rows.empty();
+                    break;
+                default:
+                    break;
+            }
+            continue;
+        }
+
+        if (!ir)
+        {
+            continue;
+        }
+
+        switch (*ir)
+        {
+            case lattice::IDCODE_PUB:
+                if (scan->tdo.size() == 32)
+                {
+                    uint32_t idcode = 0;
+                    for (size_t i = 0; i < 32; ++i)
+                    {
+                        idcode |= static_cast<uint32_t>(scan->tdo.test(i))
+                                  << i;
+                    }
+                    lattice = (idcode & 0xfff) == lattice::manufacturerId;
+                }
+                break;
+            case lattice::LSC_INIT_ADDRESS:
+                if (init.size() == 1)
+                {
+                    init.push_back(*scan);
+                }
+                break;
+            case lattice::LSC_PROG_INCR_NV:
+                if (!erased || reinitialized)
+                {
+                    fail("the SVF programs rows before the erase or in "
+                         "several runs");
+                }
+                if (plan.rows.empty())
+                {
+                    plan.initAddress = init;
+                }
+                else if (scan->tdi.size() != plan.rows.front().size())
+                {
+                    fail("the configuration rows differ in length");
+                }
+                plan.rows.push_back(scan->tdi);
+                break;
+            case lattice::ISC_PROGRAM_USERCODE:
+                plan.usercode = scan->tdi;
+                break;
+            default:
+                break;
+        }
+    }
+
+    if (!lattice)
+    {
+        fail("the SVF does not check for a Lattice IDCODE");
+    }
+    if (plan.rows.empty() || plan.initAddress.empty())
+    {
+        fail("the SVF programs no addressed configuration rows");
+    }
+    if (!verifies)
+    {
+        fail("the SVF does not verify the rows");
+    }
+    return plan;
+}
+
+uint64_t RowPlan::digest() const
+{
+    // FNV-1a over the row lengths and bytes.
+    uint64_t hash = 0xcbf29ce484222325;
+    auto mix = [&hash](uint64_t byte) {
+        hash ^= byte;
+        hash *= 0x100000001b3;
+    };
+    for (const auto& row : rows)
+    {
+        mix(row.size());
+        for (size_t i = 0; i < row.byteSize(); ++i)
+        {
+            mix(row.data()[i]);
+        }
+    }
+    return hash;
+}
+
+DifferentialSource::DifferentialSource(OpSource& source, RowPlan plan,
+                                       JtagInterface& jtag,
+                                       std::optional<size_t> resumed) :
+    source(source), plan(std::move(plan)), jtag(jtag), resumed(resumed)
+{
+    if (!this->plan.reason.empty())
+    {
+        mode = Mode::Full;
+        diffStats.fallback = this->plan.reason;
+        diffStats.rowsWritten = this->plan.rows.size();
+    }
+}
+
+bool DifferentialSource::next(SvfOp& op)
+{
+    while (true)
+    {
+        if (!pending.empty())
+        {
+            op = std::move(pending.front());
+            pending.pop_front();
+            return true;
+        }
+
+        if (!source.next(op))
+        {
+            return false;
+        }
+        if (mode == Mode::Full)
+        {
+            return true;
+        }
+        if (!keep(op))
+        {
+            continue;
+        }
+        if (pending.empty())
+        {
+            return true;
+        }
+        // Address moves go ahead of the row they are for.
+        pending.push_back(std::move(op));
+    }
+}
+
+bool DifferentialSource::keep(const SvfOp& op)
+{
+    auto scan = std::get_if<ScanOp>(&op);
+    if (!scan)
+    {
+        return !std::holds_alternative<RunTestOp>(op) || !skipping;
+    }
+
+    skipping = false;
+    if (scan->type == ScanType::IR)
+    {
+        ir = opcodeOf(*scan);
+        if (ir == lattice::ISC_ERASE)
+        {
+            if (mode == Mode::Undecided)
+            {
+                readBack();
+            }
+            skipping = mode == Mode::Differential;
+            return !skipping;
+        }
+        if (ir == lattice::LSC_INIT_ADDRESS)
+        {
+            row = 0;
+            addressStale = false;
+        }
+        return true;
+    }
+
+    if (mode != Mode::Differential)
+    {
+        return true;
+    }
+
+    switch (ir.value_or(0))
+    {
+        case lattice::ISC_PROGRAM_USERCODE:
+            if (resumed)
+            {
+                return true;
+            }
+            // readBack() found the USERCODE unchanged.
+            skipping = true;
+            return false;
+        case lattice::ISC_ERASE:
+            skipping = true;
+            return false;
+        case lattice::LSC_PROG_INCR_NV:
+        {
+            auto current = row++;
+            if (current < changed.size() && !changed[current])
+            {
+                ++diffStats.rowsSkipped;
+                addressStale = true;
+                skipping = true;
+                return false;
+            }
+
+            ++diffStats.rowsWritten;
+            if (addressStale)
+            {
+                seek(current);
+                addressStale = false;
+            }
+            return true;
+        }
+        default:
+            return true;
+    }
+}
+
+void DifferentialSource::readBack()
+{
+    // Until the rows are known to allow it, program in full.
+    mode = Mode::Full;
+    diffStats.rowsWritten = plan.rows.size();
+
+    BitVector captured;
+    if (plan.usercode && !resumed)
+    {
+        jtag.shift(ScanType::IR, opcodeBits(lattice::USERCODE), nullptr,
+                   TapState::Idle);
+        jtag.shift(ScanType::DR, BitVector(plan.usercode->size()), &captured,
+                   TapState::Idle);
+        if (captured != *plan.usercode)
+        {
+            diffStats.fallback = "the USERCODE changes";
+            return;
+        }
+    }
+
+    for (const auto& scan : plan.initAddress)
+    {
+        jtag.shift(scan.type, scan.tdi, nullptr, TapState::Idle);
+    }
+    jtag.shift(ScanType::IR, opcodeBits(lattice::LSC_READ_INCR_NV), nullptr,
+               TapState::Idle);
+
+    auto rowBits = plan.rows.front().size();
+    BitVector zeros(rowBits);
+    BitVector ones(rowBits);
+    ones.fill(true);
+
+    changed.assign(plan.rows.size(), false);
+    for (size_t i = 0; i < plan.rows.size(); ++i)
+    {
+        jtag.idle(plan.readDelay.tck);
+        if (plan.readDelay.minTime > 0)
+        {
+            jtag.flush();
+            wait.until(PreciseWait::Clock::now() +
+                           std::chrono::duration_cast<
+                               PreciseWait::Clock::duration>(
+                               std::chrono::duration<double>(
+                                   plan.readDelay.minTime)),
+                       jtag, 0);
+        }
+        jtag.shift(ScanType::DR, zeros, &captured, TapState::Idle);
+
+        const auto& wanted = plan.rows[i];
+        if (!firstMismatch(captured, wanted, ones))
+        {
+            continue;
+        }
+        if (resumed && i < *resumed)
+        {
+            diffStats.fallback = "row " + std::to_string(i) +
+                                 " lost what the interrupted run programmed";
+            return;
+        }
+        // Past the checkpoint the run left rows erased or programmed; any
+        // other contents mean the erase it relied on did not happen.
+        if (resumed && captured != zeros)
+        {
+            diffStats.fallback = "row " + std::to_string(i) + " is not erased";
+            return;
+        }
+
+        // Erased flash reads 0 and programming only sets bits, so a row
+        // clearing a bit that is set now needs the erase.
+        if (firstMismatch(wanted, ones, captured))
+        {
+            diffStats.fallback =
+                "row " + std::to_string(i) + " clears programmed bits";
+            return;
+        }
+        changed[i] = true;
+    }
+
+    mode = Mode::Differential;
+    diffStats.rowsWritten = 0;
+    if (resumed)
+    {
+        diffStats.rowsResumed = std::min(*resumed, plan.rows.size());
+    }
+}
+
+void DifferentialSource::seek(size_t target)
+{
+    // Operand bits 13..0 hold the page, bit 30 clear selects the
+    // configuration sector.
+    ScanOp address;
+    address.type = ScanType::DR;
+    address.tdi = BitVector(32);
+    for (size_t i = 0; i < 14; ++i)
+    {
+        address.tdi.set(i, (target >> i) & 1);
+    }
+
+    pending.push_back(instructionScan(lattice::LSC_WRITE_ADDRESS));
+    pending.push_back(std::move(address));
+    pending.push_back(instructionScan(lattice::LSC_PROG_INCR_NV));
+}
+
+} // namespace updater
+} // namespace software
+} // namespace wistron
@@ -0,0 +1,190 @@
+#pragma once
+
+#include "jtag.hpp"
+#include "ops.hpp"
+#include "precise_wait.hpp"
+
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace wistron
+{
+namespace software
+{
+namespace updater
+{
+
+/** @struct RowPlan
+ *  @brief What an SVF programs into the configuration flash of a Lattice
+ *         MachXO2/MachXO3, found in a first pass over its operations.
+ */
+struct RowPlan
+{
+    /** @brief Scan a stream for the rows it programs.
+     *
+     *  @param[in] source - The operations, read to the end
+     *
+     *  @return The plan; reason is set if the stream does not allow a
+     *          differential update
+     */
+    static RowPlan build(OpSource& source);
+
+    /** @brief Why the stream has to be played in full; empty if it does
+     *         not */
+    std::string reason;
+
+    /** @brief The scans selecting the first configuration row */
+    std::vector<ScanOp> initAddress;
+
+    /** @brief The configuration rows, in programming order */
+    std::vector<BitVector> rows;
+
+    /** @brief The delay the SVF puts before reading a row back */
+    RunTestOp readDelay;
+
+    /** @brief The USERCODE the SVF programs, if any */
+    std::optional<BitVector> usercode;
+
+    /** @brief Get a digest of the configuration rows, telling images
+     *         apart that program different data */
+    uint64_t digest() const;
+};
+
+/** @struct DifferentialStats
+ *  @brief The outcome of a differential update.
+ */
+struct DifferentialStats
+{
+    /** @brief Rows found unchanged and not programmed */
+    uint64_t rowsSkipped = 0;
+
+    /** @brief Rows programmed */
+    uint64_t rowsWritten = 0;
+
+    /** @brief Why the image was programmed in full; empty if it was not */
+    std::string fallback;
+
+    /** @brief The rows an interrupted run had programmed and that were
+     *         found intact; 0 if the run did not resume */
+    uint64_t rowsResumed = 0;
+};
+
+/** @class DifferentialSource
+ *  @brief Plays an SVF as a differential update: only configuration rows
+ *         that changed are programmed, without erasing the array.
+ *  @details When the stream reaches its ISC_ERASE, the device is in ISC mode
+ *  and the current rows are read back and compared with the new image. If
+ *  every changed row can be reached by programming alone, the erase and the
+ *  unchanged rows are dropped, and LSC_WRITE_ADDRESS moves the address
+ *  past skipped rows. Otherwise, and for anything but a plain MachXO2/
+ *  MachXO3 configuration update, the stream passes through unchanged and
+ *  the device is erased and programmed in full. The SVF's verify section
+ *  still reads back every row either way.
+ */
+class DifferentialSource : public OpSource
+{
+  public:
+    /** @brief Constructs DifferentialSource.
+     *  @details Given the rows an interrupted run of the same image
+     *  programmed, the run resumes: those rows have to read back as
+     *  programmed, and the USERCODE is programmed again rather than
+     *  compared, as the run may not have got to it. Rows after its last
+     *  checkpoint have to read back erased, or as the image if the run got
+     *  to them.
+     *
+     *  @param[in] source  - The operations to filter
+     *  @param[in] plan    - The plan built from the same operations
+     *  @param[in] jtag    - The backend the operations are played on, for
+     *                       reading back the current rows
+     *  @param[in] resumed - The rows an interrupted run programmed
+     */
+    DifferentialSource(OpSource& source, RowPlan plan, JtagInterface& jtag,
+                       std::optional<size_t> resumed = std::nullopt);
+
+    bool next(SvfOp& op) override;
+
+    size_t offset() const override
+    {
+        return source.offset();
+    }
+
+    size_t size() const override
+    {
+        return source.size();
+    }
+
+    size_t line() const override
+    {
+        return source.line();
+    }
+
+    /** @brief Get the outcome so far */
+    const DifferentialStats& stats() const
+    {
+        return diffStats;
+    }
+
+  private:
+    /** @brief How the stream is being filtered */
+    enum class Mode
+    {
+        Undecided,
+        Differential,
+        Full,
+    };
+
+    /** @brief Decide whether the stream passes through */
+    bool keep(const SvfOp& op);
+
+    /** @brief Read the current rows back and pick the mode */
+    void readBack();
+
+    /** @brief Queue the scans moving the row address to a row */
+    void seek(size_t target);
+
+    /** @brief The wrapped stream */
+    OpSource& source;
+
+    /** @brief The rows the stream programs */
+    RowPlan plan;
+
+    /** @brief The backend */
+    JtagInterface& jtag;
+
+    /** @brief The rows an interrupted run programmed */
+    std::optional<size_t> resumed;
+
+    /** @brief The filter mode */
+    Mode mode = Mode::Undecided;
+
+    /** @brief Per row, whether it has to be programmed */
+    std::vector<bool> changed;
+
+    /** @brief The last instruction the stream loaded */
+    std::optional<uint8_t> ir;
+
+    /** @brief The next row the stream programs */
+    size_t row = 0;
+
+    /** @brief Whether the device's row address lags behind row */
+    bool addressStale = false;
+
+    /** @brief Whether RUNTESTs are dropped along with a skipped scan */
+    bool skipping = false;
+
+    /** @brief Operations to hand out before reading on */
+    std::deque<SvfOp> pending;
+
+    /** @brief The wait primitive for the read back */
+    PreciseWait wait;
+
+    /** @brief The outcome */
+    DifferentialStats diffStats;
+};
+
+} // namespace updater
+} // namespace software
+} // namespace wistron
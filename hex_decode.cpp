@@ -0,0 +1,169 @@
+#include "hex_decode.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+namespace wistron
+{
+namespace software
+{
+namespace updater
+{
+
+namespace
+{
+
+#if defined(__x86_64__) || defined(__i386__)
+
+__attribute__((target("ssse3"))) bool decodeSsse3(const char* text,
+                                                  uint8_t* out)
+{
+    auto chars = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text));
+
+    // Bytes above 0x7f compare as negative, so they fail both ranges.
+    auto digit = _mm_and_si128(_mm_cmpgt_epi8(chars, _mm_set1_epi8('0' - 1)),
+                               _mm_cmplt_epi8(chars, _mm_set1_epi8('9' + 1)));
+    auto lower = _mm_or_si128(chars, _mm_set1_epi8(0x20));
+    auto alpha = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)),
+                               _mm_cmplt_epi8(lower, _mm_set1_epi8('f' + 1)));
+    if (_mm_movemask_epi8(_mm_or_si128(digit, alpha)) != 0xffff)
+    {
+        return false;
+    }
+
+    auto values = _mm_or_si128(
+        _mm_and_si128(digit, _mm_sub_epi8(chars, _mm_set1_epi8('0'))),
+        _mm_andnot_si128(digit, _mm_sub_epi8(lower, _mm_set1_epi8('a' - 10))));
+
+    // Each digit pair becomes high * 16 + low in a 16 bit lane.
+    auto pairs = _mm_maddubs_epi16(values, _mm_set1_epi16(0x0110));
+    auto bytes = _mm_packus_epi16(pairs, pairs);
+
+    // The first pair is the most significant byte, so reverse them.
+    auto reversed = _mm_shuffle_epi8(
+        bytes, _mm_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0, -1, -1, -1, -1, -1, -1,
+                             -1, -1));
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(out), reversed);
+    return true;
+}
+
+__attribute__((target("avx2"))) bool decodeAvx2(const char* text,
+                                                uint8_t* out)
+{
+    auto chars = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(text));
+
+    auto digit =
+        _mm256_and_si256(_mm256_cmpgt_epi8(chars, _mm256_set1_epi8('0' - 1)),
+                         _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), chars));
+    auto lower = _mm256_or_si256(chars, _mm256_set1_epi8(0x20));
+    auto alpha =
+        _mm256_and_si256(_mm256_cmpgt_epi8(lower, _mm256_set1_epi8('a' - 1)),
+                         _mm256_cmpgt_epi8(_mm256_set1_epi8('f' + 1), lower));
+    if (_mm256_movemask_epi8(_mm256_or_si256(digit, alpha)) != -1)
+    {
+        return false;
+    }
+
+    auto values = _mm256_or_si256(
+        _mm256_and_si256(digit, _mm256_sub_epi8(chars, _mm256_set1_epi8('0'))),
+        _mm256_andnot_si256(digit,
+                            _mm256_sub_epi8(lower, _mm256_set1_epi8('a' - 10))));
+
+    auto pairs = _mm256_maddubs_epi16(values, _mm256_set1_epi16(0x0110));
+
+    // Packing works per 128 bit lane; gather both lanes' 8 bytes into the
+    // low half before reversing all 16.
+    auto bytes = _mm256_permute4x64_epi64(_mm256_packus_epi16(pairs, pairs),
+                                          0x08);
+    auto reversed = _mm_shuffle_epi8(
+        _mm256_castsi256_si128(bytes),
+        _mm_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out), reversed);
+    return true;
+}
+
+#elif defined(__ARM_NEON)
+
+/** @brief Decode 16 digits; returns the validity of each lane */
+uint8x16_t decodeNeonLanes(uint8x16_t chars, uint8x16_t& values)
+{
+    auto digitValues = vsubq_u8(chars, vdupq_n_u8('0'));
+    auto alphaValues =
+        vsubq_u8(vorrq_u8(chars, vdupq_n_u8(0x20)), vdupq_n_u8('a'));
+    auto digit = vcltq_u8(digitValues, vdupq_n_u8(10));
+    auto alpha = vcltq_u8(alphaValues, vdupq_n_u8(6));
+    values =
+        vbslq_u8(digit, digitValues, vaddq_u8(alphaValues, vdupq_n_u8(10)));
+    return vorrq_u8(digit, alpha);
+}
+
+bool decodeNeon(const char* text, uint8_t* out)
+{
+    // De-interleave: val[0] holds the high digits, val[1] the low ones.
+    auto chars = vld2q_u8(reinterpret_cast<const uint8_t*>(text));
+
+    uint8x16_t high;
+    uint8x16_t low;
+    auto valid = vandq_u8(decodeNeonLanes(chars.val[0], high),
+                          decodeNeonLanes(chars.val[1], low));
+
+    // Horizontal minimum, spelled out for ARMv7 which lacks vminvq_u8.
+    auto folded = vand_u8(vget_low_u8(valid), vget_high_u8(valid));
+    folded = vpmin_u8(folded, folded);
+    folded = vpmin_u8(folded, folded);
+    folded = vpmin_u8(folded, folded);
+    if (vget_lane_u8(folded, 0) != 0xff)
+    {
+        return false;
+    }
+
+    auto bytes = vorrq_u8(vshlq_n_u8(high, 4), low);
+    auto reversed = vrev64q_u8(bytes);
+    vst1q_u8(out, vcombine_u8(vget_high_u8(reversed), vget_low_u8(reversed)));
+    return true;
+}
+
+#endif
+
+const HexKernel& selectHexKernel()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    static constexpr HexKernel avx2{"avx2", 32, decodeAvx2};
+    static constexpr HexKernel ssse3{"ssse3", 16, decodeSsse3};
+
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    {
+        return avx2;
+    }
+    if (__builtin_cpu_supports("ssse3"))
+    {
+        return ssse3;
+    }
+#elif defined(__ARM_NEON)
+    static constexpr HexKernel neon{"neon", 32, decodeNeon};
+    return neon;
+#endif
+    return scalarHexKernel();
+}
+
+} // namespace
+
+const HexKernel& scalarHexKernel()
+{
+    static constexpr HexKernel scalar{"scalar", 0, nullptr};
+    return scalar;
+}
+
+const HexKernel& bestHexKernel()
+{
+    static const HexKernel& best = selectHexKernel();
+    return best;
+}
+
+} // namespace updater
+} // namespace software
+} // namespace wistron
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace wistron
+{
+namespace software
+{
+namespace updater
+{
+
+/** @struct HexKernel
+ *  @brief A block decoder for SVF hex scan data.
+ *  @details decode() converts blockChars hex digits, most significant first,
+ *  into blockChars / 2 bytes least significant first, i.e. it reverses the
+ *  digit pairs while decoding them. It validates the whole block first and
+ *  writes nothing if any character is not a hex digit, so the caller can
+ *  fall back to the scalar path for blocks holding whitespace.
+ */
+struct HexKernel
+{
+    /** @brief Name for logs and benchmarks */
+    const char* name;
+
+    /** @brief Digits consumed per call; 0 for the scalar path */
+    size_t blockChars;
+
+    /** @brief Decode one block.
+     *
+     *  @param[in]  text - blockChars characters
+     *  @param[out] out  - blockChars / 2 bytes
+     *
+     *  @return false if the block holds a non hex character
+     */
+    bool (*decode)(const char* text, uint8_t* out);
+};
+
+/** @brief The digit-at-a-time kernel, always available */
+const HexKernel& scalarHexKernel();
+
+/** @brief The fastest kernel the running CPU supports (AVX2 or SSSE3 on
+ *         x86, NEON on ARM, scalar otherwise) */
+const HexKernel& bestHexKernel();
+
+} // namespace updater
+} // namespace software
+} // namespace wistron
@@ -0,0 +1,368 @@
+#include "i2c_config_port.hpp"
+
+#include "lattice_isc.hpp"
+
+#include <fcntl.h>
+#include <linux/i2c-dev.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <chrono>
+#include <limits>
+#include <stdexcept>
+#include <system_error>
+#include <thread>
+
+namespace wistron
+{
+namespace software
+{
+namespace updater
+{
+
+namespace
+{
+
+/** @brief Instructions whose data scan is written after the command */
+constexpr std::array<uint8_t, 5> writeInstructions = {
+    lattice::LSC_PROG_INCR_NV,     lattice::LSC_WRITE_ADDRESS,
+    lattice::ISC_PROGRAM_USERCODE, lattice::LSC_PROG_FEATURE,
+    lattice::LSC_PROG_FEABITS,
+};
+
+/** @brief Instructions whose operand is the number of pages scanned */
+constexpr std::array<uint8_t, 3> pageInstructions = {
+    lattice::LSC_PROG_INCR_NV,
+    lattice::LSC_READ_INCR_NV,
+    lattice::LSC_READ_UFM,
+};
+
+/** @brief Instructions the config port takes with two operand bytes */
+constexpr std::array<uint8_t, 2> shortInstructions = {
+    lattice::ISC_DISABLE,
+    lattice::LSC_REFRESH,
+};
+
+/** @brief The operand bytes following the opcode */
+constexpr size_t operandBytes = 3;
+
+/** @brief Delays shorter than this pass while the next command's START and
+ *         address byte are on the bus, at up to 400 kHz */
+constexpr auto busGap = std::chrono::microseconds(22);
+
+bool contains(const auto& instructions, uint8_t opcode)
+{
+    return std::ranges::find(instructions, opcode) != instructions.end();
+}
+
+} // namespace
+
+I2cDevice::I2cDevice(const std::string& path) :
+    fd(open(path.c_str(), O_RDWR | O_CLOEXEC))
+{
+    if (fd < 0)
+    {
+        auto error = errno;
+        throw std::system_error(error, std::generic_category(),
+                                "Failed to open " + path);
+    }
+
+    unsigned long functions = 0;
+    if (ioctl(fd, I2C_FUNCS, &functions) < 0)
+    {
+        auto error = errno;
+        close(fd);
+        throw std::system_error(error, std::generic_category(),
+                                "Failed to query " + path);
+    }
+    if (!(functions & I2C_FUNC_I2C))
+    {
+        close(fd);
+        throw std::runtime_error(path + " does not support I2C transfers");
+    }
+    mangling = functions & I2C_FUNC_PROTOCOL_MANGLING;
+}
+
+void I2cDevice::lock(uint16_t address)
+{
+    // A byte range lock per address, so CPLDs at other addresses on the
+    // adapter can still be programmed in parallel.
+    struct flock range{};
+    range.l_type = F_WRLCK;
+    range.l_whence = SEEK_SET;
+    range.l_start = address;
+    range.l_len = 1;
+    if (fcntl(fd, F_OFD_SETLK, &range) < 0)
+    {
+        auto error = errno;
+        throw std::system_error(error, std::generic_category(),
+                                "The config port at " +
+                                    std::to_string(address) +
+                                    " is in use by another programming run");
+    }
+}
+
+I2cDevice::~I2cDevice()
+{
+    if (fd >= 0)
+    {
+        close(fd);
+    }
+}
+
+void I2cDevice::transfer(std::span<i2c_msg> messages)
+{
+    i2c_rdwr_ioctl_data data{messages.data(),
+                             static_cast<uint32_t>(messages.size())};
+    if (ioctl(fd, I2C_RDWR, &data) < 0)
+    {
+        auto error = errno;
+        throw std::system_error(error, std::generic_category(),
+                                "Failed to transfer to the config port");
+    }
+}
+
+void I2cConfigPort::moveTo(TapState state)
+{
+    if (state == TapState::Reset)
+    {
+        // Test-Logic-Reset loads IDCODE, which is read as it is.
+        instruction = lattice::IDCODE_PUB;
+        issued = true;
+    }
+    current = state;
+}
+
+void I2cConfigPort::idle(uint32_t tck)
+{
+    if (instruction && !issued)
+    {
+        command(none, nullptr);
+    }
+
+    if (frequency == 0)
+    {
+        return;
+    }
+    auto delay = std::chrono::nanoseconds(uint64_t{tck} * 1'000'000'000 /
+                                          frequency);
+    if (delay >= busGap)
+    {
+        flush();
+        std::this_thread::sleep_for(delay);
+    }
+}
+
+void I2cConfigPort::shift(ScanType type, const BitVector& tdi, BitVector* tdo,
+                          TapState endState)
+{
+    if (type == ScanType::IR)
+    {
+        if (tdi.size() != lattice::irBits)
+        {
+            throw std::runtime_error(
+                "The I2C config port takes 8 bit instructions, not " +
+                std::to_string(tdi.size()) + " bits");
+        }
+        instruction = tdi.data()[0];
+        issued = false;
+        if (tdo)
+        {
+            // What an instruction register captures by IEEE 1149.1.
+            tdo->resize(tdi.size());
+            tdo->set(0, true);
+        }
+    }
+    else
+    {
+        if (!instruction)
+        {
+            throw std::runtime_error("Data scan without an instruction");
+        }
+        command(tdi, tdo);
+        issued = true;
+    }
+    current = endState;
+}
+
+void I2cConfigPort::command(const BitVector& data, BitVector* tdo)
+{
+    auto opcode = *instruction;
+    if (opcode == lattice::LSC_PRELOAD)
+    {
+        if (tdo)
+        {
+            tdo->resize(data.size());
+        }
+        return;
+    }
+
+    bool write = !tdo && contains(writeInstructions, opcode);
+    bool operand = !tdo && !write && !data.empty();
+    if (operand && data.size() > operandBytes * 8)
+    {
+        throw std::runtime_error(
+            "Instruction " + std::to_string(opcode) +
+            " has no config port equivalent for its " +
+            std::to_string(data.size()) + " bit scan");
+    }
+
+    size_t readBytes = tdo ? (data.size() + 7) / 8 : 0;
+    if (messages.size() + 2 > I2C_RDWR_IOCTL_MAX_MSGS)
+    {
+        flush();
+    }
+
+    auto start = buffer.size();
+    buffer.push_back(opcode);
+    if (opcode == lattice::ISC_NOOP)
+    {
+        buffer.insert(buffer.end(), operandBytes, 0xff);
+    }
+    else if (contains(pageInstructions, opcode) && !data.empty())
+    {
+        if (data.size() % lattice::pageBits != 0)
+        {
+            throw std::runtime_error(
+                "Page scan of " + std::to_string(data.size()) + " bits");
+        }
+        auto pages = data.size() / lattice::pageBits;
+        buffer.push_back(0);
+        buffer.push_back(static_cast<uint8_t>(pages >> 8));
+        buffer.push_back(static_cast<uint8_t>(pages));
+    }
+    else if (operand)
+    {
+        appendI2cBits(buffer, data);
+        buffer.resize(start + 1 + operandBytes, 0);
+    }
+    else
+    {
+        buffer.insert(buffer.end(), operandBytes, 0);
+    }
+    if (contains(shortInstructions, opcode))
+    {
+        buffer.pop_back();
+    }
+    if (write)
+    {
+        appendI2cBits(buffer, data);
+    }
+    if (buffer.size() - start > std::numeric_limits<uint16_t>::max() ||
+        readBytes > std::numeric_limits<uint16_t>::max())
+    {
+        throw std::runtime_error("Scan too long for an I2C message");
+    }
+    ++commands;
+
+    if (!tdo)
+    {
+        bool batching = bus->canStop();
+        queue(start, buffer.size() - start, batching ? I2C_M_STOP : 0);
+        if (!batching)
+        {
+            flush();
+        }
+        return;
+    }
+
+    auto readStart = buffer.size();
+    buffer.resize(readStart + readBytes);
+    queue(start, readStart - start, 0);
+    queue(readStart, readBytes, I2C_M_RD);
+    transmit();
+    readI2cBits(buffer.data() + readStart, *tdo, data.size());
+    buffer.clear();
+    messages.clear();
+    offsets.clear();
+}
+
+void I2cConfigPort::queue(size_t offset, size_t length, uint16_t flags)
+{
+    i2c_msg message{};
+    message.addr = address;
+    message.flags = flags;
+    message.len = static_cast<uint16_t>(length);
+    messages.push_back(message);
+    offsets.push_back(offset);
+}
+
+void I2cConfigPort::transmit()
+{
+    // The buffer may have moved while messages were queued.
+    for (size_t i = 0; i < messages.size(); ++i)
+    {
+        messages[i].buf = buffer.data() + offsets[i];
+    }
+    bus->transfer(messages);
+    saved += commands - 1;
+    commands = 0;
+}
+
+void I2cConfigPort::flush()
+{
+    if (messages.empty())
+    {
+        return;
+    }
+    transmit();
+    buffer.clear();
+    messages.clear();
+    offsets.clear();
+}
+
+void appendI2cBits(std::vector<uint8_t>& bytes, const BitVector& bits)
+{
+    auto first = bytes.size();
+    auto size = bits.size();
+    bytes.resize(first + (size + 7) / 8, 0);
+    for (size_t i = 0; i < size; ++i)
+    {
+        if (bits.test(size - 1 - i))
+        {
+            bytes[first + i / 8] |= 0x80 >> (i % 8);
+        }
+    }
+}
+
+void readI2cBits(const uint8_t* bytes, BitVector& bits, size_t size)
+{
+    bits.resize(size);
+    for (size_t i = 0; i < size; ++i)
+    {
+        bits.set(size - 1 - i, (bytes[i / 8] >> (7 - i % 8)) & 1);
+    }
+}
+
+bool isI2cDevice(const std::string& device)
+{
+    return device.starts_with("/dev/i2c-");
+}
+
+std::unique_ptr<I2cConfigPort> openI2cConfigPort(const std::string& device,
+                                                 uint16_t defaultAddress)
+{
+    auto path = device;
+    auto address = defaultAddress;
+    if (auto at = device.find('@'); at != std::string::npos)
+    {
+        path = device.substr(0, at);
+        size_t end = 0;
+        auto value = std::stoul(device.substr(at + 1), &end, 0);
+        if (end != device.size() - at - 1 || value > 0x7f)
+        {
+            throw std::invalid_argument("Invalid I2C address in " + device);
+        }
+        address = static_cast<uint16_t>(value);
+    }
+    auto bus = std::make_unique<I2cDevice>(path);
+    bus->lock(address);
+    return std::make_unique<I2cConfigPort>(std::move(bus), address);
+}
+
+} // namespace updater
+} // namespace software
+} // namespace wistron
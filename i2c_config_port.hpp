@@ -0,0 +1,254 @@
+#pragma once
+
+#include "jtag.hpp"
+
+#include <linux/i2c.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace wistron
+{
+namespace software
+{
+namespace updater
+{
+
+/** @class I2cBus
+ *  @brief An I2C adapter the config port is reached through.
+ *  @details I2cDevice is the kernel's adapter; a user-space stand-in that
+ *  answers the messages like a CPLD lets the config port be exercised
+ *  without hardware.
+ */
+class I2cBus
+{
+  public:
+    I2cBus() = default;
+    I2cBus(const I2cBus&) = delete;
+    I2cBus& operator=(const I2cBus&) = delete;
+    I2cBus(I2cBus&&) = delete;
+    I2cBus& operator=(I2cBus&&) = delete;
+    virtual ~I2cBus() = default;
+
+    /** @brief Exchange messages in one combined transfer.
+     *  @details Messages are joined by repeated STARTs and the last one
+     *  ends with a STOP, as with I2C_RDWR. A message flagged I2C_M_STOP
+     *  ends with a STOP as well if canStop() allows it.
+     *
+     *  @param[in,out] messages - The messages; read ones receive the data
+     *
+     *  @error  std::system_error if the transfer fails
+     */
+    virtual void transfer(std::span<i2c_msg> messages) = 0;
+
+    /** @brief Whether I2C_M_STOP may be used within a transfer */
+    virtual bool canStop() const
+    {
+        return false;
+    }
+};
+
+/** @class I2cDevice
+ *  @brief I2cBus on top of the Linux I2C character device (/dev/i2c-N).
+ */
+class I2cDevice : public I2cBus
+{
+  public:
+    /** @brief Opens the I2C adapter.
+     *
+     *  @param[in] path - The device node, e.g. /dev/i2c-4
+     *
+     *  @error  std::system_error if the device can not be opened,
+     *          std::runtime_error if it does not do plain I2C transfers
+     */
+    explicit I2cDevice(const std::string& path);
+
+    ~I2cDevice() override;
+
+    /** @brief Claim the config port at an address for as long as the
+     *         adapter is open, against other processes and other opens.
+     *
+     *  @param[in] address - The 7-bit slave address
+     *
+     *  @error  std::system_error if another open holds it
+     */
+    void lock(uint16_t address);
+
+    void transfer(std::span<i2c_msg> messages) override;
+
+    bool canStop() const override
+    {
+        return mangling;
+    }
+
+  private:
+    /** @brief The device file descriptor */
+    int fd = -1;
+
+    /** @brief Whether the adapter supports I2C_FUNC_PROTOCOL_MANGLING */
+    bool mangling = false;
+};
+
+/** @class I2cConfigPort
+ *  @brief JtagInterface on top of the I2C slave configuration port of
+ *         Lattice MachXO2/MachXO3 devices.
+ *  @details The config port takes the sysCONFIG instructions of the JTAG
+ *  port as commands: the opcode, three operand bytes and the data to write,
+ *  optionally followed by a read after a repeated START. An instruction
+ *  scan selects the opcode and the data scan through it makes the command:
+ *  - a scan whose TDO is wanted reads the register back,
+ *  - a scan of a programming instruction is the data written,
+ *  - any other scan of up to 24 bits is the operand,
+ *  page instructions get the page count as operand, and an instruction
+ *  without data scan is sent when the SVF waits after it, as vendor SVFs
+ *  do. Scan bits go over the bus most significant first, so the bytes
+ *  read as the SVF's hex digits. Boundary scan preloads are JTAG only and
+ *  dropped; other scans with no config port equivalent fail.
+ *
+ *  Commands that read nothing are queued and sent with one I2C_RDWR,
+ *  separated by STOPs, if the adapter allows I2C_M_STOP; a read sends the
+ *  queue along with it. There is no TCK: delays given in clocks are waited
+ *  out at the frequency set, and the bus speed is the adapter's. Only a
+ *  single device with 8 bit instructions is supported.
+ */
+class I2cConfigPort : public JtagInterface
+{
+  public:
+    /** @brief Constructs I2cConfigPort.
+     *
+     *  @param[in] bus     - The adapter the device is on
+     *  @param[in] address - The 7 bit address of the config port
+     */
+    I2cConfigPort(std::unique_ptr<I2cBus> bus, uint16_t address) :
+        bus(std::move(bus)), address(address)
+    {}
+
+    /** @brief Set the TCK frequency delays given in clocks assume.
+     *
+     *  @param[in] hz - The frequency in Hz
+     */
+    void setFrequency(uint32_t hz) override
+    {
+        frequency = hz;
+    }
+
+    /** @brief There is no TRST on the config port */
+    void setTrst(bool /*asserted*/) override {}
+
+    void moveTo(TapState state) override;
+    void idle(uint32_t tck) override;
+    void shift(ScanType type, const BitVector& tdi, BitVector* tdo,
+               TapState endState) override;
+    void flush() override;
+
+    TapState state() const override
+    {
+        return current;
+    }
+
+    /** @brief Get the number of ioctls batching has saved so far */
+    uint64_t ioctlsSaved() const override
+    {
+        return saved;
+    }
+
+  private:
+    /** @brief Queue the command of the loaded instruction.
+     *
+     *  @param[in]  data - The data scan; empty for none
+     *  @param[out] tdo  - Receives the register read back; null to read
+     *                     nothing
+     */
+    void command(const BitVector& data, BitVector* tdo);
+
+    /** @brief Queue a message over bytes of the buffer */
+    void queue(size_t offset, size_t length, uint16_t flags);
+
+    /** @brief Send the queued messages */
+    void transmit();
+
+    /** @brief The adapter */
+    std::unique_ptr<I2cBus> bus;
+
+    /** @brief The config port address */
+    uint16_t address;
+
+    /** @brief The TCK frequency delays are waited out at */
+    uint32_t frequency = 0;
+
+    /** @brief The tracked TAP state */
+    TapState current = TapState::Reset;
+
+    /** @brief The opcode the last instruction scan loaded */
+    std::optional<uint8_t> instruction;
+
+    /** @brief Whether a command was sent for the loaded instruction */
+    bool issued = false;
+
+    /** @brief The bytes of the queued messages */
+    std::vector<uint8_t> buffer;
+
+    /** @brief The queued messages, their buffers set when sent */
+    std::vector<i2c_msg> messages;
+
+    /** @brief The offset of each queued message's bytes in buffer */
+    std::vector<size_t> offsets;
+
+    /** @brief The number of commands queued */
+    uint64_t commands = 0;
+
+    /** @brief ioctls saved by batching */
+    uint64_t saved = 0;
+
+    /** @brief An empty data scan */
+    BitVector none;
+};
+
+/** @brief Append the bits of a scan to I2C bytes, most significant bit
+ *         first, as the config port exchanges them.
+ *
+ *  @param[in,out] bytes - The bytes to append to
+ *  @param[in]     bits  - The scan bits
+ */
+void appendI2cBits(std::vector<uint8_t>& bytes, const BitVector& bits);
+
+/** @brief Get the bits of a scan from I2C bytes, most significant bit
+ *         first.
+ *
+ *  @param[in]  bytes - (size + 7) / 8 bytes
+ *  @param[out] bits  - The scan bits
+ *  @param[in]  size  - The number of bits
+ */
+void readI2cBits(const uint8_t* bytes, BitVector& bits, size_t size);
+
+/** @brief Check whether a device node is an I2C adapter rather than a JTAG
+ *         controller.
+ *
+ *  @param[in] device - The device node, /dev/i2c-N for I2C, optionally
+ *                      followed by @ and the config port address
+ *
+ *  @return true for an I2C adapter
+ */
+bool isI2cDevice(const std::string& device);
+
+/** @brief Open the config port an I2C device node names.
+ *
+ *  @param[in] device         - /dev/i2c-N or /dev/i2c-N@address, e.g.
+ *                              /dev/i2c-4@0x40
+ *  @param[in] defaultAddress - The address if the node names none
+ *
+ *  @return The config port
+ *  @error  std::system_error if the adapter can not be opened,
+ *          std::invalid_argument for a malformed address
+ */
+std::unique_ptr<I2cConfigPort> openI2cConfigPort(const std::string& device,
+                                                 uint16_t defaultAddress);
+
+} // namespace updater
+} // namespace software
+} // namespace wistron
@@ -146,6 +146,8 @@ void ItemUpdater::createActivation(sdbusplus::message_t& m)
 
         auto activation = createActivationObject(
             path, versionId, extendedVersion, activationState, associations);
+        // Compile the .svf while the image waits for activation.
+        activation->compileImage();
         activations.emplace(versionId, std::move(activation));
 
         auto versionPtr =
@@ -155,6 +157,57 @@ void ItemUpdater::createActivation(sdbusplus::message_t& m)
     return;
 }
 
+void ItemUpdater::resumeInterrupted()
+{
+    for (const auto& versionId : interruptedVersions())
+    {
+        auto path = fs::path(SOFTWARE_OBJPATH) / versionId;
+        auto it = activations.find(versionId);
+        if (it == activations.end())
+        {
+            fs::path dir(checkpointDir(versionId));
+            auto manifestPath = dir / MANIFEST_FILE_NAME;
+            auto version = VersionClass::getCPLDVersion(manifestPath.string());
+            if (version.empty())
+            {
+                error("No version to resume in {PATH}", "PATH",
+                      manifestPath.string());
+                continue;
+            }
+
+            auto extendedVersion = Version::getValue(
+                manifestPath.string(),
+                {{"extended_version", ""}})["extended_version"];
+            AssociationList associations = {std::make_tuple(
+                ACTIVATION_FWD_ASSOCIATION, ACTIVATION_REV_ASSOCIATION,
+                CPLD_INVENTORY_PATH)};
+            it = activations
+                     .emplace(versionId,
+                              createActivationObject(
+                                  path, versionId, extendedVersion,
+                                  server::Activation::Activations::Ready,
+                                  associations))
+                     .first;
+            versions.emplace(versionId,
+                             createVersionObject(
+                                 path, versionId, version,
+                                 server::Version::VersionPurpose::CPLD, dir));
+        }
+
+        info("Resuming the interrupted activation of version {VERSIONID}",
+             "VERSIONID", versionId);
+        auto& resumed = *it->second;
+        resumed.requestedActivation(
+            server::Activation::RequestedActivations::Active);
+        if (resumed.server::Activation::activation() !=
+            server::Activation::Activations::Activating)
+        {
+            // An installed version being flashed again is Active.
+            resumed.activation(server::Activation::Activations::Activating);
+        }
+    }
+}
+
 void ItemUpdater::processCPLDSvf(const bool& isInitial)
 {
     // Check MEDIA_DIR and create if it does not exist
@@ -506,7 +559,7 @@ void ItemUpdater::deleteAll()
     }
 }
 
-bool ItemUpdater::freeSpace()
+bool ItemUpdater::freeSpace(const std::string& device)
 {
     bool isSpaceFreed = false;
     //  Versions with the highest priority in front
@@ -518,6 +571,12 @@ bool ItemUpdater::freeSpace()
     std::size_t count = 0;
     for (const auto& iter : activations)
     {
+        // CPLDs on other chains keep their versions.
+        if (iter.second->jtagDevice() != device)
+        {
+            continue;
+        }
+
         if ((iter.second.get()->activation() ==
              server::Activation::Activations::Active) ||
             (iter.second.get()->activation() ==
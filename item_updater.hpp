@@ -1,6 +1,7 @@
 #pragma once
 
 #include "activation.hpp"
+#include "chain_scheduler.hpp"
 #include "version.hpp"
 #include "xyz/openbmc_project/Collection/DeleteAll/server.hpp"
 
@@ -52,6 +53,8 @@ class ItemUpdater : public ItemUpdaterInherit
 
         // Emit deferred signal.
         emit_object_added();
+
+        resumeInterrupted();
     }
 
     ~ItemUpdater() = default;
@@ -77,6 +80,14 @@ class ItemUpdater : public ItemUpdaterInherit
      */
     void processCPLDSvf(const bool& isInitial);
 
+    /**
+     *  @brief Activate again the versions whose programming was running
+     *         when the updater went down, resuming it from its last
+     *         checkpoint. The versions gone with a reboot are recreated
+     *         from what their checkpoint dir keeps.
+     */
+    void resumeInterrupted();
+
     /** @brief Deletes version
      *
      *  @param[in] entryId - Id of the version to delete
@@ -97,9 +108,12 @@ class ItemUpdater : public ItemUpdaterInherit
      *         version(s) with the highest priority, skipping the
      *         functional PNOR version.
      *
+     *  @param[in] device - Only versions for the CPLD behind this JTAG
+     *                      device count and are deleted
+     *
      *  @return - Return if space is freed or not
      */
-    bool freeSpace();
+    bool freeSpace(const std::string& device);
 
     /** @brief Creates an active association to the
      *  newly active software .svf
@@ -144,6 +158,9 @@ class ItemUpdater : public ItemUpdaterInherit
      */
     static std::string determineId(const std::string& symlinkPath);
 
+    /** @brief Runs programming and verification, one job per JTAG chain */
+    ChainScheduler scheduler;
+
      /** @brief Callback function for Software.Version match.
      *  @details Creates an Activation D-Bus object.
      *
@@ -1,7 +1,13 @@
 #include "config.h"
 
+#include "compiled_image.hpp"
 #include "item_updater.hpp"
+#include "playback_estimate.hpp"
+#include "programmer.hpp"
+#include "serialize.hpp"
+#include "tck_calibration.hpp"
 #include "watch.hpp"
+#include "xsvf_parser.hpp"
 
 #include <CLI/CLI.hpp>
 #include <phosphor-logging/log.hpp>
@@ -9,6 +15,11 @@
 #include <sdbusplus/server/manager.hpp>
 #include <sdeventplus/event.hpp>
 
+#include <algorithm>
+#include <chrono>
+#include <exception>
+#include <filesystem>
+#include <iostream>
 #include <map>
 #include <memory>
 #include <string>
@@ -31,6 +42,150 @@ void initializeService(sdbusplus::bus_t& bus)
                   &updater, std::placeholders::_1));
     bus.request_name(BUSNAME_UPDATER);
 }
+
+int calibrateTckFrequency(const std::string& device)
+{
+    try
+    {
+        auto chain = Programmer::openChain(device);
+        auto profile = calibrateTck(
+            *chain, std::min<uint32_t>(JTAG_FREQUENCY, JTAG_FREQUENCY_CAP),
+            JTAG_FREQUENCY_CAP);
+        storeTckProfile(device, profile);
+        std::cout << device << ": " << profile.idcodes.size()
+                  << " device(s), stable up to " << profile.stableHz
+                  << " Hz, programming at "
+                  << withMargin(profile.stableHz, JTAG_FREQUENCY_MARGIN,
+                                JTAG_FREQUENCY_CAP)
+                  << " Hz\n";
+        return 0;
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "TCK calibration failed: " << e.what() << "\n";
+        return 1;
+    }
+}
+
+int compileImage(const std::vector<std::string>& svfPaths,
+                 const std::vector<size_t>& irLengths,
+                 const std::string& compiledPath)
+{
+    try
+    {
+        auto stats = compileChain(svfPaths, irLengths, compiledPath);
+        if (svfPaths.size() > 1)
+        {
+            std::cout << "Merged " << svfPaths.size() << " devices: "
+                      << stats.chain.mergedScans << " shared scans, "
+                      << stats.chain.soloScans << " single-device scans, "
+                      << stats.chain.bypassLoads << " bypass loads\n";
+        }
+        std::cout << compiledPath << ": " << stats.imageSize << " bytes, "
+                  << stats.patternBytes
+                  << " bytes of scan data stored as fill patterns\n";
+        std::cout << compiledPath << ": dropped " << stats.tap.opsDropped
+                  << " redundant TAP transitions, trimmed "
+                  << stats.tap.walksTrimmed << " walks, saved "
+                  << stats.tap.tmsSaved << " TMS clocks\n";
+        return 0;
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "Compile failed: " << e.what() << "\n";
+        return 1;
+    }
+}
+
+int estimateImage(const std::string& device, const std::string& image)
+{
+    try
+    {
+        // The frequency the daemon programs at, without touching the chain.
+        uint32_t frequency =
+            std::min<uint32_t>(JTAG_FREQUENCY, JTAG_FREQUENCY_CAP);
+        TckProfile profile;
+        if (restoreTckProfile(device, profile))
+        {
+            frequency = withMargin(profile.stableHz, JTAG_FREQUENCY_MARGIN,
+                                   JTAG_FREQUENCY_CAP);
+        }
+
+        auto extension = std::filesystem::path(image).extension();
+        std::unique_ptr<OpSource> source;
+        if (extension == ".svf" || extension == ".xsvf")
+        {
+            source = openOpFile(image);
+        }
+        else
+        {
+            source = std::make_unique<CompiledImageReader>(image);
+        }
+
+        auto estimate = estimatePlayback(*source, frequency);
+        std::cout << image << ": " << estimate.tck() << " TCK cycles at "
+                  << frequency << " Hz and "
+                  << std::chrono::duration_cast<std::chrono::milliseconds>(
+                         estimate.waitTime())
+                         .count()
+                  << " ms of waits, programming takes up to "
+                  << std::chrono::duration_cast<std::chrono::seconds>(
+                         estimate.duration())
+                         .count()
+                  << " s\n";
+        return 0;
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "Estimate failed: " << e.what() << "\n";
+        return 1;
+    }
+}
+
+int verifyImage(sd_event* loop, const std::string& device,
+                const std::string& image)
+{
+    ProgramRequest request;
+    request.device = device;
+    request.verifyOnly = true;
+    auto extension = std::filesystem::path(image).extension();
+    if (extension == ".svf" || extension == ".xsvf" || extension == ".jbc")
+    {
+        request.svfPaths = {image};
+    }
+    else
+    {
+        request.compiledPath = image;
+    }
+
+    int rc = 1;
+    try
+    {
+        Programmer verifier(
+            loop, std::move(request), nullptr,
+            [&](const std::string& failure) {
+                if (failure.empty())
+                {
+                    std::cout << device << " matches " << image << "\n";
+                    rc = 0;
+                }
+                else
+                {
+                    std::cerr << (verifier.mismatched() ? "Mismatch: "
+                                                        : "Verify failed: ")
+                              << failure << "\n";
+                    rc = verifier.mismatched() ? 2 : 1;
+                }
+                sd_event_exit(loop, 0);
+            });
+        sd_event_loop(loop);
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "Verify failed: " << e.what() << "\n";
+    }
+    return rc;
+}
 } // namespace updater
 } // namespace software
 } // namespace openpower
@@ -45,9 +200,80 @@ int main(int argc, char* argv[])
     bus.attach_event(loop.get(), SD_EVENT_PRIORITY_NORMAL);
 
     CLI::App app{"CPLD firmware manager"};
-    
+
+    bool calibrate = false;
+    std::string calibrateDevice = JTAG_DEVICE;
+    app.add_flag("--calibrate-tck", calibrate,
+                 "Find the highest stable JTAG TCK frequency, store it for "
+                 "later updates and exit");
+    app.add_option("--calibrate-device", calibrateDevice,
+                   "The JTAG device node or /dev/i2c-N[@address] "
+                   "--calibrate-tck calibrates, as a MANIFEST's JtagDevice "
+                   "names it")
+        ->needs("--calibrate-tck");
+
+    std::string verifyDevice = JTAG_DEVICE;
+    std::string verifyPath;
+    auto verify = app.add_subcommand(
+        "verify", "Compare the CPLD with an image without programming it and "
+                  "exit; 0 on a match, 2 on a mismatch");
+    verify->add_option("image", verifyPath,
+                       "The .svf, .xsvf, .jbc or compiled image")
+        ->required();
+    verify->add_option("-d,--device", verifyDevice,
+                       "The JTAG device node, /dev/i2c-N[@address] for "
+                       "the I2C config port or, with -Djtag-simulator, "
+                       "sim:[IDCODE,...] for a simulated chain");
+
+    std::string estimateDevice = JTAG_DEVICE;
+    std::string estimatePath;
+    auto estimate = app.add_subcommand(
+        "estimate", "Print how long programming an image takes at the "
+                    "calibrated TCK frequency and exit");
+    estimate
+        ->add_option("image", estimatePath,
+                     "The .svf, .xsvf or compiled image")
+        ->required();
+    estimate->add_option("-d,--device", estimateDevice,
+                         "The device node whose calibration to use");
+
+    std::vector<std::string> compileSvfs;
+    std::vector<size_t> compileIrLengths;
+    std::string compilePath = CPLD_COMPILED_FILE_NAME;
+    auto compile = app.add_subcommand(
+        "compile", "Compile SVF or XSVF files into an op stream, report "
+                   "what was merged and optimized away and exit");
+    compile
+        ->add_option("svf", compileSvfs,
+                     "One SVF or XSVF per chain device, the device nearest "
+                     "TDO first")
+        ->required();
+    compile->add_option("-o,--output", compilePath, "The compiled image");
+    compile->add_option("-i,--ir-lengths", compileIrLengths,
+                        "The instruction length per device");
+
     CLI11_PARSE(app, argc, argv);
 
+    if (calibrate)
+    {
+        return calibrateTckFrequency(calibrateDevice);
+    }
+
+    if (*compile)
+    {
+        return compileImage(compileSvfs, compileIrLengths, compilePath);
+    }
+
+    if (*estimate)
+    {
+        return estimateImage(estimateDevice, estimatePath);
+    }
+
+    if (*verify)
+    {
+        return verifyImage(loop.get(), verifyDevice, verifyPath);
+    }
+
     initializeService(bus);
 
     try
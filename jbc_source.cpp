@@ -0,0 +1,1237 @@
+#include "jbc_source.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cstdlib>
+#include <filesystem>
+#include <limits>
+#include <optional>
+#include <strings.h>
+
+namespace wistron
+{
+namespace software
+{
+namespace updater
+{
+
+namespace
+{
+
+/** @brief Format 2 header magic, "JAM" and a 1 */
+constexpr uint32_t magic = 0x4a414d01;
+
+/** @brief Format 1 (Jam 1.1) header magic */
+constexpr uint32_t jam11Magic = 0x4a414d00;
+
+/** @brief Format 2 header size and table entry sizes */
+constexpr size_t headerSize = 68;
+constexpr size_t symbolSize = 19;
+constexpr size_t actionSize = 12;
+constexpr size_t procSize = 13;
+
+/** @brief Symbol attribute bits */
+constexpr uint8_t compressed = 0x02;
+constexpr uint8_t initialized = 0x04;
+constexpr uint8_t array = 0x08;
+constexpr uint8_t integerArray = 0x10;
+
+/** @brief Procedure attribute of one that only runs on request */
+constexpr uint8_t optionalProcedure = 0x01;
+
+/** @brief The largest array accepted, in elements */
+constexpr size_t maxArraySize = 64 * 1024 * 1024;
+
+/** @brief The longest preamble or postamble accepted, in bits */
+constexpr int32_t maxAmble = 64 * 1024;
+
+/** @brief The largest PRINT history kept */
+constexpr size_t maxPrinted = 64;
+
+/** @brief The exit code reporting a verify failure */
+constexpr int32_t exitVerifyFailure = 11;
+
+/** @brief JBC instructions; the top two bits give the number of 32-bit
+ *         arguments following the opcode */
+constexpr uint8_t NOP = 0x00;
+constexpr uint8_t DUP = 0x01;
+constexpr uint8_t SWP = 0x02;
+constexpr uint8_t ADD = 0x03;
+constexpr uint8_t SUB = 0x04;
+constexpr uint8_t MULT = 0x05;
+constexpr uint8_t DIV = 0x06;
+constexpr uint8_t MOD = 0x07;
+constexpr uint8_t SHL = 0x08;
+constexpr uint8_t SHR = 0x09;
+constexpr uint8_t NOT = 0x0a;
+constexpr uint8_t AND = 0x0b;
+constexpr uint8_t OR = 0x0c;
+constexpr uint8_t XOR = 0x0d;
+constexpr uint8_t INV = 0x0e;
+constexpr uint8_t GT = 0x0f;
+constexpr uint8_t LT = 0x10;
+constexpr uint8_t RET = 0x11;
+constexpr uint8_t CMPS = 0x12;
+constexpr uint8_t PINT = 0x13;
+constexpr uint8_t PRNT = 0x14;
+constexpr uint8_t DSS = 0x15;
+constexpr uint8_t DSSC = 0x16;
+constexpr uint8_t ISS = 0x17;
+constexpr uint8_t ISSC = 0x18;
+constexpr uint8_t DPR = 0x1c;
+constexpr uint8_t DPRL = 0x1d;
+constexpr uint8_t DPO = 0x1e;
+constexpr uint8_t DPOL = 0x1f;
+constexpr uint8_t IPR = 0x20;
+constexpr uint8_t IPRL = 0x21;
+constexpr uint8_t IPO = 0x22;
+constexpr uint8_t IPOL = 0x23;
+constexpr uint8_t PCHR = 0x24;
+constexpr uint8_t EXIT = 0x25;
+constexpr uint8_t EQU = 0x26;
+constexpr uint8_t POPT = 0x27;
+constexpr uint8_t ABS = 0x2c;
+constexpr uint8_t BCH0 = 0x2d;
+constexpr uint8_t PSH0 = 0x2f;
+constexpr uint8_t PSHL = 0x40;
+constexpr uint8_t PSHV = 0x41;
+constexpr uint8_t JMP = 0x42;
+constexpr uint8_t CALL = 0x43;
+constexpr uint8_t NEXT = 0x44;
+constexpr uint8_t PSTR = 0x45;
+constexpr uint8_t SINT = 0x47;
+constexpr uint8_t ST = 0x48;
+constexpr uint8_t ISTP = 0x49;
+constexpr uint8_t DSTP = 0x4a;
+constexpr uint8_t SWPN = 0x4b;
+constexpr uint8_t DUPN = 0x4c;
+constexpr uint8_t POPV = 0x4d;
+constexpr uint8_t POPE = 0x4e;
+constexpr uint8_t POPA = 0x4f;
+constexpr uint8_t JMPZ = 0x50;
+constexpr uint8_t DS = 0x51;
+constexpr uint8_t IS = 0x52;
+constexpr uint8_t DPRA = 0x53;
+constexpr uint8_t DPOA = 0x54;
+constexpr uint8_t IPRA = 0x55;
+constexpr uint8_t IPOA = 0x56;
+constexpr uint8_t EXPT = 0x57;
+constexpr uint8_t PSHE = 0x58;
+constexpr uint8_t PSHA = 0x59;
+constexpr uint8_t DYNA = 0x5a;
+constexpr uint8_t EXPV = 0x5c;
+constexpr uint8_t COPY = 0x80;
+constexpr uint8_t DSC = 0x82;
+constexpr uint8_t ISC = 0x83;
+constexpr uint8_t WAIT = 0x84;
+constexpr uint8_t CMPA = 0xc0;
+
+/** @brief Wrap a result into the machine's 32-bit integers */
+int32_t wrap(int64_t value)
+{
+    return static_cast<int32_t>(static_cast<uint32_t>(value));
+}
+
+/** @brief Describe an exit code as Altera's players do */
+std::string describeExit(int32_t code)
+{
+    static constexpr const char* descriptions[] = {
+        "success",
+        "checking chain failure",
+        "reading IDCODE failure",
+        "reading USERCODE failure",
+        "reading UESCODE failure",
+        "entering ISP failure",
+        "unrecognized device",
+        "device revision is not supported",
+        "erase failure",
+        "device is not blank",
+        "device programming failure",
+        "device verify failure",
+        "read failure",
+        "calculating checksum failure",
+        "setting security bit failure",
+        "querying security bit failure",
+        "exit ISP failure",
+        "performing system test failure",
+    };
+
+    std::string text = "JBC exited with code " + std::to_string(code);
+    if (code >= 0 && static_cast<size_t>(code) < std::size(descriptions))
+    {
+        text += ", ";
+        text += descriptions[code];
+    }
+    return text;
+}
+
+} // namespace
+
+bool JbcError::mismatch() const
+{
+    return exitCode == exitVerifyFailure;
+}
+
+JbcSource::JbcSource(std::string_view data, const std::string& action,
+                     JtagInterface& jtag,
+                     std::pmr::memory_resource* resource) :
+    data(data), jtag(jtag), irPre(resource), irPost(resource),
+    drPre(resource), drPost(resource), recycler(resource), bits(resource),
+    tdi(resource), tdo(resource), captured(resource)
+{
+    load(action);
+}
+
+void JbcSource::load(const std::string& action)
+{
+    if (data.size() < headerSize)
+    {
+        fail("the header is truncated");
+    }
+    auto signature = wordAt(0);
+    if (signature == jam11Magic)
+    {
+        fail("format 1 (Jam 1.1) is not supported");
+    }
+    if (signature != magic)
+    {
+        fail("not a JBC file");
+    }
+
+    actionTable = wordAt(4);
+    procTable = wordAt(8);
+    stringTable = wordAt(12);
+    size_t symbolTable = wordAt(24);
+    dataSection = wordAt(28);
+    codeSection = wordAt(32);
+    size_t debugSection = wordAt(36);
+    size_t actionCount = wordAt(48);
+    procCount = wordAt(52);
+    size_t symbolCount = wordAt(64);
+
+    if (codeSection >= data.size())
+    {
+        fail("the code section lies beyond the end of the file");
+    }
+    codeEnd = debugSection > codeSection && debugSection <= data.size()
+                  ? debugSection
+                  : data.size();
+    if (symbolTable > data.size() ||
+        symbolCount > (data.size() - symbolTable) / symbolSize)
+    {
+        fail("the symbol table exceeds the file");
+    }
+
+    variables.resize(symbolCount);
+    for (size_t i = 0; i < symbolCount; ++i)
+    {
+        auto entry = symbolTable + i * symbolSize;
+        loadSymbol(variables[i], byteAt(entry), wordAt(entry + 11),
+                   wordAt(entry + 15));
+    }
+
+    std::optional<uint32_t> first;
+    for (size_t i = 0; i < actionCount && !first; ++i)
+    {
+        auto entry = actionTable + i * actionSize;
+        auto name = string(wordAt(entry));
+        if (name.size() == action.size() &&
+            strncasecmp(name.data(), action.c_str(), name.size()) == 0)
+        {
+            first = wordAt(entry + 8);
+        }
+    }
+    if (!first)
+    {
+        fail("there is no action " + action);
+    }
+
+    // The action's procedures are chained through their table entries.
+    auto index = *first;
+    for (size_t count = 0;; ++count)
+    {
+        if (index >= procCount || count > procCount)
+        {
+            fail("the procedure list of " + action + " is corrupt");
+        }
+        auto entry = procTable + index * procSize;
+        if ((byteAt(entry + 8) & 0x03) != optionalProcedure)
+        {
+            procedures.push_back(index);
+        }
+        index = wordAt(entry + 4);
+        if (index == 0)
+        {
+            break;
+        }
+    }
+
+    running = true;
+    procedure = 0;
+    if (procedures.empty())
+    {
+        done = true;
+        return;
+    }
+    jump(wordAt(procTable + procedures.front() * procSize + 9));
+}
+
+void JbcSource::loadSymbol(Variable& var, uint8_t attributes, uint32_t value,
+                           uint32_t size)
+{
+    var.isArray = attributes & array;
+    if (!var.isArray)
+    {
+        if (attributes & initialized)
+        {
+            var.value = static_cast<int32_t>(value);
+        }
+        return;
+    }
+
+    var.isInteger = attributes & integerArray;
+    if ((attributes & (integerArray | initialized | compressed)) ==
+        (initialized | compressed))
+    {
+        auto bytes = uncompress(dataSection + value, size);
+        var.size = bytes.size() * 8;
+        var.bits.load(bytes.data(), var.size);
+        return;
+    }
+
+    if (size > maxArraySize)
+    {
+        fail("array of " + std::to_string(size) + " elements is too large");
+    }
+    var.size = size;
+    auto offset = dataSection + value;
+    if (!(attributes & initialized))
+    {
+        if (var.isInteger)
+        {
+            var.integers.assign(size, 0);
+        }
+        else
+        {
+            var.bits.resize(size);
+        }
+    }
+    else if (var.isInteger)
+    {
+        var.integers.reserve(size);
+        for (size_t i = 0; i < size; ++i)
+        {
+            var.integers.push_back(static_cast<int32_t>(wordAt(offset + i * 4)));
+        }
+    }
+    else
+    {
+        // Left in the mapping until the program writes to it.
+        if (offset > data.size() || (size + 7) / 8 > data.size() - offset)
+        {
+            fail("initialized array exceeds the file");
+        }
+        var.initial = reinterpret_cast<const uint8_t*>(data.data()) + offset;
+    }
+}
+
+std::vector<uint8_t> JbcSource::uncompress(size_t offset, size_t length) const
+{
+    if (offset > data.size() || length > data.size() - offset)
+    {
+        fail("compressed array exceeds the file");
+    }
+    auto in = reinterpret_cast<const uint8_t*>(data.data()) + offset;
+
+    // Fields are packed least significant bit first.
+    size_t index = 0;
+    unsigned available = 8;
+    auto readPacked = [&](unsigned count) {
+        uint32_t result = 0;
+        unsigned shift = 0;
+        while (count > 0)
+        {
+            if (index >= length)
+            {
+                fail("compressed array is truncated");
+            }
+            uint32_t byte = in[index] >> (8 - available);
+            result |= byte << shift;
+            if (count <= available)
+            {
+                result &= (1u << (count + shift)) - 1;
+                available -= count;
+                count = 0;
+            }
+            else
+            {
+                ++index;
+                shift += available;
+                count -= available;
+                available = 8;
+            }
+        }
+        return result;
+    };
+
+    uint32_t total = 0;
+    for (unsigned i = 0; i < 4; ++i)
+    {
+        total |= readPacked(8) << (8 * i);
+    }
+    if (total > maxArraySize / 8)
+    {
+        fail("compressed array is too large");
+    }
+
+    // Literal runs of three bytes and back references of up to 255 bytes
+    // within the last 8191.
+    constexpr size_t window = 8191;
+    std::vector<uint8_t> out(total);
+    size_t i = 0;
+    while (i < total)
+    {
+        if (readPacked(1) == 0)
+        {
+            for (size_t j = 0; j < 3 && i < total; ++j)
+            {
+                out[i++] = static_cast<uint8_t>(readPacked(8));
+            }
+            continue;
+        }
+
+        auto reach = std::min(i, window);
+        auto distance = readPacked(reach == 0 ? 1 : std::bit_width(reach));
+        auto run = readPacked(8);
+        if (distance > i)
+        {
+            fail("compressed array refers before its start");
+        }
+        for (size_t j = 0; j < run && i < total; ++j, ++i)
+        {
+            out[i] = out[i - distance];
+        }
+    }
+    return out;
+}
+
+bool JbcSource::next(SvfOp& op)
+{
+    while (!done)
+    {
+        if (step(op))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool JbcSource::step(SvfOp& op)
+{
+    if (pc < codeSection || pc >= codeEnd)
+    {
+        fail("ran off the code section");
+    }
+    instruction = pc - codeSection;
+    furthest = std::max(furthest, instruction);
+
+    auto opcode = byteAt(pc++);
+    std::array<uint32_t, 3> args{};
+    for (size_t i = 0; i < static_cast<size_t>(opcode >> 6); ++i)
+    {
+        args[i] = wordAt(pc);
+        pc += 4;
+    }
+
+    auto swapWith = [this](size_t n) {
+        need(n + 1);
+        std::swap(top(), top(n));
+    };
+    auto duplicate = [this](size_t n) {
+        need(n + 1);
+        push(top(n));
+    };
+
+    switch (opcode)
+    {
+        case NOP:
+            break;
+        case DUP:
+            duplicate(0);
+            break;
+        case SWP:
+            swapWith(1);
+            break;
+        case ADD:
+        case SUB:
+        case MULT:
+        case DIV:
+        case MOD:
+        case SHL:
+        case SHR:
+        case AND:
+        case OR:
+        case XOR:
+        case GT:
+        case LT:
+        case EQU:
+        {
+            int64_t b = pop();
+            int64_t a = top();
+            if ((opcode == DIV || opcode == MOD) && b == 0)
+            {
+                fail("division by zero");
+            }
+            if ((opcode == SHL || opcode == SHR) && (b < 0 || b > 31))
+            {
+                fail("shift by " + std::to_string(b));
+            }
+            switch (opcode)
+            {
+                case ADD:
+                    a += b;
+                    break;
+                case SUB:
+                    a -= b;
+                    break;
+                case MULT:
+                    a *= b;
+                    break;
+                case DIV:
+                    a /= b;
+                    break;
+                case MOD:
+                    a %= b;
+                    break;
+                case SHL:
+                    a = static_cast<int64_t>(static_cast<uint32_t>(a) << b);
+                    break;
+                case SHR:
+                    a >>= b;
+                    break;
+                case AND:
+                    a &= b;
+                    break;
+                case OR:
+                    a |= b;
+                    break;
+                case XOR:
+                    a ^= b;
+                    break;
+                case GT:
+                    a = a > b;
+                    break;
+                case LT:
+                    a = a < b;
+                    break;
+                case EQU:
+                    a = a == b;
+                    break;
+            }
+            top() = wrap(a);
+            break;
+        }
+        case NOT:
+            need(1);
+            top() = ~top();
+            break;
+        case INV:
+            need(1);
+            top() = top() == 0;
+            break;
+        case ABS:
+            need(1);
+            top() = wrap(std::abs(static_cast<int64_t>(top())));
+            break;
+        case RET:
+            // Returning from a procedure of the action runs the next one.
+            if (depth == 0)
+            {
+                nextProcedure();
+            }
+            else
+            {
+                jump(static_cast<uint32_t>(pop()));
+            }
+            break;
+        case CMPS:
+        {
+            auto a = static_cast<uint32_t>(pop());
+            auto b = static_cast<uint32_t>(pop());
+            auto mask = static_cast<uint32_t>(pop());
+            auto count = top();
+            if (count < 1 || count > 32)
+            {
+                fail("compare of " + std::to_string(count) + " bits");
+            }
+            mask &= 0xffffffffu >> (32 - count);
+            top() = (a & mask) == (b & mask);
+            break;
+        }
+        case PINT:
+            message += std::to_string(pop());
+            break;
+        case PCHR:
+            message += static_cast<char>(pop());
+            break;
+        case PSTR:
+            message += string(args[0]);
+            break;
+        case PRNT:
+            if (output.size() == maxPrinted)
+            {
+                output.erase(output.begin());
+            }
+            output.push_back(std::move(message));
+            message.clear();
+            break;
+        case DSS:
+        case ISS:
+        {
+            auto value = pop();
+            literal(value, pop());
+            scan(op, opcode == DSS ? ScanType::DR : ScanType::IR, bits);
+            return true;
+        }
+        case DSSC:
+        case ISSC:
+        {
+            auto value = pop();
+            need(1);
+            literal(value, top());
+            capture(opcode == DSSC ? ScanType::DR : ScanType::IR, bits);
+            top() = integer(captured);
+            break;
+        }
+        case DPR:
+        case DPO:
+        case IPR:
+        case IPO:
+            amble(opcode, pop());
+            break;
+        case DPRL:
+        case DPOL:
+        case IPRL:
+        case IPOL:
+        {
+            auto count = pop();
+            auto value = pop();
+            literal(value, count);
+            amble(opcode, count).assign(0, bits);
+            break;
+        }
+        case DPRA:
+        case DPOA:
+        case IPRA:
+        case IPOA:
+        {
+            auto& var = booleanArray(args[0]);
+            auto right = pop();
+            auto range = slice(pop(), right);
+            if (range.reversed)
+            {
+                fail("reversed preamble or postamble data");
+            }
+            check(var, range);
+            read(var, range,
+                 amble(opcode, static_cast<int32_t>(range.count)), 0);
+            break;
+        }
+        case EXIT:
+        {
+            auto code = pop();
+            done = true;
+            if (code != 0)
+            {
+                throw JbcError(describeExit(code), code);
+            }
+            break;
+        }
+        case POPT:
+            pop();
+            break;
+        case BCH0:
+            // A batch of stack shuffles the compiler emits as one opcode.
+            swapWith(1);
+            swapWith(7);
+            swapWith(1);
+            swapWith(6);
+            duplicate(8);
+            swapWith(2);
+            swapWith(1);
+            duplicate(6);
+            duplicate(6);
+            break;
+        case PSH0:
+            push(0);
+            break;
+        case PSHL:
+            push(static_cast<int32_t>(args[0]));
+            break;
+        case PSHV:
+            push(variable(args[0]).value);
+            break;
+        case JMP:
+            jump(args[0]);
+            break;
+        case CALL:
+            push(static_cast<int32_t>(pc - codeSection));
+            jump(args[0]);
+            break;
+        case NEXT:
+        {
+            // FOR loop: step, end and the loop's top address on the stack.
+            need(3);
+            auto increment = top();
+            auto end = top(1);
+            auto& iterator = variable(args[0]).value;
+            if (increment < 0 ? iterator <= end : iterator >= end)
+            {
+                depth -= 3;
+            }
+            else
+            {
+                iterator = wrap(static_cast<int64_t>(iterator) + increment);
+                jump(static_cast<uint32_t>(top(2)));
+            }
+            break;
+        }
+        case SINT:
+            walk.push_back(state(args[0]));
+            break;
+        case ST:
+        {
+            auto target = state(args[0]);
+            if (!isStableState(target))
+            {
+                fail("STATE ends in a transient state");
+            }
+            StateOp stateOp;
+            stateOp.path = std::move(walk);
+            stateOp.path.push_back(target);
+            walk.clear();
+            recycler.assign(op, std::move(stateOp));
+            return true;
+        }
+        case ISTP:
+        case DSTP:
+        {
+            auto target = state(args[0]);
+            if (!isStableState(target))
+            {
+                fail("scans can only end in a stable state");
+            }
+            (opcode == ISTP ? irStop : drStop) = target;
+            break;
+        }
+        case SWPN:
+            swapWith(args[0]);
+            break;
+        case DUPN:
+            duplicate(args[0]);
+            break;
+        case POPV:
+            variable(args[0]).value = pop();
+            break;
+        case POPE:
+        {
+            auto& var = variable(args[0]);
+            auto index = static_cast<uint32_t>(pop());
+            auto value = pop();
+            if (!var.isArray || !var.isInteger || index >= var.size)
+            {
+                fail("integer array index out of range");
+            }
+            var.integers[index] = value;
+            break;
+        }
+        case POPA:
+        {
+            auto& var = booleanArray(args[0]);
+            auto left = pop();
+            auto range = slice(left, pop());
+            auto value = static_cast<uint32_t>(pop());
+            if (range.reversed || range.count > 32)
+            {
+                fail("Boolean array store of more than 32 bits");
+            }
+            check(var, range);
+            auto& target = writable(var);
+            for (size_t i = 0; i < range.count; ++i)
+            {
+                target.set(range.start + i, (value >> i) & 1);
+            }
+            break;
+        }
+        case JMPZ:
+            if (pop() == 0)
+            {
+                jump(args[0]);
+            }
+            break;
+        case DS:
+        case IS:
+        {
+            auto& var = booleanArray(args[0]);
+            auto right = pop();
+            auto range = slice(pop(), right);
+            range.count = static_cast<uint32_t>(pop());
+            check(var, range);
+            bits.resize(range.count);
+            read(var, range, bits, 0);
+            scan(op, opcode == DS ? ScanType::DR : ScanType::IR, bits);
+            return true;
+        }
+        case EXPT:
+            // Exported values are for interactive players to show.
+            need(3);
+            depth -= 3;
+            break;
+        case EXPV:
+            pop();
+            break;
+        case PSHE:
+        {
+            auto& var = variable(args[0]);
+            need(1);
+            auto index = static_cast<uint32_t>(top());
+            if (!var.isArray || !var.isInteger || index >= var.size)
+            {
+                fail("integer array index out of range");
+            }
+            top() = var.integers[index];
+            break;
+        }
+        case PSHA:
+        {
+            auto& var = booleanArray(args[0]);
+            auto left = pop();
+            need(1);
+            auto range = slice(left, top());
+            if (range.reversed || range.count > 32)
+            {
+                fail("Boolean array load of more than 32 bits");
+            }
+            check(var, range);
+            bits.resize(range.count);
+            read(var, range, bits, 0);
+            top() = integer(bits);
+            break;
+        }
+        case DYNA:
+        {
+            auto& var = variable(args[0]);
+            auto size = static_cast<uint32_t>(pop());
+            if (!var.isArray || size > maxArraySize)
+            {
+                fail("can not resize to " + std::to_string(size));
+            }
+            // Growing starts the array over, as Altera's players do.
+            if (size > var.size)
+            {
+                var.size = size;
+                if (var.isInteger)
+                {
+                    var.integers.assign(size, 0);
+                }
+                else
+                {
+                    var.initial = nullptr;
+                    var.bits.resize(size);
+                }
+            }
+            break;
+        }
+        case COPY:
+        {
+            auto& source = booleanArray(args[0]);
+            auto& target = booleanArray(args[1]);
+            auto sourceRight = pop();
+            auto from = slice(pop(), sourceRight);
+            auto targetRight = pop();
+            auto to = slice(pop(), targetRight);
+            if ((from.reversed || to.reversed) && from.count != to.count)
+            {
+                fail("reversed array copy between slices of unequal length");
+            }
+            from.count = to.count = std::min(from.count, to.count);
+            check(source, from);
+            check(target, to);
+            bits.resize(from.count);
+            read(source, from, bits, 0);
+            write(target, to, bits, 0);
+            break;
+        }
+        case DSC:
+        case ISC:
+        {
+            auto& source = booleanArray(args[0]);
+            auto& target = booleanArray(args[1]);
+            auto captureRight = pop();
+            auto into = slice(pop(), captureRight);
+            auto scanRight = pop();
+            auto from = slice(pop(), scanRight);
+            from.count = into.count = static_cast<uint32_t>(pop());
+            check(source, from);
+            check(target, into);
+            bits.resize(from.count);
+            read(source, from, bits, 0);
+            capture(opcode == DSC ? ScanType::DR : ScanType::IR, bits);
+            write(target, into, captured, 0);
+            break;
+        }
+        case WAIT:
+        {
+            RunTestOp wait;
+            wait.runState = state(args[0]);
+            wait.endState = state(args[1]);
+            auto cycles = pop();
+            auto microseconds = pop();
+            // The maximum cycles and time are not enforced.
+            pop();
+            pop();
+            if (!isStableState(wait.runState) || !isStableState(wait.endState))
+            {
+                fail("WAIT needs stable states");
+            }
+            if (cycles < 0 || microseconds < 0)
+            {
+                fail("negative WAIT");
+            }
+            if (!walk.empty())
+            {
+                fail("STATE leaves the TAP in a transient state");
+            }
+            wait.tck = static_cast<uint32_t>(cycles);
+            wait.minTime = microseconds / 1e6;
+            recycler.assign(op, wait);
+            return true;
+        }
+        case CMPA:
+        {
+            // Compare two arrays under a mask, pushing 1 if they match.
+            auto& first = booleanArray(args[0]);
+            auto& second = booleanArray(args[1]);
+            auto& mask = booleanArray(args[2]);
+            auto firstRight = pop();
+            auto a = slice(pop(), firstRight);
+            auto secondRight = pop();
+            auto b = slice(pop(), secondRight);
+            auto maskRight = pop();
+            auto m = slice(pop(), maskRight);
+            if (a.reversed || b.reversed || m.reversed)
+            {
+                fail("reversed array compare");
+            }
+            a.count = b.count = m.count = std::min({a.count, b.count, m.count});
+            check(first, a);
+            check(second, b);
+            check(mask, m);
+            bool match = true;
+            for (size_t i = 0; i < a.count && match; ++i)
+            {
+                match = !bit(mask, m.start + i) ||
+                        bit(first, a.start + i) == bit(second, b.start + i);
+            }
+            push(match);
+            break;
+        }
+        default:
+            fail("unsupported instruction " + std::to_string(opcode));
+    }
+    return false;
+}
+
+void JbcSource::nextProcedure()
+{
+    if (++procedure >= procedures.size())
+    {
+        done = true;
+        return;
+    }
+    jump(wordAt(procTable + procedures[procedure] * procSize + 9));
+}
+
+void JbcSource::jump(uint32_t target)
+{
+    if (target >= codeEnd - codeSection)
+    {
+        fail("jump beyond the code section");
+    }
+    pc = codeSection + target;
+}
+
+uint8_t JbcSource::byteAt(size_t offset) const
+{
+    if (offset >= data.size())
+    {
+        fail("the file is truncated");
+    }
+    return static_cast<uint8_t>(data[offset]);
+}
+
+uint32_t JbcSource::wordAt(size_t offset) const
+{
+    if (offset > data.size() || data.size() - offset < 4)
+    {
+        fail("the file is truncated");
+    }
+    uint32_t value = 0;
+    for (size_t i = 0; i < 4; ++i)
+    {
+        value = (value << 8) | static_cast<uint8_t>(data[offset + i]);
+    }
+    return value;
+}
+
+std::string_view JbcSource::string(uint32_t id) const
+{
+    auto start = stringTable + id;
+    auto end = start < data.size() ? data.find('\0', start)
+                                   : std::string_view::npos;
+    if (end == std::string_view::npos)
+    {
+        fail("string " + std::to_string(id) + " is out of range");
+    }
+    return data.substr(start, end - start);
+}
+
+JbcSource::Variable& JbcSource::variable(uint32_t id)
+{
+    if (id >= variables.size())
+    {
+        fail("symbol " + std::to_string(id) + " is out of range");
+    }
+    return variables[id];
+}
+
+JbcSource::Variable& JbcSource::booleanArray(uint32_t id)
+{
+    auto& var = variable(id);
+    if (!var.isArray || var.isInteger)
+    {
+        fail("symbol " + std::to_string(id) + " is not a Boolean array");
+    }
+    return var;
+}
+
+bool JbcSource::bit(const Variable& var, size_t index) const
+{
+    if (var.initial)
+    {
+        return (var.initial[index / 8] >> (index % 8)) & 1;
+    }
+    return var.bits.test(index);
+}
+
+BitVector& JbcSource::writable(Variable& var)
+{
+    if (var.initial)
+    {
+        var.bits.load(var.initial, var.size);
+        var.initial = nullptr;
+    }
+    return var.bits;
+}
+
+JbcSource::Slice JbcSource::slice(int32_t left, int32_t right)
+{
+    // A[7..0] runs from bit 0 up, A[0..7] from bit 7 down.
+    Slice range;
+    auto low = std::min(left, right);
+    range.start = low < 0 ? std::numeric_limits<size_t>::max()
+                          : static_cast<size_t>(low);
+    range.count = static_cast<size_t>(
+        std::abs(static_cast<int64_t>(left) - right) + 1);
+    range.reversed = right > left;
+    return range;
+}
+
+void JbcSource::check(const Variable& var, const Slice& range) const
+{
+    if (range.start > var.size || range.count > var.size - range.start)
+    {
+        fail("array index out of range");
+    }
+}
+
+void JbcSource::read(const Variable& var, const Slice& range, BitVector& to,
+                     size_t offset) const
+{
+    for (size_t i = 0; i < range.count; ++i)
+    {
+        auto index = range.reversed ? range.start + range.count - 1 - i
+                                    : range.start + i;
+        to.set(offset + i, bit(var, index));
+    }
+}
+
+void JbcSource::write(Variable& var, const Slice& range,
+                      const BitVector& from, size_t offset)
+{
+    auto& target = writable(var);
+    for (size_t i = 0; i < range.count; ++i)
+    {
+        auto index = range.reversed ? range.start + range.count - 1 - i
+                                    : range.start + i;
+        target.set(index, from.test(offset + i));
+    }
+}
+
+void JbcSource::literal(int32_t value, int32_t count)
+{
+    if (count < 0 || count > 32)
+    {
+        fail("literal of " + std::to_string(count) + " bits");
+    }
+    bits.resize(static_cast<size_t>(count));
+    for (int32_t i = 0; i < count; ++i)
+    {
+        bits.set(i, (static_cast<uint32_t>(value) >> i) & 1);
+    }
+}
+
+int32_t JbcSource::integer(const BitVector& from)
+{
+    uint32_t value = 0;
+    for (size_t i = 0; i < from.size() && i < 32; ++i)
+    {
+        value |= static_cast<uint32_t>(from.test(i)) << i;
+    }
+    return static_cast<int32_t>(value);
+}
+
+void JbcSource::frame(ScanType type, const BitVector& data,
+                      BitVector& tdi) const
+{
+    const auto& pre = type == ScanType::IR ? irPre : drPre;
+    const auto& post = type == ScanType::IR ? irPost : drPost;
+    tdi.resize(pre.size() + data.size() + post.size());
+    tdi.assign(0, pre);
+    tdi.assign(pre.size(), data);
+    tdi.assign(pre.size() + data.size(), post);
+}
+
+void JbcSource::scan(SvfOp& op, ScanType type, const BitVector& data)
+{
+    if (!walk.empty())
+    {
+        fail("STATE leaves the TAP in a transient state");
+    }
+    auto& scan = recycler.scan(op);
+    scan.type = type;
+    scan.endState = type == ScanType::IR ? irStop : drStop;
+    frame(type, data, scan.tdi);
+    scan.tdo.clear();
+    scan.mask.clear();
+}
+
+void JbcSource::capture(ScanType type, const BitVector& data)
+{
+    if (!walk.empty())
+    {
+        fail("STATE leaves the TAP in a transient state");
+    }
+    frame(type, data, tdi);
+    jtag.shift(type, tdi, &tdo, type == ScanType::IR ? irStop : drStop);
+    auto pre = type == ScanType::IR ? irPre.size() : drPre.size();
+    captured.resize(data.size());
+    for (size_t i = 0; i < data.size(); ++i)
+    {
+        captured.set(i, tdo.test(pre + i));
+    }
+}
+
+BitVector& JbcSource::amble(uint8_t opcode, int32_t count)
+{
+    if (count < 0 || count > maxAmble)
+    {
+        fail("preamble or postamble of " + std::to_string(count) + " bits");
+    }
+
+    BitVector* target = nullptr;
+    switch (opcode)
+    {
+        case DPR:
+        case DPRL:
+        case DPRA:
+            target = &drPre;
+            break;
+        case DPO:
+        case DPOL:
+        case DPOA:
+            target = &drPost;
+            break;
+        case IPR:
+        case IPRL:
+        case IPRA:
+            target = &irPre;
+            break;
+        default:
+            target = &irPost;
+            break;
+    }
+
+    // The other devices are put in BYPASS unless the program says
+    // otherwise.
+    target->resize(static_cast<size_t>(count), true);
+    return *target;
+}
+
+TapState JbcSource::state(uint32_t code) const
+{
+    // JBC numbers the states as TapState does.
+    if (code >= tapStateCount)
+    {
+        fail("invalid TAP state " + std::to_string(code));
+    }
+    return static_cast<TapState>(code);
+}
+
+void JbcSource::push(int32_t value)
+{
+    if (depth == stack.size())
+    {
+        fail("stack overflow");
+    }
+    stack[depth++] = value;
+}
+
+int32_t JbcSource::pop()
+{
+    need(1);
+    return stack[--depth];
+}
+
+int32_t& JbcSource::top(size_t index)
+{
+    return stack[depth - 1 - index];
+}
+
+void JbcSource::need(size_t count) const
+{
+    if (depth < count)
+    {
+        fail("stack underflow");
+    }
+}
+
+void JbcSource::fail(const std::string& message) const
+{
+    if (!running)
+    {
+        throw JbcError("Malformed JBC: " + message);
+    }
+    throw JbcError("JBC code offset " + std::to_string(instruction) + ": " +
+                   message);
+}
+
+bool isJbcPath(const std::string& path)
+{
+    return std::filesystem::path(path).extension() == ".jbc";
+}
+
+} // namespace updater
+} // namespace software
+} // namespace wistron
@@ -0,0 +1,392 @@
+#pragma once
+
+#include "bit_vector.hpp"
+#include "jtag.hpp"
+#include "mapped_file.hpp"
+#include "ops.hpp"
+#include "tap_state.hpp"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace wistron
+{
+namespace software
+{
+namespace updater
+{
+
+/** @class JbcError
+ *  @brief A JBC program that is malformed, uses an unsupported feature or
+ *         exited with an error code.
+ */
+class JbcError : public std::runtime_error
+{
+  public:
+    /** @brief Constructs JbcError.
+     *
+     *  @param[in] message  - What went wrong
+     *  @param[in] exitCode - The exit code of the program; 0 if it did not
+     *                        exit but failed to run
+     */
+    explicit JbcError(const std::string& message, int32_t exitCode = 0) :
+        std::runtime_error(message), exitCode(exitCode)
+    {}
+
+    /** @brief Whether the program found the device to hold other data than
+     *         it expects */
+    bool mismatch() const;
+
+    /** @brief The exit code of the program */
+    int32_t exitCode;
+};
+
+/** @class JbcSource
+ *  @brief Runs an Intel/Altera JAM STAPL byte-code (.jbc) program and
+ *         hands its JTAG operations to the player.
+ *  @details A JBC file is a program for a small stack machine, not a list
+ *  of scans: programming data is stored once, compressed, and the loops
+ *  that shift it row by row are part of the code. The program is run one
+ *  instruction at a time until it produces a scan, wait or state change
+ *  the player can execute, so the update shares the batched backend, the
+ *  waits and the progress reporting of SVF playback.
+ *
+ *  Scans whose captured TDO the program reads back are made on the chain
+ *  from next() directly, as the program branches on the result. The source
+ *  therefore has to stay on the player thread, with no filter between the
+ *  two that reorders or drops operations. The program verifies the device
+ *  itself and reports the outcome through its exit code.
+ *
+ *  Only format 2 (STAPL) files are supported; the requested action's
+ *  procedures are run in order, recommended ones included and optional
+ *  ones skipped. Vector signals and the Jam 1.1 REVA instruction are not
+ *  supported.
+ */
+class JbcSource : public OpSource
+{
+  public:
+    /** @brief Constructs JbcSource.
+     *
+     *  @param[in] data     - The JBC contents; must outlive the source
+     *  @param[in] action   - The action to run, e.g. PROGRAM or VERIFY
+     *  @param[in] jtag     - The backend capturing scans are made on; the
+     *                        one the player drives
+     *  @param[in] resource - The memory resource scan data is allocated
+     *                        from
+     *
+     *  @error  JbcError if the file is malformed or lacks the action
+     */
+    JbcSource(
+        std::string_view data, const std::string& action, JtagInterface& jtag,
+        std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+
+    /** @brief Run the program up to its next operation.
+     *
+     *  @param[in,out] op - The operation
+     *
+     *  @return false once the action completed
+     *  @error  JbcError if the program fails or exits with an error code
+     */
+    bool next(SvfOp& op) override;
+
+    /** @brief JBC does not say how much is left; the furthest code offset
+     *         reached stands in for it, as the programming procedures run
+     *         mostly straight through */
+    size_t offset() const override
+    {
+        return furthest;
+    }
+
+    size_t size() const override
+    {
+        return codeEnd - codeSection;
+    }
+
+    /** @brief The code offset of the last instruction; JBC has no lines */
+    size_t line() const override
+    {
+        return instruction;
+    }
+
+    /** @brief Get the lines the program printed */
+    const std::vector<std::string>& printed() const
+    {
+        return output;
+    }
+
+  private:
+    /** @struct Variable
+     *  @brief A scalar, Boolean array or integer array of the program.
+     */
+    struct Variable
+    {
+        /** @brief The value of a scalar */
+        int32_t value = 0;
+
+        /** @brief Whether the variable is an array */
+        bool isArray = false;
+
+        /** @brief Whether an array holds integers rather than bits */
+        bool isInteger = false;
+
+        /** @brief The number of elements of an array */
+        size_t size = 0;
+
+        /** @brief The bits of a Boolean array that was not written yet,
+         *         in the file */
+        const uint8_t* initial = nullptr;
+
+        /** @brief The bits of a Boolean array once written or uncompressed */
+        BitVector bits;
+
+        /** @brief The elements of an integer array */
+        std::vector<int32_t> integers;
+    };
+
+    /** @struct Slice
+     *  @brief A range of array bits; bit 0 is the one at start, or at its
+     *         other end if reversed.
+     */
+    struct Slice
+    {
+        size_t start = 0;
+        size_t count = 0;
+        bool reversed = false;
+    };
+
+    /** @brief Read the header, symbols and procedure list */
+    void load(const std::string& action);
+
+    /** @brief Initialize a variable from its symbol table entry */
+    void loadSymbol(Variable& var, uint8_t attributes, uint32_t value,
+                    uint32_t size);
+
+    /** @brief Unpack a compressed Boolean array */
+    std::vector<uint8_t> uncompress(size_t offset, size_t length) const;
+
+    /** @brief Execute one instruction.
+     *
+     *  @param[in,out] op - The operation to fill
+     *
+     *  @return true if it produced op
+     */
+    bool step(SvfOp& op);
+
+    /** @brief Continue with the next procedure of the action, or finish */
+    void nextProcedure();
+
+    /** @brief Jump to a code offset */
+    void jump(uint32_t target);
+
+    uint8_t byteAt(size_t offset) const;
+    uint32_t wordAt(size_t offset) const;
+
+    /** @brief Get a string of the string table */
+    std::string_view string(uint32_t id) const;
+
+    /** @brief Get a variable by symbol index */
+    Variable& variable(uint32_t id);
+
+    /** @brief Get a Boolean array by symbol index */
+    Variable& booleanArray(uint32_t id);
+
+    /** @brief Get a bit of a Boolean array */
+    bool bit(const Variable& var, size_t index) const;
+
+    /** @brief Get the writable bits of a Boolean array */
+    BitVector& writable(Variable& var);
+
+    /** @brief Get the slice between a left and right index */
+    static Slice slice(int32_t left, int32_t right);
+
+    /** @brief Check that a slice lies within an array */
+    void check(const Variable& var, const Slice& range) const;
+
+    /** @brief Copy the bits of a slice into a vector */
+    void read(const Variable& var, const Slice& range, BitVector& to,
+              size_t offset) const;
+
+    /** @brief Copy bits of a vector into a slice */
+    void write(Variable& var, const Slice& range, const BitVector& from,
+               size_t offset);
+
+    /** @brief Load the low bits of an integer into bits */
+    void literal(int32_t value, int32_t count);
+
+    /** @brief Get the integer the low bits of a vector make up */
+    static int32_t integer(const BitVector& from);
+
+    /** @brief Build the scan of a register from the preamble, data and
+     *         postamble */
+    void frame(ScanType type, const BitVector& data, BitVector& tdi) const;
+
+    /** @brief Hand out a scan of the given data */
+    void scan(SvfOp& op, ScanType type, const BitVector& data);
+
+    /** @brief Make a scan on the chain, leaving the captured data bits in
+     *         captured */
+    void capture(ScanType type, const BitVector& data);
+
+    /** @brief Get the preamble or postamble an instruction sets, resized
+     *         to count bits of ones */
+    BitVector& amble(uint8_t opcode, int32_t count);
+
+    /** @brief Get the TAP state an instruction names */
+    TapState state(uint32_t code) const;
+
+    void push(int32_t value);
+    int32_t pop();
+    int32_t& top(size_t index = 0);
+    void need(size_t count) const;
+
+    /** @brief Throw a JbcError for the current instruction */
+    [[noreturn]] void fail(const std::string& message) const;
+
+    /** @brief The JBC contents */
+    std::string_view data;
+
+    /** @brief The backend capturing scans are made on */
+    JtagInterface& jtag;
+
+    /** @brief Section offsets within data */
+    size_t actionTable = 0;
+    size_t procTable = 0;
+    size_t stringTable = 0;
+    size_t dataSection = 0;
+    size_t codeSection = 0;
+    size_t codeEnd = 0;
+    size_t procCount = 0;
+
+    /** @brief The procedures of the action still to run, the next one
+     *         first */
+    std::vector<uint32_t> procedures;
+
+    /** @brief The position of the next procedure in procedures */
+    size_t procedure = 0;
+
+    /** @brief The variables, by symbol index */
+    std::vector<Variable> variables;
+
+    /** @brief The operand stack */
+    std::array<int32_t, 128> stack{};
+    size_t depth = 0;
+
+    /** @brief The program counter, a file offset */
+    size_t pc = 0;
+
+    /** @brief The code offset of the instruction being executed */
+    size_t instruction = 0;
+
+    /** @brief The furthest code offset reached */
+    size_t furthest = 0;
+
+    /** @brief Whether the program started running */
+    bool running = false;
+
+    /** @brief Whether the action completed */
+    bool done = false;
+
+    /** @brief The stable state scans end in */
+    TapState irStop = TapState::Idle;
+    TapState drStop = TapState::Idle;
+
+    /** @brief The bits shifted before and after the data of a scan, for
+     *         the other devices of the chain */
+    BitVector irPre;
+    BitVector irPost;
+    BitVector drPre;
+    BitVector drPost;
+
+    /** @brief Transient states of a STATE, walked through on the way to
+     *         its stable one */
+    std::vector<TapState> walk;
+
+    /** @brief The PRINT line being assembled */
+    std::string message;
+
+    /** @brief The lines printed */
+    std::vector<std::string> output;
+
+    /** @brief Reuses the scan buffers of the operations handed out */
+    ScanRecycler recycler;
+
+    /** @brief Scan data, reused across instructions */
+    BitVector bits;
+    BitVector tdi;
+    BitVector tdo;
+    BitVector captured;
+};
+
+/** @class JbcFile
+ *  @brief A JbcSource over a mapped JBC file.
+ */
+class JbcFile : public OpSource
+{
+  public:
+    /** @brief Maps a JBC file.
+     *
+     *  @param[in] path     - The JBC file path
+     *  @param[in] action   - The action to run
+     *  @param[in] jtag     - The backend capturing scans are made on
+     *  @param[in] resource - The memory resource scan data is allocated
+     *                        from
+     *
+     *  @error  std::system_error if the file can not be mapped, JbcError if
+     *          it is malformed
+     */
+    JbcFile(
+        const std::string& path, const std::string& action, JtagInterface& jtag,
+        std::pmr::memory_resource* resource = std::pmr::get_default_resource()) :
+        file(path), source(file.view(), action, jtag, resource)
+    {}
+
+    bool next(SvfOp& op) override
+    {
+        return source.next(op);
+    }
+
+    size_t offset() const override
+    {
+        return source.offset();
+    }
+
+    size_t size() const override
+    {
+        return source.size();
+    }
+
+    size_t line() const override
+    {
+        return source.line();
+    }
+
+    /** @brief Get the lines the program printed */
+    const std::vector<std::string>& printed() const
+    {
+        return source.printed();
+    }
+
+  private:
+    /** @brief The mapped file */
+    MappedFile file;
+
+    /** @brief The program reading the mapping */
+    JbcSource source;
+};
+
+/** @brief Check whether a programming file is a JBC program.
+ *
+ *  @param[in] path - The file path
+ *
+ *  @return true if it has the .jbc extension
+ */
+bool isJbcPath(const std::string& path);
+
+} // namespace updater
+} // namespace software
+} // namespace wistron
@@ -0,0 +1,475 @@
+#include "jtag.hpp"
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <system_error>
+
+namespace wistron
+{
+namespace software
+{
+namespace updater
+{
+
+namespace
+{
+
+// Mirrors include/uapi/linux/jtag.h of the BMC kernel, which is not part of
+// the generic kernel headers.
+constexpr uint8_t jtagStateCurrent = 16;
+
+enum JtagXferType : uint8_t
+{
+    JTAG_SIR_XFER = 0,
+    JTAG_SDR_XFER = 1,
+};
+
+enum JtagXferDirection : uint8_t
+{
+    JTAG_READ_XFER = 1,
+    JTAG_WRITE_XFER = 2,
+    JTAG_READ_WRITE_XFER = 3,
+};
+
+struct jtag_tap_state
+{
+    uint8_t reset;
+    uint8_t from;
+    uint8_t endstate;
+    uint32_t tck;
+};
+
+struct jtag_xfer
+{
+    uint8_t type;
+    uint8_t direction;
+    uint8_t from;
+    uint8_t endstate;
+    uint32_t padding;
+    uint32_t length;
+    uint64_t tdio;
+};
+
+struct jtag_mode
+{
+    uint32_t feature;
+    uint32_t mode;
+};
+
+struct tck_bitbang
+{
+    uint8_t tms;
+    uint8_t tdi;
+    uint8_t tdo;
+} __attribute__((__packed__));
+
+struct bitbang_packet
+{
+    struct tck_bitbang* data;
+    uint32_t length;
+} __attribute__((__packed__));
+
+constexpr uint32_t JTAG_XFER_MODE = 0;
+constexpr uint32_t JTAG_XFER_HW_MODE = 1;
+constexpr uint8_t JTAG_NO_RESET = 0;
+constexpr uint8_t JTAG_FORCE_RESET = 1;
+constexpr uint32_t JTAG_MAX_XFER_DATA_LEN = 65535;
+
+constexpr auto jtagIoctlMagic = 0xb2;
+constexpr auto JTAG_SIOCSTATE = _IOW(jtagIoctlMagic, 0, struct jtag_tap_state);
+constexpr auto JTAG_SIOCFREQ = _IOW(jtagIoctlMagic, 1, unsigned int);
+constexpr auto JTAG_IOCXFER = _IOWR(jtagIoctlMagic, 3, struct jtag_xfer);
+constexpr auto JTAG_SIOCMODE = _IOW(jtagIoctlMagic, 5, unsigned int);
+constexpr auto JTAG_IOCBITBANG = _IOW(jtagIoctlMagic, 6, unsigned int);
+constexpr auto JTAG_SIOCTRST = _IOW(jtagIoctlMagic, 7, unsigned int);
+
+/** @brief The most clocks the driver accepts in one bit-bang packet */
+constexpr size_t maxBatchClocks = JTAG_MAX_XFER_DATA_LEN - 1;
+
+} // namespace
+
+JtagDevice::JtagDevice(const std::string& path) :
+    fd(open(path.c_str(), O_RDWR | O_CLOEXEC))
+{
+    if (fd < 0)
+    {
+        auto error = errno;
+        throw std::system_error(error, std::generic_category(),
+                                "Failed to open " + path);
+    }
+
+    // The updater and the command line tools may each open the chain;
+    // before anything touches the TAP, make sure nobody else is using it.
+    if (flock(fd, LOCK_EX | LOCK_NB) < 0)
+    {
+        auto error = errno;
+        close(fd);
+        throw std::system_error(error, std::generic_category(),
+                                path + " is in use by another programming "
+                                       "run");
+    }
+
+    try
+    {
+        jtag_mode mode{JTAG_XFER_MODE, JTAG_XFER_HW_MODE};
+        control(JTAG_SIOCMODE, &mode, "set JTAG mode");
+
+        jtag_tap_state tapState{JTAG_FORCE_RESET, jtagStateCurrent,
+                                static_cast<uint8_t>(TapState::Reset), 0};
+        control(JTAG_SIOCSTATE, &tapState, "reset TAP");
+
+        // One clock with TMS high keeps the TAP in Reset, so it is a
+        // harmless probe for bit-bang support.
+        tck_bitbang probe{1, 0, 0};
+        bitbang_packet packet{&probe, 1};
+        if (ioctl(fd, JTAG_IOCBITBANG, &packet) == 0)
+        {
+            batching = true;
+            batch.reserve(maxBatchClocks * sizeof(tck_bitbang));
+        }
+        else if (errno != ENOTTY && errno != EINVAL && errno != EOPNOTSUPP)
+        {
+            auto error = errno;
+            throw std::system_error(error, std::generic_category(),
+                                    "Failed to probe JTAG bit-bang");
+        }
+    }
+    catch (...)
+    {
+        close(fd);
+        throw;
+    }
+}
+
+JtagDevice::~JtagDevice()
+{
+    if (fd >= 0)
+    {
+        close(fd);
+    }
+}
+
+void JtagDevice::control(unsigned long request, void* arg, const char* what)
+{
+    if (ioctl(fd, request, arg) < 0)
+    {
+        auto error = errno;
+        throw std::system_error(error, std::generic_category(),
+                                std::string("Failed to ") + what);
+    }
+}
+
+bool JtagDevice::reserve(size_t clocks)
+{
+    if (!batching || clocks > maxBatchClocks)
+    {
+        flush();
+        return false;
+    }
+    if (batch.size() / sizeof(tck_bitbang) + clocks > maxBatchClocks)
+    {
+        flush();
+    }
+    ++batchedOps;
+    return true;
+}
+
+void JtagDevice::clock(bool tms, bool tdi)
+{
+    batch.push_back(tms);
+    batch.push_back(tdi);
+    batch.push_back(0);
+}
+
+void JtagDevice::clock(const TmsPath& path)
+{
+    for (uint8_t i = 0; i < path.length; ++i)
+    {
+        bool tms = (path.bits >> i) & 1;
+        clock(tms, false);
+        current = nextTapState(current, tms);
+    }
+}
+
+void JtagDevice::transmit()
+{
+    bitbang_packet packet{reinterpret_cast<tck_bitbang*>(batch.data()),
+                          static_cast<uint32_t>(batch.size() /
+                                                sizeof(tck_bitbang))};
+    control(JTAG_IOCBITBANG, &packet, "bit-bang JTAG batch");
+    saved += batchedOps - 1;
+}
+
+void JtagDevice::flush()
+{
+    if (batch.empty())
+    {
+        return;
+    }
+
+    transmit();
+    batch.clear();
+    batchedOps = 0;
+}
+
+void JtagDevice::setFrequency(uint32_t hz)
+{
+    flush();
+    unsigned int frequency = hz;
+    control(JTAG_SIOCFREQ, &frequency, "set TCK frequency");
+}
+
+void JtagDevice::setTrst(bool asserted)
+{
+    flush();
+    unsigned int value = asserted ? 1 : 0;
+    control(JTAG_SIOCTRST, &value, "drive TRST");
+}
+
+void JtagDevice::moveTo(TapState state)
+{
+    if (state == current && state != TapState::Reset)
+    {
+        return;
+    }
+
+    auto path = state == TapState::Reset ? resetPath : tmsPath(current, state);
+    if (reserve(path.length))
+    {
+        clock(path);
+        return;
+    }
+
+    // Name the tracked state explicitly, bit-bang batches bypass the
+    // driver's own tracking.
+    jtag_tap_state tapState{
+        state == TapState::Reset ? JTAG_FORCE_RESET : JTAG_NO_RESET,
+        static_cast<uint8_t>(current), static_cast<uint8_t>(state), 0};
+    control(JTAG_SIOCSTATE, &tapState, "move TAP state");
+    current = state;
+}
+
+void JtagDevice::idle(uint32_t tck)
+{
+    if (tck == 0)
+    {
+        return;
+    }
+
+    if (reserve(tck))
+    {
+        // Reset is held with TMS high, the other stable states with TMS low.
+        bool tms = current == TapState::Reset;
+        for (uint32_t i = 0; i < tck; ++i)
+        {
+            clock(tms, false);
+        }
+        return;
+    }
+
+    jtag_tap_state tapState{JTAG_NO_RESET, static_cast<uint8_t>(current),
+                            static_cast<uint8_t>(current), tck};
+    control(JTAG_SIOCSTATE, &tapState, "clock TCK");
+}
+
+bool JtagDevice::idleNow(uint32_t tck)
+{
+    // Bit-bang clocks run at the speed of the driver's register writes,
+    // only the state ioctl clocks at the programmed frequency.
+    flush();
+    if (tck != 0)
+    {
+        jtag_tap_state tapState{JTAG_NO_RESET, static_cast<uint8_t>(current),
+                                static_cast<uint8_t>(current), tck};
+        control(JTAG_SIOCSTATE, &tapState, "clock TCK");
+    }
+    return true;
+}
+
+void JtagDevice::shift(ScanType type, const BitVector& tdi, BitVector* tdo,
+                       TapState endState)
+{
+    if (tdi.empty())
+    {
+        moveTo(endState);
+        return;
+    }
+
+    if (batchShift(
+            type, tdi.size(), [&tdi](size_t bit) { return tdi.test(bit); },
+            tdo, endState))
+    {
+        return;
+    }
+
+    // The driver shifts in place, so the buffer handed over receives TDO.
+    BitVector scratch;
+    BitVector& buffer = tdo ? *tdo : scratch;
+    buffer = tdi;
+    transfer(type, tdi.size(), buffer.data(), tdo != nullptr, endState);
+}
+
+void JtagDevice::shiftFill(ScanType type, size_t bits, bool level,
+                           BitVector* tdo, TapState endState)
+{
+    if (bits == 0)
+    {
+        moveTo(endState);
+        return;
+    }
+
+    if (batchShift(
+            type, bits, [level](size_t) { return level; }, tdo, endState))
+    {
+        return;
+    }
+
+    // The pattern is generated straight into the buffer the driver shifts
+    // in place; TDO overwrites it, so it is filled anew for every scan.
+    uint8_t* tdio = nullptr;
+    if (tdo)
+    {
+        tdo->resize(bits, level);
+        tdio = tdo->data();
+    }
+    else
+    {
+        fillBuffer.assign((bits + 7) / 8, level ? 0xff : 0x00);
+        tdio = fillBuffer.data();
+    }
+    transfer(type, bits, tdio, tdo != nullptr, endState);
+}
+
+template <typename Tdi>
+bool JtagDevice::batchShift(ScanType type, size_t bits, Tdi tdi,
+                            BitVector* tdo, TapState endState)
+{
+    // Enter Shift through Capture as the driver does, even from a Pause
+    // state where Exit2 would be shorter.
+    auto select =
+        type == ScanType::IR ? TapState::IRSelect : TapState::DRSelect;
+    auto toSelect = tmsPath(current, select);
+    auto exit = type == ScanType::IR ? TapState::IRExit1 : TapState::DRExit1;
+    auto toEnd = tmsPath(exit, endState);
+    if (!reserve(toSelect.length + 2 + bits + toEnd.length))
+    {
+        return false;
+    }
+
+    clock(toSelect);
+    clock(false, false);
+    clock(false, false);
+
+    auto first = batch.size() / sizeof(tck_bitbang);
+    for (size_t i = 0; i < bits; ++i)
+    {
+        clock(i + 1 == bits, tdi(i));
+    }
+    current = exit;
+    clock(toEnd);
+
+    if (tdo)
+    {
+        transmit();
+        tdo->resize(bits);
+        auto clocks =
+            reinterpret_cast<const tck_bitbang*>(batch.data()) + first;
+        for (size_t i = 0; i < bits; ++i)
+        {
+            tdo->set(i, clocks[i].tdo & 1);
+        }
+        batch.clear();
+        batchedOps = 0;
+    }
+    return true;
+}
+
+void JtagDevice::transfer(ScanType type, size_t bits, uint8_t* tdio,
+                          bool capture, TapState endState)
+{
+    // The driver enters a shift through Capture even from Pause, so a scan
+    // can not be cut into several transfers.
+    if (bits > JTAG_MAX_XFER_DATA_LEN)
+    {
+        if (!batching)
+        {
+            throw std::system_error(
+                EMSGSIZE, std::generic_category(),
+                "Failed to shift " + std::to_string(bits) +
+                    " bits, the driver transfers at most " +
+                    std::to_string(JTAG_MAX_XFER_DATA_LEN));
+        }
+        packetShift(type, bits, tdio, capture, endState);
+        return;
+    }
+
+    jtag_xfer xfer{};
+    xfer.type = type == ScanType::IR ? JTAG_SIR_XFER : JTAG_SDR_XFER;
+    xfer.direction = capture ? JTAG_READ_WRITE_XFER : JTAG_WRITE_XFER;
+    xfer.from = static_cast<uint8_t>(current);
+    xfer.endstate = static_cast<uint8_t>(endState);
+    xfer.length = static_cast<uint32_t>(bits);
+    xfer.tdio = reinterpret_cast<uintptr_t>(tdio);
+    control(JTAG_IOCXFER, &xfer, "shift scan data");
+
+    current = endState;
+}
+
+void JtagDevice::packetShift(ScanType type, size_t bits, uint8_t* tdio,
+                             bool capture, TapState endState)
+{
+    flush();
+    auto select =
+        type == ScanType::IR ? TapState::IRSelect : TapState::DRSelect;
+    auto exit = type == ScanType::IR ? TapState::IRExit1 : TapState::DRExit1;
+    clock(tmsPath(current, select));
+    clock(false, false);
+    clock(false, false);
+
+    // Bits from sent on went out in the current packet, from offset on.
+    size_t sent = 0;
+    size_t offset = batch.size() / sizeof(tck_bitbang);
+    auto send = [&](size_t upTo) {
+        batchedOps = 1;
+        transmit();
+        auto clocks =
+            reinterpret_cast<const tck_bitbang*>(batch.data()) + offset;
+        for (size_t i = sent; capture && i < upTo; ++i)
+        {
+            auto mask = static_cast<uint8_t>(1u << (i % 8));
+            tdio[i / 8] = (clocks[i - sent].tdo & 1) ? (tdio[i / 8] | mask)
+                                                     : (tdio[i / 8] & ~mask);
+        }
+        batch.clear();
+        batchedOps = 0;
+        sent = upTo;
+        offset = 0;
+    };
+
+    for (size_t i = 0; i < bits; ++i)
+    {
+        if (batch.size() / sizeof(tck_bitbang) == maxBatchClocks)
+        {
+            send(i);
+        }
+        clock(i + 1 == bits, (tdio[i / 8] >> (i % 8)) & 1);
+    }
+    current = exit;
+
+    auto toEnd = tmsPath(exit, endState);
+    if (batch.size() / sizeof(tck_bitbang) + toEnd.length > maxBatchClocks)
+    {
+        send(bits);
+    }
+    clock(toEnd);
+    send(bits);
+}
+
+} // namespace updater
+} // namespace software
+} // namespace wistron
@@ -0,0 +1,260 @@
+#pragma once
+
+#include "bit_vector.hpp"
+#include "tap_state.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace wistron
+{
+namespace software
+{
+namespace updater
+{
+
+/** @enum ScanType
+ *  @brief The register a scan shifts through.
+ */
+enum class ScanType : uint8_t
+{
+    IR,
+    DR,
+};
+
+/** @class JtagInterface
+ *  @brief Backend interface the programming engine drives.
+ *  @details A backend tracks the TAP state itself so callers only name
+ *  where the TAP has to end up. Backends may queue operations; they reach
+ *  the wire at the latest on flush(), and a shift that captures TDO returns
+ *  only once it completed.
+ */
+class JtagInterface
+{
+  public:
+    JtagInterface() = default;
+    JtagInterface(const JtagInterface&) = delete;
+    JtagInterface& operator=(const JtagInterface&) = delete;
+    JtagInterface(JtagInterface&&) = delete;
+    JtagInterface& operator=(JtagInterface&&) = delete;
+    virtual ~JtagInterface() = default;
+
+    /** @brief Set the TCK frequency.
+     *
+     *  @param[in] hz - The frequency in Hz
+     */
+    virtual void setFrequency(uint32_t hz) = 0;
+
+    /** @brief Drive the optional TRST signal.
+     *
+     *  @param[in] asserted - Whether TRST is asserted (reset active)
+     */
+    virtual void setTrst(bool asserted) = 0;
+
+    /** @brief Move the TAP to a stable state along the shortest path.
+     *
+     *  @param[in] state - The stable state to move to
+     */
+    virtual void moveTo(TapState state) = 0;
+
+    /** @brief Clock TCK while staying in the current stable state.
+     *
+     *  @param[in] tck - The number of clocks
+     */
+    virtual void idle(uint32_t tck) = 0;
+
+    /** @brief Clock TCK in the current stable state right away, at the
+     *         configured frequency.
+     *  @details Unlike idle(), queued operations are sent first and the call
+     *  returns once the clocks are done, so it takes tck / frequency and
+     *  can fill a delay.
+     *
+     *  @param[in] tck - The number of clocks
+     *
+     *  @return false if the backend can not clock at a known rate; nothing
+     *          was clocked then
+     */
+    virtual bool idleNow(uint32_t /*tck*/)
+    {
+        return false;
+    }
+
+    /** @brief Shift data through the instruction or data register.
+     *
+     *  @param[in]  type     - Which register to shift through
+     *  @param[in]  tdi      - The bits to shift in
+     *  @param[out] tdo      - Captured bits, sized like tdi; may be null
+     *                         when the caller does not need them
+     *  @param[in]  endState - The stable state to end in
+     */
+    virtual void shift(ScanType type, const BitVector& tdi, BitVector* tdo,
+                       TapState endState) = 0;
+
+    /** @brief Shift the same level into every bit of the instruction or
+     *         data register.
+     *  @details Erase verify and blank check sequences shift long runs of
+     *  ones or zeros; backends generate them where they are sent instead
+     *  of reading them from a buffer.
+     *
+     *  @param[in]  type     - Which register to shift through
+     *  @param[in]  bits     - The number of bits to shift
+     *  @param[in]  level    - The TDI level of every bit
+     *  @param[out] tdo      - Captured bits, bits long; may be null when
+     *                         the caller does not need them
+     *  @param[in]  endState - The stable state to end in
+     */
+    virtual void shiftFill(ScanType type, size_t bits, bool level,
+                           BitVector* tdo, TapState endState)
+    {
+        BitVector tdi;
+        tdi.resize(bits, level);
+        shift(type, tdi, tdo, endState);
+    }
+
+    /** @brief Send all queued operations to the hardware */
+    virtual void flush() {}
+
+    /** @brief Get the number of ioctls batching has saved so far */
+    virtual uint64_t ioctlsSaved() const
+    {
+        return 0;
+    }
+
+    /** @brief Get the current TAP state */
+    virtual TapState state() const = 0;
+};
+
+/** @class JtagDevice
+ *  @brief JtagInterface on top of the Linux JTAG driver (/dev/jtagN).
+ *  @details Consecutive state moves, idle clocks and shifts are queued as
+ *  TMS/TDI pairs and sent with a single bit-bang ioctl, up to the driver's
+ *  transfer limit. ISC programming alternates short SIR/SDR/RUNTEST
+ *  commands, and one ioctl each would dominate the wall time. Operations
+ *  too long for one batch use the driver's hardware transfers, as does
+ *  everything on drivers without bit-bang support. Scans beyond the
+ *  hardware transfer limit are shifted as several bit-bang packets, and
+ *  rejected by drivers without them.
+ *
+ *  The device node is locked with flock() while it is open, so a second
+ *  user, e.g. the command line verify during an activation, is refused
+ *  rather than interleaving its scans.
+ */
+class JtagDevice : public JtagInterface
+{
+  public:
+    /** @brief Opens the JTAG device and resets the TAP.
+     *
+     *  @param[in] path - The device node, e.g. /dev/jtag0
+     *
+     *  @error  std::system_error if the device can not be opened or is in
+     *          use
+     */
+    explicit JtagDevice(const std::string& path);
+
+    ~JtagDevice() override;
+
+    void setFrequency(uint32_t hz) override;
+    void setTrst(bool asserted) override;
+    void moveTo(TapState state) override;
+    void idle(uint32_t tck) override;
+    bool idleNow(uint32_t tck) override;
+    void shift(ScanType type, const BitVector& tdi, BitVector* tdo,
+               TapState endState) override;
+    void shiftFill(ScanType type, size_t bits, bool level, BitVector* tdo,
+                   TapState endState) override;
+    void flush() override;
+
+    TapState state() const override
+    {
+        return current;
+    }
+
+    uint64_t ioctlsSaved() const override
+    {
+        return saved;
+    }
+
+  private:
+    /** @brief Issue an ioctl, throwing std::system_error on failure */
+    void control(unsigned long request, void* arg, const char* what);
+
+    /** @brief Make room for clocks in the batch.
+     *
+     *  @param[in] clocks - The number of clocks to queue
+     *
+     *  @return false if the operation can not be batched at all
+     */
+    bool reserve(size_t clocks);
+
+    /** @brief Queue one TCK */
+    void clock(bool tms, bool tdi);
+
+    /** @brief Queue the clocks of a TMS path, updating the tracked state */
+    void clock(const TmsPath& path);
+
+    /** @brief Send the batch, leaving the captured TDO in place */
+    void transmit();
+
+    /** @brief Queue a scan in the batch, capturing TDO if asked to.
+     *
+     *  @param[in]  type     - Which register to shift through
+     *  @param[in]  bits     - The number of bits to shift
+     *  @param[in]  tdi      - Gives the TDI level of a bit by its index
+     *  @param[out] tdo      - Captured bits; may be null
+     *  @param[in]  endState - The stable state to end in
+     *
+     *  @return false if the scan can not be batched; nothing was queued
+     */
+    template <typename Tdi>
+    bool batchShift(ScanType type, size_t bits, Tdi tdi, BitVector* tdo,
+                    TapState endState);
+
+    /** @brief Shift with a hardware transfer of the driver.
+     *
+     *  @param[in]     type     - Which register to shift through
+     *  @param[in]     bits     - The number of bits to shift
+     *  @param[in,out] tdio     - The bits to shift in; receives TDO
+     *  @param[in]     capture  - Whether TDO is wanted
+     *  @param[in]     endState - The stable state to end in
+     */
+    void transfer(ScanType type, size_t bits, uint8_t* tdio, bool capture,
+                  TapState endState);
+
+    /** @brief Shift a scan longer than a hardware transfer takes as a run
+     *         of bit-bang packets, the TAP staying in Shift between them.
+     *
+     *  @param[in]     type     - Which register to shift through
+     *  @param[in]     bits     - The number of bits to shift
+     *  @param[in,out] tdio     - The bits to shift in; receives TDO
+     *  @param[in]     capture  - Whether TDO is wanted
+     *  @param[in]     endState - The stable state to end in
+     */
+    void packetShift(ScanType type, size_t bits, uint8_t* tdio, bool capture,
+                     TapState endState);
+
+    /** @brief The device file descriptor */
+    int fd = -1;
+
+    /** @brief The tracked TAP state, including queued operations */
+    TapState current = TapState::Reset;
+
+    /** @brief Whether the driver supports bit-bang batches */
+    bool batching = false;
+
+    /** @brief Queued clocks as struct tck_bitbang triples */
+    std::vector<uint8_t> batch;
+
+    /** @brief The transfer buffer of fill scans whose TDO is not wanted */
+    std::vector<uint8_t> fillBuffer;
+
+    /** @brief The number of operations in the batch */
+    uint64_t batchedOps = 0;
+
+    /** @brief ioctls saved by batching */
+    uint64_t saved = 0;
+};
+
+} // namespace updater
+} // namespace software
+} // namespace wistron
@@ -0,0 +1,597 @@
+#include "jtag_simulator.hpp"
+
+#include "lattice_isc.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <system_error>
+#include <thread>
+
+namespace wistron
+{
+namespace software
+{
+namespace updater
+{
+
+namespace
+{
+
+/** @brief ISC_ERASE operand bits selecting what to erase */
+constexpr uint32_t eraseFeature = 0x02;
+constexpr uint32_t eraseConfig = 0x04;
+constexpr uint32_t eraseUfm = 0x08;
+
+/** @brief LSC_WRITE_ADDRESS fields */
+constexpr uint32_t addressPageMask = 0x3fff;
+constexpr size_t addressUfmBit = 30;
+
+/** @brief Status register bits besides busy */
+constexpr size_t statusDoneBit = 8;
+constexpr size_t statusEnabledBit = 9;
+constexpr size_t statusFailBit = 13;
+
+constexpr size_t featureBits = 64;
+constexpr size_t feabitsBits = 16;
+
+/** @brief Get the low 32 bits of a register */
+uint32_t low32(const BitVector& value)
+{
+    uint32_t result = 0;
+    for (size_t i = 0; i < std::min<size_t>(value.size(), 32); ++i)
+    {
+        result |= uint32_t{value.test(i)} << i;
+    }
+    return result;
+}
+
+/** @brief Set the low bits of a register to a number */
+void setLow(BitVector& value, uint32_t number)
+{
+    for (size_t i = 0; i < std::min<size_t>(value.size(), 32); ++i)
+    {
+        value.set(i, (number >> i) & 1);
+    }
+}
+
+/** @brief Sleep for clocks at a frequency */
+void clockTime(uint32_t tck, uint32_t hz)
+{
+    if (hz != 0 && tck != 0)
+    {
+        std::this_thread::sleep_for(
+            std::chrono::nanoseconds(uint64_t{tck} * 1'000'000'000 / hz));
+    }
+}
+
+} // namespace
+
+SimulatedCpld::SimulatedCpld(const SimulatedCpldConfig& part) :
+    settings(part), config(part.configPages, BitVector(lattice::pageBits)),
+    ufm(part.ufmPages, BitVector(lattice::pageBits)), feature(featureBits),
+    feabits(feabitsBits)
+{}
+
+size_t SimulatedCpld::registerBits(uint8_t opcode)
+{
+    switch (opcode)
+    {
+        case lattice::IDCODE_PUB:
+        case lattice::USERCODE:
+        case lattice::LSC_READ_STATUS:
+        case lattice::ISC_PROGRAM_USERCODE:
+        case lattice::LSC_WRITE_ADDRESS:
+            return 32;
+        case lattice::LSC_PROG_INCR_NV:
+        case lattice::LSC_READ_INCR_NV:
+        case lattice::LSC_READ_UFM:
+            return lattice::pageBits;
+        case lattice::LSC_PROG_FEATURE:
+        case lattice::LSC_READ_FEATURE:
+            return featureBits;
+        case lattice::LSC_PROG_FEABITS:
+        case lattice::LSC_READ_FEABITS:
+            return feabitsBits;
+        case lattice::ISC_ENABLE:
+        case lattice::ISC_ENABLE_X:
+        case lattice::ISC_ERASE:
+        case lattice::LSC_INIT_ADDRESS:
+        case lattice::LSC_INIT_ADDR_UFM:
+            return 8;
+        default:
+            return 1;
+    }
+}
+
+bool SimulatedCpld::busy()
+{
+    if (std::chrono::steady_clock::now() < busyUntil)
+    {
+        ++counters.busyViolations;
+        failed = true;
+        return true;
+    }
+    return false;
+}
+
+void SimulatedCpld::occupy(std::chrono::microseconds time)
+{
+    busyUntil = std::chrono::steady_clock::now() + time;
+}
+
+std::vector<BitVector>& SimulatedCpld::sector()
+{
+    return ufmSelected ? ufm : config;
+}
+
+void SimulatedCpld::select(uint8_t opcode)
+{
+    switch (opcode)
+    {
+        case lattice::ISC_PROGRAM_DONE:
+            if (!busy() && enabled)
+            {
+                doneBit = true;
+                occupy(settings.programTime);
+            }
+            break;
+        case lattice::ISC_DISABLE:
+        case lattice::LSC_REFRESH:
+            enabled = false;
+            break;
+        case lattice::LSC_INIT_ADDRESS:
+        case lattice::LSC_INIT_ADDR_UFM:
+            if (!busy())
+            {
+                address = 0;
+                ufmSelected = opcode == lattice::LSC_INIT_ADDR_UFM;
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+void SimulatedCpld::capture(uint8_t opcode, BitVector& value)
+{
+    auto size = value.size();
+    value.resize(size);
+    switch (opcode)
+    {
+        case lattice::IDCODE_PUB:
+            setLow(value, settings.idcode);
+            break;
+        case lattice::USERCODE:
+            setLow(value, user);
+            break;
+        case lattice::LSC_READ_STATUS:
+        {
+            bool working = std::chrono::steady_clock::now() < busyUntil;
+            setLow(value, uint32_t{doneBit} << statusDoneBit |
+                              uint32_t{enabled} << statusEnabledBit |
+                              uint32_t{working} << lattice::statusBusyBit |
+                              uint32_t{failed} << statusFailBit);
+            break;
+        }
+        case lattice::LSC_CHECK_BUSY:
+            if (size != 0 && std::chrono::steady_clock::now() < busyUntil)
+            {
+                value.set(size - 1, true);
+            }
+            break;
+        case lattice::LSC_READ_INCR_NV:
+        case lattice::LSC_READ_UFM:
+        {
+            if (busy())
+            {
+                break;
+            }
+            // Pages follow each other from the most significant end, the
+            // order the config port sends them in.
+            auto& pages = sector();
+            for (auto end = size; end >= lattice::pageBits;
+                 end -= lattice::pageBits)
+            {
+                if (address < pages.size())
+                {
+                    value.assign(end - lattice::pageBits, pages[address]);
+                }
+                ++address;
+                ++counters.pagesRead;
+            }
+            break;
+        }
+        case lattice::LSC_READ_FEATURE:
+            if (size == featureBits)
+            {
+                value = feature;
+            }
+            break;
+        case lattice::LSC_READ_FEABITS:
+            if (size == feabitsBits)
+            {
+                value = feabits;
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+void SimulatedCpld::update(uint8_t opcode, const BitVector& value)
+{
+    switch (opcode)
+    {
+        case lattice::ISC_ENABLE:
+        case lattice::ISC_ENABLE_X:
+            enabled = true;
+            failed = false;
+            return;
+        case lattice::LSC_INIT_ADDRESS:
+        case lattice::LSC_INIT_ADDR_UFM:
+            select(opcode);
+            return;
+        case lattice::ISC_ERASE:
+        case lattice::LSC_WRITE_ADDRESS:
+        case lattice::LSC_PROG_INCR_NV:
+        case lattice::ISC_PROGRAM_USERCODE:
+        case lattice::LSC_PROG_FEATURE:
+        case lattice::LSC_PROG_FEABITS:
+            break;
+        default:
+            return;
+    }
+
+    if (busy())
+    {
+        return;
+    }
+    if (!enabled)
+    {
+        failed = true;
+        return;
+    }
+
+    auto operand = low32(value);
+    switch (opcode)
+    {
+        case lattice::ISC_ERASE:
+            if (operand & eraseConfig)
+            {
+                std::ranges::for_each(config,
+                                      [](auto& page) { page.fill(false); });
+                doneBit = false;
+            }
+            if (operand & eraseUfm)
+            {
+                std::ranges::for_each(ufm,
+                                      [](auto& page) { page.fill(false); });
+            }
+            if (operand & eraseFeature)
+            {
+                feature.fill(false);
+                feabits.fill(false);
+            }
+            ++counters.erases;
+            occupy(settings.eraseTime);
+            break;
+        case lattice::LSC_WRITE_ADDRESS:
+            address = operand & addressPageMask;
+            ufmSelected = (operand >> addressUfmBit) & 1;
+            break;
+        case lattice::LSC_PROG_INCR_NV:
+        {
+            auto& pages = sector();
+            for (auto end = value.size(); end >= lattice::pageBits;
+                 end -= lattice::pageBits)
+            {
+                if (address >= pages.size())
+                {
+                    failed = true;
+                    return;
+                }
+                // Flash bits only go from erased to programmed.
+                auto& page = pages[address];
+                auto data = value.slice(end - lattice::pageBits,
+                                        lattice::pageBits);
+                for (size_t i = 0; i < lattice::pageBits; ++i)
+                {
+                    page.set(i, page.test(i) || data.test(i));
+                }
+                if (!ufmSelected && settings.stuckPage == address)
+                {
+                    page.set(0, !page.test(0));
+                }
+                ++address;
+                ++counters.pagesProgrammed;
+            }
+            occupy(settings.programTime);
+            break;
+        }
+        case lattice::ISC_PROGRAM_USERCODE:
+            user = operand;
+            occupy(settings.programTime);
+            break;
+        case lattice::LSC_PROG_FEATURE:
+            if (value.size() == featureBits)
+            {
+                feature = value;
+            }
+            occupy(settings.programTime);
+            break;
+        case lattice::LSC_PROG_FEABITS:
+            if (value.size() == feabitsBits)
+            {
+                feabits = value;
+            }
+            occupy(settings.programTime);
+            break;
+        default:
+            break;
+    }
+}
+
+SimulatedChain::SimulatedChain(
+    std::vector<std::shared_ptr<SimulatedCpld>> models)
+{
+    for (auto& model : models)
+    {
+        devices.push_back({std::move(model), 0, BitVector(lattice::irBits),
+                           BitVector()});
+    }
+    reset();
+}
+
+void SimulatedChain::reset()
+{
+    for (auto& tap : devices)
+    {
+        tap.instruction = lattice::IDCODE_PUB;
+    }
+    current = TapState::Reset;
+}
+
+bool SimulatedChain::clock(bool tms, bool tdi)
+{
+    // The devices' shift registers are in series, TDI entering the last
+    // device and TDO leaving the first one.
+    bool tdo = false;
+    if (current == TapState::IRShift || current == TapState::DRShift)
+    {
+        auto reg = current == TapState::IRShift ? &Tap::ir : &Tap::dr;
+        for (size_t i = 0; i < devices.size(); ++i)
+        {
+            auto& bits = devices[i].*reg;
+            bool in = i + 1 < devices.size()
+                          ? (devices[i + 1].*reg).test(0)
+                          : tdi;
+            if (i == 0)
+            {
+                tdo = bits.test(0);
+            }
+            for (size_t bit = 0; bit + 1 < bits.size(); ++bit)
+            {
+                bits.set(bit, bits.test(bit + 1));
+            }
+            bits.set(bits.size() - 1, in);
+        }
+    }
+
+    current = nextTapState(current, tms);
+    for (auto& tap : devices)
+    {
+        switch (current)
+        {
+            case TapState::Reset:
+                tap.instruction = lattice::IDCODE_PUB;
+                break;
+            case TapState::IRCapture:
+                // What an instruction register captures by IEEE 1149.1.
+                tap.ir.resize(lattice::irBits);
+                tap.ir.set(0, true);
+                break;
+            case TapState::DRCapture:
+                tap.dr.resize(SimulatedCpld::registerBits(tap.instruction));
+                tap.model->capture(tap.instruction, tap.dr);
+                break;
+            case TapState::IRUpdate:
+                tap.instruction = static_cast<uint8_t>(low32(tap.ir));
+                tap.model->select(tap.instruction);
+                break;
+            case TapState::DRUpdate:
+                tap.model->update(tap.instruction, tap.dr);
+                break;
+            default:
+                break;
+        }
+    }
+    return tdo;
+}
+
+void SimulatedChain::setTrst(bool asserted)
+{
+    if (asserted)
+    {
+        reset();
+    }
+}
+
+void SimulatedChain::moveTo(TapState state)
+{
+    auto path = state == TapState::Reset ? resetPath : tmsPath(current, state);
+    for (uint8_t i = 0; i < path.length; ++i)
+    {
+        clock((path.bits >> i) & 1, false);
+    }
+}
+
+void SimulatedChain::idle(uint32_t tck)
+{
+    // Holding a stable state changes nothing but the time.
+    clockTime(tck, frequency);
+}
+
+bool SimulatedChain::idleNow(uint32_t tck)
+{
+    clockTime(tck, frequency);
+    return frequency != 0;
+}
+
+void SimulatedChain::countScan()
+{
+    if (!scansLeft)
+    {
+        return;
+    }
+    if (*scansLeft == 0)
+    {
+        throw std::system_error(EIO, std::generic_category(),
+                                "Simulated JTAG cable failure");
+    }
+    --*scansLeft;
+}
+
+void SimulatedChain::shift(ScanType type, const BitVector& tdi, BitVector* tdo,
+                           TapState endState)
+{
+    countScan();
+    if (tdi.empty())
+    {
+        moveTo(endState);
+        return;
+    }
+
+    // Enter Shift through Capture as the JTAG driver does.
+    auto select =
+        type == ScanType::IR ? TapState::IRSelect : TapState::DRSelect;
+    moveTo(select);
+    clock(false, false);
+    clock(false, false);
+
+    if (tdo)
+    {
+        tdo->resize(tdi.size());
+    }
+    for (size_t i = 0; i < tdi.size(); ++i)
+    {
+        bool out = clock(i + 1 == tdi.size(), tdi.test(i));
+        if (tdo)
+        {
+            tdo->set(i, out);
+        }
+    }
+    moveTo(endState);
+}
+
+void SimulatedI2cBus::transfer(std::span<i2c_msg> messages)
+{
+    for (size_t i = 0; i < messages.size(); ++i)
+    {
+        auto& message = messages[i];
+        if ((message.flags & I2C_M_STOP) && !stops)
+        {
+            throw std::system_error(EOPNOTSUPP, std::generic_category(),
+                                    "I2C_M_STOP is not supported");
+        }
+        if ((message.flags & I2C_M_RD) || message.len == 0)
+        {
+            throw std::system_error(EIO, std::generic_category(),
+                                    "Config port read without command");
+        }
+
+        auto opcode = message.buf[0];
+        model->select(opcode);
+        if (i + 1 < messages.size() && (messages[i + 1].flags & I2C_M_RD))
+        {
+            auto& read = messages[++i];
+            value.resize(size_t{read.len} * 8);
+            model->capture(opcode, value);
+            std::vector<uint8_t> bytes;
+            appendI2cBits(bytes, value);
+            std::ranges::copy(bytes, read.buf);
+            continue;
+        }
+
+        // The opcode and operand bytes, two for the short commands, are
+        // followed by the data written.
+        size_t header = opcode == lattice::ISC_DISABLE ||
+                                opcode == lattice::LSC_REFRESH
+                            ? 3
+                            : 4;
+        if (message.len > header)
+        {
+            readI2cBits(message.buf + header, value,
+                        (message.len - header) * size_t{8});
+        }
+        else if (message.len > 1)
+        {
+            readI2cBits(message.buf + 1, value, 8);
+        }
+        else
+        {
+            continue;
+        }
+        model->update(opcode, value);
+    }
+}
+
+std::unique_ptr<JtagInterface> openSimulatedChain(const std::string& device)
+{
+    static std::mutex mutex;
+    static std::map<std::string, std::vector<std::shared_ptr<SimulatedCpld>>>
+        chains;
+
+    bool i2c = device.starts_with("sim-i2c:");
+    std::lock_guard lock(mutex);
+    auto& models = chains[device];
+    if (models.empty())
+    {
+        std::vector<std::shared_ptr<SimulatedCpld>> parsed;
+        auto list = device.substr(device.find(':') + 1);
+        size_t pos = 0;
+        while (pos < list.size())
+        {
+            auto comma = std::min(list.find(',', pos), list.size());
+            auto idcode = list.substr(pos, comma - pos);
+            size_t end = 0;
+            unsigned long value = 0;
+            try
+            {
+                value = std::stoul(idcode, &end, 16);
+            }
+            catch (const std::logic_error&)
+            {}
+            if (end == 0 || end != idcode.size() || value > 0xffffffff)
+            {
+                throw std::invalid_argument("Invalid IDCODE in " + device);
+            }
+            SimulatedCpldConfig config;
+            config.idcode = static_cast<uint32_t>(value);
+            parsed.push_back(std::make_shared<SimulatedCpld>(config));
+            pos = comma + 1;
+        }
+        if (parsed.empty())
+        {
+            parsed.push_back(std::make_shared<SimulatedCpld>());
+        }
+        models = std::move(parsed);
+    }
+
+    if (i2c)
+    {
+        if (models.size() != 1)
+        {
+            throw std::invalid_argument(device + " names several devices");
+        }
+        return std::make_unique<I2cConfigPort>(
+            std::make_unique<SimulatedI2cBus>(models.front()), 0x40);
+    }
+    return std::make_unique<SimulatedChain>(models);
+}
+
+} // namespace updater
+} // namespace software
+} // namespace wistron
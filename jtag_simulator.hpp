@@ -0,0 +1,347 @@
+#pragma once
+
+#include "i2c_config_port.hpp"
+#include "jtag.hpp"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace wistron
+{
+namespace software
+{
+namespace updater
+{
+
+/** @struct SimulatedCpldConfig
+ *  @brief The part a SimulatedCpld models and the faults it injects.
+ */
+struct SimulatedCpldConfig
+{
+    /** @brief The IDCODE; a MachXO2-1200 by default */
+    uint32_t idcode = 0x012ba043;
+
+    /** @brief The number of configuration flash pages */
+    size_t configPages = 2175;
+
+    /** @brief The number of UFM pages */
+    size_t ufmPages = 512;
+
+    /** @brief How long an erase keeps the device busy */
+    std::chrono::microseconds eraseTime{100000};
+
+    /** @brief How long programming a page, the USERCODE, the feature row
+     *         or the DONE bit keeps the device busy */
+    std::chrono::microseconds programTime{200};
+
+    /** @brief A configuration page whose bit 0 reads back inverted once
+     *         programmed, as a worn flash cell would */
+    std::optional<size_t> stuckPage;
+};
+
+/** @struct SimulatedCpldStats
+ *  @brief What a SimulatedCpld was asked to do.
+ */
+struct SimulatedCpldStats
+{
+    /** @brief Pages programmed, configuration and UFM */
+    uint64_t pagesProgrammed = 0;
+
+    /** @brief Pages read back */
+    uint64_t pagesRead = 0;
+
+    /** @brief Erase operations */
+    uint64_t erases = 0;
+
+    /** @brief Commands that arrived while the device was busy and were
+     *         dropped */
+    uint64_t busyViolations = 0;
+};
+
+/** @class SimulatedCpld
+ *  @brief A model of the sysCONFIG interface of a Lattice MachXO2/MachXO3.
+ *  @details The model holds the configuration flash and UFM pages, the
+ *  USERCODE, feature row and DONE bit, and executes the ISC instructions on
+ *  them the way the JTAG TAP and the I2C config port hand them over:
+ *  select() when an instruction is loaded, capture() for the register read
+ *  back and update() for the data shifted in. Erased flash reads as zeros.
+ *
+ *  Erase and program operations keep the device busy for their configured
+ *  time, measured on the steady clock. Commands other than status reads
+ *  arriving in that time are dropped and set the status register's fail
+ *  bit, so a wait that is too short shows in the read back, as on the
+ *  part.
+ */
+class SimulatedCpld
+{
+  public:
+    /** @brief Constructs a blank device.
+     *
+     *  @param[in] part - The part and the faults to inject
+     */
+    explicit SimulatedCpld(const SimulatedCpldConfig& part = {});
+
+    /** @brief Get the length of the data register an instruction selects.
+     *
+     *  @param[in] opcode - The instruction
+     *
+     *  @return The length in bits; 1 for BYPASS and unknown instructions
+     */
+    static size_t registerBits(uint8_t opcode);
+
+    /** @brief Execute an instruction that takes no data when it is loaded.
+     *
+     *  @param[in] opcode - The instruction
+     */
+    void select(uint8_t opcode);
+
+    /** @brief Capture the register an instruction reads.
+     *
+     *  @param[in]     opcode - The instruction
+     *  @param[in,out] value  - Receives the register, at the length it has
+     *                          on entry; reads of several pages continue
+     *                          with the following ones
+     */
+    void capture(uint8_t opcode, BitVector& value);
+
+    /** @brief Execute an instruction with the data shifted in.
+     *
+     *  @param[in] opcode - The instruction
+     *  @param[in] value  - The data register
+     */
+    void update(uint8_t opcode, const BitVector& value);
+
+    /** @brief Get a configuration flash page */
+    const BitVector& configPage(size_t page) const
+    {
+        return config.at(page);
+    }
+
+    /** @brief Get the USERCODE */
+    uint32_t usercode() const
+    {
+        return user;
+    }
+
+    /** @brief Whether the DONE bit is programmed */
+    bool done() const
+    {
+        return doneBit;
+    }
+
+    /** @brief Get the statistics so far */
+    const SimulatedCpldStats& stats() const
+    {
+        return counters;
+    }
+
+    /** @brief Get the IDCODE */
+    uint32_t idcode() const
+    {
+        return settings.idcode;
+    }
+
+  private:
+    /** @brief Check whether the device is still busy; a command arriving
+     *         meanwhile is counted and fails the operation */
+    bool busy();
+
+    /** @brief Start a busy period */
+    void occupy(std::chrono::microseconds time);
+
+    /** @brief Get the pages the address points into */
+    std::vector<BitVector>& sector();
+
+    /** @brief The part and the faults */
+    SimulatedCpldConfig settings;
+
+    /** @brief The flash pages */
+    std::vector<BitVector> config;
+    std::vector<BitVector> ufm;
+
+    /** @brief The other non-volatile registers */
+    uint32_t user = 0;
+    BitVector feature;
+    BitVector feabits;
+    bool doneBit = false;
+
+    /** @brief Whether ISC_ENABLE put the device in programming mode */
+    bool enabled = false;
+
+    /** @brief Whether an operation failed since programming mode began */
+    bool failed = false;
+
+    /** @brief Whether the address points into the UFM */
+    bool ufmSelected = false;
+
+    /** @brief The page address */
+    size_t address = 0;
+
+    /** @brief When the current busy period ends */
+    std::chrono::steady_clock::time_point busyUntil{};
+
+    /** @brief The statistics */
+    SimulatedCpldStats counters;
+};
+
+/** @class SimulatedChain
+ *  @brief JtagInterface over simulated devices, in place of a JTAG
+ *         controller.
+ *  @details Every operation is clocked through the IEEE 1149.1 TAP state
+ *  machine of each device, one TCK at a time, with the devices' IR and DR
+ *  shift registers in series; Capture and Update states call into the
+ *  device models. Clocks in a stable state take their time at the
+ *  frequency set, shifts are instant.
+ *
+ *  Chains are shared by their spec for the life of the process, so an
+ *  update can be verified afterwards, see openSimulatedChain().
+ */
+class SimulatedChain : public JtagInterface
+{
+  public:
+    /** @brief Constructs SimulatedChain.
+     *
+     *  @param[in] models - The devices, the one nearest TDO first
+     */
+    explicit SimulatedChain(std::vector<std::shared_ptr<SimulatedCpld>> models);
+
+    void setFrequency(uint32_t hz) override
+    {
+        frequency = hz;
+    }
+
+    void setTrst(bool asserted) override;
+    void moveTo(TapState state) override;
+    void idle(uint32_t tck) override;
+    bool idleNow(uint32_t tck) override;
+    void shift(ScanType type, const BitVector& tdi, BitVector* tdo,
+               TapState endState) override;
+
+    TapState state() const override
+    {
+        return current;
+    }
+
+    /** @brief Fail every operation with EIO once a number of scans was
+     *         made, as a disconnected cable would.
+     *
+     *  @param[in] scans - The scans to let through
+     */
+    void failAfter(uint64_t scans)
+    {
+        scansLeft = scans;
+    }
+
+    /** @brief Get a device, the one nearest TDO first */
+    SimulatedCpld& device(size_t index)
+    {
+        return *devices.at(index).model;
+    }
+
+  private:
+    /** @struct Tap
+     *  @brief The TAP controller registers of a device.
+     */
+    struct Tap
+    {
+        std::shared_ptr<SimulatedCpld> model;
+
+        /** @brief The instruction in effect */
+        uint8_t instruction = 0;
+
+        /** @brief The shift registers */
+        BitVector ir;
+        BitVector dr;
+    };
+
+    /** @brief Clock TCK once; returns TDO */
+    bool clock(bool tms, bool tdi);
+
+    /** @brief Reset the TAP controllers */
+    void reset();
+
+    /** @brief Count a scan against failAfter() */
+    void countScan();
+
+    /** @brief The devices, the one nearest TDO first */
+    std::vector<Tap> devices;
+
+    /** @brief The TAP state */
+    TapState current = TapState::Reset;
+
+    /** @brief The TCK frequency */
+    uint32_t frequency = 0;
+
+    /** @brief Scans left before failing */
+    std::optional<uint64_t> scansLeft;
+};
+
+/** @class SimulatedI2cBus
+ *  @brief I2cBus answering for the config port of a simulated device.
+ */
+class SimulatedI2cBus : public I2cBus
+{
+  public:
+    /** @brief Constructs SimulatedI2cBus.
+     *
+     *  @param[in] model - The device behind the config port
+     *  @param[in] stops - Whether to accept I2C_M_STOP within a transfer
+     */
+    explicit SimulatedI2cBus(std::shared_ptr<SimulatedCpld> model,
+                             bool stops = true) :
+        model(std::move(model)), stops(stops)
+    {}
+
+    void transfer(std::span<i2c_msg> messages) override;
+
+    bool canStop() const override
+    {
+        return stops;
+    }
+
+  private:
+    /** @brief The device */
+    std::shared_ptr<SimulatedCpld> model;
+
+    /** @brief Whether I2C_M_STOP is accepted */
+    bool stops;
+
+    /** @brief Register data, reused across messages */
+    BitVector value;
+};
+
+/** @brief Check whether a device node names a simulated chain.
+ *  @details Inline, so builds without the simulator can still tell the
+ *  spec apart and refuse it.
+ *
+ *  @param[in] device - The device node
+ *
+ *  @return true for sim:... and sim-i2c:...
+ */
+inline bool isSimulatedDevice(const std::string& device)
+{
+    return device.starts_with("sim:") || device.starts_with("sim-i2c:");
+}
+
+/** @brief Open the simulated backend a device node names.
+ *  @details sim:[IDCODE,...] is a JTAG chain of devices with those IDCODEs,
+ *  the one nearest TDO first, and sim-i2c:[IDCODE] the config port of a
+ *  single device; a MachXO2-1200 if no IDCODE is given. The devices of a
+ *  spec persist for the life of the process.
+ *
+ *  @param[in] device - The device node
+ *
+ *  @return The backend
+ *  @error  std::invalid_argument for a malformed IDCODE
+ */
+std::unique_ptr<JtagInterface> openSimulatedChain(const std::string& device);
+
+} // namespace updater
+} // namespace software
+} // namespace wistron
@@ -0,0 +1,147 @@
+#include "lattice_busy_wait.hpp"
+
+#include "lattice_isc.hpp"
+
+#include <algorithm>
+#include <array>
+#include <thread>
+
+namespace wistron
+{
+namespace software
+{
+namespace updater
+{
+
+namespace
+{
+
+/** @brief Instructions whose RUNTEST waits for the internal busy flag */
+constexpr std::array<uint8_t, 6> busyInstructions = {
+    lattice::ISC_ERASE,        lattice::ISC_PROGRAM_DONE,
+    lattice::LSC_PROG_INCR_NV, lattice::ISC_PROGRAM_USERCODE,
+    lattice::LSC_PROG_FEATURE, lattice::LSC_PROG_FEABITS,
+};
+
+/** @brief Busy instructions the SVF may shift further operands through
+ *         without repeating the SIR. Loading the others again would start
+ *         them over, as ISC_ERASE and ISC_PROGRAM_DONE do in Run-Test/Idle. */
+constexpr std::array<uint8_t, 4> operandInstructions = {
+    lattice::LSC_PROG_INCR_NV,
+    lattice::ISC_PROGRAM_USERCODE,
+    lattice::LSC_PROG_FEATURE,
+    lattice::LSC_PROG_FEABITS,
+};
+
+constexpr auto firstPollInterval = std::chrono::microseconds(100);
+constexpr auto maxPollInterval = std::chrono::milliseconds(10);
+
+} // namespace
+
+void LatticeBusyWait::observe(const ScanOp& op)
+{
+    if (op.type != ScanType::IR)
+    {
+        // The IDCODE the SVF expects tells whether the device is a Lattice
+        // part at all; the opcodes mean something else to other vendors.
+        if (instruction &&
+            instruction->tdi.data()[0] == lattice::IDCODE_PUB &&
+            op.tdo.size() == 32)
+        {
+            uint32_t idcode = 0;
+            for (size_t i = 0; i < 32; ++i)
+            {
+                idcode |= static_cast<uint32_t>(op.tdo.test(i)) << i;
+            }
+            lattice = (idcode & 0xfff) == lattice::manufacturerId;
+        }
+        return;
+    }
+
+    if (op.tdi.size() == lattice::irBits)
+    {
+        instruction = op;
+    }
+    else
+    {
+        instruction.reset();
+    }
+}
+
+bool LatticeBusyWait::busy(JtagInterface& jtag)
+{
+    BitVector readStatus(lattice::irBits);
+    readStatus.data()[0] = lattice::LSC_READ_STATUS;
+    jtag.shift(ScanType::IR, readStatus, nullptr, TapState::Idle);
+    jtag.shift(ScanType::DR, BitVector(lattice::statusBits), &status,
+               TapState::Idle);
+    return status.test(lattice::statusBusyBit);
+}
+
+bool LatticeBusyWait::wait(JtagInterface& jtag, const RunTestOp& op)
+{
+    if (!lattice || !instruction || op.runState != TapState::Idle ||
+        op.minTime <= 0 ||
+        std::ranges::find(busyInstructions, instruction->tdi.data()[0]) ==
+            busyInstructions.end())
+    {
+        return false;
+    }
+
+    // As in SvfPlayer, the time runs from the first clock.
+    using Clock = std::chrono::steady_clock;
+    jtag.flush();
+    auto start = Clock::now();
+    auto deadline =
+        start + std::chrono::duration_cast<Clock::duration>(
+                    std::chrono::duration<double>(op.minTime));
+    jtag.idle(op.tck);
+    jtag.flush();
+    auto interval = std::chrono::duration_cast<Clock::duration>(
+        firstPollInterval);
+
+    bool ready = !busy(jtag);
+    while (!ready)
+    {
+        auto now = Clock::now();
+        if (now >= deadline)
+        {
+            break;
+        }
+        std::this_thread::sleep_for(
+            std::min<Clock::duration>(interval, deadline - now));
+        interval = std::min<Clock::duration>(interval * 2, maxPollInterval);
+        ready = !busy(jtag);
+    }
+
+    // Load the interrupted instruction again if the SVF may shift more
+    // data through it without repeating the SIR.
+    if (std::ranges::find(operandInstructions, instruction->tdi.data()[0]) !=
+        operandInstructions.end())
+    {
+        jtag.shift(ScanType::IR, instruction->tdi, nullptr, TapState::Idle);
+    }
+    else
+    {
+        instruction.reset();
+    }
+
+    if (ready)
+    {
+        auto elapsed = Clock::now() - start;
+        ++waitStats.shortened;
+        if (elapsed < deadline - start)
+        {
+            waitStats.saved += deadline - start - elapsed;
+        }
+    }
+    else
+    {
+        ++waitStats.expired;
+    }
+    return true;
+}
+
+} // namespace updater
+} // namespace software
+} // namespace wistron
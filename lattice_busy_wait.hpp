@@ -0,0 +1,96 @@
+#pragma once
+
+#include "jtag.hpp"
+#include "ops.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <optional>
+
+namespace wistron
+{
+namespace software
+{
+namespace updater
+{
+
+/** @struct BusyWaitStats
+ *  @brief What polling the busy flag achieved over a playback.
+ */
+struct BusyWaitStats
+{
+    /** @brief Delays ended early because the device reported ready */
+    uint64_t shortened = 0;
+
+    /** @brief Delays the device stayed busy for until the SVF's minimum */
+    uint64_t expired = 0;
+
+    /** @brief Time saved against the SVF's minimum delays */
+    std::chrono::nanoseconds saved{0};
+};
+
+/** @class LatticeBusyWait
+ *  @brief Replaces the padded RUNTEST delays of Lattice ISC program and erase
+ *         sequences by polling the device's busy flag.
+ *  @details Vendor SVFs follow every row program, erase and DONE bit program
+ *  with a worst-case RUNTEST delay. When the instruction preceding such a
+ *  RUNTEST is one of those ISC operations, the status register is read with
+ *  LSC_READ_STATUS until its busy bit clears, bounded by the SVF's minimum
+ *  delay. The interrupted instruction is loaded again afterwards if it
+ *  takes an operand, so the following scans see the instruction register
+ *  the SVF left; instructions without one would run again.
+ *
+ *  Polling only starts once the SVF checked for a Lattice IDCODE, other
+ *  vendors' parts give the opcodes meanings of their own.
+ */
+class LatticeBusyWait
+{
+  public:
+    /** @brief Note a scan the player executed.
+     *
+     *  @param[in] op - The scan
+     */
+    void observe(const ScanOp& op);
+
+    /** @brief Wait out a RUNTEST by polling, if it follows a known busy
+     *         operation.
+     *  @details The TAP has to be in op.runState already. On success the
+     *  RUNTEST's clocks were issued and the TAP is back in op.runState.
+     *
+     *  @param[in] jtag - The JTAG backend
+     *  @param[in] op   - The RUNTEST
+     *
+     *  @return false if the pattern is not recognized and the caller has to
+     *          run the RUNTEST itself
+     */
+    bool wait(JtagInterface& jtag, const RunTestOp& op);
+
+    /** @brief Get the statistics so far */
+    const BusyWaitStats& stats() const
+    {
+        return waitStats;
+    }
+
+  private:
+    /** @brief Read the status register.
+     *
+     *  @return true if the device reports busy
+     */
+    bool busy(JtagInterface& jtag);
+
+    /** @brief The last instruction scan, if it was an 8 bit one */
+    std::optional<ScanOp> instruction;
+
+    /** @brief Whether the last IDCODE the SVF expects is a Lattice one */
+    bool lattice = false;
+
+    /** @brief The statistics */
+    BusyWaitStats waitStats;
+
+    /** @brief Captured status, reused across polls */
+    BitVector status;
+};
+
+} // namespace updater
+} // namespace software
+} // namespace wistron
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace wistron
+{
+namespace software
+{
+namespace updater
+{
+namespace lattice
+{
+
+// MachXO2/MachXO3 sysCONFIG instructions (8 bit IR), see Lattice TN1204.
+constexpr uint8_t ISC_ERASE = 0x0e;
+constexpr uint8_t LSC_PRELOAD = 0x1c;
+constexpr uint8_t ISC_DISABLE = 0x26;
+constexpr uint8_t LSC_READ_STATUS = 0x3c;
+constexpr uint8_t LSC_INIT_ADDRESS = 0x46;
+constexpr uint8_t LSC_INIT_ADDR_UFM = 0x47;
+constexpr uint8_t ISC_PROGRAM_DONE = 0x5e;
+constexpr uint8_t LSC_PROG_INCR_NV = 0x70;
+constexpr uint8_t LSC_READ_INCR_NV = 0x73;
+constexpr uint8_t ISC_ENABLE_X = 0x74;
+constexpr uint8_t LSC_REFRESH = 0x79;
+constexpr uint8_t LSC_WRITE_ADDRESS = 0xb4;
+constexpr uint8_t USERCODE = 0xc0;
+constexpr uint8_t ISC_PROGRAM_USERCODE = 0xc2;
+constexpr uint8_t ISC_ENABLE = 0xc6;
+constexpr uint8_t LSC_READ_UFM = 0xca;
+constexpr uint8_t IDCODE_PUB = 0xe0;
+constexpr uint8_t LSC_PROG_FEATURE = 0xe4;
+constexpr uint8_t LSC_READ_FEATURE = 0xe7;
+constexpr uint8_t LSC_CHECK_BUSY = 0xf0;
+constexpr uint8_t LSC_PROG_FEABITS = 0xf8;
+constexpr uint8_t LSC_READ_FEABITS = 0xfb;
+constexpr uint8_t ISC_NOOP = 0xff;
+
+/** @brief The instruction register length */
+constexpr size_t irBits = 8;
+
+/** @brief The length of a configuration flash or UFM page */
+constexpr size_t pageBits = 128;
+
+/** @brief The status register length and its busy bit */
+constexpr size_t statusBits = 32;
+constexpr size_t statusBusyBit = 12;
+
+/** @brief The JEDEC manufacturer field of Lattice IDCODEs, bits 11..0 */
+constexpr uint32_t manufacturerId = 0x043;
+
+} // namespace lattice
+} // namespace updater
+} // namespace software
+} // namespace wistron
@@ -0,0 +1,68 @@
+#include "mapped_file.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <system_error>
+
+namespace wistron
+{
+namespace software
+{
+namespace updater
+{
+
+MappedFile::MappedFile(const std::string& path)
+{
+    auto fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        auto error = errno;
+        throw std::system_error(error, std::generic_category(),
+                                "Failed to open " + path);
+    }
+
+    struct stat st
+    {};
+    if (fstat(fd, &st) < 0)
+    {
+        auto error = errno;
+        close(fd);
+        throw std::system_error(error, std::generic_category(),
+                                "Failed to stat " + path);
+    }
+
+    length = static_cast<size_t>(st.st_size);
+    if (length != 0)
+    {
+        addr = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (addr == MAP_FAILED)
+        {
+            auto error = errno;
+            addr = nullptr;
+            close(fd);
+            throw std::system_error(error, std::generic_category(),
+                                    "Failed to map " + path);
+        }
+        // The file is read once front to back.
+        madvise(addr, length, MADV_SEQUENTIAL);
+    }
+
+    // The mapping stays valid without the descriptor.
+    close(fd);
+}
+
+MappedFile::~MappedFile()
+{
+    if (addr)
+    {
+        munmap(addr, length);
+    }
+}
+
+} // namespace updater
+} // namespace software
+} // namespace wistron
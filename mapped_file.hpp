@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+namespace wistron
+{
+namespace software
+{
+namespace updater
+{
+
+/** @class MappedFile
+ *  @brief RAII read-only memory mapping of a whole file.
+ *  @details Images live in tmpfs, so mapping them shares the page cache
+ *  pages instead of copying the file onto the heap.
+ */
+class MappedFile
+{
+  public:
+    /** @brief Maps a file.
+     *
+     *  @param[in] path - The file to map
+     *
+     *  @error  std::system_error if the file can not be opened or mapped
+     */
+    explicit MappedFile(const std::string& path);
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    MappedFile(MappedFile&&) = delete;
+    MappedFile& operator=(MappedFile&&) = delete;
+
+    ~MappedFile();
+
+    /** @brief The file contents */
+    std::string_view view() const
+    {
+        return {static_cast<const char*>(addr), length};
+    }
+
+  private:
+    /** @brief The mapping, null for an empty file */
+    void* addr = nullptr;
+
+    /** @brief The mapping length in bytes */
+    size_t length = 0;
+};
+
+} // namespace updater
+} // namespace software
+} // namespace wistron
@@ -0,0 +1,227 @@
+#pragma once
+
+#include "bit_vector.hpp"
+#include "jtag.hpp"
+#include "tap_state.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <optional>
+#include <utility>
+#include <variant>
+#include <vector>
+
+namespace wistron
+{
+namespace software
+{
+namespace updater
+{
+
+/** @struct ScanOp
+ *  @brief A complete SIR/SDR scan, header and trailer bits included.
+ */
+struct ScanOp
+{
+    /** @brief The register to shift through */
+    ScanType type = ScanType::DR;
+
+    /** @brief The bits to shift in; empty for a fill scan */
+    BitVector tdi;
+
+    /** @brief The TDI level of a fill scan, which shifts the same value
+     *         into every bit without storing them; unset when tdi holds
+     *         the bits */
+    std::optional<bool> fill;
+
+    /** @brief The length of a fill scan in bits */
+    size_t fillBits = 0;
+
+    /** @brief The expected TDO; empty when nothing is checked */
+    BitVector tdo;
+
+    /** @brief The TDO compare mask; sized like tdo */
+    BitVector mask;
+
+    /** @brief The stable state to end in (ENDIR/ENDDR) */
+    TapState endState = TapState::Idle;
+
+    /** @brief Get the length of the scan in bits */
+    size_t bits() const
+    {
+        return fill ? fillBits : tdi.size();
+    }
+};
+
+/** @struct RunTestOp
+ *  @brief A RUNTEST: clock and/or wait in a stable state.
+ */
+struct RunTestOp
+{
+    /** @brief The state to clock in */
+    TapState runState = TapState::Idle;
+
+    /** @brief The number of TCK cycles to clock */
+    uint32_t tck = 0;
+
+    /** @brief The minimum time to spend in runState, in seconds */
+    double minTime = 0;
+
+    /** @brief The maximum time allowed, in seconds; 0 if unbounded */
+    double maxTime = 0;
+
+    /** @brief The stable state to end in */
+    TapState endState = TapState::Idle;
+};
+
+/** @struct StateOp
+ *  @brief A STATE command: walk the TAP through the listed states.
+ */
+struct StateOp
+{
+    /** @brief The states to walk through; the last one is stable */
+    std::vector<TapState> path;
+};
+
+/** @struct FrequencyOp
+ *  @brief A FREQUENCY command.
+ */
+struct FrequencyOp
+{
+    /** @brief The maximum TCK frequency in Hz; 0 for full speed */
+    double hz = 0;
+};
+
+/** @struct TrstOp
+ *  @brief A TRST ON/OFF command.
+ */
+struct TrstOp
+{
+    /** @brief Whether TRST is asserted */
+    bool asserted = false;
+};
+
+/** @brief One operation of the programming engine. */
+using SvfOp = std::variant<ScanOp, RunTestOp, StateOp, FrequencyOp, TrstOp>;
+
+/** @class ScanRecycler
+ *  @brief Keeps the buffers of the scans in an operation stream for reuse.
+ *  @details A decoding source passes every operation it fills through the
+ *  recycler. A scan decodes into the buffers the operation already holds,
+ *  and a scan the operation held before a RUNTEST or STATE is kept aside
+ *  for the next scan rather than freed, so a stream replays without
+ *  allocating once the largest scans were seen.
+ */
+class ScanRecycler
+{
+  public:
+    /** @brief Constructs ScanRecycler.
+     *
+     *  @param[in] resource - The memory resource scan buffers come from
+     */
+    explicit ScanRecycler(std::pmr::memory_resource* resource) :
+        resource(resource)
+    {
+        spares.reserve(maxSpares);
+    }
+
+    /** @brief Get the memory resource scan buffers come from */
+    std::pmr::memory_resource* memoryResource() const
+    {
+        return resource;
+    }
+
+    /** @brief Turn an operation into a scan to decode into.
+     *
+     *  @param[in,out] op - The operation
+     *
+     *  @return The scan; its contents are to be overwritten
+     */
+    ScanOp& scan(SvfOp& op)
+    {
+        auto* scan = std::get_if<ScanOp>(&op);
+        if (scan && scan->tdi.resource() == resource)
+        {
+            scan->fill.reset();
+            return *scan;
+        }
+
+        if (!spares.empty())
+        {
+            auto& reused = op.emplace<ScanOp>(std::move(spares.back()));
+            spares.pop_back();
+            reused.fill.reset();
+            return reused;
+        }
+
+        auto& fresh = op.emplace<ScanOp>();
+        fresh.tdi = BitVector(resource);
+        fresh.tdo = BitVector(resource);
+        fresh.mask = BitVector(resource);
+        return fresh;
+    }
+
+    /** @brief Turn an operation into another kind, keeping a scan it held.
+     *
+     *  @param[in,out] op    - The operation
+     *  @param[in]     value - The new operation
+     */
+    template <typename T>
+    void assign(SvfOp& op, T&& value)
+    {
+        auto* scan = std::get_if<ScanOp>(&op);
+        if (scan && scan->tdi.resource() == resource &&
+            spares.size() < maxSpares)
+        {
+            spares.push_back(std::move(*scan));
+        }
+        op = std::forward<T>(value);
+    }
+
+  private:
+    /** @brief The most scans kept aside; covers the scans one RUNTEST or
+     *         STATE displaces in a pipeline's ring many times over */
+    static constexpr size_t maxSpares = 64;
+
+    /** @brief The memory resource scan buffers come from */
+    std::pmr::memory_resource* resource;
+
+    /** @brief Scans kept aside */
+    std::vector<ScanOp> spares;
+};
+
+/** @class OpSource
+ *  @brief A stream of operations, e.g. parsed SVF or a compiled image.
+ */
+class OpSource
+{
+  public:
+    OpSource() = default;
+    OpSource(const OpSource&) = delete;
+    OpSource& operator=(const OpSource&) = delete;
+    OpSource(OpSource&&) = delete;
+    OpSource& operator=(OpSource&&) = delete;
+    virtual ~OpSource() = default;
+
+    /** @brief Read the next operation.
+     *
+     *  @param[out] op - The operation
+     *
+     *  @return false once the end of the stream is reached
+     */
+    virtual bool next(SvfOp& op) = 0;
+
+    /** @brief The input position reached, in bytes */
+    virtual size_t offset() const = 0;
+
+    /** @brief The total input size in bytes */
+    virtual size_t size() const = 0;
+
+    /** @brief The source line of the last operation read */
+    virtual size_t line() const = 0;
+};
+
+} // namespace updater
+} // namespace software
+} // namespace wistron
@@ -0,0 +1,107 @@
+#include "pipelined_source.hpp"
+
+#include <utility>
+
+namespace wistron
+{
+namespace software
+{
+namespace updater
+{
+
+PipelinedSource::PipelinedSource(OpSource& source, size_t depth) :
+    source(source), ring(depth), totalSize(source.size()),
+    producer(&PipelinedSource::produce, this)
+{}
+
+PipelinedSource::~PipelinedSource()
+{
+    // The producer finishes the operation it decodes, finds the ring
+    // drained or stopping set, and returns.
+    stopping = true;
+    ring.drain();
+    producer.join();
+}
+
+void PipelinedSource::produce()
+{
+    while (!stopping)
+    {
+        auto* slot = ring.claim();
+        if (!slot)
+        {
+            ++producerWaits;
+            ring.waitForSpace();
+            continue;
+        }
+
+        try
+        {
+            slot->end = !source.next(slot->op);
+            slot->offset = source.offset();
+            slot->line = source.line();
+        }
+        catch (...)
+        {
+            slot->end = true;
+            slot->line = source.line();
+            slot->error = std::current_exception();
+        }
+
+        ring.publish();
+        if (slot->end)
+        {
+            return;
+        }
+    }
+}
+
+bool PipelinedSource::next(SvfOp& op)
+{
+    if (ended)
+    {
+        return false;
+    }
+
+    auto* slot = ring.front();
+    if (!slot)
+    {
+        ++consumerStats.consumerWaits;
+        do
+        {
+            ring.waitForData();
+            slot = ring.front();
+        } while (!slot);
+    }
+
+    currentLine = slot->line;
+    if (slot->end)
+    {
+        ended = true;
+        if (slot->error)
+        {
+            std::rethrow_exception(std::exchange(slot->error, nullptr));
+        }
+        return false;
+    }
+
+    currentOffset = slot->offset;
+    std::swap(op, slot->op);
+    ring.release();
+    ++consumerStats.ops;
+    return true;
+}
+
+PipelineStats PipelinedSource::stats() const
+{
+    auto stats = consumerStats;
+    if (ended)
+    {
+        stats.producerWaits = producerWaits;
+    }
+    return stats;
+}
+
+} // namespace updater
+} // namespace software
+} // namespace wistron
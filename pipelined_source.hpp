@@ -0,0 +1,154 @@
+#pragma once
+
+#include "ops.hpp"
+#include "spsc_ring.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <thread>
+
+namespace wistron
+{
+namespace software
+{
+namespace updater
+{
+
+/** @struct PipelineStats
+ *  @brief How the two stages of a pipelined source kept up with each other.
+ */
+struct PipelineStats
+{
+    /** @brief Operations passed through the ring */
+    uint64_t ops = 0;
+
+    /** @brief Times the consumer found the ring empty and had to wait for
+     *         the decoder */
+    uint64_t consumerWaits = 0;
+
+    /** @brief Times the decoder found the ring full and had to wait for the
+     *         consumer */
+    uint64_t producerWaits = 0;
+};
+
+/** @class PipelinedSource
+ *  @brief Decodes an operation stream on a thread of its own, ahead of the
+ *         consumer.
+ *  @details The wrapped source, typically parsing SVF text or reading a
+ *  compiled image, runs on a producer thread that fills a bounded
+ *  single-producer/single-consumer ring. The consumer, the player shifting
+ *  the operations out, only swaps finished operations out of the ring, so
+ *  on a multi-core BMC parsing overlaps the JTAG I/O rather than alternating
+ *  with it. Operations are swapped rather than copied: the consumer's
+ *  previous operation goes back into the slot, and the wrapped source
+ *  decodes into its buffers again, so the ring doubles as a pool of scan
+ *  buffers. An exception of the wrapped source is rethrown to the consumer
+ *  at the position it occurred.
+ *
+ *  The wrapped source must not touch the JTAG chain, as it runs
+ *  concurrently with the consumer.
+ */
+class PipelinedSource : public OpSource
+{
+  public:
+    /** @brief Constructs PipelinedSource and starts decoding.
+     *
+     *  @param[in] source - The source to decode ahead; it must outlive this
+     *                      object
+     *  @param[in] depth  - The number of operations to decode ahead at most
+     */
+    explicit PipelinedSource(OpSource& source, size_t depth = defaultDepth);
+
+    PipelinedSource(const PipelinedSource&) = delete;
+    PipelinedSource& operator=(const PipelinedSource&) = delete;
+    PipelinedSource(PipelinedSource&&) = delete;
+    PipelinedSource& operator=(PipelinedSource&&) = delete;
+
+    /** @brief Stops decoding and joins the producer */
+    ~PipelinedSource() override;
+
+    /** @brief Read the next operation.
+     *
+     *  @param[out] op - The operation; its buffers are reused for decoding
+     *
+     *  @return false once the end of the stream is reached
+     *  @error  Whatever the wrapped source threw
+     */
+    bool next(SvfOp& op) override;
+
+    size_t offset() const override
+    {
+        return currentOffset;
+    }
+
+    size_t size() const override
+    {
+        return totalSize;
+    }
+
+    size_t line() const override
+    {
+        return currentLine;
+    }
+
+    /** @brief Get the statistics so far; valid once next() returned false
+     *         or threw */
+    PipelineStats stats() const;
+
+    /** @brief The default depth, enough to cover a row's worth of scans */
+    static constexpr size_t defaultDepth = 256;
+
+  private:
+    /** @struct Slot
+     *  @brief An operation decoded ahead, with its position.
+     */
+    struct Slot
+    {
+        SvfOp op;
+        size_t offset = 0;
+        size_t line = 0;
+
+        /** @brief Marks the end of the stream */
+        bool end = false;
+
+        /** @brief What ended the stream early, if anything */
+        std::exception_ptr error;
+    };
+
+    /** @brief The producer thread body */
+    void produce();
+
+    /** @brief The source decoded ahead */
+    OpSource& source;
+
+    /** @brief The decoded operations */
+    SpscRing<Slot> ring;
+
+    /** @brief The input size, fixed when decoding starts */
+    size_t totalSize;
+
+    /** @brief The position of the last operation handed out */
+    size_t currentOffset = 0;
+    size_t currentLine = 0;
+
+    /** @brief Whether the end marker was consumed */
+    bool ended = false;
+
+    /** @brief Set to make the producer stop early */
+    std::atomic<bool> stopping = false;
+
+    /** @brief Consumer side statistics */
+    PipelineStats consumerStats;
+
+    /** @brief Producer side statistics, read once the producer is done */
+    uint64_t producerWaits = 0;
+
+    /** @brief The producer */
+    std::thread producer;
+};
+
+} // namespace updater
+} // namespace software
+} // namespace wistron
@@ -0,0 +1,128 @@
+#include "playback_estimate.hpp"
+
+#include <algorithm>
+
+namespace wistron
+{
+namespace software
+{
+namespace updater
+{
+
+void PlaybackEstimator::add(const SvfOp& op)
+{
+    if (const auto* scan = std::get_if<ScanOp>(&op))
+    {
+        // Select, Capture and Shift, the bits, the last one moving to
+        // Exit1, and on to the end state, as JtagDevice clocks a scan.
+        auto ir = scan->type == ScanType::IR;
+        auto select = ir ? TapState::IRSelect : TapState::DRSelect;
+        auto exit = ir ? TapState::IRExit1 : TapState::DRExit1;
+        clock(tmsPath(state, select).length + 2 + scan->bits() +
+              tmsPath(exit, scan->endState).length);
+        bits += scan->bits();
+        state = scan->endState;
+    }
+    else if (const auto* runTest = std::get_if<RunTestOp>(&op))
+    {
+        walk(runTest->runState);
+        auto clocked = clocking;
+        clock(runTest->tck);
+        clocked = clocking - clocked;
+        waiting += std::max(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::duration<double>(runTest->minTime)) -
+                clocked,
+            std::chrono::nanoseconds(0));
+        walk(runTest->endState);
+    }
+    else if (const auto* stateOp = std::get_if<StateOp>(&op))
+    {
+        for (auto to : stateOp->path)
+        {
+            if (isStableState(to))
+            {
+                walk(to);
+            }
+        }
+    }
+    else if (const auto* frequencyOp = std::get_if<FrequencyOp>(&op))
+    {
+        frequency = maxFrequency;
+        if (frequencyOp->hz > 0)
+        {
+            frequency = std::min<uint32_t>(
+                maxFrequency, static_cast<uint32_t>(frequencyOp->hz));
+        }
+    }
+}
+
+void PlaybackEstimator::clock(uint64_t count)
+{
+    clocks += count;
+    if (frequency != 0)
+    {
+        clocking += std::chrono::nanoseconds(count * 1'000'000'000 /
+                                             frequency);
+    }
+}
+
+void PlaybackEstimator::walk(TapState to)
+{
+    if (to == TapState::Reset)
+    {
+        clock(resetPath.length);
+    }
+    else
+    {
+        clock(tmsPath(state, to).length);
+    }
+    state = to;
+}
+
+PlaybackEstimator estimatePlayback(OpSource& source, uint32_t maxFrequency)
+{
+    PlaybackEstimator estimator(maxFrequency);
+    SvfOp op;
+    while (source.next(op))
+    {
+        estimator.add(op);
+    }
+    return estimator;
+}
+
+double playedFraction(const PlaybackEstimator& played,
+                      const PlaybackEstimator& total)
+{
+    double fraction = 0;
+    if (total.duration().count() > 0)
+    {
+        fraction = static_cast<double>(played.duration().count()) /
+                   total.duration().count();
+    }
+    else if (total.tck() > 0)
+    {
+        fraction = static_cast<double>(played.tck()) / total.tck();
+    }
+    return std::clamp(fraction, 0.0, 1.0);
+}
+
+bool EstimatingSource::next(SvfOp& op)
+{
+    // The player asks for the next operation once it is done with the last.
+    completed = estimator;
+    if (!source.next(op))
+    {
+        return false;
+    }
+    estimator.add(op);
+    if (callback)
+    {
+        callback(completed);
+    }
+    return true;
+}
+
+} // namespace updater
+} // namespace software
+} // namespace wistron
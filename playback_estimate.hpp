@@ -0,0 +1,187 @@
+#pragma once
+
+#include "ops.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+
+namespace wistron
+{
+namespace software
+{
+namespace updater
+{
+
+/** @class PlaybackEstimator
+ *  @brief Adds up what playing operations costs on the wire.
+ *  @details Each operation is charged the TCK cycles SvfPlayer and the
+ *  backends clock for it: the TMS walks between states, entering a shift
+ *  through Capture, the scan bits and the RUNTEST clocks. Those take their
+ *  time at the frequency in effect, which FREQUENCY commands lower from
+ *  the maximum as in playback. A RUNTEST takes its clocks or its minimum
+ *  time, whichever is longer, as SvfPlayer plays it.
+ *
+ *  The result is an upper bound: busy flag polling and differential
+ *  programming can only shorten a run. At frequency 0, full speed, clocks
+ *  are taken as free.
+ */
+class PlaybackEstimator
+{
+  public:
+    /** @brief Constructs PlaybackEstimator.
+     *
+     *  @param[in] maxFrequency - The TCK frequency playback starts at and
+     *                            FREQUENCY commands are capped to
+     */
+    explicit PlaybackEstimator(uint32_t maxFrequency) :
+        maxFrequency(maxFrequency), frequency(maxFrequency)
+    {}
+
+    /** @brief Charge an operation.
+     *
+     *  @param[in] op - The operation, in playback order
+     */
+    void add(const SvfOp& op);
+
+    /** @brief Get the TCK cycles charged */
+    uint64_t tck() const
+    {
+        return clocks;
+    }
+
+    /** @brief Get the scan bits charged, a part of tck() */
+    uint64_t scanBits() const
+    {
+        return bits;
+    }
+
+    /** @brief Get the time spent clocking */
+    std::chrono::nanoseconds clockTime() const
+    {
+        return clocking;
+    }
+
+    /** @brief Get the RUNTEST minimum times charged */
+    std::chrono::nanoseconds waitTime() const
+    {
+        return waiting;
+    }
+
+    /** @brief Get the total time */
+    std::chrono::nanoseconds duration() const
+    {
+        return clocking + waiting;
+    }
+
+  private:
+    /** @brief Charge clocks at the frequency in effect */
+    void clock(uint64_t count);
+
+    /** @brief Charge the walk to a state */
+    void walk(TapState to);
+
+    /** @brief The frequency FREQUENCY commands are capped to */
+    uint32_t maxFrequency;
+
+    /** @brief The frequency in effect */
+    uint32_t frequency;
+
+    /** @brief The TAP state after the operations so far */
+    TapState state = TapState::Reset;
+
+    /** @brief The totals */
+    uint64_t clocks = 0;
+    uint64_t bits = 0;
+    std::chrono::nanoseconds clocking{0};
+    std::chrono::nanoseconds waiting{0};
+};
+
+/** @brief Estimate playing a whole operation stream.
+ *
+ *  @param[in] source       - The operations
+ *  @param[in] maxFrequency - The TCK frequency to play at
+ *
+ *  @return The totals
+ *  @error  Whatever source throws
+ */
+PlaybackEstimator estimatePlayback(OpSource& source, uint32_t maxFrequency);
+
+/** @brief Get how much of a run has played.
+ *  @details The played time out of the total, so scan bits count at the
+ *  time they take to clock and waits as they pass. At full speed, where
+ *  clocks take no time and a run may have no waits, the TCK cycles are
+ *  compared instead.
+ *
+ *  @param[in] played - The cost of the operations played
+ *  @param[in] total  - The cost of the whole run
+ *
+ *  @return The fraction played, 0 to 1
+ */
+double playedFraction(const PlaybackEstimator& played,
+                      const PlaybackEstimator& total);
+
+/** @class EstimatingSource
+ *  @brief Passes operations through, charging each one to the played cost
+ *         once the player asks for the next, so a run's estimate can be
+ *         checked off as it plays.
+ */
+class EstimatingSource : public OpSource
+{
+  public:
+    /** @brief Callback receiving the played cost before each operation */
+    using PlayedCallback = std::function<void(const PlaybackEstimator&)>;
+
+    /** @brief Constructs EstimatingSource.
+     *
+     *  @param[in] source       - The operations to pass on
+     *  @param[in] maxFrequency - The TCK frequency they are played at
+     *  @param[in] callback     - Invoked for every operation passed on
+     */
+    EstimatingSource(OpSource& source, uint32_t maxFrequency,
+                     PlayedCallback callback = {}) :
+        source(source), estimator(maxFrequency), completed(maxFrequency),
+        callback(std::move(callback))
+    {}
+
+    bool next(SvfOp& op) override;
+
+    size_t offset() const override
+    {
+        return source.offset();
+    }
+
+    size_t size() const override
+    {
+        return source.size();
+    }
+
+    size_t line() const override
+    {
+        return source.line();
+    }
+
+    /** @brief Get the cost of the operations played so far, i.e. all but
+     *         the one passed on last */
+    const PlaybackEstimator& played() const
+    {
+        return completed;
+    }
+
+  private:
+    /** @brief The wrapped stream */
+    OpSource& source;
+
+    /** @brief The cost of the operations passed on */
+    PlaybackEstimator estimator;
+
+    /** @brief The cost of the operations played */
+    PlaybackEstimator completed;
+
+    /** @brief The callback */
+    PlayedCallback callback;
+};
+
+} // namespace updater
+} // namespace software
+} // namespace wistron
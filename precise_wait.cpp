@@ -0,0 +1,113 @@
+#include "precise_wait.hpp"
+
+#include <time.h>
+
+#include <bit>
+#include <cerrno>
+
+namespace wistron
+{
+namespace software
+{
+namespace updater
+{
+
+namespace
+{
+
+using namespace std::chrono_literals;
+
+/** @brief Waits this short are spun, and every wait ends spinning this
+ *         long, which absorbs the jitter of the coarser methods */
+constexpr auto spinTime = 50us;
+
+/** @brief Waits up to this long are filled with TCK idle cycles; beyond it
+ *         sleeping is cheaper than keeping the JTAG engine busy */
+constexpr auto tckIdleLimit = 2ms;
+
+/** @brief How early clock_nanosleep() is asked to return, covering timer
+ *         slack and wakeup latency */
+constexpr auto sleepMargin = 200us;
+
+} // namespace
+
+void OvershootHistogram::record(std::chrono::nanoseconds value)
+{
+    auto us = static_cast<uint64_t>(
+        std::chrono::ceil<std::chrono::microseconds>(value).count());
+    size_t bucket = us <= 1 ? 0 : std::bit_width(us - 1);
+    buckets[std::min(bucket, bucketCount - 1)]++;
+
+    ++count;
+    total += value;
+    max = std::max(max, value);
+}
+
+std::string OvershootHistogram::summary() const
+{
+    std::string text;
+    for (size_t i = 0; i < buckets.size(); ++i)
+    {
+        if (buckets[i] == 0)
+        {
+            continue;
+        }
+        if (!text.empty())
+        {
+            text += ' ';
+        }
+        text += i + 1 == buckets.size() ? ">" : "<=";
+        text += std::to_string(1ull << std::min(i, buckets.size() - 2));
+        text += "us:" + std::to_string(buckets[i]);
+    }
+    return text;
+}
+
+void PreciseWait::until(Clock::time_point deadline, JtagInterface& jtag,
+                        uint32_t tckHz)
+{
+    auto remaining = deadline - Clock::now();
+
+    // Without a known TCK rate only sleeping and spinning remain.
+    auto sleepAbove =
+        tckHz != 0 ? tckIdleLimit
+                   : std::chrono::duration_cast<std::chrono::microseconds>(
+                         sleepMargin + spinTime);
+    if (remaining > sleepAbove)
+    {
+        // steady_clock is CLOCK_MONOTONIC, so its time points convert
+        // directly to an absolute clock_nanosleep() deadline.
+        auto wake = (deadline - sleepMargin).time_since_epoch();
+        auto seconds = std::chrono::floor<std::chrono::seconds>(wake);
+        timespec ts{};
+        ts.tv_sec = static_cast<time_t>(seconds.count());
+        ts.tv_nsec = static_cast<long>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(wake -
+                                                                 seconds)
+                .count());
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts,
+                               nullptr) == EINTR)
+        {}
+        remaining = deadline - Clock::now();
+    }
+
+    if (remaining > spinTime && tckHz != 0)
+    {
+        auto clocks = std::chrono::duration<double>(remaining - spinTime)
+                          .count() *
+                      tckHz;
+        if (clocks >= 1)
+        {
+            jtag.idleNow(static_cast<uint32_t>(clocks));
+        }
+    }
+
+    while (Clock::now() < deadline)
+    {}
+
+    overshoot.record(Clock::now() - deadline);
+}
+
+} // namespace updater
+} // namespace software
+} // namespace wistron
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "jtag.hpp"
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+namespace wistron
+{
+namespace software
+{
+namespace updater
+{
+
+/** @struct OvershootHistogram
+ *  @brief How late waits returned, in power of two microsecond buckets.
+ */
+struct OvershootHistogram
+{
+    /** @brief The number of buckets; the last one collects everything
+     *         beyond 2^(bucketCount - 2) us */
+    static constexpr size_t bucketCount = 16;
+
+    /** @brief Count a wait.
+     *
+     *  @param[in] overshoot - How late the wait returned
+     */
+    void record(std::chrono::nanoseconds overshoot);
+
+    /** @brief Format the non-empty buckets, e.g. "<=1us:812 <=2us:40" */
+    std::string summary() const;
+
+    /** @brief Waits per bucket; bucket i holds overshoots up to 2^i us,
+     *         bucket 0 those up to 1 us */
+    std::array<uint64_t, bucketCount> buckets{};
+
+    /** @brief The number of waits */
+    uint64_t count = 0;
+
+    /** @brief The sum of all overshoots */
+    std::chrono::nanoseconds total{0};
+
+    /** @brief The largest overshoot */
+    std::chrono::nanoseconds max{0};
+};
+
+/** @class PreciseWait
+ *  @brief The SVF engine's wait primitive.
+ *  @details Relative sleeps on a loaded BMC return milliseconds late, which
+ *  adds up to minutes over thousands of rows. Waits are therefore made
+ *  against an absolute deadline: long ones sleep with clock_nanosleep()
+ *  until shortly before it, medium ones clock TCK in the current stable
+ *  state, whose duration the hardware keeps, and the rest is spun out.
+ */
+class PreciseWait
+{
+  public:
+    using Clock = std::chrono::steady_clock;
+
+    /** @brief Wait until a deadline.
+     *
+     *  @param[in] deadline - When to return
+     *  @param[in] jtag     - The backend to clock TCK on
+     *  @param[in] tckHz    - The TCK frequency; 0 if unknown, which rules
+     *                        out TCK idling
+     */
+    void until(Clock::time_point deadline, JtagInterface& jtag,
+               uint32_t tckHz);
+
+    /** @brief Get the overshoot histogram so far */
+    const OvershootHistogram& histogram() const
+    {
+        return overshoot;
+    }
+
+  private:
+    /** @brief The observed overshoot */
+    OvershootHistogram overshoot;
+};
+
+} // namespace updater
+} // namespace software
+} // namespace wistron
@@ -0,0 +1,711 @@
+#include "config.h"
+
+#include "programmer.hpp"
+
+#include "chain_merger.hpp"
+#include "checkpoint_source.hpp"
+#include "compiled_image.hpp"
+#include "differential_source.hpp"
+#include "i2c_config_port.hpp"
+#include "jbc_source.hpp"
+#include "jtag.hpp"
+#include "jtag_simulator.hpp"
+#include "pipelined_source.hpp"
+#include "scan_arena.hpp"
+#include "serialize.hpp"
+#include "svf_parser.hpp"
+#include "tap_optimizer.hpp"
+#include "tck_calibration.hpp"
+#include "verify_source.hpp"
+#include "xsvf_parser.hpp"
+
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <phosphor-logging/lg2.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <filesystem>
+#include <optional>
+#include <system_error>
+
+namespace wistron
+{
+namespace software
+{
+namespace updater
+{
+
+PHOSPHOR_LOG2_USING;
+
+Programmer::Programmer(sd_event* loop, ProgramRequest request,
+                       ProgressCallback progress, DoneCallback done) :
+    progressCallback(std::move(progress)), doneCallback(std::move(done)),
+    fd(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC))
+{
+    if (fd() < 0)
+    {
+        auto error = errno;
+        throw std::system_error(error, std::generic_category(),
+                                "Error occurred during the eventfd");
+    }
+
+    decltype(eventSource.get()) sourcePtr = nullptr;
+    auto rc = sd_event_add_io(loop, &sourcePtr, fd(), EPOLLIN, callback, this);
+    eventSource.reset(sourcePtr);
+    if (0 > rc)
+    {
+        throw std::system_error(-rc, std::generic_category(),
+                                "Error occurred during the sd_event_add_io");
+    }
+
+    // Held back progress goes out when this fires, should the worker post
+    // nothing more meanwhile.
+    sourcePtr = nullptr;
+    rc = sd_event_add_time(loop, &sourcePtr, CLOCK_MONOTONIC, 0, 0,
+                           flushCallback, this);
+    flushTimer.reset(sourcePtr);
+    if (0 > rc)
+    {
+        throw std::system_error(-rc, std::generic_category(),
+                                "Error occurred during the sd_event_add_time");
+    }
+    sd_event_source_set_enabled(flushTimer.get(), SD_EVENT_OFF);
+
+    worker = std::thread(&Programmer::run, this, std::move(request));
+}
+
+Programmer::~Programmer()
+{
+    {
+        std::lock_guard lock(playerMutex);
+        cancelled = true;
+        if (player)
+        {
+            player->cancel();
+        }
+    }
+
+    if (worker.joinable())
+    {
+        worker.join();
+    }
+}
+
+std::unique_ptr<OpSource>
+    Programmer::openSource(const ProgramRequest& request,
+                           std::pmr::memory_resource* resource)
+{
+    if (request.compiled.valid())
+    {
+        request.compiled.wait();
+    }
+
+    if (request.compiledPath.empty())
+    {
+        return openSvf(request, resource);
+    }
+
+    try
+    {
+        auto reader = std::make_unique<CompiledImageReader>(
+            request.compiledPath, resource);
+        if (request.svfPaths.empty() || reader->builtFrom(request.svfPaths))
+        {
+            return reader;
+        }
+    }
+    catch (const CompiledImageError&)
+    {}
+    catch (const std::system_error&)
+    {}
+
+    if (request.svfPaths.empty())
+    {
+        throw std::runtime_error("No usable image at " + request.compiledPath);
+    }
+
+    try
+    {
+        compileChain(request.svfPaths, request.irLengths,
+                     request.compiledPath);
+        return std::make_unique<CompiledImageReader>(request.compiledPath,
+                                                     resource);
+    }
+    catch (const std::system_error&)
+    {
+        // Without a writable cache the SVF is still good to play.
+        return openSvf(request, resource);
+    }
+}
+
+std::unique_ptr<OpSource>
+    Programmer::openSvf(const ProgramRequest& request,
+                        std::pmr::memory_resource* resource)
+{
+    if (request.svfPaths.empty())
+    {
+        throw std::runtime_error("No SVF to program from");
+    }
+    if (request.svfPaths.size() == 1)
+    {
+        return openOpFile(request.svfPaths.front(), resource);
+    }
+    return std::make_unique<ChainFiles>(request.svfPaths, request.irLengths);
+}
+
+std::unique_ptr<JtagInterface> Programmer::openChain(const std::string& device)
+{
+    if (isI2cDevice(device))
+    {
+        return openI2cConfigPort(device, CPLD_I2C_ADDRESS);
+    }
+    if (isSimulatedDevice(device))
+    {
+#if JTAG_SIMULATOR
+        return openSimulatedChain(device);
+#else
+        throw std::invalid_argument(
+            "Simulated chains are not built in: " + device);
+#endif
+    }
+    return std::make_unique<JtagDevice>(device);
+}
+
+uint32_t Programmer::tckFrequency(JtagInterface& jtag,
+                                  const std::string& device)
+{
+    uint32_t fallback = std::min<uint32_t>(JTAG_FREQUENCY, JTAG_FREQUENCY_CAP);
+
+    TckProfile profile;
+    if (!restoreTckProfile(device, profile))
+    {
+        return fallback;
+    }
+
+    jtag.setFrequency(fallback);
+    if (readIdcodes(jtag) != profile.idcodes)
+    {
+        info("JTAG chain on {DEVICE} changed since calibration, using "
+             "{FREQUENCY} Hz",
+             "DEVICE", device, "FREQUENCY", fallback);
+        return fallback;
+    }
+
+    return withMargin(profile.stableHz, JTAG_FREQUENCY_MARGIN,
+                      JTAG_FREQUENCY_CAP);
+}
+
+void Programmer::run(const ProgramRequest& request)
+{
+    try
+    {
+        if (request.svfPaths.size() == 1 &&
+            isJbcPath(request.svfPaths.front()))
+        {
+            runJbc(request);
+        }
+        else
+        {
+            runSvf(request);
+        }
+    }
+    catch (const TdoMismatch& e)
+    {
+        failure = e.what();
+        mismatch = true;
+    }
+    catch (const JbcError& e)
+    {
+        failure = e.what();
+        mismatch = e.mismatch();
+    }
+    catch (const std::exception& e)
+    {
+        failure = e.what();
+    }
+
+    finished = true;
+    notify();
+}
+
+void Programmer::runSvf(const ProgramRequest& request)
+{
+    // Declared first, so the scan buffers of everything below are gone
+    // when it releases them in one go.
+    ScanArena arena;
+    auto source = openSource(request, &arena);
+    checkCancelled();
+    auto chain = openChain(request.device);
+    auto& jtag = *chain;
+    auto frequency = tckFrequency(jtag, request.device);
+    checkCancelled();
+
+    // The estimate takes a pass of its own over the operations, and the
+    // ones played are checked off against it for the progress. A verify
+    // has no estimate, the player reports how far into the image it is.
+    std::optional<PlaybackEstimator> total;
+    SvfPlayer::ProgressCallback offsetProgress;
+    if (request.verifyOnly)
+    {
+        offsetProgress = [this](uint8_t value) {
+            percent = value;
+            notify();
+        };
+    }
+    else
+    {
+        auto ahead = openSource(request);
+        TapOptimizer optimized(*ahead);
+        total = estimatePlayback(optimized, frequency);
+        estimated = std::chrono::duration_cast<std::chrono::seconds>(
+                        total->duration())
+                        .count();
+        remaining = estimated.load();
+        notify();
+        info("Programming through {DEVICE} takes up to {SECONDS} s: {TCK} "
+             "TCK cycles at {FREQUENCY} Hz and {WAIT_MS} ms of waits",
+             "DEVICE", request.device, "SECONDS", estimated.load(), "TCK",
+             total->tck(), "FREQUENCY", frequency, "WAIT_MS",
+             std::chrono::duration_cast<std::chrono::milliseconds>(
+                 total->waitTime())
+                 .count());
+        checkCancelled();
+    }
+
+    SvfPlayer svfPlayer(jtag, frequency, std::move(offsetProgress));
+    svfPlayer.setSmartWait(SVF_SMART_WAIT);
+    svfPlayer.setVerifyWindow(TDO_VERIFY_WINDOW);
+
+    // Compiled images come optimized, an SVF played directly gets its
+    // redundant TAP transitions dropped here.
+    TapOptimizer optimizer(*source);
+
+    // Decoding runs ahead on a thread of its own. The filters stay on
+    // this one, as the differential one reads rows over the chain.
+    OpSource* decoded = &optimizer;
+    std::unique_ptr<PipelinedSource> pipeline;
+    if (PIPELINED_PLAYBACK)
+    {
+        pipeline = std::make_unique<PipelinedSource>(optimizer);
+        decoded = pipeline.get();
+    }
+
+    // The plan needs a pass of its own over the operations.
+    std::optional<RowPlan> plan;
+    auto checkpointing = !request.verifyOnly && CHECKPOINT_ROWS != 0 &&
+                         !request.checkpointDir.empty();
+    if (!request.verifyOnly && (DIFFERENTIAL_PROGRAMMING || checkpointing))
+    {
+        plan = RowPlan::build(*openSource(request));
+        checkCancelled();
+    }
+
+    // Without its checkpoints a run is not resumed, but goes on.
+    ProgramCheckpoint checkpoint;
+    auto record = [&request, &checkpoint]() {
+        try
+        {
+            storeCheckpoint(request.checkpointDir, checkpoint);
+        }
+        catch (const std::exception& e)
+        {
+            info("Failed to store the checkpoint in {DIR}: {ERROR}", "DIR",
+                 request.checkpointDir, "ERROR", e.what());
+        }
+    };
+
+    std::optional<size_t> resumed;
+    if (checkpointing && plan->reason.empty())
+    {
+        resumed = resumableRows(request, *plan);
+        checkpoint.device = request.device;
+        checkpoint.digest = plan->digest();
+        checkpoint.rows = resumed.value_or(0);
+        checkpoint.running = true;
+        record();
+    }
+    else if (checkpointing)
+    {
+        info("Programming through {DEVICE} can not be resumed: {REASON}",
+             "DEVICE", request.device, "REASON", plan->reason);
+        checkpointing = false;
+    }
+
+    OpSource* ops = decoded;
+    std::unique_ptr<DifferentialSource> differential;
+    std::unique_ptr<VerifySource> verify;
+    std::unique_ptr<CheckpointSource> checkpoints;
+    if (request.verifyOnly)
+    {
+        verify = std::make_unique<VerifySource>(*decoded);
+        ops = verify.get();
+    }
+    else if (DIFFERENTIAL_PROGRAMMING || resumed)
+    {
+        differential = std::make_unique<DifferentialSource>(
+            *decoded, std::move(*plan), jtag, resumed);
+        ops = differential.get();
+    }
+
+    if (checkpointing)
+    {
+        // A checkpoint only counts once the rows before it are on the
+        // device, not queued in the backend.
+        checkpoints = std::make_unique<CheckpointSource>(
+            *ops, CHECKPOINT_ROWS,
+            [&jtag, &checkpoint, &record](size_t rows) {
+            jtag.flush();
+            checkpoint.rows = rows;
+            record();
+        });
+        ops = checkpoints.get();
+    }
+
+    std::unique_ptr<EstimatingSource> estimating;
+    if (total)
+    {
+        estimating = std::make_unique<EstimatingSource>(
+            *ops, frequency, [this, &total](const PlaybackEstimator& played) {
+            postPlayed(*total, played);
+        });
+        ops = estimating.get();
+    }
+
+    attach(&svfPlayer);
+
+    try
+    {
+        svfPlayer.play(*ops);
+    }
+    catch (...)
+    {
+        attach(nullptr);
+        // A run stopped along with the updater stays marked running and is
+        // resumed when it comes back. A failed one is not resumed at all:
+        // it may have left the rows past its checkpoint half written, and
+        // a retry starts over.
+        if (checkpointing && !cancelled)
+        {
+            removeCheckpoint(request.checkpointDir);
+        }
+        throw;
+    }
+
+    attach(nullptr);
+
+    if (total)
+    {
+        percent = 100;
+        remaining = 0;
+        notify();
+    }
+
+    if (verify)
+    {
+        const auto& stats = verify->stats();
+        if (stats.scansCompared == 0)
+        {
+            throw std::runtime_error("The image reads nothing back");
+        }
+        info("Verified through {DEVICE}: {SCANS} scans and {BITS} "
+             "masked bits match, {DROPPED} programming operations "
+             "skipped",
+             "DEVICE", request.device, "SCANS", stats.scansCompared,
+             "BITS", stats.bitsCompared, "DROPPED", stats.opsDropped);
+    }
+    else
+    {
+        info("Programmed through {DEVICE} at {FREQUENCY} Hz, batching "
+             "saved {COUNT} ioctls",
+             "DEVICE", request.device, "FREQUENCY", frequency, "COUNT",
+             jtag.ioctlsSaved());
+    }
+    const auto& overshoot = svfPlayer.waitOvershoot();
+    if (overshoot.count != 0)
+    {
+        info("RUNTEST wait overshoot: {HISTOGRAM}, max {MAX_US} us",
+             "HISTOGRAM", overshoot.summary(), "MAX_US",
+             std::chrono::duration_cast<std::chrono::microseconds>(
+                 overshoot.max)
+                 .count());
+    }
+    if (differential)
+    {
+        const auto& stats = differential->stats();
+        if (stats.rowsResumed != 0)
+        {
+            info("Resumed programming after {RESUMED} rows the interrupted "
+                 "run programmed",
+                 "RESUMED", stats.rowsResumed);
+        }
+        if (stats.fallback.empty())
+        {
+            info("Differential update wrote {WRITTEN} rows and skipped "
+                 "{SKIPPED} unchanged ones",
+                 "WRITTEN", stats.rowsWritten, "SKIPPED",
+                 stats.rowsSkipped);
+        }
+        else
+        {
+            info("Programmed all {WRITTEN} rows, a differential update "
+                 "is not possible: {REASON}",
+                 "WRITTEN", stats.rowsWritten, "REASON", stats.fallback);
+        }
+    }
+    auto arenaStats = arena.stats();
+    info("Scan buffers: {ALLOCATIONS} allocations served by {HEAP} heap "
+         "blocks, peak {PEAK} bytes in use of {ARENA} bytes held",
+         "ALLOCATIONS", arenaStats.allocations, "HEAP",
+         arenaStats.heapAllocations, "PEAK", arenaStats.peakBytesInUse,
+         "ARENA", arenaStats.peakHeapBytes);
+    if (auto stalls = svfPlayer.verifyStalls())
+    {
+        info("The shifter waited {COUNT} times for TDO verification "
+             "to catch up",
+             "COUNT", stalls);
+    }
+    if (auto stats = optimizer.stats(); stats.opsDropped != 0)
+    {
+        info("Dropped {DROPPED} redundant TAP transitions, saving {TMS} "
+             "TMS clocks",
+             "DROPPED", stats.opsDropped, "TMS", stats.tmsSaved);
+    }
+    if (pipeline)
+    {
+        auto stats = pipeline->stats();
+        info("Decoded {OPS} operations ahead, the shifter waited "
+             "{CONSUMER} times and the decoder {PRODUCER} times",
+             "OPS", stats.ops, "CONSUMER", stats.consumerWaits,
+             "PRODUCER", stats.producerWaits);
+    }
+    if (auto stats = svfPlayer.busyWaitStats())
+    {
+        info("Busy polling ended {SHORTENED} delays early and saved "
+             "{SAVED_MS} ms, {EXPIRED} ran to the SVF minimum",
+             "SHORTENED", stats->shortened, "SAVED_MS",
+             std::chrono::duration_cast<std::chrono::milliseconds>(
+                 stats->saved)
+                 .count(),
+             "EXPIRED", stats->expired);
+    }
+}
+
+std::optional<size_t>
+    Programmer::resumableRows(const ProgramRequest& request,
+                              const RowPlan& plan)
+{
+    // The cached image may be gone after a reboot, the one kept along
+    // with the checkpoints is not.
+    std::error_code ec;
+    std::filesystem::create_directories(request.checkpointDir, ec);
+    auto kept = std::filesystem::path(request.checkpointDir) /
+                CPLD_COMPILED_FILE_NAME;
+    if (!request.compiledPath.empty() &&
+        !std::filesystem::equivalent(request.compiledPath, kept, ec))
+    {
+        std::filesystem::copy_file(
+            request.compiledPath, kept,
+            std::filesystem::copy_options::overwrite_existing, ec);
+    }
+
+    ProgramCheckpoint checkpoint;
+    if (!restoreCheckpoint(request.checkpointDir, checkpoint) ||
+        !checkpoint.running || checkpoint.rows == 0 ||
+        checkpoint.device != request.device ||
+        checkpoint.digest != plan.digest())
+    {
+        return std::nullopt;
+    }
+    return checkpoint.rows;
+}
+
+void Programmer::runJbc(const ProgramRequest& request)
+{
+    const auto& path = request.svfPaths.front();
+    ScanArena arena;
+    auto chain = openChain(request.device);
+    auto& jtag = *chain;
+    auto frequency = tckFrequency(jtag, request.device);
+    checkCancelled();
+    SvfPlayer svfPlayer(jtag, frequency, [this](uint8_t value) {
+        percent = value;
+        notify();
+    });
+
+    // The program branches on what it reads back, so it runs right ahead
+    // of the player on this thread, without the decoding pipeline and the
+    // SVF filters in between. Busy flag polling is for Lattice parts only.
+    JbcFile program(path, request.verifyOnly ? "VERIFY" : "PROGRAM", jtag,
+                    &arena);
+    auto logPrinted = [&]() {
+        for (const auto& line : program.printed())
+        {
+            info("{PATH}: {LINE}", "PATH", path, "LINE", line);
+        }
+    };
+
+    attach(&svfPlayer);
+
+    try
+    {
+        svfPlayer.play(program);
+    }
+    catch (...)
+    {
+        attach(nullptr);
+        logPrinted();
+        throw;
+    }
+
+    attach(nullptr);
+
+    logPrinted();
+    info("{ACTION} {PATH} through {DEVICE} at {FREQUENCY} Hz, batching "
+         "saved {COUNT} ioctls",
+         "ACTION", request.verifyOnly ? "Verified" : "Programmed", "PATH",
+         path, "DEVICE", request.device, "FREQUENCY", frequency, "COUNT",
+         jtag.ioctlsSaved());
+}
+
+void Programmer::attach(SvfPlayer* svfPlayer)
+{
+    std::lock_guard lock(playerMutex);
+    player = svfPlayer;
+    if (player && cancelled)
+    {
+        player->cancel();
+    }
+}
+
+void Programmer::checkCancelled() const
+{
+    if (cancelled)
+    {
+        throw std::runtime_error("Programming cancelled");
+    }
+}
+
+void Programmer::postPlayed(const PlaybackEstimator& total,
+                            const PlaybackEstimator& played)
+{
+    // 100 is left for the end of the run, past its final flush.
+    auto value = static_cast<uint8_t>(
+        std::min(99.0, playedFraction(played, total) * 100));
+    auto left = std::chrono::duration_cast<std::chrono::seconds>(
+                    std::max(total.duration() - played.duration(),
+                             std::chrono::nanoseconds(0)))
+                    .count();
+
+    // Waking the loop for every operation would cost more than playing
+    // many of them.
+    if (value != percent || static_cast<uint64_t>(left) != remaining)
+    {
+        percent = value;
+        remaining = left;
+        notify();
+    }
+}
+
+void Programmer::notify()
+{
+    uint64_t value = 1;
+    // Only fails if the counter would overflow, which still wakes the loop.
+    [[maybe_unused]] auto rc = write(fd(), &value, sizeof(value));
+}
+
+std::optional<std::chrono::steady_clock::duration>
+    Programmer::publishable(const ProgrammingProgress& current) const
+{
+    // The start, a new estimate and the end always go out. In between,
+    // the percentage and the time left are paced.
+    if (reported == ProgrammingProgress{} || current.percent == 100 ||
+        current.estimated != reported.estimated)
+    {
+        return std::nullopt;
+    }
+    auto wait = lastReport +
+                std::chrono::milliseconds(PROGRESS_MIN_INTERVAL_MS) -
+                std::chrono::steady_clock::now();
+    if (wait > std::chrono::steady_clock::duration::zero())
+    {
+        return wait;
+    }
+    if (current.percent >= reported.percent + PROGRESS_MIN_DELTA ||
+        current.remaining != reported.remaining)
+    {
+        return std::nullopt;
+    }
+    // Only a percentage step too small to report is left; the worker
+    // posts again once it grows.
+    return std::chrono::steady_clock::duration::max();
+}
+
+void Programmer::publish()
+{
+    ProgrammingProgress current{
+        percent.load(), std::chrono::seconds(estimated.load()),
+        std::chrono::seconds(remaining.load())};
+    if (current == reported || !progressCallback)
+    {
+        return;
+    }
+
+    auto wait = publishable(current);
+    if (!wait)
+    {
+        sd_event_source_set_enabled(flushTimer.get(), SD_EVENT_OFF);
+        reported = current;
+        lastReport = std::chrono::steady_clock::now();
+        progressCallback(current);
+    }
+    else if (*wait != std::chrono::steady_clock::duration::max())
+    {
+        uint64_t now = 0;
+        sd_event_now(sd_event_source_get_event(flushTimer.get()),
+                     CLOCK_MONOTONIC, &now);
+        sd_event_source_set_time(
+            flushTimer.get(),
+            now + std::chrono::ceil<std::chrono::microseconds>(*wait).count());
+        sd_event_source_set_enabled(flushTimer.get(), SD_EVENT_ONESHOT);
+    }
+}
+
+int Programmer::callback(sd_event_source*, int fd, uint32_t revents,
+                         void* userdata)
+{
+    if (!(revents & EPOLLIN))
+    {
+        return 0;
+    }
+
+    uint64_t value = 0;
+    if (0 > read(fd, &value, sizeof(value)) && errno != EAGAIN)
+    {
+        auto error = errno;
+        throw std::system_error(error, std::generic_category(),
+                                "failed to read eventfd");
+    }
+
+    auto programmer = static_cast<Programmer*>(userdata);
+    programmer->publish();
+
+    if (programmer->finished.exchange(false) && programmer->doneCallback)
+    {
+        programmer->doneCallback(programmer->failure);
+    }
+
+    return 0;
+}
+
+int Programmer::flushCallback(sd_event_source*, uint64_t, void* userdata)
+{
+    static_cast<Programmer*>(userdata)->publish();
+    return 0;
+}
+
+} // namespace updater
+} // namespace software
+} // namespace wistron
@@ -0,0 +1,317 @@
+#pragma once
+
+#include "differential_source.hpp"
+#include "playback_estimate.hpp"
+#include "svf_player.hpp"
+#include "watch.hpp"
+
+#include <systemd/sd-event.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace wistron
+{
+namespace software
+{
+namespace updater
+{
+
+/** @struct ProgramRequest
+ *  @brief What to program and through which device.
+ */
+struct ProgramRequest
+{
+    /** @brief The JTAG device node, the I2C adapter of the CPLD's config
+     *         port as /dev/i2c-N[@address], or a simulated chain */
+    std::string device;
+
+    /** @brief The SVF or XSVF sources, one per device of the chain, the
+     *         device nearest TDO first; may be empty if compiledPath holds a
+     *         valid image. Several sources are merged into a single pass.
+     *         A single JBC program is run as is. */
+    std::vector<std::string> svfPaths;
+
+    /** @brief The instruction length per device of svfPaths; missing or 0
+     *         entries are taken from the SVF */
+    std::vector<size_t> irLengths;
+
+    /** @brief The compiled image to replay, rebuilt from svfPaths when it
+     *         is missing or stale */
+    std::string compiledPath;
+
+    /** @brief A background compilation of compiledPath still in flight;
+     *         may be invalid */
+    std::shared_future<void> compiled;
+
+    /** @brief Only read the device back and compare it with the image,
+     *         without erasing or programming */
+    bool verifyOnly = false;
+
+    /** @brief The dir to keep the checkpoints of the run and a copy of
+     *         compiledPath in, to resume it after an interruption; empty
+     *         not to */
+    std::string checkpointDir;
+};
+
+/** @struct ProgrammingProgress
+ *  @brief How far a run got and how long it has left.
+ */
+struct ProgrammingProgress
+{
+    /** @brief The completed percentage (0-100) */
+    uint8_t percent = 0;
+
+    /** @brief The estimated duration of the whole run; 0 if the image
+     *         gives no estimate */
+    std::chrono::seconds estimated{0};
+
+    /** @brief The estimated time left */
+    std::chrono::seconds remaining{0};
+
+    bool operator==(const ProgrammingProgress&) const = default;
+};
+
+/** @class Programmer
+ *  @brief Programs or verifies a CPLD from an SVF file or JBC program on a
+ *         worker thread.
+ *  @details JTAG programming takes minutes, so it runs off the D-Bus event
+ *  loop. The compiled image of the SVF is replayed when one is available.
+ *  The worker wakes the loop through an eventfd hooked up with sd-event,
+ *  and both callbacks are invoked from the loop, so they may safely touch
+ *  D-Bus objects.
+ */
+class Programmer
+{
+  public:
+    /** @brief Callback reporting the progress */
+    using ProgressCallback = std::function<void(const ProgrammingProgress&)>;
+
+    /** @brief Callback invoked once programming ended; the argument is
+     *         empty on success and describes the failure otherwise */
+    using DoneCallback = std::function<void(const std::string&)>;
+
+    /** @brief Starts programming.
+     *
+     *  @param[in] loop     - sd-event object
+     *  @param[in] request  - What to program
+     *  @param[in] progress - The progress callback
+     *  @param[in] done     - The completion callback
+     */
+    Programmer(sd_event* loop, ProgramRequest request,
+               ProgressCallback progress, DoneCallback done);
+
+    Programmer(const Programmer&) = delete;
+    Programmer& operator=(const Programmer&) = delete;
+    Programmer(Programmer&&) = delete;
+    Programmer& operator=(Programmer&&) = delete;
+
+    /** @brief Cancels programming if still running and waits for the
+     *         worker to stop */
+    ~Programmer();
+
+    /** @brief Whether the run failed because the device read back other
+     *         data than the image expects; valid once done was invoked */
+    bool mismatched() const
+    {
+        return mismatch;
+    }
+
+    /** @brief Open the backend a device node names: the config port for
+     *         an I2C adapter, a simulated chain for sim:..., the JTAG chain
+     *         otherwise.
+     *
+     *  @param[in] device - The device node
+     *
+     *  @return The backend
+     *  @error  std::invalid_argument for sim:... unless the simulator is
+     *          built in
+     */
+    static std::unique_ptr<JtagInterface> openChain(const std::string& device);
+
+  private:
+    /** @brief sd-event callback, invoked when the worker posted an update
+     *
+     *  @param[in] s - event source, floating (unused) in our case
+     *  @param[in] fd - eventfd
+     *  @param[in] revents - events that matched for fd
+     *  @param[in] userdata - pointer to Programmer object
+     *  @returns 0 on success, -1 on fail
+     */
+    static int callback(sd_event_source* s, int fd, uint32_t revents,
+                        void* userdata);
+
+    /** @brief The worker thread body */
+    void run(const ProgramRequest& request);
+
+    /** @brief Play the compiled image or the SVF sources of a request */
+    void runSvf(const ProgramRequest& request);
+
+    /** @brief Run the PROGRAM or VERIFY action of a JBC program */
+    void runJbc(const ProgramRequest& request);
+
+    /** @brief Keep a copy of the image in the checkpoint dir of a request
+     *         and get the rows an interrupted run of it programmed.
+     *
+     *  @param[in] request - What to program
+     *  @param[in] plan    - The plan of the image
+     *
+     *  @return The rows of the last checkpoint, if it is of an
+     *          interrupted run of the same image on the same device
+     */
+    static std::optional<size_t> resumableRows(const ProgramRequest& request,
+                                               const RowPlan& plan);
+
+    /** @brief Open the operations to play: the compiled image, rebuilt
+     *         first if needed, or the SVF itself if no image can be built.
+     *
+     *  @param[in] request  - What to program
+     *  @param[in] resource - The memory resource scan data is allocated
+     *                        from
+     *
+     *  @return The operations
+     */
+    static std::unique_ptr<OpSource> openSource(
+        const ProgramRequest& request,
+        std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+
+    /** @brief Open the SVF sources to play directly, merged into one chain
+     *         stream if there are several.
+     *
+     *  @return The operations
+     */
+    static std::unique_ptr<OpSource>
+        openSvf(const ProgramRequest& request,
+                std::pmr::memory_resource* resource);
+
+    /** @brief Pick the TCK frequency for a chain.
+     *  @details The calibrated limit less the configured margin, if the
+     *  chain still holds the devices it was calibrated with, or the default
+     *  frequency otherwise.
+     *
+     *  @param[in] jtag   - The opened chain
+     *  @param[in] device - The JTAG device node
+     *
+     *  @return The frequency in Hz
+     */
+    static uint32_t tckFrequency(JtagInterface& jtag,
+                                 const std::string& device);
+
+    /** @brief Register the player of the run, or clear it.
+     *  @details A player registered after the run was cancelled is
+     *  cancelled right away.
+     *
+     *  @param[in] svfPlayer - The player; nullptr once it is done
+     */
+    void attach(SvfPlayer* svfPlayer);
+
+    /** @brief Stop setting up a run that was cancelled.
+     *
+     *  @error std::runtime_error when cancelled
+     */
+    void checkCancelled() const;
+
+    /** @brief Post the progress of a run from the operations played.
+     *
+     *  @param[in] total  - The cost of the whole run
+     *  @param[in] played - The cost of the operations played so far
+     */
+    void postPlayed(const PlaybackEstimator& total,
+                    const PlaybackEstimator& played);
+
+    /** @brief Whether progress is due to be delivered.
+     *  @details Updates are held back until PROGRESS_MIN_INTERVAL_MS passed
+     *  since the last one, and then until the percentage moved
+     *  PROGRESS_MIN_DELTA or the time left changed, so clients see steady
+     *  progress without a signal for every step.
+     *
+     *  @param[in] current - The progress posted by the worker
+     *
+     *  @return std::nullopt if it is due, else how long until it may be;
+     *          duration::max() if only further progress makes it due
+     */
+    std::optional<std::chrono::steady_clock::duration>
+        publishable(const ProgrammingProgress& current) const;
+
+    /** @brief Deliver the progress posted by the worker if it is due, or
+     *         arm flushTimer for when it will be */
+    void publish();
+
+    /** @brief sd-event callback of flushTimer
+     *
+     *  @param[in] s - event source, floating (unused) in our case
+     *  @param[in] usec - the time the timer was set to (unused)
+     *  @param[in] userdata - the Programmer
+     *
+     *  @return 0
+     */
+    static int flushCallback(sd_event_source* s, uint64_t usec,
+                             void* userdata);
+
+    /** @brief Wake up the event loop */
+    void notify();
+
+    /** @brief The progress callback */
+    ProgressCallback progressCallback;
+
+    /** @brief The completion callback */
+    DoneCallback doneCallback;
+
+    /** @brief eventfd the worker signals */
+    CustomFd fd;
+
+    /** @brief event source */
+    EventSourcePtr eventSource;
+
+    /** @brief Timer delivering progress held back by publishable() */
+    EventSourcePtr flushTimer;
+
+    /** @brief The last progress posted by the worker */
+    std::atomic<uint8_t> percent = 0;
+
+    /** @brief The estimated duration and the time left in seconds, as
+     *         last posted by the worker */
+    std::atomic<uint64_t> estimated = 0;
+    std::atomic<uint64_t> remaining = 0;
+
+    /** @brief The last progress delivered to progressCallback */
+    ProgrammingProgress reported;
+
+    /** @brief When reported was delivered */
+    std::chrono::steady_clock::time_point lastReport{};
+
+    /** @brief Set by the worker once it is done */
+    std::atomic<bool> finished = false;
+
+    /** @brief The failure, written by the worker before finished is set */
+    std::string failure;
+
+    /** @brief Whether failure is a TDO mismatch, written along with it */
+    bool mismatch = false;
+
+    /** @brief Guards player and cancelled */
+    std::mutex playerMutex;
+
+    /** @brief The running player, for cancellation */
+    SvfPlayer* player = nullptr;
+
+    /** @brief Set when the run is to stop, also before it got to play */
+    std::atomic<bool> cancelled = false;
+
+    /** @brief The worker thread */
+    std::thread worker;
+};
+
+} // namespace updater
+} // namespace software
+} // namespace wistron
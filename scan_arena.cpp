@@ -0,0 +1,86 @@
+#include "scan_arena.hpp"
+
+namespace wistron
+{
+namespace software
+{
+namespace updater
+{
+
+namespace
+{
+
+/** @brief The largest buffer pooled; larger ones come from the heap
+ *         directly. Covers the row scans of common CPLDs many times over. */
+constexpr size_t largestPooled = 64 * 1024;
+
+} // namespace
+
+ScanArena::ScanArena() : pools(std::pmr::pool_options{0, largestPooled}, &heap)
+{}
+
+ArenaStats ScanArena::stats() const
+{
+    ArenaStats stats;
+    stats.allocations = allocations.load(std::memory_order_relaxed);
+    stats.heapAllocations = heap.allocations.load(std::memory_order_relaxed);
+    stats.bytesInUse = bytesInUse.load(std::memory_order_relaxed);
+    stats.peakBytesInUse = peakBytesInUse.load(std::memory_order_relaxed);
+    stats.peakHeapBytes = heap.peakBytes.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void* ScanArena::do_allocate(size_t bytes, size_t alignment)
+{
+    auto* p = pools.allocate(bytes, alignment);
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    raise(peakBytesInUse,
+          bytesInUse.fetch_add(bytes, std::memory_order_relaxed) + bytes);
+    return p;
+}
+
+void ScanArena::do_deallocate(void* p, size_t bytes, size_t alignment)
+{
+    pools.deallocate(p, bytes, alignment);
+    bytesInUse.fetch_sub(bytes, std::memory_order_relaxed);
+}
+
+bool ScanArena::do_is_equal(
+    const std::pmr::memory_resource& other) const noexcept
+{
+    return this == &other;
+}
+
+void ScanArena::raise(std::atomic<size_t>& peak, size_t value)
+{
+    auto current = peak.load(std::memory_order_relaxed);
+    while (value > current &&
+           !peak.compare_exchange_weak(current, value,
+                                       std::memory_order_relaxed))
+    {}
+}
+
+void* ScanArena::Heap::do_allocate(size_t bytes, size_t alignment)
+{
+    auto* p = std::pmr::new_delete_resource()->allocate(bytes, alignment);
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    raise(peakBytes, this->bytes.fetch_add(bytes, std::memory_order_relaxed) +
+                         bytes);
+    return p;
+}
+
+void ScanArena::Heap::do_deallocate(void* p, size_t bytes, size_t alignment)
+{
+    std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+    this->bytes.fetch_sub(bytes, std::memory_order_relaxed);
+}
+
+bool ScanArena::Heap::do_is_equal(
+    const std::pmr::memory_resource& other) const noexcept
+{
+    return this == &other;
+}
+
+} // namespace updater
+} // namespace software
+} // namespace wistron
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+
+namespace wistron
+{
+namespace software
+{
+namespace updater
+{
+
+/** @struct ArenaStats
+ *  @brief What a scan arena handed out and what it took from the heap.
+ */
+struct ArenaStats
+{
+    /** @brief Buffers handed out */
+    uint64_t allocations = 0;
+
+    /** @brief Blocks taken from the heap to carve buffers from */
+    uint64_t heapAllocations = 0;
+
+    /** @brief Bytes handed out and not yet returned */
+    size_t bytesInUse = 0;
+
+    /** @brief The most bytes handed out at once */
+    size_t peakBytesInUse = 0;
+
+    /** @brief The most bytes held from the heap at once, i.e. the peak
+     *         arena size */
+    size_t peakHeapBytes = 0;
+};
+
+/** @class ScanArena
+ *  @brief The memory resource the scan buffers of one programming run are
+ *         allocated from.
+ *  @details Buffers are pooled by size class in blocks taken from the heap,
+ *  so a freed buffer is handed out again for the next scan of its size
+ *  and the number of heap allocations levels off once the largest scans
+ *  were seen. All blocks are released in one go when the arena is
+ *  destroyed, at the end of the run or when it is cancelled; every buffer
+ *  allocated from it must be gone by then. Buffers may be allocated and
+ *  freed from any thread, as scans move between the decoding, shifting and
+ *  verifying threads.
+ */
+class ScanArena : public std::pmr::memory_resource
+{
+  public:
+    ScanArena();
+
+    ScanArena(const ScanArena&) = delete;
+    ScanArena& operator=(const ScanArena&) = delete;
+    ScanArena(ScanArena&&) = delete;
+    ScanArena& operator=(ScanArena&&) = delete;
+    ~ScanArena() override = default;
+
+    /** @brief Get the statistics so far */
+    ArenaStats stats() const;
+
+  private:
+    /** @class Heap
+     *  @brief The upstream of the pools, counting what they take.
+     */
+    class Heap : public std::pmr::memory_resource
+    {
+      public:
+        void* do_allocate(size_t bytes, size_t alignment) override;
+        void do_deallocate(void* p, size_t bytes, size_t alignment) override;
+        bool do_is_equal(
+            const std::pmr::memory_resource& other) const noexcept override;
+
+        std::atomic<uint64_t> allocations = 0;
+        std::atomic<size_t> bytes = 0;
+        std::atomic<size_t> peakBytes = 0;
+    };
+
+    void* do_allocate(size_t bytes, size_t alignment) override;
+    void do_deallocate(void* p, size_t bytes, size_t alignment) override;
+    bool do_is_equal(
+        const std::pmr::memory_resource& other) const noexcept override;
+
+    /** @brief Raise a peak to a value if it is higher */
+    static void raise(std::atomic<size_t>& peak, size_t value);
+
+    /** @brief The heap the pools grow from; declared first so it outlives
+     *         them */
+    Heap heap;
+
+    /** @brief The size class pools */
+    std::pmr::synchronized_pool_resource pools;
+
+    std::atomic<uint64_t> allocations = 0;
+    std::atomic<size_t> bytesInUse = 0;
+    std::atomic<size_t> peakBytesInUse = 0;
+};
+
+} // namespace updater
+} // namespace software
+} // namespace wistron
@@ -3,13 +3,20 @@
 #include "serialize.hpp"
 
 #include <cereal/archives/json.hpp>
+#include <cereal/types/vector.hpp>
 #include <sdbusplus/server.hpp>
 #include <phosphor-logging/elog-errors.hpp>
 #include <phosphor-logging/elog.hpp>
 #include <phosphor-logging/lg2.hpp>
 
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
 #include <filesystem>
 #include <fstream>
+#include <system_error>
 
 namespace wistron
 {
@@ -21,6 +28,25 @@ namespace updater
 PHOSPHOR_LOG2_USING;
 using namespace phosphor::logging;
 
+namespace
+{
+
+/** @brief The calibration file of a JTAG device, e.g.
+ *         /var/lib/wistron-cpld-code-mgmt/tck-jtag0 */
+std::string tckProfilePath(const std::string& device)
+{
+    return PERSIST_DIR + std::string("tck-") +
+           std::filesystem::path(device).filename().string();
+}
+
+/** @brief The prefix of checkpoint dirs in PERSIST_DIR */
+constexpr auto checkpointPrefix = "resume-";
+
+/** @brief The checkpoint file in a checkpoint dir */
+constexpr auto checkpointFile = "checkpoint";
+
+} // namespace
+
 void storeToFile(const std::string& versionId, uint8_t priority)
 {
     auto bus = sdbusplus::bus::new_default();
@@ -78,6 +104,171 @@ void removeFile(const std::string& versionId)
     {
         std::filesystem::remove(path);
     }
+
+    // A deleted version is not to be resumed either.
+    std::error_code ec;
+    std::filesystem::remove_all(checkpointDir(versionId), ec);
+}
+
+void storeTckProfile(const std::string& device, const TckProfile& profile)
+{
+    if (!std::filesystem::is_directory(PERSIST_DIR))
+    {
+        std::filesystem::create_directories(PERSIST_DIR);
+    }
+
+    std::ofstream output(tckProfilePath(device));
+    cereal::JSONOutputArchive archive(output);
+    archive(cereal::make_nvp("idcodes", profile.idcodes),
+            cereal::make_nvp("stableHz", profile.stableHz));
+}
+
+bool restoreTckProfile(const std::string& device, TckProfile& profile)
+{
+    auto path = tckProfilePath(device);
+    if (std::filesystem::exists(path))
+    {
+        std::ifstream input(path, std::ios::in);
+        try
+        {
+            cereal::JSONInputArchive archive(input);
+            archive(cereal::make_nvp("idcodes", profile.idcodes),
+                    cereal::make_nvp("stableHz", profile.stableHz));
+            return true;
+        }
+        catch (const cereal::Exception& e)
+        {
+            std::filesystem::remove(path);
+        }
+    }
+
+    return false;
+}
+
+std::string checkpointDir(const std::string& versionId)
+{
+    return PERSIST_DIR + std::string(checkpointPrefix) + versionId;
+}
+
+void storeCheckpoint(const std::string& dir,
+                     const ProgramCheckpoint& checkpoint)
+{
+    auto path = std::filesystem::path(dir) / checkpointFile;
+    auto temporary = path;
+    temporary += ".tmp";
+    {
+        std::ofstream output(temporary);
+        cereal::JSONOutputArchive archive(output);
+        archive(cereal::make_nvp("device", checkpoint.device),
+                cereal::make_nvp("digest", checkpoint.digest),
+                cereal::make_nvp("rows", checkpoint.rows),
+                cereal::make_nvp("running", checkpoint.running));
+    }
+
+    // On disk before it replaces the previous checkpoint, so a power loss
+    // leaves one or the other.
+    int fd = open(temporary.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0 || fsync(fd) < 0)
+    {
+        auto saved = errno;
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+        throw std::system_error(saved, std::generic_category(),
+                                "Failed to store " + path.string());
+    }
+    close(fd);
+    std::filesystem::rename(temporary, path);
+
+    // And the rename itself, or the previous checkpoint may come back.
+    fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0 || fsync(fd) < 0)
+    {
+        auto saved = errno;
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+        throw std::system_error(saved, std::generic_category(),
+                                "Failed to store " + path.string());
+    }
+    close(fd);
+}
+
+bool restoreCheckpoint(const std::string& dir, ProgramCheckpoint& checkpoint)
+{
+    auto path = std::filesystem::path(dir) / checkpointFile;
+    if (std::filesystem::exists(path))
+    {
+        std::ifstream input(path, std::ios::in);
+        try
+        {
+            cereal::JSONInputArchive archive(input);
+            archive(cereal::make_nvp("device", checkpoint.device),
+                    cereal::make_nvp("digest", checkpoint.digest),
+                    cereal::make_nvp("rows", checkpoint.rows),
+                    cereal::make_nvp("running", checkpoint.running));
+            return true;
+        }
+        catch (const cereal::Exception& e)
+        {
+            std::filesystem::remove(path);
+        }
+    }
+
+    return false;
+}
+
+void removeCheckpoint(const std::string& dir)
+{
+    std::error_code ec;
+    std::filesystem::remove(std::filesystem::path(dir) / checkpointFile, ec);
+}
+
+void removeCheckpoints(const std::string& device)
+{
+    std::vector<std::filesystem::path> dirs;
+    std::error_code ec;
+    for (const auto& entry :
+         std::filesystem::directory_iterator(PERSIST_DIR, ec))
+    {
+        ProgramCheckpoint checkpoint;
+        if (entry.is_directory() &&
+            entry.path().filename().string().starts_with(checkpointPrefix) &&
+            restoreCheckpoint(entry.path(), checkpoint) &&
+            checkpoint.device == device)
+        {
+            dirs.push_back(entry.path());
+        }
+    }
+    for (const auto& dir : dirs)
+    {
+        std::filesystem::remove_all(dir, ec);
+    }
+}
+
+std::vector<std::string> interruptedVersions()
+{
+    std::vector<std::string> versionIds;
+    std::error_code ec;
+    for (const auto& entry :
+         std::filesystem::directory_iterator(PERSIST_DIR, ec))
+    {
+        auto name = entry.path().filename().string();
+        if (!entry.is_directory() || !name.starts_with(checkpointPrefix))
+        {
+            continue;
+        }
+
+        auto versionId = name.substr(std::strlen(checkpointPrefix));
+        ProgramCheckpoint checkpoint;
+        if (restoreCheckpoint(entry.path(), checkpoint) && checkpoint.running)
+        {
+            versionIds.push_back(versionId);
+        }
+    }
+    return versionIds;
 }
 
 } // namespace updater
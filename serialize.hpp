@@ -1,6 +1,10 @@
 #pragma once
 
+#include "tck_calibration.hpp"
+
+#include <cstdint>
 #include <string>
+#include <vector>
 
 namespace wistron
 {
@@ -22,11 +26,85 @@ void storeToFile(const std::string& versionId, uint8_t priority);
  */
 bool restoreFromFile(const std::string& versionId, uint8_t& priority);
 
-/** @brief Removes the serial file for a given version.
+/** @brief Removes the serial file and checkpoint dir for a given version.
  *  @param[in] versionId - The version for which to remove a file, if it exists.
  */
 void removeFile(const std::string& versionId);
 
+/** @brief Serialization function - stores the TCK calibration of a chain
+ *  @param[in] device - The JTAG device node the chain hangs off.
+ *  @param[in] profile - The calibration result.
+ */
+void storeTckProfile(const std::string& device, const TckProfile& profile);
+
+/** @brief Serialization function - restores the TCK calibration of a chain
+ *  @param[in] device - The JTAG device node the chain hangs off.
+ *  @param[out] profile - The calibration result.
+ *  @return true if restore was successful, false if not
+ */
+bool restoreTckProfile(const std::string& device, TckProfile& profile);
+
+/** @struct ProgramCheckpoint
+ *  @brief How far programming a version got, to resume it from there.
+ */
+struct ProgramCheckpoint
+{
+    /** @brief The JTAG device node the CPLD is programmed through */
+    std::string device;
+
+    /** @brief RowPlan::digest() of the image being programmed */
+    uint64_t digest = 0;
+
+    /** @brief The configuration rows programmed; 0 until the erase is done
+     *         and the first checkpoint taken */
+    uint64_t rows = 0;
+
+    /** @brief Whether programming was running when this was stored, i.e.
+     *         the updater went down in the middle of it */
+    bool running = false;
+};
+
+/** @brief Get the dir a version keeps its checkpoint, MANIFEST and
+ *         compiled image in while it is programmed, e.g.
+ *         /var/lib/wistron-cpld-code-mgmt/resume-2a1022fe
+ *  @param[in] versionId - The version.
+ *  @return The dir path
+ */
+std::string checkpointDir(const std::string& versionId);
+
+/** @brief Serialization function - stores a programming checkpoint,
+ *         replacing the previous one atomically
+ *  @param[in] dir - The checkpoint dir of the version.
+ *  @param[in] checkpoint - The checkpoint.
+ *  @error std::system_error if it can not be stored
+ */
+void storeCheckpoint(const std::string& dir,
+                     const ProgramCheckpoint& checkpoint);
+
+/** @brief Serialization function - restores a programming checkpoint
+ *  @param[in] dir - The checkpoint dir of the version.
+ *  @param[out] checkpoint - The checkpoint.
+ *  @return true if restore was successful, false if not
+ */
+bool restoreCheckpoint(const std::string& dir, ProgramCheckpoint& checkpoint);
+
+/** @brief Removes a programming checkpoint, keeping the rest of the dir
+ *  @param[in] dir - The checkpoint dir of the version.
+ */
+void removeCheckpoint(const std::string& dir);
+
+/** @brief Removes the checkpoint dirs of every version programmed through
+ *         a device, once a newer image made them stale.
+ *  @param[in] device - The JTAG device node.
+ */
+void removeCheckpoints(const std::string& device);
+
+/** @brief Get the versions whose programming was running when the updater
+ *         went down.
+ *  @return The version ids
+ */
+std::vector<std::string> interruptedVersions();
+
 } // namespace updater
 } // namespace software
 } // namespace wistron
@@ -0,0 +1,145 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+namespace wistron
+{
+namespace software
+{
+namespace updater
+{
+
+/** @class SpscRing
+ *  @brief A bounded single-producer/single-consumer ring of reusable slots.
+ *  @details The slots are constructed once and never freed while the ring
+ *  lives: the producer fills a claimed slot in place and publishes it, the
+ *  consumer reads it and releases it back. Whatever the slot holds, e.g.
+ *  scan buffers, is handed to the producer again for reuse. Only the two
+ *  indices are shared, so neither side takes a lock; a side that runs out
+ *  of slots blocks on the other's index with std::atomic::wait().
+ */
+template <typename T>
+class SpscRing
+{
+  public:
+    /** @brief Constructs SpscRing.
+     *
+     *  @param[in] capacity - The number of slots
+     */
+    explicit SpscRing(size_t capacity) : slots(capacity) {}
+
+    SpscRing(const SpscRing&) = delete;
+    SpscRing& operator=(const SpscRing&) = delete;
+    SpscRing(SpscRing&&) = delete;
+    SpscRing& operator=(SpscRing&&) = delete;
+    ~SpscRing() = default;
+
+    /** @brief Get the next free slot, producer side.
+     *
+     *  @return The slot, or nullptr if all slots are in use
+     */
+    T* claim()
+    {
+        auto h = head.value.load(std::memory_order_relaxed);
+        if (h - tail.value.load(std::memory_order_acquire) == slots.size())
+        {
+            return nullptr;
+        }
+        return &slots[h % slots.size()];
+    }
+
+    /** @brief Wait until a slot is free, producer side.
+     *  @details Returns early once the consumer released the ring with
+     *  drain(), which the caller has to check for.
+     */
+    void waitForSpace()
+    {
+        auto t = tail.value.load(std::memory_order_acquire);
+        if (head.value.load(std::memory_order_relaxed) - t == slots.size())
+        {
+            tail.value.wait(t, std::memory_order_acquire);
+        }
+    }
+
+    /** @brief Wait until the consumer released every published slot,
+     *         producer side */
+    void waitForEmpty()
+    {
+        auto h = head.value.load(std::memory_order_relaxed);
+        for (auto t = tail.value.load(std::memory_order_acquire); t != h;
+             t = tail.value.load(std::memory_order_acquire))
+        {
+            tail.value.wait(t, std::memory_order_acquire);
+        }
+    }
+
+    /** @brief Hand the slot returned by claim() to the consumer */
+    void publish()
+    {
+        head.value.fetch_add(1, std::memory_order_release);
+        head.value.notify_one();
+    }
+
+    /** @brief Get the oldest published slot, consumer side.
+     *
+     *  @return The slot, or nullptr if none is published
+     */
+    T* front()
+    {
+        auto t = tail.value.load(std::memory_order_relaxed);
+        if (head.value.load(std::memory_order_acquire) == t)
+        {
+            return nullptr;
+        }
+        return &slots[t % slots.size()];
+    }
+
+    /** @brief Wait until a slot is published, consumer side */
+    void waitForData()
+    {
+        auto h = head.value.load(std::memory_order_acquire);
+        if (h == tail.value.load(std::memory_order_relaxed))
+        {
+            head.value.wait(h, std::memory_order_acquire);
+        }
+    }
+
+    /** @brief Hand the slot returned by front() back to the producer */
+    void release()
+    {
+        tail.value.fetch_add(1, std::memory_order_release);
+        tail.value.notify_one();
+    }
+
+    /** @brief Release all published slots at once, consumer side; wakes a
+     *         waiting producer */
+    void drain()
+    {
+        tail.value.store(head.value.load(std::memory_order_acquire),
+                         std::memory_order_release);
+        tail.value.notify_one();
+    }
+
+  private:
+    /** @brief An index on a cache line of its own, so the two sides do not
+     *         invalidate each other's line on every update */
+    struct alignas(64) Index
+    {
+        std::atomic<size_t> value = 0;
+    };
+
+    /** @brief The slots */
+    std::vector<T> slots;
+
+    /** @brief Slots published so far, written by the producer */
+    Index head;
+
+    /** @brief Slots released so far, written by the consumer */
+    Index tail;
+};
+
+} // namespace updater
+} // namespace software
+} // namespace wistron
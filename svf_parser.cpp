@@ -0,0 +1,365 @@
+#include "svf_parser.hpp"
+
+#include <cctype>
+#include <charconv>
+
+namespace wistron
+{
+namespace software
+{
+namespace updater
+{
+
+namespace
+{
+
+bool equalsIgnoreCase(std::string_view lhs, std::string_view rhs)
+{
+    if (lhs.size() != rhs.size())
+    {
+        return false;
+    }
+    for (size_t i = 0; i < lhs.size(); ++i)
+    {
+        if (std::toupper(static_cast<unsigned char>(lhs[i])) !=
+            std::toupper(static_cast<unsigned char>(rhs[i])))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/** @brief Strip the parentheses of a data token */
+std::string_view unwrap(std::string_view token)
+{
+    if (token.size() < 2 || token.front() != '(' || token.back() != ')')
+    {
+        return {};
+    }
+    return token.substr(1, token.size() - 2);
+}
+
+} // namespace
+
+bool SvfParser::next(SvfOp& op)
+{
+    while (tokenizer.next(statement))
+    {
+        auto command = statement.command;
+        const auto& args = statement.args;
+
+        if (equalsIgnoreCase(command, "SIR"))
+        {
+            parseScan(sir, false);
+            composeScan(ScanType::IR, hir, sir, tir, endIR,
+                        recycler.scan(op));
+            return true;
+        }
+        if (equalsIgnoreCase(command, "SDR"))
+        {
+            parseScan(sdr, false);
+            composeScan(ScanType::DR, hdr, sdr, tdr, endDR,
+                        recycler.scan(op));
+            return true;
+        }
+        if (equalsIgnoreCase(command, "RUNTEST"))
+        {
+            recycler.assign(op, parseRunTest());
+            return true;
+        }
+        if (equalsIgnoreCase(command, "STATE"))
+        {
+            parseState(op);
+            return true;
+        }
+        if (equalsIgnoreCase(command, "HIR"))
+        {
+            parseScan(hir, true);
+        }
+        else if (equalsIgnoreCase(command, "HDR"))
+        {
+            parseScan(hdr, true);
+        }
+        else if (equalsIgnoreCase(command, "TIR"))
+        {
+            parseScan(tir, true);
+        }
+        else if (equalsIgnoreCase(command, "TDR"))
+        {
+            parseScan(tdr, true);
+        }
+        else if (equalsIgnoreCase(command, "ENDIR") && args.size() == 1)
+        {
+            endIR = parseStableState(args[0]);
+        }
+        else if (equalsIgnoreCase(command, "ENDDR") && args.size() == 1)
+        {
+            endDR = parseStableState(args[0]);
+        }
+        else if (equalsIgnoreCase(command, "FREQUENCY"))
+        {
+            FrequencyOp frequency;
+            if (args.size() == 2 && equalsIgnoreCase(args[1], "HZ"))
+            {
+                frequency.hz = parseNumber(args[0]);
+            }
+            else if (!args.empty())
+            {
+                fail("malformed FREQUENCY");
+            }
+            recycler.assign(op, frequency);
+            return true;
+        }
+        else if (equalsIgnoreCase(command, "TRST") && args.size() == 1)
+        {
+            if (equalsIgnoreCase(args[0], "ON") ||
+                equalsIgnoreCase(args[0], "OFF"))
+            {
+                recycler.assign(op, TrstOp{equalsIgnoreCase(args[0], "ON")});
+                return true;
+            }
+            if (!equalsIgnoreCase(args[0], "Z") &&
+                !equalsIgnoreCase(args[0], "ABSENT"))
+            {
+                fail("malformed TRST");
+            }
+        }
+        else
+        {
+            fail("unsupported statement " + std::string(command));
+        }
+    }
+    return false;
+}
+
+void SvfParser::parseScan(ScanParams& params, bool sticky)
+{
+    const auto& args = statement.args;
+    if (args.empty())
+    {
+        fail("missing scan length");
+    }
+
+    auto length = static_cast<size_t>(parseNumber(args[0]));
+    bool resized = length != params.length;
+    if (resized)
+    {
+        params.length = length;
+        params.tdi.resize(length);
+        params.mask.clear();
+        params.smask.clear();
+        params.tdo.clear();
+    }
+    if (!sticky)
+    {
+        params.tdo.clear();
+    }
+
+    bool hasTdi = false;
+    for (size_t i = 1; i < args.size(); i += 2)
+    {
+        if (i + 1 >= args.size())
+        {
+            fail("missing scan data");
+        }
+
+        auto data = unwrap(args[i + 1]);
+        if (data.data() == nullptr)
+        {
+            fail("scan data must be in parentheses");
+        }
+
+        BitVector* bits = nullptr;
+        if (equalsIgnoreCase(args[i], "TDI"))
+        {
+            bits = &params.tdi;
+            hasTdi = true;
+        }
+        else if (equalsIgnoreCase(args[i], "TDO"))
+        {
+            bits = &params.tdo;
+        }
+        else if (equalsIgnoreCase(args[i], "MASK"))
+        {
+            bits = &params.mask;
+        }
+        else if (equalsIgnoreCase(args[i], "SMASK"))
+        {
+            bits = &params.smask;
+        }
+        else
+        {
+            fail("unknown scan parameter " + std::string(args[i]));
+        }
+
+        try
+        {
+            // Decoded in place, the sticky buffers are reused by every
+            // scan of the same register.
+            bits->decodeHex(data, length);
+        }
+        catch (const std::invalid_argument& e)
+        {
+            fail(e.what());
+        }
+    }
+
+    if (resized && !hasTdi && length != 0)
+    {
+        fail("TDI is required when the scan length changes");
+    }
+}
+
+void SvfParser::composeScan(ScanType type, const ScanParams& header,
+                            const ScanParams& data, const ScanParams& trailer,
+                            TapState endState, ScanOp& scan) const
+{
+    scan.type = type;
+    scan.endState = endState;
+
+    // The header is shifted first, so it occupies the low bits.
+    auto length = header.length + data.length + trailer.length;
+    scan.tdi.resize(length);
+    scan.tdi.assign(0, header.tdi);
+    scan.tdi.assign(header.length, data.tdi);
+    scan.tdi.assign(header.length + data.length, trailer.tdi);
+
+    if (header.tdo.empty() && data.tdo.empty() && trailer.tdo.empty())
+    {
+        scan.tdo.clear();
+        scan.mask.clear();
+        return;
+    }
+
+    scan.tdo.resize(length);
+    scan.mask.resize(length);
+    size_t offset = 0;
+    for (const auto* params : {&header, &data, &trailer})
+    {
+        if (!params->tdo.empty())
+        {
+            scan.tdo.assign(offset, params->tdo);
+            if (params->mask.empty())
+            {
+                scan.mask.fill(offset, params->length, true);
+            }
+            else
+            {
+                scan.mask.assign(offset, params->mask);
+            }
+        }
+        offset += params->length;
+    }
+}
+
+RunTestOp SvfParser::parseRunTest()
+{
+    const auto& args = statement.args;
+    RunTestOp runTest;
+    size_t i = 0;
+
+    if (i < args.size() && parseTapState(args[i]))
+    {
+        runState = parseStableState(args[i]);
+        // An explicit run state is also the default end state.
+        runEndState = runState;
+        ++i;
+    }
+
+    while (i < args.size())
+    {
+        if (equalsIgnoreCase(args[i], "ENDSTATE") && i + 1 < args.size())
+        {
+            runEndState = parseStableState(args[i + 1]);
+            i += 2;
+        }
+        else if (equalsIgnoreCase(args[i], "MAXIMUM") &&
+                 i + 2 < args.size() && equalsIgnoreCase(args[i + 2], "SEC"))
+        {
+            runTest.maxTime = parseNumber(args[i + 1]);
+            i += 3;
+        }
+        else if (i + 1 < args.size() && equalsIgnoreCase(args[i + 1], "TCK"))
+        {
+            runTest.tck = static_cast<uint32_t>(parseNumber(args[i]));
+            i += 2;
+        }
+        else if (i + 1 < args.size() && equalsIgnoreCase(args[i + 1], "SCK"))
+        {
+            // There is no system clock to drive, the minimum time covers it.
+            i += 2;
+        }
+        else if (i + 1 < args.size() && equalsIgnoreCase(args[i + 1], "SEC"))
+        {
+            runTest.minTime = parseNumber(args[i]);
+            i += 2;
+        }
+        else
+        {
+            fail("malformed RUNTEST");
+        }
+    }
+
+    runTest.runState = runState;
+    runTest.endState = runEndState;
+    return runTest;
+}
+
+void SvfParser::parseState(SvfOp& op)
+{
+    auto* state = std::get_if<StateOp>(&op);
+    if (!state)
+    {
+        recycler.assign(op, StateOp{});
+        state = &std::get<StateOp>(op);
+    }
+    state->path.clear();
+
+    const auto& args = statement.args;
+    for (size_t i = 0; i < args.size(); ++i)
+    {
+        auto next = parseTapState(args[i]);
+        if (!next)
+        {
+            fail("unknown state " + std::string(args[i]));
+        }
+        state->path.push_back(*next);
+    }
+
+    if (state->path.empty() || !isStableState(state->path.back()))
+    {
+        fail("STATE must end in a stable state");
+    }
+}
+
+TapState SvfParser::parseStableState(std::string_view name) const
+{
+    auto state = parseTapState(name);
+    if (!state || !isStableState(*state))
+    {
+        fail("invalid stable state " + std::string(name));
+    }
+    return *state;
+}
+
+double SvfParser::parseNumber(std::string_view token) const
+{
+    double value = 0;
+    auto [end, ec] =
+        std::from_chars(token.data(), token.data() + token.size(), value);
+    if (ec != std::errc() || end != token.data() + token.size() || value < 0)
+    {
+        fail("invalid number " + std::string(token));
+    }
+    return value;
+}
+
+void SvfParser::fail(const std::string& message) const
+{
+    throw SvfError(statement.line, message);
+}
+
+} // namespace updater
+} // namespace software
+} // namespace wistron
@@ -0,0 +1,184 @@
+#pragma once
+
+#include "bit_vector.hpp"
+#include "mapped_file.hpp"
+#include "ops.hpp"
+#include "svf_tokenizer.hpp"
+#include "tap_state.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace wistron
+{
+namespace software
+{
+namespace updater
+{
+
+/** @class SvfParser
+ *  @brief Translates SVF text into engine operations, one statement at a
+ *         time.
+ *  @details The parser resolves all SVF state: sticky TDI/MASK values,
+ *  header/trailer registers, ENDIR/ENDDR and RUNTEST defaults. The operations
+ *  it produces can be executed without further context. Only the sticky
+ *  values and the operation being built are held, so memory use is bounded
+ *  by the longest scan rather than by the file size.
+ */
+class SvfParser : public OpSource
+{
+  public:
+    /** @brief Constructs SvfParser.
+     *
+     *  @param[in] text     - The SVF text; must outlive the parser
+     *  @param[in] resource - The memory resource scan data is allocated
+     *                        from, e.g. the arena of a programming run
+     */
+    explicit SvfParser(
+        std::string_view text,
+        std::pmr::memory_resource* resource = std::pmr::get_default_resource()) :
+        tokenizer(text), recycler(resource), sir(resource), sdr(resource),
+        hir(resource), hdr(resource), tir(resource), tdr(resource)
+    {}
+
+    /** @brief Parse up to the next operation.
+     *  @details Scans are decoded into the buffers op already holds, so a
+     *  caller passing the same op again parses without allocating.
+     *
+     *  @param[in,out] op - The operation
+     *
+     *  @return false once the end of the text is reached
+     *  @error  SvfError on malformed input
+     */
+    bool next(SvfOp& op) override;
+
+    size_t offset() const override
+    {
+        return tokenizer.offset();
+    }
+
+    size_t size() const override
+    {
+        return tokenizer.size();
+    }
+
+    size_t line() const override
+    {
+        return statement.line;
+    }
+
+  private:
+    /** @brief Sticky values of one SIR/SDR/HIR/HDR/TIR/TDR register.
+     *  @details An empty mask or smask stands for the all ones default, so
+     *  it is not materialized for every register and length.
+     */
+    struct ScanParams
+    {
+        explicit ScanParams(std::pmr::memory_resource* resource) :
+            tdi(resource), tdo(resource), mask(resource), smask(resource)
+        {}
+
+        size_t length = 0;
+        BitVector tdi;
+        BitVector tdo;
+        BitVector mask;
+        BitVector smask;
+    };
+
+    /** @brief Parse the arguments of a scan command into params */
+    void parseScan(ScanParams& params, bool sticky);
+
+    /** @brief Build the operation of a SIR/SDR in scan's buffers */
+    void composeScan(ScanType type, const ScanParams& header,
+                     const ScanParams& data, const ScanParams& trailer,
+                     TapState endState, ScanOp& scan) const;
+
+    RunTestOp parseRunTest();
+
+    /** @brief Parse a STATE into the buffer of op's path, if it has one */
+    void parseState(SvfOp& op);
+
+    /** @brief Parse a stable state name */
+    TapState parseStableState(std::string_view name) const;
+
+    /** @brief Parse a number */
+    double parseNumber(std::string_view token) const;
+
+    /** @brief Throw an SvfError for the current statement */
+    [[noreturn]] void fail(const std::string& message) const;
+
+    /** @brief Splits the text into statements */
+    SvfTokenizer tokenizer;
+
+    /** @brief The statement being parsed */
+    SvfStatement statement;
+
+    /** @brief Reuses the scan buffers of the operations handed out */
+    ScanRecycler recycler;
+
+    ScanParams sir;
+    ScanParams sdr;
+    ScanParams hir;
+    ScanParams hdr;
+    ScanParams tir;
+    ScanParams tdr;
+
+    TapState endIR = TapState::Idle;
+    TapState endDR = TapState::Idle;
+    TapState runState = TapState::Idle;
+    TapState runEndState = TapState::Idle;
+};
+
+/** @class SvfFile
+ *  @brief An SvfParser over a mapped SVF file.
+ */
+class SvfFile : public OpSource
+{
+  public:
+    /** @brief Maps an SVF file.
+     *
+     *  @param[in] path     - The SVF file path
+     *  @param[in] resource - The memory resource scan data is allocated
+     *                        from
+     *
+     *  @error  std::system_error if the file can not be mapped
+     */
+    explicit SvfFile(
+        const std::string& path,
+        std::pmr::memory_resource* resource = std::pmr::get_default_resource()) :
+        file(path), parser(file.view(), resource)
+    {}
+
+    bool next(SvfOp& op) override
+    {
+        return parser.next(op);
+    }
+
+    size_t offset() const override
+    {
+        return parser.offset();
+    }
+
+    size_t size() const override
+    {
+        return parser.size();
+    }
+
+    size_t line() const override
+    {
+        return parser.line();
+    }
+
+  private:
+    /** @brief The mapped file */
+    MappedFile file;
+
+    /** @brief The parser reading the mapping */
+    SvfParser parser;
+};
+
+} // namespace updater
+} // namespace software
+} // namespace wistron
@@ -0,0 +1,205 @@
+#include "svf_player.hpp"
+
+#include "svf_parser.hpp"
+
+#include <algorithm>
+#include <chrono>
+
+namespace wistron
+{
+namespace software
+{
+namespace updater
+{
+
+void SvfPlayer::play(const std::string& path)
+{
+    // Parse straight out of the mapping, a heap copy of a multi-megabyte
+    // SVF costs memory the BMC may not have.
+    SvfFile file(path);
+    play(file);
+}
+
+void SvfPlayer::play(std::string_view text)
+{
+    SvfParser parser(text);
+    play(parser);
+}
+
+void SvfPlayer::play(OpSource& source)
+{
+    frequency = maxFrequency;
+    jtag.setFrequency(frequency);
+    jtag.moveTo(TapState::Reset);
+    command = 0;
+    verifier.reset();
+    unverified = false;
+    if (verifyWindow != 0)
+    {
+        verifier.emplace(verifyWindow);
+    }
+
+    SvfOp op;
+    uint8_t reported = 0;
+    if (progress)
+    {
+        progress(reported);
+    }
+
+    while (source.next(op))
+    {
+        if (cancelled)
+        {
+            throw std::runtime_error("SVF playback cancelled");
+        }
+
+        line = source.line();
+        std::visit([this](auto& op) { execute(op); }, op);
+        ++command;
+        if (verifier)
+        {
+            verifier->check();
+        }
+
+        if (progress && source.size() != 0)
+        {
+            auto percent =
+                static_cast<uint8_t>(source.offset() * 100 / source.size());
+            if (percent != reported)
+            {
+                reported = percent;
+                progress(reported);
+            }
+        }
+    }
+
+    jtag.moveTo(TapState::Idle);
+    jtag.flush();
+    if (verifier)
+    {
+        verifier->drain();
+    }
+    if (progress && reported != 100)
+    {
+        progress(100);
+    }
+}
+
+void SvfPlayer::settle()
+{
+    if (verifier && unverified)
+    {
+        verifier->drain();
+        unverified = false;
+    }
+}
+
+void SvfPlayer::execute(ScanOp& op)
+{
+    // An instruction may erase or program, so it waits for the scans
+    // before it to match, the IDCODE check in particular.
+    if (op.type == ScanType::IR)
+    {
+        settle();
+    }
+
+    if (busyWait)
+    {
+        busyWait->observe(op);
+    }
+
+    auto* tdo = op.tdo.empty() ? nullptr : &captured;
+    if (op.fill)
+    {
+        jtag.shiftFill(op.type, op.fillBits, *op.fill, tdo, op.endState);
+    }
+    else
+    {
+        jtag.shift(op.type, op.tdi, tdo, op.endState);
+    }
+    if (!tdo)
+    {
+        return;
+    }
+
+    if (verifier)
+    {
+        // The op is decoded anew next, so its buffers can go.
+        verifier->submit(line, command, captured, op.tdo, op.mask);
+        unverified = true;
+        return;
+    }
+    if (auto bit = firstMismatch(captured, op.tdo, op.mask))
+    {
+        throw tdoMismatch(line, command, *bit, op.tdo, captured);
+    }
+}
+
+void SvfPlayer::execute(const RunTestOp& op)
+{
+    // Nor does a device operation get the time to run.
+    if (op.minTime > 0)
+    {
+        settle();
+    }
+
+    jtag.moveTo(op.runState);
+    if (busyWait && busyWait->wait(jtag, op))
+    {
+        jtag.moveTo(op.endState);
+        return;
+    }
+
+    if (op.minTime <= 0)
+    {
+        jtag.idle(op.tck);
+        jtag.moveTo(op.endState);
+        return;
+    }
+
+    // RUNTEST lasts for the clocks and the time, whichever is longer, so
+    // the time runs from the first clock; what came before is on the wire
+    // by then.
+    jtag.flush();
+    auto deadline = PreciseWait::Clock::now() +
+                    std::chrono::duration_cast<PreciseWait::Clock::duration>(
+                        std::chrono::duration<double>(op.minTime));
+    jtag.idle(op.tck);
+    jtag.flush();
+    wait.until(deadline, jtag, frequency);
+
+    jtag.moveTo(op.endState);
+}
+
+void SvfPlayer::execute(const StateOp& op)
+{
+    // The backend picks the path between stable states, transient states of
+    // the path need no explicit visit.
+    for (auto state : op.path)
+    {
+        if (isStableState(state))
+        {
+            jtag.moveTo(state);
+        }
+    }
+}
+
+void SvfPlayer::execute(const FrequencyOp& op)
+{
+    frequency = maxFrequency;
+    if (op.hz > 0)
+    {
+        frequency =
+            std::min<uint32_t>(maxFrequency, static_cast<uint32_t>(op.hz));
+    }
+    jtag.setFrequency(frequency);
+}
+
+void SvfPlayer::execute(const TrstOp& op)
+{
+    jtag.setTrst(op.asserted);
+}
+
+} // namespace updater
+} // namespace software
+} // namespace wistron
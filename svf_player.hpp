@@ -0,0 +1,188 @@
+#pragma once
+
+#include "jtag.hpp"
+#include "lattice_busy_wait.hpp"
+#include "ops.hpp"
+#include "precise_wait.hpp"
+#include "svf_tokenizer.hpp"
+#include "tdo_verifier.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace wistron
+{
+namespace software
+{
+namespace updater
+{
+
+/** @class SvfPlayer
+ *  @brief Plays SVF files and compiled images against a JTAG backend.
+ */
+class SvfPlayer
+{
+  public:
+    /** @brief Callback reporting the completed percentage (0-100) */
+    using ProgressCallback = std::function<void(uint8_t)>;
+
+    /** @brief Constructs SvfPlayer.
+     *
+     *  @param[in] jtag         - The JTAG backend to drive
+     *  @param[in] maxFrequency - The highest TCK frequency to use, in Hz;
+     *                            SVF FREQUENCY commands may only lower it
+     *  @param[in] progress     - Optional progress callback
+     */
+    SvfPlayer(JtagInterface& jtag, uint32_t maxFrequency,
+              ProgressCallback progress = {}) :
+        jtag(jtag), maxFrequency(maxFrequency), progress(std::move(progress))
+    {}
+
+    /** @brief Play an SVF file.
+     *
+     *  @param[in] path - The SVF file path
+     *
+     *  @error  SvfError on malformed input, TdoMismatch on a TDO mismatch,
+     *          std::system_error on I/O failures,
+     *          std::runtime_error when cancelled
+     */
+    void play(const std::string& path);
+
+    /** @brief Play SVF text.
+     *
+     *  @param[in] text - The SVF text
+     */
+    void play(std::string_view text);
+
+    /** @brief Play an operation stream, e.g. a compiled image.
+     *
+     *  @param[in] source - The operations to play
+     */
+    void play(OpSource& source);
+
+    /** @brief Enable polling the Lattice busy flag in place of padded
+     *         RUNTEST delays.
+     *
+     *  @param[in] enable - Whether to poll
+     */
+    void setSmartWait(bool enable)
+    {
+        if (enable)
+        {
+            busyWait.emplace();
+        }
+        else
+        {
+            busyWait.reset();
+        }
+    }
+
+    /** @brief Compare captured TDO on a verifier thread while shifting on.
+     *  @details The shifter still waits for the compares before an SIR
+     *  and before a RUNTEST with a minimum time, so a mismatch, e.g. of
+     *  the IDCODE, stops playback before the next instruction is loaded
+     *  or a device operation is given its time.
+     *
+     *  @param[in] window - The number of scans the shifter may run ahead of
+     *                      the compare; 0 compares inline
+     */
+    void setVerifyWindow(size_t window)
+    {
+        verifyWindow = window;
+    }
+
+    /** @brief Get the number of times the shifter waited for the verifier
+     *         during the last play() */
+    uint64_t verifyStalls() const
+    {
+        return verifier ? verifier->stalls() : 0;
+    }
+
+    /** @brief Get what busy flag polling achieved; empty if disabled */
+    std::optional<BusyWaitStats> busyWaitStats() const
+    {
+        if (!busyWait)
+        {
+            return std::nullopt;
+        }
+        return busyWait->stats();
+    }
+
+    /** @brief Get how late RUNTEST waits returned */
+    const OvershootHistogram& waitOvershoot() const
+    {
+        return wait.histogram();
+    }
+
+    /** @brief Request the running play() to stop after the current
+     *         operation, or the next one to stop at once. May be called
+     *         from any thread.
+     */
+    void cancel()
+    {
+        cancelled = true;
+    }
+
+  private:
+    /** @brief Wait for the scans queued with the verifier to compare
+     *
+     *  @error  TdoMismatch if one of them mismatched
+     */
+    void settle();
+
+    /** @brief Shift a scan; its TDO buffers may be handed to the verifier */
+    void execute(ScanOp& op);
+    void execute(const RunTestOp& op);
+    void execute(const StateOp& op);
+    void execute(const FrequencyOp& op);
+    void execute(const TrstOp& op);
+
+    /** @brief The JTAG backend */
+    JtagInterface& jtag;
+
+    /** @brief The frequency ceiling in Hz */
+    uint32_t maxFrequency;
+
+    /** @brief The progress callback */
+    ProgressCallback progress;
+
+    /** @brief The TCK frequency in effect, in Hz */
+    uint32_t frequency = 0;
+
+    /** @brief The RUNTEST wait primitive */
+    PreciseWait wait;
+
+    /** @brief Set to stop playing */
+    std::atomic<bool> cancelled = false;
+
+    /** @brief The line of the operation being executed */
+    size_t line = 0;
+
+    /** @brief The index of the operation being executed */
+    size_t command = 0;
+
+    /** @brief The verify window; 0 compares inline */
+    size_t verifyWindow = 0;
+
+    /** @brief The verifier of the running play(), if it compares off
+     *         thread */
+    std::optional<TdoVerifier> verifier;
+
+    /** @brief Whether scans were queued with the verifier since it was
+     *         last drained */
+    bool unverified = false;
+
+    /** @brief The busy flag poller, if smart wait is enabled */
+    std::optional<LatticeBusyWait> busyWait;
+
+    /** @brief Captured TDO, reused across scans */
+    BitVector captured;
+};
+
+} // namespace updater
+} // namespace software
+} // namespace wistron
@@ -0,0 +1,116 @@
+#include "svf_tokenizer.hpp"
+
+namespace wistron
+{
+namespace software
+{
+namespace updater
+{
+
+namespace
+{
+
+bool isBlank(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+} // namespace
+
+void SvfTokenizer::skipBlanks()
+{
+    while (pos < text.size())
+    {
+        auto c = text[pos];
+        if (c == '\n')
+        {
+            ++currentLine;
+            ++pos;
+        }
+        else if (isBlank(c))
+        {
+            ++pos;
+        }
+        else if (c == '!' || (c == '/' && pos + 1 < text.size() &&
+                              text[pos + 1] == '/'))
+        {
+            // Comments run to the end of the line.
+            auto end = text.find('\n', pos);
+            pos = end == std::string_view::npos ? text.size() : end;
+        }
+        else
+        {
+            break;
+        }
+    }
+}
+
+bool SvfTokenizer::next(SvfStatement& statement)
+{
+    statement.command = {};
+    statement.args.clear();
+    skipBlanks();
+    if (pos >= text.size())
+    {
+        return false;
+    }
+
+    statement.line = currentLine;
+    while (true)
+    {
+        skipBlanks();
+        if (pos >= text.size())
+        {
+            throw SvfError(statement.line,
+                           "statement is not terminated by ';'");
+        }
+
+        auto c = text[pos];
+        if (c == ';')
+        {
+            ++pos;
+            if (statement.command.empty())
+            {
+                throw SvfError(statement.line, "empty statement");
+            }
+            return true;
+        }
+
+        auto start = pos;
+        if (c == '(')
+        {
+            auto end = text.find(')', pos);
+            if (end == std::string_view::npos)
+            {
+                throw SvfError(statement.line, "unbalanced parenthesis");
+            }
+            for (; pos < end; ++pos)
+            {
+                currentLine += text[pos] == '\n';
+            }
+            ++pos;
+        }
+        else
+        {
+            while (pos < text.size() && !isBlank(text[pos]) &&
+                   text[pos] != ';' && text[pos] != '(')
+            {
+                ++pos;
+            }
+        }
+
+        auto token = text.substr(start, pos - start);
+        if (statement.command.empty())
+        {
+            statement.command = token;
+        }
+        else
+        {
+            statement.args.push_back(token);
+        }
+    }
+}
+
+} // namespace updater
+} // namespace software
+} // namespace wistron
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace wistron
+{
+namespace software
+{
+namespace updater
+{
+
+/** @class SvfError
+ *  @brief Malformed or unsupported SVF input.
+ */
+class SvfError : public std::runtime_error
+{
+  public:
+    /** @brief Constructs SvfError.
+     *
+     *  @param[in] line    - The line of the offending statement
+     *  @param[in] message - What is wrong with it
+     */
+    SvfError(size_t line, const std::string& message) :
+        std::runtime_error("SVF line " + std::to_string(line) + ": " +
+                           message),
+        line(line)
+    {}
+
+    /** @brief The line of the offending statement */
+    size_t line;
+};
+
+/** @struct SvfStatement
+ *  @brief One ';' terminated SVF statement.
+ *  @details All views point into the tokenized text. Parenthesised data is
+ *  a single argument, parentheses included, and may span lines.
+ */
+struct SvfStatement
+{
+    /** @brief The command keyword, e.g. SIR */
+    std::string_view command;
+
+    /** @brief The arguments following the command */
+    std::vector<std::string_view> args;
+
+    /** @brief The line the statement starts on */
+    size_t line = 0;
+};
+
+/** @class SvfTokenizer
+ *  @brief Zero-copy, single pass splitter of SVF text into statements.
+ *  @details Nothing is copied out of the text; the only allocation is the
+ *  argument list, whose capacity is reused across statements.
+ */
+class SvfTokenizer
+{
+  public:
+    /** @brief Constructs SvfTokenizer.
+     *
+     *  @param[in] text - The SVF text; must outlive the tokenizer
+     */
+    explicit SvfTokenizer(std::string_view text) : text(text)
+    {}
+
+    /** @brief Read the next statement.
+     *
+     *  @param[out] statement - The statement; reuse it across calls
+     *
+     *  @return false once the end of the text is reached
+     *  @error  SvfError on an unterminated statement or parenthesis
+     */
+    bool next(SvfStatement& statement);
+
+    /** @brief The byte offset tokenizing has reached */
+    size_t offset() const
+    {
+        return pos;
+    }
+
+    /** @brief The total size of the text in bytes */
+    size_t size() const
+    {
+        return text.size();
+    }
+
+  private:
+    /** @brief Skip whitespace and comments */
+    void skipBlanks();
+
+    /** @brief The SVF text */
+    std::string_view text;
+
+    /** @brief The tokenize position */
+    size_t pos = 0;
+
+    /** @brief The current line */
+    size_t currentLine = 1;
+};
+
+} // namespace updater
+} // namespace software
+} // namespace wistron
@@ -0,0 +1,104 @@
+#include "tap_optimizer.hpp"
+
+namespace wistron
+{
+namespace software
+{
+namespace updater
+{
+
+bool TapOptimizer::next(SvfOp& op)
+{
+    while (source.next(op))
+    {
+        if (keep(op))
+        {
+            return true;
+        }
+        ++optimizerStats.opsDropped;
+    }
+    return false;
+}
+
+bool TapOptimizer::keep(SvfOp& op)
+{
+    if (auto scan = std::get_if<ScanOp>(&op))
+    {
+        current = scan->endState;
+        return true;
+    }
+
+    if (auto runTest = std::get_if<RunTestOp>(&op))
+    {
+        if (current && runTest->tck == 0 && runTest->minTime == 0 &&
+            runTest->runState == *current && runTest->endState == *current)
+        {
+            optimizerStats.tmsSaved += 2 * clocks(*current, *current);
+            return false;
+        }
+        current = runTest->endState;
+        return true;
+    }
+
+    if (std::holds_alternative<TrstOp>(op))
+    {
+        // TRST may not be wired, and the backend does not follow it either;
+        // the next move has to name its state again.
+        current.reset();
+        return true;
+    }
+
+    auto state = std::get_if<StateOp>(&op);
+    if (!state)
+    {
+        return true;
+    }
+
+    // Compact the walk in place. Transient states only stay if a stable
+    // state after them does, the player visits the stable ones alone.
+    auto& path = state->path;
+    auto position = current;
+    size_t out = 0;
+    size_t stableEnd = 0;
+    bool trimmed = false;
+    for (auto next : path)
+    {
+        if (!isStableState(next))
+        {
+            path[out++] = next;
+        }
+        else if (position == next)
+        {
+            optimizerStats.tmsSaved += clocks(next, next);
+            out = stableEnd;
+            trimmed = true;
+        }
+        else
+        {
+            path[out++] = next;
+            stableEnd = out;
+            position = next;
+        }
+    }
+    path.resize(stableEnd);
+    current = position;
+
+    if (path.empty())
+    {
+        return false;
+    }
+    if (trimmed)
+    {
+        ++optimizerStats.walksTrimmed;
+    }
+    return true;
+}
+
+uint8_t TapOptimizer::clocks(TapState from, TapState to)
+{
+    return to == TapState::Reset ? resetPath.length : tmsPath(from, to).length;
+}
+
+} // namespace updater
+} // namespace software
+} // namespace wistron
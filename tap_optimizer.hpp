@@ -0,0 +1,99 @@
+#pragma once
+
+#include "ops.hpp"
+#include "tap_state.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+
+namespace wistron
+{
+namespace software
+{
+namespace updater
+{
+
+/** @struct TapOptimizerStats
+ *  @brief What the TAP optimizer took out of a stream.
+ */
+struct TapOptimizerStats
+{
+    /** @brief Operations dropped because they left the TAP where it was */
+    uint64_t opsDropped = 0;
+
+    /** @brief STATE walks shortened by states the TAP was already in */
+    uint64_t walksTrimmed = 0;
+
+    /** @brief TMS clocks the backend would have spent on them */
+    uint64_t tmsSaved = 0;
+};
+
+/** @class TapOptimizer
+ *  @brief Drops TAP state transitions that do not move the TAP.
+ *  @details The optimizer tracks the state each operation leaves the TAP
+ *  in. Vendor tools emit STATE RESET and STATE IDLE around every block of
+ *  commands, and chained or concatenated streams repeat them per device;
+ *  a STATE whose stable states the TAP is already in, a RESET after a
+ *  RESET and a RUNTEST without clocks or delay in the current state are
+ *  dropped, and leading states of a walk the TAP is in are trimmed.
+ *  Stable states further along a walk are kept, as passing through the
+ *  capture and update states has side effects. The TAP state is unknown
+ *  until the stream puts it somewhere and again after a TRST, so the RESET
+ *  following either always stays.
+ */
+class TapOptimizer : public OpSource
+{
+  public:
+    /** @brief Constructs TapOptimizer.
+     *
+     *  @param[in] source - The stream to filter
+     */
+    explicit TapOptimizer(OpSource& source) : source(source) {}
+
+    bool next(SvfOp& op) override;
+
+    size_t offset() const override
+    {
+        return source.offset();
+    }
+
+    size_t size() const override
+    {
+        return source.size();
+    }
+
+    size_t line() const override
+    {
+        return source.line();
+    }
+
+    /** @brief Get what was taken out so far */
+    const TapOptimizerStats& stats() const
+    {
+        return optimizerStats;
+    }
+
+  private:
+    /** @brief Decide whether an operation passes, trimming it if needed,
+     *         and track the state it leaves the TAP in */
+    bool keep(SvfOp& op);
+
+    /** @brief Get the TMS clocks the backend spends moving between two
+     *         states */
+    static uint8_t clocks(TapState from, TapState to);
+
+    /** @brief The wrapped stream */
+    OpSource& source;
+
+    /** @brief The TAP state the kept operations end in; unset while
+     *         unknown */
+    std::optional<TapState> current;
+
+    /** @brief The statistics */
+    TapOptimizerStats optimizerStats;
+};
+
+} // namespace updater
+} // namespace software
+} // namespace wistron
@@ -0,0 +1,59 @@
+#include "tap_state.hpp"
+
+#include <array>
+#include <cctype>
+
+namespace wistron
+{
+namespace software
+{
+namespace updater
+{
+
+namespace
+{
+
+constexpr std::array<std::string_view, tapStateCount> tapStateNames = {
+    "RESET",   "IDLE",    "DRSELECT", "DRCAPTURE", "DRSHIFT",  "DREXIT1",
+    "DRPAUSE", "DREXIT2", "DRUPDATE", "IRSELECT",  "IRCAPTURE", "IRSHIFT",
+    "IREXIT1", "IRPAUSE", "IREXIT2",  "IRUPDATE"};
+
+bool equalsIgnoreCase(std::string_view lhs, std::string_view rhs)
+{
+    if (lhs.size() != rhs.size())
+    {
+        return false;
+    }
+    for (size_t i = 0; i < lhs.size(); ++i)
+    {
+        if (std::toupper(static_cast<unsigned char>(lhs[i])) !=
+            std::toupper(static_cast<unsigned char>(rhs[i])))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+std::optional<TapState> parseTapState(std::string_view name)
+{
+    for (size_t i = 0; i < tapStateNames.size(); ++i)
+    {
+        if (equalsIgnoreCase(name, tapStateNames[i]))
+        {
+            return static_cast<TapState>(i);
+        }
+    }
+    return std::nullopt;
+}
+
+std::string_view toString(TapState state)
+{
+    return tapStateNames[static_cast<size_t>(state)];
+}
+
+} // namespace updater
+} // namespace software
+} // namespace wistron
@@ -0,0 +1,232 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+
+namespace wistron
+{
+namespace software
+{
+namespace updater
+{
+
+/** @enum TapState
+ *  @brief IEEE 1149.1 TAP controller states.
+ *  @details The order matches enum jtag_tapstate of the Linux JTAG driver,
+ *  so a TapState can be handed to the driver as is.
+ */
+enum class TapState : uint8_t
+{
+    Reset,
+    Idle,
+    DRSelect,
+    DRCapture,
+    DRShift,
+    DRExit1,
+    DRPause,
+    DRExit2,
+    DRUpdate,
+    IRSelect,
+    IRCapture,
+    IRShift,
+    IRExit1,
+    IRPause,
+    IRExit2,
+    IRUpdate,
+};
+
+/** @brief The number of TAP controller states */
+constexpr size_t tapStateCount = 16;
+
+/** @brief Get the state the TAP controller enters on one TCK.
+ *
+ *  @param[in] state - The current state
+ *  @param[in] tms   - The TMS level sampled on the rising edge of TCK
+ *
+ *  @return The next state
+ */
+constexpr TapState nextTapState(TapState state, bool tms)
+{
+    switch (state)
+    {
+        case TapState::Reset:
+            return tms ? TapState::Reset : TapState::Idle;
+        case TapState::Idle:
+            return tms ? TapState::DRSelect : TapState::Idle;
+        case TapState::DRSelect:
+            return tms ? TapState::IRSelect : TapState::DRCapture;
+        case TapState::DRCapture:
+            return tms ? TapState::DRExit1 : TapState::DRShift;
+        case TapState::DRShift:
+            return tms ? TapState::DRExit1 : TapState::DRShift;
+        case TapState::DRExit1:
+            return tms ? TapState::DRUpdate : TapState::DRPause;
+        case TapState::DRPause:
+            return tms ? TapState::DRExit2 : TapState::DRPause;
+        case TapState::DRExit2:
+            return tms ? TapState::DRUpdate : TapState::DRShift;
+        case TapState::DRUpdate:
+            return tms ? TapState::DRSelect : TapState::Idle;
+        case TapState::IRSelect:
+            return tms ? TapState::Reset : TapState::IRCapture;
+        case TapState::IRCapture:
+            return tms ? TapState::IRExit1 : TapState::IRShift;
+        case TapState::IRShift:
+            return tms ? TapState::IRExit1 : TapState::IRShift;
+        case TapState::IRExit1:
+            return tms ? TapState::IRUpdate : TapState::IRPause;
+        case TapState::IRPause:
+            return tms ? TapState::IRExit2 : TapState::IRPause;
+        case TapState::IRExit2:
+            return tms ? TapState::IRUpdate : TapState::IRShift;
+        case TapState::IRUpdate:
+            return tms ? TapState::DRSelect : TapState::Idle;
+    }
+    return TapState::Reset;
+}
+
+/** @brief Check whether a state can be held without clocking TMS high,
+ *         i.e. whether an SVF command may end in it.
+ *
+ *  @param[in] state - The state to check
+ *
+ *  @return true for RESET, IDLE, DRPAUSE and IRPAUSE
+ */
+constexpr bool isStableState(TapState state)
+{
+    return state == TapState::Reset || state == TapState::Idle ||
+           state == TapState::DRPause || state == TapState::IRPause;
+}
+
+/** @struct TmsPath
+ *  @brief A TMS sequence moving the TAP controller between two states.
+ */
+struct TmsPath
+{
+    /** @brief The TMS level of each clock, the first clock in bit 0 */
+    uint8_t bits = 0;
+
+    /** @brief The number of clocks */
+    uint8_t length = 0;
+};
+
+/** @brief Moving to Reset always clocks TMS high this often, which resets
+ *         the TAP from any state */
+inline constexpr TmsPath resetPath{0x1f, 5};
+
+/** @brief Search the shortest TMS sequence between two states.
+ *  @details Breadth first search over the 16 states; every state is
+ *  reachable from every other one within 8 clocks. Use tmsPath(), which
+ *  looks the result up in a table built at compile time.
+ *
+ *  @param[in] from - The current state
+ *  @param[in] to   - The state to move to
+ *
+ *  @return The sequence; empty if from equals to
+ */
+constexpr TmsPath searchTmsPath(TapState from, TapState to)
+{
+    std::array<TmsPath, tapStateCount> paths{};
+    std::array<bool, tapStateCount> visited{};
+    std::array<TapState, tapStateCount> queue{};
+    size_t head = 0;
+    size_t tail = 0;
+
+    visited[static_cast<size_t>(from)] = true;
+    queue[tail++] = from;
+    while (head < tail)
+    {
+        auto state = queue[head++];
+        auto path = paths[static_cast<size_t>(state)];
+        if (state == to)
+        {
+            return path;
+        }
+
+        for (bool tms : {false, true})
+        {
+            auto next = static_cast<size_t>(nextTapState(state, tms));
+            if (!visited[next])
+            {
+                visited[next] = true;
+                paths[next] = {static_cast<uint8_t>(
+                                   path.bits | (tms ? 1u << path.length : 0)),
+                               static_cast<uint8_t>(path.length + 1)};
+                queue[tail++] = static_cast<TapState>(next);
+            }
+        }
+    }
+    return {};
+}
+
+/** @brief The shortest TMS sequences between all pairs of states, indexed
+ *         by the current state and then by the state to move to */
+inline constexpr auto tmsPathTable = []() {
+    std::array<std::array<TmsPath, tapStateCount>, tapStateCount> table{};
+    for (size_t from = 0; from < tapStateCount; ++from)
+    {
+        for (size_t to = 0; to < tapStateCount; ++to)
+        {
+            table[from][to] = searchTmsPath(static_cast<TapState>(from),
+                                            static_cast<TapState>(to));
+        }
+    }
+    return table;
+}();
+
+static_assert(
+    []() {
+        for (const auto& row : tmsPathTable)
+        {
+            for (const auto& path : row)
+            {
+                if (path.length > 8)
+                {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }(),
+    "a TMS path does not fit TmsPath::bits");
+static_assert(tmsPathTable[static_cast<size_t>(TapState::Reset)]
+                          [static_cast<size_t>(TapState::Idle)]
+                              .length == 1);
+static_assert(tmsPathTable[static_cast<size_t>(TapState::Idle)]
+                          [static_cast<size_t>(TapState::IRShift)]
+                              .bits == 0x3);
+
+/** @brief Get the shortest TMS sequence between two states.
+ *
+ *  @param[in] from - The current state
+ *  @param[in] to   - The state to move to
+ *
+ *  @return The sequence; empty if from equals to
+ */
+constexpr TmsPath tmsPath(TapState from, TapState to)
+{
+    return tmsPathTable[static_cast<size_t>(from)][static_cast<size_t>(to)];
+}
+
+/** @brief Parse an SVF state name (e.g. "IDLE", "DRPAUSE").
+ *
+ *  @param[in] name - The state name, case insensitive
+ *
+ *  @return The state or std::nullopt if the name is unknown
+ */
+std::optional<TapState> parseTapState(std::string_view name);
+
+/** @brief Get the SVF name of a state.
+ *
+ *  @param[in] state - The state
+ *
+ *  @return The SVF state name
+ */
+std::string_view toString(TapState state);
+
+} // namespace updater
+} // namespace software
+} // namespace wistron
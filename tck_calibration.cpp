@@ -0,0 +1,153 @@
+#include "tck_calibration.hpp"
+
+#include <algorithm>
+#include <random>
+#include <stdexcept>
+
+namespace wistron
+{
+namespace software
+{
+namespace updater
+{
+
+namespace
+{
+
+/** @brief The longest chain looked for */
+constexpr size_t maxDevices = 16;
+
+/** @brief Ones shifted into IR to select BYPASS on every device; covers any
+ *         realistic total IR length */
+constexpr size_t bypassIrBits = 256;
+
+/** @brief The length of the pattern shifted through the BYPASS registers */
+constexpr size_t patternBits = 256;
+
+/** @brief Readbacks per frequency step */
+constexpr int trials = 3;
+
+constexpr uint32_t noDevice = 0xffffffff;
+
+bool bypassIntact(JtagInterface& jtag, size_t devices, std::mt19937& random)
+{
+    BitVector ones(bypassIrBits);
+    ones.fill(true);
+    jtag.shift(ScanType::IR, ones, nullptr, TapState::Idle);
+
+    // Each BYPASS register delays the pattern by one bit and captures 0.
+    BitVector tdi(devices + patternBits);
+    for (size_t i = 0; i < patternBits; ++i)
+    {
+        tdi.set(i, random() & 1);
+    }
+    BitVector tdo;
+    jtag.shift(ScanType::DR, tdi, &tdo, TapState::Idle);
+
+    for (size_t i = 0; i < devices; ++i)
+    {
+        if (tdo.test(i))
+        {
+            return false;
+        }
+    }
+    for (size_t i = 0; i < patternBits; ++i)
+    {
+        if (tdo.test(devices + i) != tdi.test(i))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+std::vector<uint32_t> readIdcodes(JtagInterface& jtag)
+{
+    // Test-Logic-Reset selects IDCODE, or BYPASS on devices without one.
+    // An IDCODE always has bit 0 set, BYPASS captures 0, and the ones shifted
+    // in read back as 0xffffffff once the whole chain is out.
+    jtag.moveTo(TapState::Reset);
+    BitVector tdi((maxDevices + 1) * 32);
+    tdi.fill(true);
+    BitVector tdo;
+    jtag.shift(ScanType::DR, tdi, &tdo, TapState::Idle);
+
+    std::vector<uint32_t> idcodes;
+    size_t bit = 0;
+    while (idcodes.size() < maxDevices && bit + 32 <= tdo.size())
+    {
+        if (!tdo.test(bit))
+        {
+            idcodes.push_back(0);
+            ++bit;
+            continue;
+        }
+
+        uint32_t idcode = 0;
+        for (size_t i = 0; i < 32; ++i)
+        {
+            idcode |= static_cast<uint32_t>(tdo.test(bit + i)) << i;
+        }
+        if (idcode == noDevice)
+        {
+            break;
+        }
+        idcodes.push_back(idcode);
+        bit += 32;
+    }
+    return idcodes;
+}
+
+TckProfile calibrateTck(JtagInterface& jtag, uint32_t startHz,
+                        uint32_t capHz)
+{
+    jtag.setFrequency(startHz);
+    TckProfile profile{readIdcodes(jtag), startHz};
+    if (profile.idcodes.empty() ||
+        std::ranges::all_of(profile.idcodes,
+                            [](uint32_t idcode) { return idcode == 0; }))
+    {
+        throw std::runtime_error("No JTAG chain answers at " +
+                                 std::to_string(startHz) + " Hz");
+    }
+
+    // A fixed seed keeps calibration runs comparable.
+    std::mt19937 random(0x5eed);
+    for (uint32_t hz = startHz; hz < capHz;)
+    {
+        // Steps of 25%, so the result is within that of the real limit.
+        hz = std::min<uint32_t>(capHz, std::max<uint32_t>(hz + 1, hz / 4 * 5));
+        jtag.setFrequency(hz);
+
+        bool stable = true;
+        for (int i = 0; i < trials && stable; ++i)
+        {
+            stable = readIdcodes(jtag) == profile.idcodes &&
+                     bypassIntact(jtag, profile.idcodes.size(), random);
+        }
+        if (!stable)
+        {
+            break;
+        }
+        profile.stableHz = hz;
+    }
+
+    jtag.setFrequency(startHz);
+    jtag.moveTo(TapState::Reset);
+    jtag.flush();
+    return profile;
+}
+
+uint32_t withMargin(uint32_t stableHz, uint32_t marginPercent, uint32_t capHz)
+{
+    auto hz = static_cast<uint64_t>(stableHz) *
+              (100 - std::min<uint32_t>(marginPercent, 99)) / 100;
+    return static_cast<uint32_t>(
+        std::clamp<uint64_t>(hz, 1, std::max<uint32_t>(capHz, 1)));
+}
+
+} // namespace updater
+} // namespace software
+} // namespace wistron
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "jtag.hpp"
+
+#include <cstdint>
+#include <vector>
+
+namespace wistron
+{
+namespace software
+{
+namespace updater
+{
+
+/** @struct TckProfile
+ *  @brief The calibrated TCK limit of a JTAG chain.
+ */
+struct TckProfile
+{
+    /** @brief The IDCODEs of the chain, the device nearest TDO first; 0 for
+     *         a device without IDCODE register */
+    std::vector<uint32_t> idcodes;
+
+    /** @brief The highest frequency the chain read back reliably at, in Hz */
+    uint32_t stableHz = 0;
+};
+
+/** @brief Read the IDCODEs a chain holds after Test-Logic-Reset.
+ *
+ *  @param[in] jtag - The JTAG backend
+ *
+ *  @return The IDCODEs, the device nearest TDO first; 0 for a device
+ *          without IDCODE register
+ */
+std::vector<uint32_t> readIdcodes(JtagInterface& jtag);
+
+/** @brief Find the highest TCK frequency a chain works reliably at.
+ *  @details The chain is read at startHz for reference, then at increasing
+ *  frequencies. Each step reads the IDCODEs back and shifts a pseudo random
+ *  pattern through the BYPASS registers of all devices, several times. The
+ *  first frequency that misreads ends the search. The device configuration
+ *  is not touched.
+ *
+ *  @param[in] jtag    - The JTAG backend
+ *  @param[in] startHz - A frequency known to work
+ *  @param[in] capHz   - The highest frequency to try
+ *
+ *  @return The profile; stableHz is at least startHz
+ *  @error  std::runtime_error if no chain answers at startHz
+ */
+TckProfile calibrateTck(JtagInterface& jtag, uint32_t startHz,
+                        uint32_t capHz);
+
+/** @brief Get the frequency to program at from a calibrated limit.
+ *
+ *  @param[in] stableHz      - The calibrated limit
+ *  @param[in] marginPercent - How far to stay below the limit
+ *  @param[in] capHz         - The hard upper bound
+ *
+ *  @return The frequency in Hz, at least 1
+ */
+uint32_t withMargin(uint32_t stableHz, uint32_t marginPercent, uint32_t capHz);
+
+} // namespace updater
+} // namespace software
+} // namespace wistron
@@ -0,0 +1,101 @@
+#include "tdo_verifier.hpp"
+
+#include <utility>
+
+namespace wistron
+{
+namespace software
+{
+namespace updater
+{
+
+TdoMismatch tdoMismatch(size_t line, size_t command, size_t bit,
+                        const BitVector& expected, const BitVector& captured)
+{
+    return TdoMismatch(line, command, bit,
+                       "TDO mismatch at bit " + std::to_string(bit) +
+                           " of command " + std::to_string(command) +
+                           ", expected " + expected.toHex() + " got " +
+                           captured.toHex());
+}
+
+TdoVerifier::TdoVerifier(size_t window) :
+    ring(window), thread(&TdoVerifier::run, this)
+{}
+
+TdoVerifier::~TdoVerifier()
+{
+    claim().stop = true;
+    ring.publish();
+    thread.join();
+}
+
+void TdoVerifier::submit(size_t line, size_t command, BitVector& captured,
+                         BitVector& expected, BitVector& mask)
+{
+    check();
+
+    auto& job = claim();
+    job.line = line;
+    job.command = command;
+    std::swap(job.captured, captured);
+    std::swap(job.expected, expected);
+    std::swap(job.mask, mask);
+    ring.publish();
+}
+
+void TdoVerifier::drain()
+{
+    ring.waitForEmpty();
+    check();
+}
+
+TdoVerifier::Job& TdoVerifier::claim()
+{
+    auto* job = ring.claim();
+    if (!job)
+    {
+        ++windowStalls;
+        do
+        {
+            ring.waitForSpace();
+            job = ring.claim();
+        } while (!job);
+    }
+    return *job;
+}
+
+void TdoVerifier::run()
+{
+    while (true)
+    {
+        auto* job = ring.front();
+        if (!job)
+        {
+            ring.waitForData();
+            continue;
+        }
+        if (job->stop)
+        {
+            return;
+        }
+
+        // Only the first mismatch counts, the caller stops on it.
+        if (!failed.load(std::memory_order_relaxed))
+        {
+            if (auto bit = firstMismatch(job->captured, job->expected,
+                                         job->mask))
+            {
+                mismatch = tdoMismatch(job->line, job->command, *bit,
+                                       job->expected, job->captured);
+                failed.store(true, std::memory_order_release);
+            }
+            comparedScans.fetch_add(1, std::memory_order_relaxed);
+        }
+        ring.release();
+    }
+}
+
+} // namespace updater
+} // namespace software
+} // namespace wistron
@@ -0,0 +1,178 @@
+#pragma once
+
+#include "bit_vector.hpp"
+#include "spsc_ring.hpp"
+#include "svf_tokenizer.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <thread>
+
+namespace wistron
+{
+namespace software
+{
+namespace updater
+{
+
+/** @class TdoMismatch
+ *  @brief Captured TDO that differs from the expected value in a masked bit.
+ */
+class TdoMismatch : public SvfError
+{
+  public:
+    /** @brief Constructs TdoMismatch.
+     *
+     *  @param[in] line    - The line of the scan
+     *  @param[in] command - The index of the scan's operation in the stream
+     *  @param[in] bit     - The first mismatching bit
+     *  @param[in] message - The expected and captured values
+     */
+    TdoMismatch(size_t line, size_t command, size_t bit,
+                const std::string& message) :
+        SvfError(line, message), command(command), bit(bit)
+    {}
+
+    /** @brief The index of the scan's operation in the stream */
+    size_t command;
+
+    /** @brief The first mismatching bit */
+    size_t bit;
+};
+
+/** @brief Build the mismatch of a scan whose captured TDO differs.
+ *
+ *  @param[in] line     - The line of the scan
+ *  @param[in] command  - The index of the scan's operation
+ *  @param[in] bit      - The first mismatching bit
+ *  @param[in] expected - The expected TDO
+ *  @param[in] captured - The captured TDO
+ *
+ *  @return The exception to throw
+ */
+TdoMismatch tdoMismatch(size_t line, size_t command, size_t bit,
+                        const BitVector& expected, const BitVector& captured);
+
+/** @class TdoVerifier
+ *  @brief Compares captured TDO against the expected value on a thread of
+ *         its own.
+ *  @details The player hands each captured scan over and carries on
+ *  shifting while the verifier thread runs the masked compare. Captures
+ *  are passed through a bounded ring whose slots keep their buffers: the
+ *  caller gets the buffers of an already compared scan back in exchange,
+ *  so nothing is allocated once the ring is warm. The ring's depth bounds
+ *  how many scans the shifter may run ahead of verification; with it full
+ *  the shifter waits.
+ *
+ *  A mismatch is reported on the next submit() or check(), so programming
+ *  stops within the window of the failing scan rather than at its end.
+ *  Scans after it are no longer compared.
+ */
+class TdoVerifier
+{
+  public:
+    /** @brief Constructs TdoVerifier and starts its thread.
+     *
+     *  @param[in] window - The number of scans the caller may run ahead
+     */
+    explicit TdoVerifier(size_t window);
+
+    TdoVerifier(const TdoVerifier&) = delete;
+    TdoVerifier& operator=(const TdoVerifier&) = delete;
+    TdoVerifier(TdoVerifier&&) = delete;
+    TdoVerifier& operator=(TdoVerifier&&) = delete;
+
+    /** @brief Stops the thread; pending compares are dropped */
+    ~TdoVerifier();
+
+    /** @brief Queue a scan for comparison, waiting if the window is full.
+     *  @details The three vectors are swapped with those of a compared
+     *  scan, so their contents are unspecified afterwards.
+     *
+     *  @param[in]     line     - The line of the scan
+     *  @param[in]     command  - The index of the scan's operation
+     *  @param[in,out] captured - The captured TDO
+     *  @param[in,out] expected - The expected TDO
+     *  @param[in,out] mask     - The compare mask
+     *
+     *  @error  TdoMismatch if a queued scan mismatched
+     */
+    void submit(size_t line, size_t command, BitVector& captured,
+                BitVector& expected, BitVector& mask);
+
+    /** @brief Report a mismatch found so far, without waiting.
+     *
+     *  @error  TdoMismatch if a queued scan mismatched
+     */
+    void check()
+    {
+        if (failed.load(std::memory_order_acquire))
+        {
+            throw mismatch;
+        }
+    }
+
+    /** @brief Wait until all queued scans are compared.
+     *
+     *  @error  TdoMismatch if one of them mismatched
+     */
+    void drain();
+
+    /** @brief Get the number of scans compared */
+    uint64_t compared() const
+    {
+        return comparedScans.load(std::memory_order_relaxed);
+    }
+
+    /** @brief Get the number of times the caller waited for a full window */
+    uint64_t stalls() const
+    {
+        return windowStalls;
+    }
+
+  private:
+    /** @struct Job
+     *  @brief One scan to compare.
+     */
+    struct Job
+    {
+        size_t line = 0;
+        size_t command = 0;
+        BitVector captured;
+        BitVector expected;
+        BitVector mask;
+
+        /** @brief Makes the thread exit */
+        bool stop = false;
+    };
+
+    /** @brief The verifier thread body */
+    void run();
+
+    /** @brief Claim a slot, waiting while the window is full */
+    Job& claim();
+
+    /** @brief The scans in flight */
+    SpscRing<Job> ring;
+
+    /** @brief Set once a mismatch is stored in mismatch */
+    std::atomic<bool> failed = false;
+
+    /** @brief The first mismatch; written by the thread before failed */
+    TdoMismatch mismatch{0, 0, 0, {}};
+
+    /** @brief The number of scans compared */
+    std::atomic<uint64_t> comparedScans = 0;
+
+    /** @brief Times submit() found the window full */
+    uint64_t windowStalls = 0;
+
+    /** @brief The verifier thread */
+    std::thread thread;
+};
+
+} // namespace updater
+} // namespace software
+} // namespace wistron
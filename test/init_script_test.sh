@@ -0,0 +1,57 @@
+#!/bin/bash
+# Runs the boot time init step of obmc-cpld-update on a scratch dir and
+# checks it keeps what resuming an interrupted activation needs and the
+# TCK calibration.
+set -eo pipefail
+
+script="$1"
+scratch=$(mktemp -d)
+trap 'rm -rf "$scratch"' EXIT
+
+# The CPLD version registers, as i2cget reads them.
+mkdir -p "$scratch/bin"
+cat > "$scratch/bin/i2cget" <<'STUB'
+#!/bin/sh
+case "$4" in
+  0x00) echo 0x12 ;;
+  *) echo 0x03 ;;
+esac
+STUB
+chmod +x "$scratch/bin/i2cget"
+
+export PATH="$scratch/bin:$PATH"
+export CPLD_ACTIVE_DIR="$scratch/persist"
+export CPLD_RELEASE_PATH="$scratch/cpld-release"
+export CPLD_MEDIA_DIR="$scratch/media"
+
+resume="$CPLD_ACTIVE_DIR/resume-2a1022fe"
+mkdir -p "$resume" "$CPLD_MEDIA_DIR/cpld-2a1022fe"
+echo '{"value0": {"device": "/dev/jtag0", "running": true}}' \
+  > "$resume/checkpoint"
+echo 'version=1.2.4' > "$resume/MANIFEST"
+echo 'ops' > "$resume/cpld.ops"
+echo '{"idcodes": [], "stableHz": 10000000}' > "$CPLD_ACTIVE_DIR/tck-jtag0"
+echo 'stale' > "$CPLD_ACTIVE_DIR/cpld-release"
+echo 'stale' > "$CPLD_ACTIVE_DIR/2a1022fe"
+
+bash "$script" init 1 > /dev/null
+
+fail() {
+  echo "FAIL: $*" >&2
+  exit 1
+}
+
+for file in checkpoint MANIFEST cpld.ops; do
+  [ -f "$resume/$file" ] || fail "$resume/$file was removed"
+done
+[ -f "$CPLD_ACTIVE_DIR/tck-jtag0" ] || fail "the TCK calibration was removed"
+[ ! -e "$CPLD_ACTIVE_DIR/2a1022fe" ] || fail "stale files were kept"
+[ -z "$(ls -A "$CPLD_MEDIA_DIR")" ] || fail "$CPLD_MEDIA_DIR was kept"
+grep -qx 'VERSION_ID=1.2.03' "$CPLD_ACTIVE_DIR/cpld-release" ||
+  fail "cpld-release was not recreated"
+cmp -s "$CPLD_ACTIVE_DIR/cpld-release" "$CPLD_RELEASE_PATH" ||
+  fail "$CPLD_RELEASE_PATH was not updated"
+
+# A second boot keeps them as well.
+bash "$script" init 1 > /dev/null
+[ -f "$resume/checkpoint" ] || fail "a second init removed the checkpoint"
@@ -0,0 +1,76 @@
+#include "serialize.hpp"
+
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+#include <gtest/gtest.h>
+
+namespace wistron
+{
+namespace software
+{
+namespace updater
+{
+namespace
+{
+
+class CheckpointTest : public ::testing::Test
+{
+  protected:
+    CheckpointTest()
+    {
+        std::string pattern =
+            std::filesystem::temp_directory_path() / "resume-XXXXXX";
+        dir = mkdtemp(pattern.data());
+    }
+
+    ~CheckpointTest() override
+    {
+        std::filesystem::remove_all(dir);
+    }
+
+    std::string dir;
+};
+
+TEST_F(CheckpointTest, RestoresStored)
+{
+    ProgramCheckpoint stored{"/dev/jtag0", 0x1234, 384, true};
+    storeCheckpoint(dir, stored);
+
+    ProgramCheckpoint restored;
+    ASSERT_TRUE(restoreCheckpoint(dir, restored));
+    EXPECT_EQ(restored.device, stored.device);
+    EXPECT_EQ(restored.digest, stored.digest);
+    EXPECT_EQ(restored.rows, stored.rows);
+    EXPECT_TRUE(restored.running);
+    EXPECT_FALSE(std::filesystem::exists(dir + "/checkpoint.tmp"));
+}
+
+TEST_F(CheckpointTest, FailedRunLeavesNothingToResume)
+{
+    // A failed run drops its checkpoint; the image and MANIFEST kept with
+    // it stay for the retry.
+    std::ofstream(dir + "/MANIFEST") << "version=1.2.4\n";
+    storeCheckpoint(dir, {"/dev/jtag0", 0x1234, 384, true});
+    removeCheckpoint(dir);
+
+    ProgramCheckpoint restored;
+    EXPECT_FALSE(restoreCheckpoint(dir, restored));
+    EXPECT_TRUE(std::filesystem::exists(dir + "/MANIFEST"));
+}
+
+TEST_F(CheckpointTest, CorruptCheckpointIsDropped)
+{
+    std::ofstream(dir + "/checkpoint") << "{\"value0\": {\"device\": ";
+
+    ProgramCheckpoint restored;
+    EXPECT_FALSE(restoreCheckpoint(dir, restored));
+    EXPECT_FALSE(std::filesystem::exists(dir + "/checkpoint"));
+}
+
+} // namespace
+} // namespace updater
+} // namespace software
+} // namespace wistron
@@ -0,0 +1,276 @@
+#include "checkpoint_source.hpp"
+#include "differential_source.hpp"
+#include "jtag_simulator.hpp"
+#include "svf_parser.hpp"
+#include "svf_player.hpp"
+#include "verify_source.hpp"
+
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <system_error>
+
+#include <gtest/gtest.h>
+
+namespace wistron
+{
+namespace software
+{
+namespace updater
+{
+namespace
+{
+
+constexpr size_t rows = 300;
+constexpr uint32_t frequency = 1000000;
+constexpr uint32_t usercode = 0x12345678;
+
+/** @brief A MachXO2-1200 with short flash timings, to keep the tests fast */
+SimulatedCpldConfig part()
+{
+    SimulatedCpldConfig config;
+    config.eraseTime = std::chrono::microseconds(1000);
+    config.programTime = std::chrono::microseconds(10);
+    return config;
+}
+
+/** @brief The 32 hex digits of a configuration row */
+using RowData = std::function<std::string(size_t)>;
+
+std::string hexRow(uint32_t high, size_t row)
+{
+    char digits[33];
+    std::snprintf(digits, sizeof(digits), "%08X%024zX", high, 0xa5a50000 + row);
+    return digits;
+}
+
+/** @brief Build an SVF that erases, programs and reads back the rows, in
+ *         the shape Lattice Diamond exports */
+std::string programmingSvf(const RowData& row)
+{
+    std::string svf =
+        "SIR 8 TDI (E0);\nSDR 32 TDI (00000000) TDO (012BA043) "
+        "MASK (FFFFFFFF);\n"
+        "SIR 8 TDI (C6);\nSDR 8 TDI (00);\nRUNTEST IDLE 2 TCK 1.00E-03 SEC;\n"
+        "SIR 8 TDI (0E);\nSDR 8 TDI (04);\nRUNTEST IDLE 2 TCK 5.00E-03 SEC;\n"
+        "SIR 8 TDI (46);\nSDR 8 TDI (04);\nRUNTEST IDLE 2 TCK;\n";
+    for (size_t i = 0; i < rows; ++i)
+    {
+        svf += "SIR 8 TDI (70);\nSDR 128 TDI (" + row(i) +
+               ");\nRUNTEST IDLE 2 TCK 5.00E-05 SEC;\n";
+    }
+    svf += "SIR 8 TDI (C2);\nSDR 32 TDI (12345678);\n"
+           "RUNTEST IDLE 2 TCK 1.00E-03 SEC;\n"
+           "SIR 8 TDI (46);\nSDR 8 TDI (04);\nRUNTEST IDLE 2 TCK;\n";
+    for (size_t i = 0; i < rows; ++i)
+    {
+        svf += "SIR 8 TDI (73);\nSDR 128 TDI (0) TDO (" + row(i) +
+               ") MASK (FFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFF);\n";
+    }
+    svf += "SIR 8 TDI (C0);\nSDR 32 TDI (0) TDO (12345678);\n";
+    return svf;
+}
+
+RowData image(uint32_t high)
+{
+    return [high](size_t row) { return hexRow(high, row); };
+}
+
+class SimulatedChainTest : public ::testing::Test
+{
+  protected:
+    SimulatedChainTest() :
+        model(std::make_shared<SimulatedCpld>(part())), chain({model})
+    {}
+
+    void program(const std::string& svf)
+    {
+        SvfPlayer player(chain, frequency);
+        player.play(std::string_view(svf));
+    }
+
+    VerifyStats verify(const std::string& svf)
+    {
+        SvfParser parser(svf);
+        VerifySource source(parser);
+        SvfPlayer player(chain, frequency);
+        player.play(source);
+        return source.stats();
+    }
+
+    DifferentialStats programDifferential(
+        const std::string& svf, std::optional<size_t> resumed = std::nullopt)
+    {
+        SvfParser planned(svf);
+        auto plan = RowPlan::build(planned);
+        EXPECT_EQ(plan.reason, "");
+        SvfParser parser(svf);
+        DifferentialSource source(parser, std::move(plan), chain, resumed);
+        SvfPlayer player(chain, frequency);
+        player.play(source);
+        return source.stats();
+    }
+
+    void expectRows(const RowData& row)
+    {
+        for (size_t i = 0; i < rows; ++i)
+        {
+            EXPECT_EQ(model->configPage(i).toHex(), row(i)) << "row " << i;
+        }
+        EXPECT_EQ(model->usercode(), usercode);
+        EXPECT_EQ(model->stats().busyViolations, 0);
+    }
+
+    std::shared_ptr<SimulatedCpld> model;
+    SimulatedChain chain;
+};
+
+TEST_F(SimulatedChainTest, ProgramsAndVerifies)
+{
+    auto svf = programmingSvf(image(0x11111111));
+    program(svf);
+    expectRows(image(0x11111111));
+    EXPECT_EQ(model->stats().erases, 1);
+
+    auto stats = verify(svf);
+    EXPECT_EQ(stats.scansCompared, rows + 2);
+    EXPECT_EQ(stats.bitsCompared, rows * 128 + 2 * 32);
+    EXPECT_GT(stats.opsDropped, 0);
+    EXPECT_EQ(model->stats().erases, 1);
+}
+
+TEST_F(SimulatedChainTest, VerifyReportsMismatch)
+{
+    program(programmingSvf(image(0x11111111)));
+    EXPECT_THROW(verify(programmingSvf(image(0x22222222))), TdoMismatch);
+}
+
+TEST_F(SimulatedChainTest, VerifyReportsWornCell)
+{
+    auto config = part();
+    config.stuckPage = 7;
+    SimulatedChain worn({std::make_shared<SimulatedCpld>(config)});
+
+    // The SVF's own read back catches the page.
+    auto svf = programmingSvf(image(0x11111111));
+    SvfPlayer player(worn, frequency);
+    EXPECT_THROW(player.play(std::string_view(svf)), TdoMismatch);
+
+    SvfParser parser(svf);
+    VerifySource source(parser);
+    EXPECT_THROW(player.play(source), TdoMismatch);
+}
+
+TEST_F(SimulatedChainTest, WrongPartIsNotErased)
+{
+    auto config = part();
+    config.idcode = 0x012b9043;
+    auto other = std::make_shared<SimulatedCpld>(config);
+    SimulatedChain wrong({other});
+
+    // The IDCODE mismatch stops playback before ISC_ENABLE, also with
+    // the compares running behind the shifter.
+    for (size_t window : {0, 64})
+    {
+        SvfPlayer player(wrong, frequency);
+        player.setVerifyWindow(window);
+        EXPECT_THROW(
+            player.play(std::string_view(programmingSvf(image(0x11111111)))),
+            TdoMismatch);
+        EXPECT_EQ(other->stats().erases, 0);
+    }
+}
+
+TEST_F(SimulatedChainTest, DifferentialProgramsChangedRowsOnly)
+{
+    program(programmingSvf(image(0x11111111)));
+
+    // Rows 10 to 19 gain bits, which programming alone can add.
+    auto changed = [](size_t row) {
+        return hexRow(row >= 10 && row < 20 ? 0x33333333 : 0x11111111, row);
+    };
+    auto svf = programmingSvf(changed);
+    auto stats = programDifferential(svf);
+    EXPECT_EQ(stats.fallback, "");
+    EXPECT_EQ(stats.rowsWritten, 10);
+    EXPECT_EQ(stats.rowsSkipped, rows - 10);
+    EXPECT_EQ(model->stats().erases, 1);
+    expectRows(changed);
+    verify(svf);
+}
+
+TEST_F(SimulatedChainTest, DifferentialFallsBackToErase)
+{
+    program(programmingSvf(image(0x33333333)));
+
+    // Clearing bits takes an erase.
+    auto svf = programmingSvf(image(0x11111111));
+    auto stats = programDifferential(svf);
+    EXPECT_NE(stats.fallback, "");
+    EXPECT_EQ(stats.rowsWritten, rows);
+    EXPECT_EQ(model->stats().erases, 2);
+    expectRows(image(0x11111111));
+    verify(svf);
+}
+
+TEST_F(SimulatedChainTest, ResumesInterruptedProgramming)
+{
+    program(programmingSvf(image(0x33333333)));
+
+    auto svf = programmingSvf(image(0x11111111));
+    size_t checkpoint = 0;
+    chain.failAfter(400);
+    {
+        SvfParser parser(svf);
+        CheckpointSource source(parser, 64, [&](size_t row) {
+            chain.flush();
+            checkpoint = row;
+        });
+        SvfPlayer player(chain, frequency);
+        EXPECT_THROW(player.play(source), std::system_error);
+    }
+    ASSERT_GT(checkpoint, 0);
+    ASSERT_LT(checkpoint, rows);
+
+    chain.failAfter(~uint64_t(0));
+    auto stats = programDifferential(svf, checkpoint);
+    EXPECT_EQ(stats.fallback, "");
+    EXPECT_EQ(stats.rowsResumed, checkpoint);
+    EXPECT_LE(stats.rowsWritten, rows - checkpoint);
+    EXPECT_EQ(stats.rowsWritten + stats.rowsSkipped, rows);
+    EXPECT_EQ(model->stats().erases, 2);
+    expectRows(image(0x11111111));
+    verify(svf);
+}
+
+TEST_F(SimulatedChainTest, ResumeNeedsErasedRows)
+{
+    // Rows past the checkpoint hold data the erase should have cleared,
+    // even if the image could be programmed on top of it.
+    program(programmingSvf([](size_t row) {
+        return hexRow(row < 64 ? 0x11111111 : 0x01010101, row);
+    }));
+
+    auto svf = programmingSvf(image(0x11111111));
+    auto stats = programDifferential(svf, 64);
+    EXPECT_EQ(stats.fallback, "row 64 is not erased");
+    EXPECT_EQ(stats.rowsResumed, 0);
+    EXPECT_EQ(model->stats().erases, 2);
+    expectRows(image(0x11111111));
+    verify(svf);
+}
+
+TEST_F(SimulatedChainTest, CableFailureStopsProgramming)
+{
+    chain.failAfter(10);
+    EXPECT_THROW(program(programmingSvf(image(0x11111111))),
+                 std::system_error);
+    EXPECT_THROW(verify(programmingSvf(image(0x11111111))), std::system_error);
+}
+
+} // namespace
+} // namespace updater
+} // namespace software
+} // namespace wistron
@@ -0,0 +1,124 @@
+#include "verify_source.hpp"
+
+#include "lattice_isc.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <stdexcept>
+
+namespace wistron
+{
+namespace software
+{
+namespace updater
+{
+
+namespace
+{
+
+/** @brief Instructions that leave the configuration flash as it is */
+constexpr std::array<uint8_t, 14> readOnlyInstructions = {
+    lattice::ISC_DISABLE,      lattice::LSC_READ_STATUS,
+    lattice::LSC_INIT_ADDRESS, lattice::LSC_INIT_ADDR_UFM,
+    lattice::LSC_READ_INCR_NV, lattice::ISC_ENABLE_X,
+    lattice::LSC_WRITE_ADDRESS, lattice::USERCODE,
+    lattice::LSC_READ_UFM,     lattice::IDCODE_PUB,
+    lattice::LSC_READ_FEATURE, lattice::LSC_CHECK_BUSY,
+    lattice::LSC_READ_FEABITS, lattice::ISC_NOOP,
+};
+
+/** @brief Instructions reading flash contents back */
+constexpr std::array<uint8_t, 4> readInstructions = {
+    lattice::LSC_READ_INCR_NV,
+    lattice::LSC_READ_UFM,
+    lattice::LSC_READ_FEATURE,
+    lattice::LSC_READ_FEABITS,
+};
+
+size_t popcount(const BitVector& bits)
+{
+    size_t count = 0;
+    for (size_t i = 0; i < bits.byteSize(); ++i)
+    {
+        count += std::popcount(bits.data()[i]);
+    }
+    return count;
+}
+
+} // namespace
+
+bool VerifySource::next(SvfOp& op)
+{
+    while (source.next(op))
+    {
+        if (keep(op))
+        {
+            return true;
+        }
+        ++verifyStats.opsDropped;
+    }
+    return false;
+}
+
+bool VerifySource::keep(SvfOp& op)
+{
+    auto scan = std::get_if<ScanOp>(&op);
+    if (!scan)
+    {
+        return !std::holds_alternative<RunTestOp>(op) || !dropping;
+    }
+
+    if (scan->type == ScanType::IR)
+    {
+        if (scan->tdi.size() != lattice::irBits)
+        {
+            throw std::runtime_error(
+                "verify-only mode needs a single MachXO2/MachXO3 chain, "
+                "the image shifts a " +
+                std::to_string(scan->tdi.size()) + " bit instruction");
+        }
+
+        ir = scan->tdi.data()[0];
+        if (ir == lattice::LSC_PROG_INCR_NV)
+        {
+            programmed = true;
+        }
+        if (ir == lattice::ISC_ENABLE)
+        {
+            // Transparent mode keeps the user logic running.
+            scan->tdi.data()[0] = lattice::ISC_ENABLE_X;
+            scan->tdo.clear();
+            scan->mask.clear();
+            dropping = false;
+            return true;
+        }
+
+        dropping = std::ranges::find(readOnlyInstructions, *ir) ==
+                       readOnlyInstructions.end() ||
+                   (!programmed &&
+                    std::ranges::find(readInstructions, *ir) !=
+                        readInstructions.end());
+        if (dropping)
+        {
+            return false;
+        }
+    }
+    else if (dropping)
+    {
+        return false;
+    }
+
+    if (!scan->tdo.empty())
+    {
+        ++verifyStats.scansCompared;
+        // Without a mask every bit is compared.
+        verifyStats.bitsCompared +=
+            scan->mask.empty() ? scan->tdo.size() : popcount(scan->mask);
+    }
+    return true;
+}
+
+} // namespace updater
+} // namespace software
+} // namespace wistron
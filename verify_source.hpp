@@ -0,0 +1,103 @@
+#pragma once
+
+#include "ops.hpp"
+
+#include <cstdint>
+#include <optional>
+
+namespace wistron
+{
+namespace software
+{
+namespace updater
+{
+
+/** @struct VerifyStats
+ *  @brief What a verify-only pass compared.
+ */
+struct VerifyStats
+{
+    /** @brief Scans whose TDO was compared */
+    uint64_t scansCompared = 0;
+
+    /** @brief Bits those compares covered, i.e. set in their masks */
+    uint64_t bitsCompared = 0;
+
+    /** @brief Operations dropped because they would change the device */
+    uint64_t opsDropped = 0;
+};
+
+/** @class VerifySource
+ *  @brief Plays only the read back part of a MachXO2/MachXO3 programming
+ *         stream, to check a running device against an image.
+ *  @details Instructions that erase, program or refresh the device are
+ *  dropped together with their data scans and delays, and ISC_ENABLE is
+ *  replaced by ISC_ENABLE_X so the user logic keeps running. What remains
+ *  reads the IDCODE, the USERCODE, the status and the configuration rows,
+ *  and the player compares them against the image's masked TDO as usual.
+ *  Row reads ahead of the first programmed row are the SVF's blank check
+ *  and are dropped as well.
+ */
+class VerifySource : public OpSource
+{
+  public:
+    /** @brief Constructs VerifySource.
+     *
+     *  @param[in] source - The programming stream to filter
+     */
+    explicit VerifySource(OpSource& source) : source(source) {}
+
+    /** @brief Read the next operation to play.
+     *
+     *  @param[out] op - The operation
+     *
+     *  @return false once the end of the stream is reached
+     *  @error  std::runtime_error if the stream is not for a single
+     *          MachXO2/MachXO3
+     */
+    bool next(SvfOp& op) override;
+
+    size_t offset() const override
+    {
+        return source.offset();
+    }
+
+    size_t size() const override
+    {
+        return source.size();
+    }
+
+    size_t line() const override
+    {
+        return source.line();
+    }
+
+    /** @brief Get what was compared so far */
+    const VerifyStats& stats() const
+    {
+        return verifyStats;
+    }
+
+  private:
+    /** @brief Decide whether an operation passes, rewriting it if needed */
+    bool keep(SvfOp& op);
+
+    /** @brief The wrapped stream */
+    OpSource& source;
+
+    /** @brief The last instruction the stream loaded */
+    std::optional<uint8_t> ir;
+
+    /** @brief Whether data scans and delays of ir are dropped */
+    bool dropping = false;
+
+    /** @brief Whether the stream programmed a row yet */
+    bool programmed = false;
+
+    /** @brief The statistics */
+    VerifyStats verifyStats;
+};
+
+} // namespace updater
+} // namespace software
+} // namespace wistron
@@ -0,0 +1,365 @@
+#include "xsvf_parser.hpp"
+
+#include "jbc_source.hpp"
+#include "svf_parser.hpp"
+
+#include <algorithm>
+#include <filesystem>
+#include <stdexcept>
+#include <utility>
+
+namespace wistron
+{
+namespace software
+{
+namespace updater
+{
+
+namespace
+{
+
+/** @brief XSVF opcodes, as defined by Xilinx XAPP503 */
+constexpr uint8_t XCOMPLETE = 0x00;
+constexpr uint8_t XTDOMASK = 0x01;
+constexpr uint8_t XSIR = 0x02;
+constexpr uint8_t XSDR = 0x03;
+constexpr uint8_t XRUNTEST = 0x04;
+constexpr uint8_t XREPEAT = 0x07;
+constexpr uint8_t XSDRSIZE = 0x08;
+constexpr uint8_t XSDRTDO = 0x09;
+constexpr uint8_t XSETSDRMASKS = 0x0a;
+constexpr uint8_t XSDRINC = 0x0b;
+constexpr uint8_t XSDRB = 0x0c;
+constexpr uint8_t XSDRC = 0x0d;
+constexpr uint8_t XSDRE = 0x0e;
+constexpr uint8_t XSDRTDOB = 0x0f;
+constexpr uint8_t XSDRTDOC = 0x10;
+constexpr uint8_t XSDRTDOE = 0x11;
+constexpr uint8_t XSTATE = 0x12;
+constexpr uint8_t XENDIR = 0x13;
+constexpr uint8_t XENDDR = 0x14;
+constexpr uint8_t XSIR2 = 0x15;
+constexpr uint8_t XCOMMENT = 0x16;
+constexpr uint8_t XWAIT = 0x17;
+constexpr uint8_t XTRST = 0x1c;
+
+/** @brief XTRST ON; OFF, Z and ABSENT leave TRST released */
+constexpr uint8_t trstOn = 0;
+
+/** @brief Append the bits of part to a vector */
+void append(BitVector& bits, const BitVector& part)
+{
+    BitVector head(bits);
+    bits.resize(head.size() + part.size());
+    bits.assign(0, head);
+    bits.assign(head.size(), part);
+}
+
+bool anySet(const BitVector& bits)
+{
+    return std::any_of(bits.data(), bits.data() + bits.byteSize(),
+                       [](uint8_t byte) { return byte != 0; });
+}
+
+} // namespace
+
+bool XsvfParser::next(SvfOp& op)
+{
+    if (pendingRunTest)
+    {
+        recycler.assign(op, *pendingRunTest);
+        pendingRunTest.reset();
+        return true;
+    }
+
+    while (!complete && pos < data.size())
+    {
+        ++command;
+        auto opcode = readByte();
+        if (!walk.empty() && opcode != XSTATE && opcode != XCOMMENT)
+        {
+            fail("XSTATE leaves the TAP in a transient state");
+        }
+
+        switch (opcode)
+        {
+            case XCOMPLETE:
+                complete = true;
+                break;
+            case XTDOMASK:
+                readVector(mask, sdrSize);
+                break;
+            case XSIR:
+                parseIr(op, readByte());
+                return true;
+            case XSIR2:
+                parseIr(op, readNumber(2));
+                return true;
+            case XSDR:
+                parseDr(op, false);
+                return true;
+            case XSDRTDO:
+                parseDr(op, true);
+                return true;
+            case XRUNTEST:
+                runTest = readNumber(4);
+                break;
+            case XREPEAT:
+                // Mismatches are not retried, see the class description.
+                readByte();
+                break;
+            case XSDRSIZE:
+                sdrSize = readNumber(4);
+                break;
+            case XSETSDRMASKS:
+                // Only used by XSDRINC.
+                readVector(part, sdrSize);
+                readVector(part, sdrSize);
+                break;
+            case XSDRINC:
+                fail("XSDRINC is not supported");
+            case XSDRB:
+            case XSDRTDOB:
+                parseSplitDr(op, opcode);
+                return true;
+            case XSDRC:
+            case XSDRE:
+            case XSDRTDOC:
+            case XSDRTDOE:
+                fail("split scan continued without XSDRB");
+            case XSTATE:
+            {
+                auto state = readState();
+                if (!isStableState(state))
+                {
+                    walk.push_back(state);
+                    break;
+                }
+                StateOp stateOp;
+                stateOp.path = std::move(walk);
+                stateOp.path.push_back(state);
+                walk.clear();
+                recycler.assign(op, std::move(stateOp));
+                return true;
+            }
+            case XENDIR:
+                endIR = readEndState(TapState::IRPause);
+                break;
+            case XENDDR:
+                endDR = readEndState(TapState::DRPause);
+                break;
+            case XCOMMENT:
+            {
+                auto end = data.find('\0', pos);
+                if (end == std::string_view::npos)
+                {
+                    fail("unterminated XCOMMENT");
+                }
+                pos = end + 1;
+                break;
+            }
+            case XWAIT:
+            {
+                RunTestOp wait;
+                wait.runState = readState();
+                wait.endState = readState();
+                wait.minTime = readNumber(4) / 1e6;
+                if (!isStableState(wait.runState) ||
+                    !isStableState(wait.endState))
+                {
+                    fail("XWAIT needs stable states");
+                }
+                recycler.assign(op, wait);
+                return true;
+            }
+            case XTRST:
+                recycler.assign(op, TrstOp{readByte() == trstOn});
+                return true;
+            default:
+                fail("unknown opcode " + std::to_string(opcode));
+        }
+    }
+
+    if (!walk.empty())
+    {
+        fail("XSTATE leaves the TAP in a transient state");
+    }
+    return false;
+}
+
+uint8_t XsvfParser::readByte()
+{
+    if (pos >= data.size())
+    {
+        fail("XSVF is truncated");
+    }
+    return static_cast<uint8_t>(data[pos++]);
+}
+
+uint32_t XsvfParser::readNumber(size_t bytes)
+{
+    uint32_t value = 0;
+    for (size_t i = 0; i < bytes; ++i)
+    {
+        value = (value << 8) | readByte();
+    }
+    return value;
+}
+
+void XsvfParser::readVector(BitVector& bits, size_t length)
+{
+    auto bytes = (length + 7) / 8;
+    if (data.size() - pos < bytes)
+    {
+        fail("XSVF is truncated");
+    }
+    bits.loadReversed(reinterpret_cast<const uint8_t*>(data.data() + pos),
+                      length);
+    pos += bytes;
+}
+
+TapState XsvfParser::readState()
+{
+    // XSVF numbers the states as TapState does.
+    auto value = readByte();
+    if (value >= tapStateCount)
+    {
+        fail("invalid TAP state " + std::to_string(value));
+    }
+    return static_cast<TapState>(value);
+}
+
+TapState XsvfParser::readEndState(TapState pause)
+{
+    switch (readByte())
+    {
+        case 0:
+            return TapState::Idle;
+        case 1:
+            return pause;
+        default:
+            fail("invalid end state");
+    }
+}
+
+void XsvfParser::parseIr(SvfOp& op, size_t length)
+{
+    auto& scan = recycler.scan(op);
+    scan.type = ScanType::IR;
+    scan.endState = endIR;
+    readVector(scan.tdi, length);
+    scan.tdo.clear();
+    scan.mask.clear();
+    queueRunTest();
+}
+
+void XsvfParser::parseDr(SvfOp& op, bool withTdo)
+{
+    auto& scan = recycler.scan(op);
+    scan.type = ScanType::DR;
+    scan.endState = endDR;
+    readVector(scan.tdi, sdrSize);
+    if (withTdo)
+    {
+        readVector(expected, sdrSize);
+    }
+    setCompare(scan);
+    queueRunTest();
+}
+
+void XsvfParser::parseSplitDr(SvfOp& op, uint8_t opcode)
+{
+    // The parts are shifted without leaving Shift-DR, which is one scan.
+    bool withTdo = opcode == XSDRTDOB;
+    auto& scan = recycler.scan(op);
+    scan.type = ScanType::DR;
+    scan.endState = endDR;
+    scan.tdi.clear();
+    scan.tdo.clear();
+    scan.mask.clear();
+
+    BitVector ones;
+    while (true)
+    {
+        readVector(part, sdrSize);
+        append(scan.tdi, part);
+        if (withTdo)
+        {
+            readVector(part, sdrSize);
+            append(scan.tdo, part);
+            ones.resize(sdrSize, true);
+            append(scan.mask, ones);
+        }
+
+        if (opcode == XSDRE || opcode == XSDRTDOE)
+        {
+            return;
+        }
+
+        ++command;
+        opcode = readByte();
+        auto expectedOpcodes = withTdo ? std::pair{XSDRTDOC, XSDRTDOE}
+                                       : std::pair{XSDRC, XSDRE};
+        if (opcode != expectedOpcodes.first && opcode != expectedOpcodes.second)
+        {
+            fail("split scan not ended by XSDRE");
+        }
+    }
+}
+
+void XsvfParser::setCompare(ScanOp& scan) const
+{
+    // Without an XTDOMASK or expected value nothing is compared.
+    if (expected.empty() || !anySet(mask))
+    {
+        scan.tdo.clear();
+        scan.mask.clear();
+        return;
+    }
+    if (expected.size() != sdrSize || mask.size() != sdrSize)
+    {
+        fail("XTDOMASK or expected TDO does not match XSDRSIZE");
+    }
+    scan.tdo = expected;
+    scan.mask = mask;
+}
+
+void XsvfParser::queueRunTest()
+{
+    if (runTest != 0)
+    {
+        RunTestOp wait;
+        wait.minTime = runTest / 1e6;
+        pendingRunTest = wait;
+    }
+}
+
+void XsvfParser::fail(const std::string& message) const
+{
+    throw SvfError(command, message);
+}
+
+bool isXsvfPath(const std::string& path)
+{
+    return std::filesystem::path(path).extension() == ".xsvf";
+}
+
+std::unique_ptr<OpSource> openOpFile(const std::string& path,
+                                     std::pmr::memory_resource* resource)
+{
+    if (isXsvfPath(path))
+    {
+        return std::make_unique<XsvfFile>(path, resource);
+    }
+    if (isJbcPath(path))
+    {
+        throw std::runtime_error(
+            path + " is a JBC program, which only runs against the device "
+                   "and can not be compiled or chained");
+    }
+    return std::make_unique<SvfFile>(path, resource);
+}
+
+} // namespace updater
+} // namespace software
+} // namespace wistron
@@ -0,0 +1,228 @@
+#pragma once
+
+#include "bit_vector.hpp"
+#include "mapped_file.hpp"
+#include "ops.hpp"
+#include "tap_state.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace wistron
+{
+namespace software
+{
+namespace updater
+{
+
+/** @class XsvfParser
+ *  @brief Translates Xilinx XSVF into engine operations, one command at a
+ *         time.
+ *  @details XSVF is a binary encoding of the SVF operations. Commands are
+ *  a one byte opcode followed by big-endian lengths and scan data, so no
+ *  text has to be tokenized or hex decoded. The parser resolves the sticky
+ *  XSDRSIZE, XTDOMASK, expected TDO, XRUNTEST and XENDIR/XENDDR values; the
+ *  operations it produces can be executed without further context. A
+ *  scan followed by a non-zero XRUNTEST yields the scan and a RUNTEST in
+ *  Run-Test/Idle.
+ *
+ *  XSDRB/C/E scans split over several commands are joined into one scan.
+ *  XREPEAT is read but a mismatching scan is not retried, it fails the
+ *  update as in SVF. XSDRINC is not supported.
+ */
+class XsvfParser : public OpSource
+{
+  public:
+    /** @brief Constructs XsvfParser.
+     *
+     *  @param[in] data     - The XSVF contents; must outlive the parser
+     *  @param[in] resource - The memory resource scan data is allocated
+     *                        from, e.g. the arena of a programming run
+     */
+    explicit XsvfParser(
+        std::string_view data,
+        std::pmr::memory_resource* resource = std::pmr::get_default_resource()) :
+        data(data), recycler(resource), expected(resource), mask(resource),
+        part(resource)
+    {}
+
+    /** @brief Read up to the next operation.
+     *  @details Scans are decoded into the buffers op already holds, so a
+     *  caller passing the same op again reads without allocating.
+     *
+     *  @param[in,out] op - The operation
+     *
+     *  @return false once XCOMPLETE or the end of the data is reached
+     *  @error  SvfError on malformed or unsupported input
+     */
+    bool next(SvfOp& op) override;
+
+    size_t offset() const override
+    {
+        return pos;
+    }
+
+    size_t size() const override
+    {
+        return data.size();
+    }
+
+    /** @brief The number of the last command read, counted from 1; XSVF
+     *         has no lines */
+    size_t line() const override
+    {
+        return command;
+    }
+
+  private:
+    /** @brief Read a byte */
+    uint8_t readByte();
+
+    /** @brief Read a big-endian number of up to four bytes */
+    uint32_t readNumber(size_t bytes);
+
+    /** @brief Read a scan vector */
+    void readVector(BitVector& bits, size_t length);
+
+    /** @brief Read a TAP state */
+    TapState readState();
+
+    /** @brief Read an XENDIR/XENDDR argument */
+    TapState readEndState(TapState pause);
+
+    /** @brief Read an XSIR/XSIR2 of the given length into op */
+    void parseIr(SvfOp& op, size_t length);
+
+    /** @brief Read an XSDR or XSDRTDO into op */
+    void parseDr(SvfOp& op, bool withTdo);
+
+    /** @brief Read a scan split over XSDRB/C/E or XSDRTDOB/C/E into op */
+    void parseSplitDr(SvfOp& op, uint8_t opcode);
+
+    /** @brief Set the compare of a data scan from the sticky values */
+    void setCompare(ScanOp& scan) const;
+
+    /** @brief Queue the XRUNTEST wait following a scan */
+    void queueRunTest();
+
+    /** @brief Throw an SvfError for the current command */
+    [[noreturn]] void fail(const std::string& message) const;
+
+    /** @brief The XSVF contents */
+    std::string_view data;
+
+    /** @brief The read position within data */
+    size_t pos = 0;
+
+    /** @brief The number of the command being read */
+    size_t command = 0;
+
+    /** @brief Whether XCOMPLETE was read */
+    bool complete = false;
+
+    /** @brief Reuses the scan buffers of the operations handed out */
+    ScanRecycler recycler;
+
+    /** @brief The expected TDO of the last XSDRTDO, compared by XSDR */
+    BitVector expected;
+
+    /** @brief The XTDOMASK */
+    BitVector mask;
+
+    /** @brief One part of a split scan */
+    BitVector part;
+
+    /** @brief The XSDRSIZE */
+    size_t sdrSize = 0;
+
+    /** @brief The XRUNTEST in microseconds */
+    uint32_t runTest = 0;
+
+    TapState endIR = TapState::Idle;
+    TapState endDR = TapState::Idle;
+
+    /** @brief Transient states of consecutive XSTATEs, walked through on
+     *         the way to the next stable one */
+    std::vector<TapState> walk;
+
+    /** @brief The wait to hand out after a scan */
+    std::optional<RunTestOp> pendingRunTest;
+};
+
+/** @class XsvfFile
+ *  @brief An XsvfParser over a mapped XSVF file.
+ */
+class XsvfFile : public OpSource
+{
+  public:
+    /** @brief Maps an XSVF file.
+     *
+     *  @param[in] path     - The XSVF file path
+     *  @param[in] resource - The memory resource scan data is allocated
+     *                        from
+     *
+     *  @error  std::system_error if the file can not be mapped
+     */
+    explicit XsvfFile(
+        const std::string& path,
+        std::pmr::memory_resource* resource = std::pmr::get_default_resource()) :
+        file(path), parser(file.view(), resource)
+    {}
+
+    bool next(SvfOp& op) override
+    {
+        return parser.next(op);
+    }
+
+    size_t offset() const override
+    {
+        return parser.offset();
+    }
+
+    size_t size() const override
+    {
+        return parser.size();
+    }
+
+    size_t line() const override
+    {
+        return parser.line();
+    }
+
+  private:
+    /** @brief The mapped file */
+    MappedFile file;
+
+    /** @brief The parser reading the mapping */
+    XsvfParser parser;
+};
+
+/** @brief Check whether a programming file is XSVF rather than SVF.
+ *
+ *  @param[in] path - The file path
+ *
+ *  @return true if it has the .xsvf extension
+ */
+bool isXsvfPath(const std::string& path);
+
+/** @brief Map an SVF or XSVF file, told apart by the extension.
+ *
+ *  @param[in] path     - The file path
+ *  @param[in] resource - The memory resource scan data is allocated from
+ *
+ *  @return The file's operation stream
+ *  @error  std::system_error if the file can not be mapped,
+ *          std::runtime_error for a JBC program
+ */
+std::unique_ptr<OpSource> openOpFile(
+    const std::string& path,
+    std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+
+} // namespace updater
+} // namespace software
+} // namespace wistron